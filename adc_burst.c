@@ -0,0 +1,304 @@
+/****************************************************************
+* HEADER FILES
+***************************************************************/
+#include "adc_burst.h"
+#include "adc_status.h"			// Full-rate frames are checked on the way into the record
+#include "timebase.h"
+
+	// DRAIN RINGS
+		adc_ring_t burst_rings[ADC_COUNT];
+
+	// CONFIG AND STATE
+		static burst_config_t config = {0U, BURST_TRIG_COMMAND, 0U, 0, BURST_PRE_MS, BURST_POST_MS};
+		static uint8_t state = BURST_OFF;
+
+	// RECORD BUFFERS -- free-running positions, frame p is frames[adc][p & (BURST_FRAMES - 1)]
+		static adc_frame_t frames[ADC_COUNT][BURST_FRAMES];
+		static uint32_t head[ADC_COUNT];		// Frames written
+		static uint32_t base[ADC_COUNT];		// First frame of the history since armed
+		static uint32_t start[ADC_COUNT];		// Record: first frame
+		static uint32_t end[ADC_COUNT];			// Record: one past the last frame (set when the record closes)
+		static uint32_t drained[ADC_COUNT];		// Record: next frame to drain
+		static uint8_t done[ADC_COUNT];			// Post-trigger window complete
+
+	// TRIGGER
+		static uint64_t trigger_time;
+		static uint8_t trigger_cause;
+		static uint8_t truncated;
+		static int32_t previous;				// Previous code of the trigger channel (slope)
+		static uint8_t previous_valid;
+		static uint32_t record_count;
+
+
+/**
+ * @get_s24
+ *
+ * Sign-extends one 24-bit big-endian word of a raw frame.
+ *
+ * */
+static int32_t get_s24(const uint8_t *p)
+{
+	return (int32_t)(((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8)) >> 8;
+}
+
+static uint64_t ms_ticks(uint32_t ms)
+{
+	return (uint64_t)ms * TIMEBASE_TICKS_PER_MS;
+}
+
+// Oldest frame of the history still in the buffer
+static uint32_t oldest(uint8_t adc)
+{
+	return ((head[adc] - base[adc]) > BURST_FRAMES) ? (head[adc] - BURST_FRAMES) : base[adc];
+}
+
+// Empties the history and the drain rings and waits for the next trigger
+static void rearm(void)
+{
+	for (uint8_t adc = 0; adc < ADC_COUNT; adc++) {
+		base[adc] = head[adc];
+		adc_ring_release(&burst_rings[adc], adc_ring_count(&burst_rings[adc]));
+	}
+	previous_valid = 0;
+	state = BURST_ARMED;
+}
+
+// Trigger at time: the record starts at the oldest frame of the pre-trigger window, on both ADCs
+static void start_record(uint64_t time, uint8_t cause)
+{
+	uint64_t pre = ms_ticks(config.pre_ms);
+
+	for (uint8_t adc = 0; adc < ADC_COUNT; adc++) {
+		uint32_t p = oldest(adc);
+
+		while ((p != head[adc]) && ((frames[adc][p & (BURST_FRAMES - 1U)].time + pre) < time)) {
+			p++;
+		}
+		start[adc] = p;
+		done[adc] = 0;
+	}
+	trigger_time = time;
+	trigger_cause = cause;
+	truncated = 0;
+	state = BURST_RECORDING;
+}
+
+/**
+ * @adc_burst_set
+ *
+ * Switches between streaming and burst capture and sets the trigger. Any record in progress is dropped and the
+ * history starts over. Main loop only.
+ *
+ * @input  : config - new settings
+ *
+ * @output : none
+ *
+ * @return : 1 = applied, 0 = out of range (nothing changed)
+ *
+ * */
+uint8_t adc_burst_set(const burst_config_t *new_config)
+{
+	if ((new_config->mode > 1U) || (new_config->trigger > BURST_TRIG_SLOPE) || (new_config->channel > 7U)) {
+		return 0;
+	}
+	config = *new_config;
+	if (config.mode) {
+		rearm();
+	}
+	else {
+		for (uint8_t adc = 0; adc < ADC_COUNT; adc++) {
+			adc_ring_release(&burst_rings[adc], adc_ring_count(&burst_rings[adc]));
+		}
+		state = BURST_OFF;
+	}
+	return 1;
+}
+
+/**
+ * @adc_burst_config
+ *
+ * Settings in effect.
+ *
+ * */
+const burst_config_t *adc_burst_config(void)
+{
+	return &config;
+}
+
+/**
+ * @adc_burst_state
+ *
+ * BURST_OFF / _ARMED / _RECORDING / _DRAINING.
+ *
+ * */
+uint8_t adc_burst_state(void)
+{
+	return state;
+}
+
+/**
+ * @adc_burst_trigger
+ *
+ * Host trigger (CMD_TRIGGER): starts a record now if armed, whatever the trigger setting. The pre-trigger window
+ * holds what the history has, even if it does not reach back that far yet.
+ *
+ * @input  : now - timebase ticks
+ *
+ * @output : none
+ *
+ * @return : state after the call
+ *
+ * */
+uint8_t adc_burst_trigger(uint64_t now)
+{
+	if (state == BURST_ARMED) {
+		start_record(now, BURST_TRIG_COMMAND);
+	}
+	return state;
+}
+
+/**
+ * @adc_burst_poll
+ *
+ * Moves the waiting frames of one ADC into its record buffer (armed, recording) or drops them (draining), checks
+ * the trigger, and while draining refills the drain ring from the record. Frames taken from the capture ring are
+ * status checked here, as the packet builder does not see them.
+ *
+ * @input  : adc - 0 = ADC0, 1 = ADC1
+ *           in - ring the packets would be built from (capture or decimated ring, adc_decimate_poll)
+ *
+ * @output : none
+ *
+ * @return : ring to packetize -- in while burst capture is off, the drain ring otherwise
+ *
+ * */
+adc_ring_t *adc_burst_poll(uint8_t adc, adc_ring_t *in)
+{
+	uint8_t scan = (in == &adc_rings[adc]) ? 1U : 0U;
+	uint8_t watch = ((config.trigger != BURST_TRIG_COMMAND) && ((config.channel / 4U) == adc)) ? 1U : 0U;
+	uint8_t word = (uint8_t)(3U * (config.channel % 4U + 1U));
+	adc_ring_t *out = &burst_rings[adc];
+	uint32_t waiting;
+
+	if (state == BURST_OFF) {
+		return in;
+	}
+
+	waiting = adc_ring_count(in);
+	for (uint32_t i = 0; i < waiting; i++) {
+		const adc_frame_t *frame = adc_ring_peek(in, i);
+
+		if (scan) {
+			adc_status_scan(adc, frame);
+		}
+		if ((state == BURST_DRAINING) || ((state == BURST_RECORDING) && done[adc])) {
+			continue; // Dropped
+		}
+		if (state == BURST_RECORDING) {
+			if (frame->time >= trigger_time + ms_ticks(config.post_ms)) {
+				done[adc] = 1;
+				continue;
+			}
+			if ((head[adc] - start[adc]) == BURST_FRAMES) {
+				done[adc] = 1;
+				truncated = 1;
+				continue;
+			}
+		}
+		frames[adc][head[adc] & (BURST_FRAMES - 1U)] = *frame;
+		head[adc]++;
+
+		if ((state == BURST_ARMED) && watch) {
+			int32_t x = get_s24(&frame->data[word]);
+			int32_t slope = x - previous;
+			uint8_t fire;
+
+			if (config.trigger == BURST_TRIG_LEVEL) {
+				fire = (config.threshold >= 0) ? (x >= config.threshold) : (x <= config.threshold);
+			}
+			else {
+				fire = previous_valid && (((slope >= 0) ? slope : -slope) >= config.threshold);
+			}
+			previous = x;
+			previous_valid = 1;
+
+			// Hold off until the history covers the pre-trigger window (or the whole buffer)
+			if (fire && (((head[adc] - base[adc]) >= BURST_FRAMES) ||
+				(frame->time >= frames[adc][oldest(adc) & (BURST_FRAMES - 1U)].time + ms_ticks(config.pre_ms)))) {
+				start_record(frame->time, config.trigger);
+			}
+		}
+	}
+	adc_ring_release(in, waiting);
+
+	if (state == BURST_DRAINING) {
+		uint8_t all = 1;
+
+		// Drain ring full: the rest follows on the next pass
+		while ((drained[adc] != end[adc]) && (adc_ring_count(out) < ADC_RING_SIZE)) {
+			*adc_ring_claim(out) = frames[adc][drained[adc] & (BURST_FRAMES - 1U)];
+			adc_ring_commit(out);
+			drained[adc]++;
+		}
+		for (uint8_t n = 0; n < ADC_COUNT; n++) {
+			all = all && (drained[n] == end[n]);
+		}
+		if (all) {
+			// Whole record handed to the drain rings -- history starts over while they empty
+			for (uint8_t n = 0; n < ADC_COUNT; n++) {
+				base[n] = head[n];
+			}
+			previous_valid = 0;
+			state = BURST_ARMED;
+		}
+	}
+	return out;
+}
+
+/**
+ * @adc_burst_take
+ *
+ * Closes the record once every ADC passed the end of the post-trigger window (or BURST_TIMEOUT_MS after it) and
+ * the previous record is out, and starts draining it. Call only when a packet can be sent: the record is announced by the packet built from it.
+ *
+ * @input  : record - filled in when a record closes
+ *           now - timebase ticks
+ *
+ * @output : none
+ *
+ * @return : 1 = record closed (announce it now), 0 = none
+ *
+ * */
+uint8_t adc_burst_take(burst_record_t *record, uint64_t now)
+{
+	uint8_t all = 1;
+
+	if (state != BURST_RECORDING) {
+		return 0;
+	}
+	for (uint8_t adc = 0; adc < ADC_COUNT; adc++) {
+		if (adc_ring_count(&burst_rings[adc]) != 0U) {
+			return 0; // Previous record still going out -- its packets must not follow this announcement
+		}
+		all = all && done[adc];
+	}
+	if (!all && (now < trigger_time + ms_ticks((uint32_t)config.post_ms + BURST_TIMEOUT_MS))) {
+		return 0;
+	}
+
+	record->number = record_count++;
+	record->time = trigger_time;
+	record->cause = trigger_cause;
+	record->channel = config.channel;
+	record->truncated = truncated;
+	record->pre_us = (uint32_t)config.pre_ms * 1000U;
+	record->post_us = (uint32_t)config.post_ms * 1000U;
+	for (uint8_t adc = 0; adc < ADC_COUNT; adc++) {
+		end[adc] = head[adc];
+		drained[adc] = start[adc];
+		record->frames[adc] = end[adc] - start[adc];
+		record->first_index[adc] = (end[adc] != start[adc]) ? frames[adc][start[adc] & (BURST_FRAMES - 1U)].index : 0U;
+	}
+	state = BURST_DRAINING;
+	return 1;
+}
@@ -0,0 +1,83 @@
+/****************************************************************
+* ADC BURST CAPTURE
+*
+* Triggered capture for short events (impact tests): instead of streaming, every frame goes into a per-ADC record
+* buffer in SRAM that always holds the latest history. A trigger -- a level or slope on one channel, or the host
+* (CMD_TRIGGER) -- freezes the frames of the pre-trigger window, the frames of the post-trigger window are added,
+* and then the whole record is sent, ahead of anything live, as fast as the transmit queue takes it. The record is
+* lossless at the full rate even when the link could not carry the stream continuously.
+*
+* Sits between the decimation stage and the packet builder like adc_decimate.h: adc_burst_poll takes the frames
+* the packets would have been built from and returns the ring to packetize -- the input ring while burst capture is
+* off, the record being drained (burst_rings) otherwise.
+*
+*  Armed		History kept, nothing sent. Level/slope triggers wait until the history covers the pre-trigger window
+*  Recording	Triggered at time T: frames from T - pre to T + post kept (both ADCs, same window)
+*  Draining		Record announced by a PKT_TYPE_BURST packet (adc_burst_take), then sent as ADC packets flagged
+*				PKT_FLAG_BURST. Live frames are dropped meanwhile. Armed again once the record is out
+*
+* A record that reaches BURST_FRAMES frames before the post-trigger window ends is cut short (flagged).
+***************************************************************/
+#ifndef ADC_BURST_H
+#define ADC_BURST_H
+
+#include <stdint.h>
+#include "adc_capture.h"
+
+	// CONFIG
+		#ifndef BURST_FRAMES
+		#define BURST_FRAMES 1024U		// Record frames per ADC -- MUST be a power of two (24ms at 42.667kHz, 32KB)
+		#endif
+		#ifndef BURST_PRE_MS
+		#define BURST_PRE_MS 10U		// Boot value of the pre-trigger window
+		#endif
+		#ifndef BURST_POST_MS
+		#define BURST_POST_MS 12U		// Boot value of the post-trigger window
+		#endif
+		#define BURST_TIMEOUT_MS 50U	// Record closed this long after the window even if an ADC sent nothing
+
+	// STATES
+		#define BURST_OFF			0U	// Streaming
+		#define BURST_ARMED			1U
+		#define BURST_RECORDING		2U
+		#define BURST_DRAINING		3U
+
+	// TRIGGERS -- CMD_BURST
+		#define BURST_TRIG_COMMAND	0U	// CMD_TRIGGER only
+		#define BURST_TRIG_LEVEL	1U	// Channel code >= threshold (threshold > 0) or <= threshold (threshold < 0)
+		#define BURST_TRIG_SLOPE	2U	// |code - previous code| >= threshold
+
+	typedef struct {
+		uint8_t mode;			// 0 = streaming, 1 = burst capture
+		uint8_t trigger;		// BURST_TRIG_*
+		uint8_t channel;		// Trigger channel, mask bit (0 - 3 ADC0 CH1 - CH4, 4 - 7 ADC1 CH1 - CH4)
+		int32_t threshold;		// 24-bit code
+		uint16_t pre_ms;		// Pre-trigger window
+		uint16_t post_ms;		// Post-trigger window
+	} burst_config_t;
+
+	// Finished record -- what the PKT_TYPE_BURST packet announces
+	typedef struct {
+		uint32_t number;					// Records since boot
+		uint64_t time;						// Trigger time, timebase ticks
+		uint8_t cause;						// BURST_TRIG_* that fired
+		uint8_t channel;
+		uint8_t truncated;					// Buffer full before the post-trigger window ended
+		uint32_t pre_us;
+		uint32_t post_us;
+		uint32_t frames[ADC_COUNT];			// Frames in the record
+		uint32_t first_index[ADC_COUNT];	// Index of the first of them
+	} burst_record_t;
+
+	// DRAIN RINGS -- the record on its way to the packet builder
+		extern adc_ring_t burst_rings[ADC_COUNT];
+
+	// PROTOTYPES
+		uint8_t adc_burst_set(const burst_config_t *config);
+		const burst_config_t *adc_burst_config(void);
+		uint8_t adc_burst_state(void);
+		uint8_t adc_burst_trigger(uint64_t now);
+		adc_ring_t *adc_burst_poll(uint8_t adc, adc_ring_t *in);
+		uint8_t adc_burst_take(burst_record_t *record, uint64_t now);
+
+#endif /* ADC_BURST_H */
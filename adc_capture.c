@@ -0,0 +1,288 @@
+/****************************************************************
+* HEADER FILES
+***************************************************************/
+#include "hal.h"				// Hardware abstraction (DAVE APPs on the target, simulator on the host)
+#include "adc_capture.h"
+#include "telemetry.h"			// DRDY-to-read and read latency histograms
+
+	// SAMPLE RINGS
+		adc_ring_t adc_rings[ADC_COUNT];
+
+	// PENDING READS -- conversion reported by DRDY but not yet started on the bus
+		typedef struct {
+			volatile uint8_t pending;	// Set by DRDY, cleared when the read is started (or the frame is dropped)
+			uint32_t index;				// Conversion number
+			uint64_t time;				// Capture time, timebase ticks
+			uint64_t deadline;			// Expected next DRDY -- the frame is overwritten then
+			uint32_t stamp;				// DRDY interrupt entry, CPU cycles (telemetry)
+		} adc_request_t;
+
+		static adc_request_t requests[ADC_COUNT];
+		static uint64_t drdy_period[ADC_COUNT];		// Last DRDY to DRDY time, ticks (0 = not known yet)
+
+	// DEADLINE MISSES
+		adc_capture_misses_t adc_capture_misses[ADC_COUNT];
+
+	// TRANSFER STATE
+		static adc_ring_t *volatile inflight = 0;		// Ring whose claimed slot the running transfer fills (0 = bus idle)
+		static uint8_t inflight_adc = 0;				// ADC the running transfer reads
+		static uint32_t inflight_index = 0;				// and its conversion number
+		static uint32_t inflight_stamp = 0;				// and its start, CPU cycles (telemetry)
+		static uint8_t null_tx[ADC_FRAME_BYTES] = {0x00};	// Null frame clocked out during reads
+		static uint8_t running = 0;						// DRDY interrupts enabled by adc_capture_start
+		static volatile uint8_t paused = 0;				// Bus lent to adc_config.c -- DRDY counts edges, starts no reads
+
+
+/**
+ * @capture_start
+ *
+ * Starts the read of the pending frame of one ADC into a slot of its ring.
+ * If the ring is full the frame is dropped (the ring counts the overflow) and the request is consumed anyway.
+ * The request is taken with interrupts masked: in polled mode this runs in the main loop, where the DRDY interrupt
+ * could otherwise replace it half way through.
+ *
+ * @input  : adc - 0 = ADC0, 1 = ADC1
+ *
+ * @output : none
+ *
+ * @return : 1 if the request was consumed, 0 if the bus is busy
+ *
+ * */
+static uint8_t capture_start(uint8_t adc)
+{
+	adc_request_t *req = &requests[adc];
+	adc_frame_t *frame;
+	uint32_t state, index, stamp;
+	uint64_t time;
+
+	if ((inflight != 0) || hal_adc_busy()) {
+		return 0;
+	}
+
+	state = hal_critical_enter();
+	index = req->index;
+	time = req->time;
+	stamp = req->stamp;
+	req->pending = 0;
+	hal_critical_exit(state);
+
+	frame = adc_ring_claim(&adc_rings[adc]);
+	if (frame == 0) {
+		return 1;
+	}
+
+	frame->index = index;
+	frame->time = time;
+	inflight_adc = adc;
+	inflight_index = index;
+	inflight = &adc_rings[adc];
+	TELEM_RECORD(TELEM_HIST_DRDY_TO_SPI, stamp);
+	inflight_stamp = TELEM_STAMP();
+	hal_adc_select(adc); // Change slave
+	hal_adc_transfer(null_tx, frame->data, ADC_FRAME_BYTES);
+	return 1;
+}
+
+/**
+ * @next_request
+ *
+ * Earliest deadline first: of the pending reads, the one whose ADC signals its next conversion soonest. With both
+ * ADCs at the same rate this is the older conversion; a slower ADC yields to a faster one that would lose its frame.
+ * Equal deadlines (ADCs in step) go to the ADC not read last, so an overloaded bus still serves both.
+ *
+ * @input  : none
+ *
+ * @output : none
+ *
+ * @return : ADC to read next, ADC_COUNT if nothing is pending
+ *
+ * */
+static uint8_t next_request(void)
+{
+	uint8_t next = ADC_COUNT;
+
+	for (uint8_t i = 1; i <= ADC_COUNT; i++) {
+		uint8_t adc = (uint8_t)((inflight_adc + i) % ADC_COUNT); // Last read ADC is looked at last
+
+		if (requests[adc].pending && ((next == ADC_COUNT) || (requests[adc].deadline < requests[next].deadline))) {
+			next = adc;
+		}
+	}
+	return next;
+}
+
+/**
+ * @adc_capture_drdy
+ *
+ * Called from the DRDY interrupt of an ADC. Records the conversion; in DMA mode the read is started right away
+ * if the bus is free, otherwise it is started by adc_capture_done when the running transfer ends.
+ * A conversion that is still pending when the next DRDY arrives is replaced (its index goes missing in the stream)
+ * and counted as a missed deadline.
+ *
+ * @input  : adc - 0 = ADC0, 1 = ADC1
+ *           index - conversion number
+ *           time - capture time of the DRDY edge (timebase_capture)
+ *
+ * @output : none
+ *
+ * @return : none
+ *
+ * */
+void adc_capture_drdy(uint8_t adc, uint32_t index, uint64_t time)
+{
+	adc_request_t *req = &requests[adc];
+
+	if (paused) {
+		req->time = time; // Conversion lost to the pause -- its index goes missing, the period stays measured
+		return;
+	}
+	req->stamp = TELEM_STAMP();
+	if (req->pending) {
+		adc_capture_misses[adc].dropped++;
+	}
+	if (req->time != 0U) {
+		drdy_period[adc] = time - req->time;
+	}
+	req->index = index;
+	req->time = time;
+	req->deadline = time + drdy_period[adc];
+	req->pending = 1;
+
+#if ADC_CAPTURE_DMA
+	capture_start(adc);
+#endif
+}
+
+/**
+ * @adc_capture_done
+ *
+ * Called from the SPI_MASTER_ADC end-of-receive interrupt. Publishes the completed frame to the main loop and,
+ * in DMA mode, starts the held-back read with the earliest deadline. A read still running when its ADC signalled
+ * the next conversion is counted as late (the ADC may have updated the frame under it).
+ *
+ * @input  : none
+ *
+ * @output : none
+ *
+ * @return : none
+ *
+ * */
+void adc_capture_done(void)
+{
+	adc_ring_t *done = inflight;
+
+	if (done == 0) {
+		return;
+	}
+	TELEM_RECORD(TELEM_HIST_SPI, inflight_stamp);
+	if (requests[inflight_adc].index != inflight_index) {
+		adc_capture_misses[inflight_adc].late++;
+	}
+	adc_ring_commit(done); // Frame complete -- hand it to the main loop
+	inflight = 0;
+
+#if ADC_CAPTURE_DMA
+	{
+		uint8_t next = next_request();
+
+		if (next != ADC_COUNT) {
+			capture_start(next);
+		}
+	}
+#endif
+}
+
+/**
+ * @adc_capture_poll
+ *
+ * Main loop part of the polled mode: starts the pending read with the earliest deadline. Does nothing in DMA mode.
+ *
+ * @input  : none
+ *
+ * @output : none
+ *
+ * @return : none
+ *
+ * */
+void adc_capture_poll(void)
+{
+#if !ADC_CAPTURE_DMA
+	uint8_t next = next_request();
+
+	if (next != ADC_COUNT) {
+		capture_start(next);
+	}
+#endif
+}
+
+/**
+ * @adc_capture_start
+ *
+ * Starts the capture once the ADCs are configured: enables the DRDY interrupts.
+ *
+ * @input  : none
+ *
+ * @output : none
+ *
+ * @return : none
+ *
+ * */
+void adc_capture_start(void)
+{
+	running = 1;
+	hal_irq_enable(HAL_IRQ_ADC0_DRDY);
+	hal_irq_enable(HAL_IRQ_ADC1_DRDY);
+}
+
+/**
+ * @adc_capture_pause
+ *
+ * Takes the ADC bus away from the capture so the main loop can talk to the ADCs (adc_config.c): DRDY edges are still
+ * counted but start no reads, reads that were not started yet are dropped and the running transfer is waited for.
+ * Conversions while paused are lost like any other, so their indices go missing in the stream.
+ * Does nothing before adc_capture_start.
+ *
+ * @input  : none
+ *
+ * @output : none
+ *
+ * @return : none
+ *
+ * */
+void adc_capture_pause(void)
+{
+	if (!running) {
+		return;
+	}
+	paused = 1;
+	requests[0].pending = 0;
+	requests[1].pending = 0;
+	while (hal_adc_busy() || (inflight != 0)) {} // Wait for the last frame (and its end-of-receive interrupt)
+}
+
+/**
+ * @adc_capture_resume
+ *
+ * Hands the bus back to the capture after adc_capture_pause (if it was started). The DRDY period keeps its last value
+ * until two edges after resume have measured it again.
+ *
+ * @input  : none
+ *
+ * @output : none
+ *
+ * @return : none
+ *
+ * */
+void adc_capture_resume(void)
+{
+	uint32_t state;
+
+	if (!running) {
+		return;
+	}
+	state = hal_critical_enter();
+	requests[0].time = 0; // An ADC that adc_config.c stopped and restarted would time the whole pause as its period
+	requests[1].time = 0;
+	paused = 0;
+	hal_critical_exit(state);
+}
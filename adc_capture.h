@@ -0,0 +1,49 @@
+/****************************************************************
+* ADC FRAME CAPTURE
+*
+* Moves ADC0/ADC1 frames from the SPI bus into the sample rings (adc_ring.h).
+* The DRDY interrupts only report a conversion; this module decides when the SPI read is started. When both ADCs
+* wait for the bus the one with the earliest deadline (its next DRDY, from the measured DRDY period) goes first.
+*
+*  ADC_CAPTURE_DMA = 1 -- the DRDY interrupt starts the transfer itself and the end-of-receive interrupt publishes
+*                         the frame and starts the read that was held back while the bus was busy. Frames go
+*                         straight into ring slots, the main loop never touches the bus and only sees completed
+*                         blocks of SAMPLES_PER_PACKET frames.
+*                         Requires SPI_MASTER_ADC to use DMA for transmit and receive, ADC_SPI_RxDone as its
+*                         end-of-receive callback, and the DRDY pin interrupts and the SPI/DMA interrupts at the same
+*                         priority (they must not preempt each other).
+*  ADC_CAPTURE_DMA = 0 -- the main loop polls the bus through adc_capture_poll and starts the reads (previous
+*                         behaviour, works with the SPI_MASTER_ADC APP in interrupt mode).
+***************************************************************/
+#ifndef ADC_CAPTURE_H
+#define ADC_CAPTURE_H
+
+#include <stdint.h>
+#include "adc_ring.h"
+
+	// CONFIG
+		#ifndef ADC_CAPTURE_DMA
+		#define ADC_CAPTURE_DMA 1U		// 1 = reads started from the DRDY interrupt (DMA), 0 = reads started by the main loop
+		#endif
+		#define ADC_COUNT 2U			// ADC0 = IEPE, ADC1 = FB/CL
+
+	// SAMPLE RINGS -- one per ADC, consumed by the packet builder
+		extern adc_ring_t adc_rings[ADC_COUNT];
+
+	// DEADLINE MISSES -- a frame must be read before its ADC signals the next conversion (CMD_DEADLINES)
+		typedef struct {
+			volatile uint32_t dropped;	// Still waiting for the bus at the next DRDY -- conversion lost
+			volatile uint32_t late;		// Read still running at the next DRDY -- frame may be torn
+		} adc_capture_misses_t;
+
+		extern adc_capture_misses_t adc_capture_misses[ADC_COUNT];
+
+	// PROTOTYPES
+		void adc_capture_drdy(uint8_t adc, uint32_t index, uint64_t time);
+		void adc_capture_done(void);
+		void adc_capture_poll(void);
+		void adc_capture_start(void);
+		void adc_capture_pause(void);
+		void adc_capture_resume(void);
+
+#endif /* ADC_CAPTURE_H */
@@ -0,0 +1,309 @@
+/****************************************************************
+* HEADER FILES
+***************************************************************/
+#include <string.h>
+#include "hal.h"				// Hardware abstraction (DAVE APPs on the target, simulator on the host)
+#include "adc_config.h"
+
+	// REGISTER TABLES -- boot configuration, the same for both ADCs
+		#define ADC_CONFIG_DEFAULTS { \
+			{ADC_REG_A_SYS_CFG,	0x68, 0},	/* b(01101000) -- Neg Charge Pump Powered Down | High-Res | 2.442 Internal Reference | Internal Voltage Enabled | 5/95% Comparator Threshold */ \
+			{ADC_REG_D_SYS_CFG,	0x3C, 0},	/* b(00111100) -- Watchdog Disabled | No CRC | 12ns delay for DONE (not used) | 12ns delay for Hi-Z on DOUT | Fixed Frame Size (6 frames) | CRC disabled */ \
+			{ADC_REG_CLK1,		0x02, 0},	/* b(00000010) -- XTAL CLK Source | CLKIN /2 */ \
+			{ADC_REG_CLK2,		0x4E, 0},	/* b(01001110) -- ICLK / 4 | OSR = fMOD / 48 -> 42.667kHz (0x48: OSR = fMOD / 256 -> 8kHz) */ \
+			{ADC_REG_ADC_ENA,	0x0F, 0}	/* b(00001111) -- Enables all ADC channels (note: no option to enable certain channels, all or nothing) */ \
+		}
+
+		adc_reg_t adc_config[ADC_COUNT][ADC_CONFIG_REGS] = {ADC_CONFIG_DEFAULTS, ADC_CONFIG_DEFAULTS};
+
+	// TRANSFER BUFFERS
+		static uint8_t cmd_tx[ADC_FRAME_BYTES];
+		static uint8_t cmd_rx[ADC_FRAME_BYTES];
+
+	// BRING-UP STATE -- step 0 polls for READY, step f + 1 sends frame f of the sequence (see adc_config.h)
+		#define STEP_IDLE		0xFFU
+		#define STEP_READY		0U
+		#define FRAME_UNLOCK	0U
+		#define FRAME_WREG(i)	(2U + 2U * (i))
+		#define FRAME_END		FRAME_WREG(ADC_CONFIG_REGS)	// WAKEUP (or NULL), then NULL
+
+		typedef struct {
+			uint8_t step;
+			uint8_t flags;			// ADC_BEGIN_*
+			uint8_t failed;			// Result, see adc_config_result
+			uint32_t start_ms;		// Start of the READY wait
+		} bringup_t;
+
+		static bringup_t bringup[ADC_COUNT] = {{STEP_IDLE, 0, 0, 0}, {STEP_IDLE, 0, 0, 0}};
+		static uint8_t active = STEP_IDLE;		// ADC whose frame is on the bus (STEP_IDLE = none)
+		static uint8_t served = 0;				// Last ADC given a frame -- the other one goes next
+
+
+/**
+ * @command
+ *
+ * Sends one command frame to the selected ADC and waits for it.
+ *
+ * @input  : cmd - 16-bit command word
+ *
+ * @output : none
+ *
+ * @return : response word (upper 16 bits of the first word) to the previous command
+ *
+ * */
+static uint16_t command(uint16_t cmd)
+{
+	memset(cmd_tx, 0x00, ADC_FRAME_BYTES);
+	cmd_tx[0] = (uint8_t)(cmd >> 8);
+	cmd_tx[1] = (uint8_t)cmd;
+	hal_adc_transfer(cmd_tx, cmd_rx, ADC_FRAME_BYTES);
+	while(hal_adc_busy()){} // Wait for completion
+	return (uint16_t)((cmd_rx[0] << 8) | cmd_rx[1]);
+}
+
+/**
+ * @read_register
+ *
+ * RREG of one register of the selected ADC.
+ *
+ * @return : 1 if the ADC answered for this register (value in reg->readback), 0 otherwise
+ *
+ * */
+static uint8_t read_register(adc_reg_t *reg)
+{
+	uint16_t response;
+
+	command(ADC_CMD_RREG(reg->addr));
+	response = command(ADC_CMD_NULL);
+	reg->readback = (uint8_t)response;
+	return ((response & 0xFF00U) == ADC_CMD_RREG(reg->addr)) ? 1U : 0U;
+}
+
+/**
+ * @adc_config_find
+ *
+ * Table entry of a register.
+ *
+ * @input  : adc - 0 = ADC0, 1 = ADC1
+ *           addr - register address
+ *
+ * @output : none
+ *
+ * @return : entry, or 0 if the register is not in the table (not configurable)
+ *
+ * */
+adc_reg_t *adc_config_find(uint8_t adc, uint8_t addr)
+{
+	if (adc >= ADC_COUNT) {
+		return 0;
+	}
+	for (uint8_t i = 0; i < ADC_CONFIG_REGS; i++) {
+		if (adc_config[adc][i].addr == addr) {
+			return &adc_config[adc][i];
+		}
+	}
+	return 0;
+}
+
+/**
+ * @frame_command
+ *
+ * Command word of the current step of an ADC's sequence.
+ *
+ * */
+static uint16_t frame_command(uint8_t adc)
+{
+	bringup_t *b = &bringup[adc];
+	uint8_t frame = (uint8_t)(b->step - 1U);
+
+	if (b->step == STEP_READY) {
+		return ADC_CMD_NULL;
+	}
+	if (frame == FRAME_UNLOCK) {
+		return ADC_CMD_UNLOCK;
+	}
+	if (frame == FRAME_UNLOCK + 1U) {
+		return ADC_CMD_STANDBY;
+	}
+	if (frame < FRAME_END) {
+		adc_reg_t *reg = &adc_config[adc][(frame - FRAME_WREG(0)) / 2U];
+
+		return ((frame & 1U) == 0U) ? ADC_CMD_WREG(reg->addr, reg->value) : ADC_CMD_RREG(reg->addr);
+	}
+	return ((frame == FRAME_END) && (b->flags & ADC_BEGIN_WAKEUP)) ? ADC_CMD_WAKEUP : ADC_CMD_NULL;
+}
+
+/**
+ * @frame_done
+ *
+ * Checks the response that came back with the frame just sent (it answers the frame before) and moves the ADC on.
+ *
+ * */
+static void frame_done(uint8_t adc, uint16_t response, uint32_t now_ms)
+{
+	bringup_t *b = &bringup[adc];
+	uint8_t frame = (uint8_t)(b->step - 1U);
+	uint8_t last = (b->flags & ADC_BEGIN_WAKEUP) ? (uint8_t)(FRAME_END + 1U) : FRAME_END;
+
+	if (b->step == STEP_READY) {
+		if ((response == ADC_RSP_READY) || ((response & 0xFF00U) == ADC_RSP_STATUS)) {
+			b->step = FRAME_UNLOCK + 1U;
+		}
+		else if ((now_ms - b->start_ms) >= ADC_READY_TIMEOUT_MS) {
+			b->failed |= ADC_FAIL_NOT_READY; // Carry on regardless -- the readbacks will show what happened
+			b->step = FRAME_UNLOCK + 1U;
+		}
+		return;
+	}
+
+	if ((frame == FRAME_UNLOCK + 1U) && (response != ADC_CMD_UNLOCK)) {
+		b->failed |= ADC_FAIL_NOT_READY;
+	}
+	else if ((frame >= FRAME_WREG(1)) && (frame <= FRAME_END) && ((frame & 1U) == 0U)) {
+		uint8_t i = (uint8_t)((frame - FRAME_WREG(1)) / 2U);	// RREG of entry i was the frame before
+		adc_reg_t *reg = &adc_config[adc][i];
+
+		reg->readback = (uint8_t)response;
+		if (((response & 0xFF00U) != ADC_CMD_RREG(reg->addr)) || (reg->readback != reg->value)) {
+			b->failed |= (uint8_t)(1U << i);
+		}
+	}
+	b->step = (frame == last) ? STEP_IDLE : (uint8_t)(b->step + 1U);
+}
+
+/**
+ * @adc_config_begin
+ *
+ * Starts writing the register table of one ADC; adc_config_poll does the work. The bus must not be in use by the
+ * capture (before adc_capture_start, or paused).
+ *
+ * @input  : adc - 0 = ADC0, 1 = ADC1
+ *           flags - ADC_BEGIN_POWER_UP: wait for the ADC to come out of power-on reset first
+ *                   ADC_BEGIN_WAKEUP: start conversions afterwards (otherwise it is left in standby)
+ *           now_ms - current time, for the READY timeout
+ *
+ * @output : none
+ *
+ * @return : none
+ *
+ * */
+void adc_config_begin(uint8_t adc, uint8_t flags, uint32_t now_ms)
+{
+	bringup_t *b = &bringup[adc];
+
+	b->flags = flags;
+	b->failed = 0;
+	b->start_ms = now_ms;
+	b->step = (flags & ADC_BEGIN_POWER_UP) ? STEP_READY : (uint8_t)(FRAME_UNLOCK + 1U);
+}
+
+/**
+ * @adc_config_poll
+ *
+ * Advances the configuration started by adc_config_begin by at most one frame and never waits: returns at once if
+ * the bus is busy. Frames for the two ADCs alternate, so both are brought up together.
+ *
+ * @input  : now_ms - current time, for the READY timeout
+ *
+ * @output : none
+ *
+ * @return : 1 once no ADC is being configured, 0 otherwise
+ *
+ * */
+uint8_t adc_config_poll(uint32_t now_ms)
+{
+	if (active != STEP_IDLE) {
+		if (hal_adc_busy()) {
+			return 0;
+		}
+		frame_done(active, (uint16_t)((cmd_rx[0] << 8) | cmd_rx[1]), now_ms);
+		active = STEP_IDLE;
+	}
+
+	for (uint8_t n = 1; n <= ADC_COUNT; n++) {
+		uint8_t adc = (uint8_t)((served + n) % ADC_COUNT);
+		uint16_t cmd;
+
+		if (bringup[adc].step == STEP_IDLE) {
+			continue;
+		}
+		cmd = frame_command(adc);
+		memset(cmd_tx, 0x00, ADC_FRAME_BYTES);
+		cmd_tx[0] = (uint8_t)(cmd >> 8);
+		cmd_tx[1] = (uint8_t)cmd;
+		active = adc;
+		served = adc;
+		hal_adc_select(adc); // Change slave
+		hal_adc_transfer(cmd_tx, cmd_rx, ADC_FRAME_BYTES);
+		return 0;
+	}
+
+	hal_adc_frame_length_continuous(); // Frame does not end based on DAVE App Configuration -- this allows us to grab all 144 bits of data out of the ADC during data collection
+	return 1;
+}
+
+/**
+ * @adc_config_result
+ *
+ * Outcome of the last configuration of an ADC (valid once adc_config_poll returned 1).
+ *
+ * @input  : adc - 0 = ADC0, 1 = ADC1
+ *
+ * @output : none
+ *
+ * @return : bit i set if table entry i did not read back the value written, ADC_FAIL_NOT_READY if the ADC did not
+ *           come out of reset or refused the UNLOCK; 0 = all verified
+ *
+ * */
+uint8_t adc_config_result(uint8_t adc)
+{
+	return bringup[adc].failed;
+}
+
+/**
+ * @adc_config_apply
+ *
+ * Writes the register table of one ADC and verifies every register by reading it back -- the bring-up sequence
+ * without the READY wait, run to completion. The ADC is put in standby first, so this also works while it is
+ * converting. Pauses the capture of both ADCs for the duration (14 frames on the bus).
+ *
+ * @input  : adc - 0 = ADC0, 1 = ADC1
+ *           wakeup - 1 = start conversions afterwards, 0 = leave the ADC in standby
+ *
+ * @output : none
+ *
+ * @return : see adc_config_result, 0 = all verified
+ *
+ * */
+uint8_t adc_config_apply(uint8_t adc, uint8_t wakeup)
+{
+	adc_capture_pause();
+	adc_config_begin(adc, wakeup ? ADC_BEGIN_WAKEUP : 0U, 0U);
+	while (!adc_config_poll(0U)) {} // Bus is ours, the frames follow each other
+	adc_capture_resume();
+	return adc_config_result(adc);
+}
+
+/**
+ * @adc_config_read
+ *
+ * Reads one register back from the ADC (value in reg->readback). Pauses the capture of both ADCs for three frames.
+ *
+ * @input  : adc - 0 = ADC0, 1 = ADC1
+ *           reg - table entry (adc_config_find)
+ *
+ * @output : none
+ *
+ * @return : 1 if the ADC answered, 0 otherwise
+ *
+ * */
+uint8_t adc_config_read(uint8_t adc, adc_reg_t *reg)
+{
+	uint8_t ok;
+
+	adc_capture_pause();
+	hal_adc_select(adc); // Change slave
+	ok = read_register(reg);
+	adc_capture_resume();
+	return ok;
+}
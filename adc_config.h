@@ -0,0 +1,71 @@
+/****************************************************************
+* ADC REGISTER CONFIGURATION
+*
+* Table-driven setup of the two ADS131A04 ADCs. Every ADC has a copy of the register table (defaults in
+* adc_config.c); adc_config_apply writes the whole table and reads every register back to verify it.
+* The table can be changed at run time (command channel, see command.h) and applied without a reboot.
+*
+* Both the boot bring-up and adc_config_apply run the same non-blocking sequence, one SPI frame per step:
+*
+*  0. power up only: NULL frames until the ADC reports READY -- or a status word, when it kept running through an
+*     MCU reset (watchdog) -- bounded by ADC_READY_TIMEOUT_MS (t_POR in the data sheet)
+*  1. UNLOCK, STANDBY
+*  2. per register: WREG, RREG -- each readback arrives with the next frame and is compared with the value written
+*  3. WAKEUP (if the ADC is to convert), NULL to collect its acknowledgement
+*
+* At boot adc_config_begin starts both ADCs and the main loop calls adc_config_poll every pass: the frames of the two
+* ADCs interleave on the bus and nothing waits, so Ethernet and the thermocouples come up at the same time.
+* Configuration frames are full ADC frames (ADC_FRAME_BYTES) with the command in the first word; the response to a
+* command arrives in the first word of the next frame.
+***************************************************************/
+#ifndef ADC_CONFIG_H
+#define ADC_CONFIG_H
+
+#include <stdint.h>
+#include "adc_capture.h"
+
+	// REGISTERS -- see the ADS131A04 data sheet
+		#define ADC_REG_A_SYS_CFG	0x0BU
+		#define ADC_REG_D_SYS_CFG	0x0CU
+		#define ADC_REG_CLK1		0x0DU	// CLKIN divider
+		#define ADC_REG_CLK2		0x0EU	// ICLK divider | OSR
+		#define ADC_REG_ADC_ENA		0x0FU	// Channel power (all or nothing)
+
+		#define ADC_CONFIG_REGS		5U		// Entries in the register table
+
+	// COMMANDS
+		#define ADC_CMD_NULL		0x0000U
+		#define ADC_CMD_STANDBY		0x0022U
+		#define ADC_CMD_WAKEUP		0x0033U
+		#define ADC_CMD_UNLOCK		0x0655U
+		#define ADC_CMD_RREG(addr)	(0x2000U | ((uint16_t)(addr) << 8))
+		#define ADC_CMD_WREG(addr, value)	(0x4000U | ((uint16_t)(addr) << 8) | (value))
+
+	// RESPONSES
+		#define ADC_RSP_READY		0xFF04U		// After power up, until unlocked (0xFF04 = 4 channel device)
+		#define ADC_RSP_STATUS		0x2200U		// Upper byte of the status word (RREG of STAT_1) -- answer to NULL once running
+
+	// BRING-UP
+		#define ADC_READY_TIMEOUT_MS	20U		// t_POR = 2^18 CLKIN periods = 16ms at 16.384MHz, plus margin
+		#define ADC_BEGIN_POWER_UP		0x01U	// adc_config_begin: wait for READY first (boot)
+		#define ADC_BEGIN_WAKEUP		0x02U	// adc_config_begin: start conversions afterwards
+		#define ADC_FAIL_NOT_READY		0x80U	// Result bit: no READY within ADC_READY_TIMEOUT_MS or UNLOCK not acknowledged
+
+	typedef struct {
+		uint8_t addr;
+		uint8_t value;				// Value written by adc_config_apply
+		uint8_t readback;			// Value read back by the last apply/read
+	} adc_reg_t;
+
+	// REGISTER TABLES -- one per ADC, written in table order
+		extern adc_reg_t adc_config[ADC_COUNT][ADC_CONFIG_REGS];
+
+	// PROTOTYPES
+		adc_reg_t *adc_config_find(uint8_t adc, uint8_t addr);
+		void adc_config_begin(uint8_t adc, uint8_t flags, uint32_t now_ms);
+		uint8_t adc_config_poll(uint32_t now_ms);
+		uint8_t adc_config_result(uint8_t adc);
+		uint8_t adc_config_apply(uint8_t adc, uint8_t wakeup);
+		uint8_t adc_config_read(uint8_t adc, adc_reg_t *reg);
+
+#endif /* ADC_CONFIG_H */
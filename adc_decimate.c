@@ -0,0 +1,166 @@
+/****************************************************************
+* HEADER FILES
+***************************************************************/
+#include <string.h>
+#include "adc_decimate.h"
+#include "adc_status.h"			// Status words are checked on the way through the filter
+
+	// DECIMATED RINGS
+		adc_ring_t decim_rings[ADC_COUNT];
+
+	// FILTER STATE
+		static decim_t filters[ADC_COUNT];		// log2 = 0 -> bypass
+		static uint8_t block_status[ADC_COUNT][3];	// Status words ORed over the current block
+		static uint8_t block_real[ADC_COUNT];		// Current block has a received input (not only held ones)
+		static uint64_t block_time[ADC_COUNT];		// Capture time of its last received input
+		static int32_t held[ADC_COUNT][DECIM_CHANNELS];	// Last received input, stands in for lost ones
+		static uint32_t next_index[ADC_COUNT];		// Index the next input should have
+		static uint8_t started[ADC_COUNT];			// An input was received since the filter was (re)started
+
+
+/**
+ * @get_s24
+ *
+ * Sign-extends one 24-bit big-endian word of a raw frame.
+ *
+ * */
+static int32_t get_s24(const uint8_t *p)
+{
+	return (int32_t)(((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8)) >> 8;
+}
+
+/**
+ * @block_input
+ *
+ * Integrates one input of one ADC. Its index ends a block when all low log2 bits are set: the combs run and the output
+ * goes into the decimated ring, unless the block holds no received input (lost whole) or the ring is full -- then the
+ * output is computed anyway (keeping the combs in step) and dropped.
+ *
+ * */
+static void block_input(uint8_t adc, uint32_t index, const int32_t x[DECIM_CHANNELS])
+{
+	decim_t *filter = &filters[adc];
+	uint32_t last = (1UL << filter->log2) - 1U;
+	adc_frame_t *slot;
+	int32_t y[DECIM_CHANNELS];
+
+	decim_integrate(filter, x);
+	if ((index & last) != last) {
+		return;
+	}
+
+	decim_output(filter, y);
+	slot = block_real[adc] ? adc_ring_claim(&decim_rings[adc]) : 0;
+	if (slot != 0) {
+		slot->index = index >> filter->log2;
+		slot->time = block_time[adc];
+		memset(slot->data, 0, ADC_FRAME_BYTES);
+		memcpy(slot->data, block_status[adc], 3);
+		for (uint8_t ch = 0; ch < DECIM_CHANNELS; ch++) {
+			uint8_t *p = &slot->data[3U * (ch + 1U)];
+			p[0] = (uint8_t)((uint32_t)y[ch] >> 16);
+			p[1] = (uint8_t)((uint32_t)y[ch] >> 8);
+			p[2] = (uint8_t)y[ch];
+		}
+		adc_ring_commit(&decim_rings[adc]);
+	}
+	memset(block_status[adc], 0, 3);
+	block_real[adc] = 0;
+}
+
+/**
+ * @adc_decimate_set
+ *
+ * Changes the decimation of one ADC. Restarts its filter and drops the decimated frames not yet packetized.
+ * Main loop only -- the filter runs in adc_decimate_poll.
+ *
+ * @input  : adc - 0 = ADC0, 1 = ADC1
+ *           log2 - decimation factor 2^log2 (0 = full rate, limited to DECIM_MAX_LOG2)
+ *
+ * @output : none
+ *
+ * @return : none
+ *
+ * */
+void adc_decimate_set(uint8_t adc, uint8_t log2)
+{
+	adc_ring_t *ring = &decim_rings[adc];
+
+	decim_init(&filters[adc], log2);
+	memset(block_status[adc], 0, sizeof(block_status[adc]));
+	block_real[adc] = 0;
+	started[adc] = 0;
+	adc_ring_release(ring, adc_ring_count(ring));
+}
+
+/**
+ * @adc_decimate_log2
+ *
+ * Current decimation of one ADC (2^log2).
+ *
+ * */
+uint8_t adc_decimate_log2(uint8_t adc)
+{
+	return filters[adc].log2;
+}
+
+/**
+ * @adc_decimate_poll
+ *
+ * Runs the waiting capture frames of one ADC through its filter. Output indices stay aligned to the conversion count:
+ * conversions that were lost are filled in with the last received input, so a block whose last input went missing
+ * still ends where the next block begins and every block integrates exactly 2^log2 inputs (the combs need that).
+ * A gap longer than the filter's memory (DECIM_STAGES blocks) starts the filter again instead.
+ *
+ * @input  : adc - 0 = ADC0, 1 = ADC1
+ *
+ * @output : none
+ *
+ * @return : ring to packetize -- the capture ring at full rate, the decimated ring otherwise
+ *
+ * */
+adc_ring_t *adc_decimate_poll(uint8_t adc)
+{
+	decim_t *filter = &filters[adc];
+	uint8_t *status = block_status[adc];
+	uint32_t waiting;
+
+	if (filter->log2 == 0U) {
+		return &adc_rings[adc];
+	}
+
+	waiting = adc_ring_count(&adc_rings[adc]);
+	for (uint32_t i = 0; i < waiting; i++) {
+		const adc_frame_t *frame = adc_ring_peek(&adc_rings[adc], i);
+		int32_t x[DECIM_CHANNELS];
+
+		if (started[adc] && (frame->index != next_index[adc])) {
+			if ((frame->index - next_index[adc]) > ((uint32_t)DECIM_STAGES << filter->log2)) {
+				decim_init(filter, filter->log2); // Nothing from before the gap is left in the output
+				memset(status, 0, 3);
+				block_real[adc] = 0;
+			}
+			else {
+				for (uint32_t n = next_index[adc]; n != frame->index; n++) {
+					block_input(adc, n, held[adc]);
+				}
+			}
+		}
+
+		for (uint8_t ch = 0; ch < DECIM_CHANNELS; ch++) {
+			x[ch] = get_s24(&frame->data[3U * (ch + 1U)]);
+			held[adc][ch] = x[ch];
+		}
+		adc_status_scan(adc, frame);
+		status[0] |= frame->data[0];
+		status[1] |= frame->data[1];
+		status[2] |= frame->data[2];
+		block_real[adc] = 1;
+		block_time[adc] = frame->time;
+		next_index[adc] = frame->index + 1U;
+		started[adc] = 1;
+		block_input(adc, frame->index, x);
+	}
+	adc_ring_release(&adc_rings[adc], waiting);
+	return &decim_rings[adc];
+}
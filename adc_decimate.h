@@ -0,0 +1,37 @@
+/****************************************************************
+* ADC DECIMATION
+*
+* Optional per-ADC decimation stage between the capture rings (adc_capture.h) and the packet builder.
+* Frames of a decimated ADC run through a CIC filter (decimator.h) in the main loop and the reduced-rate frames go
+* into a second ring, which the packet builder reads instead of the capture ring. A bypassed ADC (log2 = 0) is
+* packetized straight from its capture ring, so full-rate capture costs nothing extra.
+*
+* Output frames look like capture frames:
+*  index	input index >> log2 -- output n covers inputs n x 2^log2 ... (n + 1) x 2^log2 - 1, a lost input counted as the one before it
+*  time		capture time of the last received input of the block
+*  status	status words of the block ORed together, so no fault flag is lost
+***************************************************************/
+#ifndef ADC_DECIMATE_H
+#define ADC_DECIMATE_H
+
+#include <stdint.h>
+#include "adc_capture.h"
+#include "decimator.h"
+
+	// CONFIG -- decimation factor 2^log2 per ADC at boot, 0 = full rate
+		#ifndef DECIM_LOG2_ADC0
+		#define DECIM_LOG2_ADC0 0U		// IEPE -- vibration needs the full 42.667kHz
+		#endif
+		#ifndef DECIM_LOG2_ADC1
+		#define DECIM_LOG2_ADC1 0U		// FB/CL -- e.g. 7 = 333Hz
+		#endif
+
+	// DECIMATED RINGS -- one per ADC, only used while that ADC is decimated
+		extern adc_ring_t decim_rings[ADC_COUNT];
+
+	// PROTOTYPES
+		void adc_decimate_set(uint8_t adc, uint8_t log2);
+		uint8_t adc_decimate_log2(uint8_t adc);
+		adc_ring_t *adc_decimate_poll(uint8_t adc);
+
+#endif /* ADC_DECIMATE_H */
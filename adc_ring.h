@@ -0,0 +1,104 @@
+/****************************************************************
+* ADC SAMPLE RING
+*
+* Single-producer / single-consumer ring of timestamped ADC frames.
+* The producer side (claim/commit) runs in interrupt context: a slot is claimed when the SPI read of a frame is
+* started and committed from the SPI end-of-receive interrupt. The consumer side (count/peek/release) runs in the
+* main loop, which packs the frames into Ethernet packets. Head and tail are free-running counters that are only
+* written by their own side, so no locking is needed.
+*
+* No DAVE dependencies -- the same header is used by host-side tools.
+***************************************************************/
+#ifndef ADC_RING_H
+#define ADC_RING_H
+
+#include <stdint.h>
+
+	// RING SIZES
+		#define ADC_FRAME_BYTES 18U		// Status | CH1 | CH2 | CH3 | CH4 | Zeros (6 frames x 24 bits)
+		#define ADC_RING_SIZE 256U		// Frames per ring -- MUST be a power of two (6ms of headroom at 42.667kHz)
+
+	// Orders the frame data against the head/tail update (DMB on Cortex-M, full fence on the host)
+		#define ADC_RING_BARRIER() __sync_synchronize()
+
+	typedef struct {
+		uint32_t index;						// Conversion number (counted DRDY edges) -- gaps show missed conversions
+		uint64_t time;						// Capture time -- timebase ticks of the DRDY edge (timebase.h)
+		uint8_t data[ADC_FRAME_BYTES];		// Raw SPI frame as read from the ADC
+	} adc_frame_t;
+
+	typedef struct {
+		volatile uint32_t head;				// Frames committed (producer)
+		volatile uint32_t tail;				// Frames released (consumer)
+		volatile uint32_t overflows;		// Frames lost because the ring was full (producer)
+		adc_frame_t frames[ADC_RING_SIZE];
+	} adc_ring_t;
+
+
+	/**
+	 * @adc_ring_claim
+	 *
+	 * Producer: returns the slot the next frame is written into, or 0 (and counts an overflow) if the ring is full.
+	 * The slot becomes visible to the consumer only after adc_ring_commit.
+	 *
+	 * */
+	static inline adc_frame_t *adc_ring_claim(adc_ring_t *ring)
+	{
+		uint32_t head = ring->head;
+
+		if ((head - ring->tail) >= ADC_RING_SIZE) {
+			ring->overflows++;
+			return 0;
+		}
+		return &ring->frames[head & (ADC_RING_SIZE - 1U)];
+	}
+
+	/**
+	 * @adc_ring_commit
+	 *
+	 * Producer: publishes the slot returned by the last adc_ring_claim.
+	 *
+	 * */
+	static inline void adc_ring_commit(adc_ring_t *ring)
+	{
+		ADC_RING_BARRIER(); // Frame contents must land before the new head
+		ring->head = ring->head + 1U;
+	}
+
+	/**
+	 * @adc_ring_count
+	 *
+	 * Consumer: number of committed frames waiting to be read.
+	 *
+	 * */
+	static inline uint32_t adc_ring_count(const adc_ring_t *ring)
+	{
+		uint32_t count = ring->head - ring->tail;
+		ADC_RING_BARRIER(); // Frame contents are read after the head
+		return count;
+	}
+
+	/**
+	 * @adc_ring_peek
+	 *
+	 * Consumer: i-th waiting frame (0 = oldest). Only valid for i < adc_ring_count.
+	 *
+	 * */
+	static inline const adc_frame_t *adc_ring_peek(const adc_ring_t *ring, uint32_t i)
+	{
+		return &ring->frames[(ring->tail + i) & (ADC_RING_SIZE - 1U)];
+	}
+
+	/**
+	 * @adc_ring_release
+	 *
+	 * Consumer: hands the n oldest frames back to the producer.
+	 *
+	 * */
+	static inline void adc_ring_release(adc_ring_t *ring, uint32_t n)
+	{
+		ADC_RING_BARRIER(); // Finish reading the frames before the producer may reuse them
+		ring->tail = ring->tail + n;
+	}
+
+#endif /* ADC_RING_H */
@@ -0,0 +1,68 @@
+/****************************************************************
+* HEADER FILES
+***************************************************************/
+#include "adc_status.h"
+#include "adc_config.h"			// ADC_RSP_STATUS
+#include "daq_packet.h"			// PKT_FAULT_*
+
+	// COUNTERS
+		adc_status_counts_t adc_status_counts[ADC_COUNT];
+
+	// PACKET FAULT BITS -- seen since the ADC's last packet
+		static uint8_t pending[ADC_COUNT];
+
+
+/**
+ * @adc_status_scan
+ *
+ * Checks the status word of one frame taken from the capture ring.
+ *
+ * @input  : adc - 0 = ADC0, 1 = ADC1
+ *           frame - captured frame
+ *
+ * @output : none
+ *
+ * @return : none
+ *
+ * */
+void adc_status_scan(uint8_t adc, const adc_frame_t *frame)
+{
+	adc_status_counts_t *counts = &adc_status_counts[adc];
+	uint8_t stat1 = frame->data[1];
+
+	counts->frames++;
+	if (frame->data[0] != (uint8_t)(ADC_RSP_STATUS >> 8)) {
+		counts->sync_errors++;
+		pending[adc] |= PKT_FAULT_SYNC;
+		return; // Not STAT_1 -- the bits mean nothing
+	}
+	if (stat1 & ((1U << ADC_STAT1_FAULTS) - 1U)) {
+		for (uint8_t bit = 0; bit < ADC_STAT1_FAULTS; bit++) {
+			if (stat1 & (1U << bit)) {
+				counts->faults[bit]++;
+			}
+		}
+		counts->fault_frames++;
+		pending[adc] |= PKT_FAULT_ADC;
+	}
+}
+
+/**
+ * @adc_status_take
+ *
+ * Fault bits for the ADC's next packet: status faults seen since its previous packet.
+ *
+ * @input  : adc - 0 = ADC0, 1 = ADC1
+ *
+ * @output : none
+ *
+ * @return : PKT_FAULT_ADC / PKT_FAULT_SYNC
+ *
+ * */
+uint8_t adc_status_take(uint8_t adc)
+{
+	uint8_t faults = pending[adc];
+
+	pending[adc] = 0;
+	return faults;
+}
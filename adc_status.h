@@ -0,0 +1,46 @@
+/****************************************************************
+* ADC STATUS WORD
+*
+* Every ADC frame starts with the ADC's response to the command of the previous frame. During capture that is the
+* NULL command, so the word is ADC_RSP_STATUS | STAT_1. adc_status_scan checks each frame as the main loop takes it
+* from the capture ring:
+*
+*  Sync		Upper byte not ADC_RSP_STATUS -- the frame is not a status response: the SPI frame is out of step with
+*			the ADC (or the ADC reset). Counted, PKT_FAULT_SYNC in the ADC's next packet
+*  Faults	STAT_1 fault bits, counted per bit, PKT_FAULT_ADC in the ADC's next packet. F_DRDY is the ADC's own
+*			account of a conversion read after the next one was ready (adc_capture.h counts the same from DRDY)
+*
+* The STAT_1 flags clear when STAT_1 is read -- which every NULL command does -- so a fault shows in one frame per
+* occurrence unless its cause persists.
+***************************************************************/
+#ifndef ADC_STATUS_H
+#define ADC_STATUS_H
+
+#include <stdint.h>
+#include "adc_ring.h"
+#include "adc_capture.h"
+
+	// STAT_1 FAULT BITS -- see the ADS131A04 data sheet
+		#define ADC_STAT1_F_CHECK	0x01U	// Hamming/CRC check of the last command failed
+		#define ADC_STAT1_F_DRDY	0x02U	// Data not read before the next conversion
+		#define ADC_STAT1_F_RESYNC	0x04U	// ADCs resynchronized
+		#define ADC_STAT1_F_WDT		0x08U	// Watchdog timer expired
+		#define ADC_STAT1_F_ADCIN	0x10U	// Input out of range (STAT_P / STAT_N)
+		#define ADC_STAT1_F_SPI		0x20U	// SPI fault (STAT_S)
+		#define ADC_STAT1_F_OPC		0x40U	// Invalid command
+		#define ADC_STAT1_FAULTS	7U		// Bits 0 - 6
+
+	typedef struct {
+		uint32_t frames;						// Frames scanned
+		uint32_t sync_errors;					// Status word not a status response
+		uint32_t fault_frames;					// Frames with any STAT_1 fault bit set
+		uint32_t faults[ADC_STAT1_FAULTS];		// Frames with STAT_1 bit n set
+	} adc_status_counts_t;
+
+	extern adc_status_counts_t adc_status_counts[ADC_COUNT];
+
+	// PROTOTYPES
+		void adc_status_scan(uint8_t adc, const adc_frame_t *frame);
+		uint8_t adc_status_take(uint8_t adc);
+
+#endif /* ADC_STATUS_H */
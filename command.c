@@ -0,0 +1,101 @@
+/****************************************************************
+* HEADER FILES
+***************************************************************/
+#include <string.h>
+#include "command.h"
+#include "adc_ring.h"				// ADC_RING_BARRIER
+
+	// QUEUE
+		static uint8_t queue[COMMAND_QUEUE_SIZE][CMD_MAX_SIZE];
+		static volatile uint32_t head = 0;		// Commands queued (lwIP side)
+		static volatile uint32_t tail = 0;		// Commands executed (main loop)
+
+	// REASSEMBLY -- command split across TCP segments
+		static uint8_t partial[CMD_MAX_SIZE];
+		static uint32_t partial_len = 0;
+
+	volatile uint32_t command_dropped = 0;
+
+
+/**
+ * @command_receive
+ *
+ * Called from the lwIP receive callbacks with the bytes of one pbuf. Complete commands are queued; bytes that do not
+ * start a command are skipped up to the next CMD_SYNC.
+ *
+ * @input  : data, len - received bytes
+ *
+ * @output : none
+ *
+ * @return : none
+ *
+ * */
+void command_receive(const uint8_t *data, uint32_t len)
+{
+	for (uint32_t i = 0; i < len; i++) {
+		int32_t size;
+
+		partial[partial_len++] = data[i];
+		size = daq_get_command(partial, partial_len);
+
+		if (size < 0) {
+			uint32_t skip = 1;
+
+			while ((skip < partial_len) && (partial[skip] != CMD_SYNC)) {
+				skip++;
+			}
+			partial_len -= skip;
+			memmove(partial, partial + skip, partial_len);
+			command_dropped += skip;
+		}
+		else if (size > 0) {
+			if ((head - tail) < COMMAND_QUEUE_SIZE) {
+				memcpy(queue[head & (COMMAND_QUEUE_SIZE - 1U)], partial, (uint32_t)size);
+				ADC_RING_BARRIER(); // Command must land before the new head
+				head = head + 1U;
+			}
+			else {
+				command_dropped++; // Host sends faster than the main loop executes -- no reply for this one
+			}
+			partial_len = 0;
+		}
+	}
+}
+
+/**
+ * @command_reset
+ *
+ * Drops a partly received command -- on a new connection, or at the end of a UDP datagram.
+ *
+ * */
+void command_reset(void)
+{
+	partial_len = 0;
+}
+
+/**
+ * @command_next
+ *
+ * Main loop: oldest queued command (header and payload, see daq_packet.h), or 0 if there is none.
+ *
+ * */
+const uint8_t *command_next(void)
+{
+	if (head == tail) {
+		return 0;
+	}
+	ADC_RING_BARRIER(); // Command contents are read after the head
+	return queue[tail & (COMMAND_QUEUE_SIZE - 1U)];
+}
+
+/**
+ * @command_done
+ *
+ * Main loop: frees the command returned by command_next.
+ *
+ * */
+void command_done(void)
+{
+	ADC_RING_BARRIER(); // Finish reading the command before its slot may be reused
+	tail = tail + 1U;
+}
@@ -0,0 +1,28 @@
+/****************************************************************
+* COMMAND CHANNEL
+*
+* Host commands (format in daq_packet.h) arrive on the data connection: the lwIP receive callback hands the bytes to
+* command_receive, which reassembles complete commands into a small queue. The main loop takes them from there and
+* executes them (runCommand in main.c), because commands may need the ADC bus and send a reply packet.
+* Same single-producer / single-consumer scheme as the sample rings (adc_ring.h): lwIP side produces, main loop
+* consumes, no locking.
+***************************************************************/
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include <stdint.h>
+#include "daq_packet.h"
+
+	// QUEUE SIZE
+		#define COMMAND_QUEUE_SIZE 8U		// Commands waiting for the main loop -- MUST be a power of two
+
+	// STATISTICS
+		extern volatile uint32_t command_dropped;	// Commands lost to a full queue, plus bytes skipped while resyncing
+
+	// PROTOTYPES
+		void command_receive(const uint8_t *data, uint32_t len);
+		void command_reset(void);
+		const uint8_t *command_next(void);
+		void command_done(void);
+
+#endif /* COMMAND_H */
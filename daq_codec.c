@@ -0,0 +1,377 @@
+/****************************************************************
+* LOSSLESS SAMPLE CODEC -- see daq_codec.h
+***************************************************************/
+#include "daq_codec.h"
+#include <string.h>
+
+	#define MAX_COLUMNS		10U		// Time delta, status, 8 ADC channels
+
+	typedef struct {
+		uint8_t offset;				// Byte offset in the sample
+		uint8_t width;				// Bits
+		uint8_t is_signed;			// ADC channel codes -- sign extended before prediction
+	} column_t;
+
+	typedef struct {
+		uint8_t *out;
+		uint8_t *end;
+		uint32_t acc;				// Bits not yet written, right aligned
+		uint8_t bits;
+		uint8_t full;				// Ran out of room
+	} bit_writer_t;
+
+	typedef struct {
+		const uint8_t *in;
+		const uint8_t *end;
+		uint32_t acc;
+		uint8_t bits;
+		uint8_t empty;				// Ran past the end
+	} bit_reader_t;
+
+
+// Columns of a sample packet -- 0 if the mask holds thermocouple words (not coded)
+static uint8_t columns_of(uint16_t mask, column_t columns[MAX_COLUMNS]) {
+	uint8_t n = 0;
+	uint8_t offset = PKT_DELTA_BYTES;
+
+	if (mask & PKT_CH_TC) {
+		return 0;
+	}
+	columns[n].offset = 0U;
+	columns[n].width = 8U * PKT_DELTA_BYTES;
+	columns[n++].is_signed = 0U;
+	if (mask & PKT_CH_STATUS) {
+		columns[n].offset = offset;
+		columns[n].width = 8U * PKT_ADC_WORD_BYTES;
+		columns[n++].is_signed = 0U;
+		offset += PKT_ADC_WORD_BYTES;
+	}
+	for (uint8_t bit = 0; bit < 8U; bit++) {
+		if (mask & (1U << bit)) {
+			columns[n].offset = offset;
+			columns[n].width = 8U * PKT_ADC_WORD_BYTES;
+			columns[n++].is_signed = 1U;
+			offset += PKT_ADC_WORD_BYTES;
+		}
+	}
+	return n;
+}
+
+// Value cut to the column width (sign extended for channel codes) -- keeps a corrupt stream from growing the values
+static int32_t wrap(const column_t *column, uint32_t value) {
+	value &= (1UL << column->width) - 1U;
+	if (column->is_signed) {
+		uint32_t sign = 1UL << (column->width - 1U);
+
+		return (int32_t)(value ^ sign) - (int32_t)sign;
+	}
+	return (int32_t)value;
+}
+
+static int32_t get_value(const uint8_t *p, const column_t *column) {
+	uint32_t value = 0;
+
+	for (uint8_t i = 0; i < column->width / 8U; i++) {
+		value = (value << 8) | p[i];
+	}
+	return wrap(column, value);
+}
+
+static void set_value(uint8_t *p, const column_t *column, int32_t value) {
+	uint8_t bytes = column->width / 8U;
+
+	for (uint8_t i = 0; i < bytes; i++) {
+		p[i] = (uint8_t)((uint32_t)value >> (8U * (bytes - 1U - i))); // MSB first
+	}
+}
+
+static uint32_t zigzag(int32_t e) {
+	return ((uint32_t)e << 1) ^ (uint32_t)(e >> 31);
+}
+
+
+// ENCODER ////////////////////////////////////////////////////////////////////////////////////////
+
+// Appends n <= 24 bits
+static void put_bits(bit_writer_t *w, uint32_t value, uint8_t n) {
+	if (n == 0U) {
+		return;
+	}
+	w->acc = (w->acc << n) | (value & ((1UL << n) - 1U));
+	w->bits += n;
+	while (w->bits >= 8U) {
+		w->bits -= 8U;
+		if (w->out == w->end) {
+			w->full = 1U;
+		}
+		else {
+			*w->out++ = (uint8_t)(w->acc >> w->bits);
+		}
+	}
+}
+
+static void put_long(bit_writer_t *w, uint32_t value, uint8_t n) {
+	if (n > 24U) {
+		put_bits(w, value >> 24, (uint8_t)(n - 24U));
+		n = 24U;
+	}
+	put_bits(w, value, n);
+}
+
+static void put_rice(bit_writer_t *w, uint32_t u, uint8_t k) {
+	uint32_t q = u >> k;
+
+	if (q < DAQ_CODEC_ESCAPE) {
+		put_bits(w, (1UL << (q + 1U)) - 2U, (uint8_t)(q + 1U)); // q ones, then a zero
+		put_bits(w, u, k);
+	}
+	else {
+		put_bits(w, (1UL << DAQ_CODEC_ESCAPE) - 1U, DAQ_CODEC_ESCAPE);
+		put_long(w, u, DAQ_CODEC_ESCAPE_BITS);
+	}
+}
+
+// Bits to Rice code n residuals summing to sum (estimate: each quotient taken as the sum's share), best k returned
+static uint32_t rice_cost(uint32_t n, uint64_t sum, uint8_t *k) {
+	uint64_t best = (uint64_t)n + sum;
+
+	*k = 0;
+	for (uint8_t i = 1; i <= 24U; i++) {
+		uint64_t cost = (uint64_t)n * (i + 1U) + (sum >> i);
+
+		if (cost >= best) {
+			break; // Convex in k
+		}
+		best = cost;
+		*k = i;
+	}
+	return (best > 0xFFFFFFFFUL) ? 0xFFFFFFFFUL : (uint32_t)best;
+}
+
+// Codes one column: picks the predictor and k, writes them, the first values and the residuals
+static void put_column(bit_writer_t *w, const int32_t *v, uint32_t n, uint8_t width) {
+	uint64_t sum_delta = 0;
+	uint64_t sum_linear = 0;
+	uint32_t cost;
+	uint32_t c;
+	uint8_t k_delta = 0;
+	uint8_t k_linear = 0;
+	uint8_t predictor = DAQ_CODEC_VERBATIM;
+	uint8_t k = 0;
+
+	for (uint32_t i = 1; i < n; i++) {
+		sum_delta += zigzag(v[i] - v[i - 1U]);
+		if (i >= 2U) {
+			sum_linear += zigzag(v[i] - 2 * v[i - 1U] + v[i - 2U]);
+		}
+	}
+
+	cost = n * width;
+	if (sum_delta == 0U) {
+		predictor = DAQ_CODEC_CONSTANT;
+		cost = width;
+	}
+	if (n >= 2U) {
+		c = width + rice_cost(n - 1U, sum_delta, &k_delta);
+		if (c < cost) {
+			predictor = DAQ_CODEC_DELTA;
+			k = k_delta;
+			cost = c;
+		}
+		c = 2U * width + rice_cost(n - 2U, sum_linear, &k_linear);
+		if (c < cost) {
+			predictor = DAQ_CODEC_LINEAR;
+			k = k_linear;
+		}
+	}
+
+	put_bits(w, ((uint32_t)predictor << 5) | k, 8U);
+	switch (predictor) {
+		case DAQ_CODEC_VERBATIM:
+			for (uint32_t i = 0; i < n; i++) {
+				put_bits(w, (uint32_t)v[i], width);
+			}
+			break;
+
+		case DAQ_CODEC_CONSTANT:
+			put_bits(w, (uint32_t)v[0], width);
+			break;
+
+		case DAQ_CODEC_DELTA:
+			put_bits(w, (uint32_t)v[0], width);
+			for (uint32_t i = 1; i < n; i++) {
+				put_rice(w, zigzag(v[i] - v[i - 1U]), k);
+			}
+			break;
+
+		default: // DAQ_CODEC_LINEAR
+			put_bits(w, (uint32_t)v[0], width);
+			put_bits(w, (uint32_t)v[1], width);
+			for (uint32_t i = 2; i < n; i++) {
+				put_rice(w, zigzag(v[i] - 2 * v[i - 1U] + v[i - 2U]), k);
+			}
+			break;
+	}
+}
+
+/**
+ * Compresses an ADC sample packet (PKT_TYPE_SAMPLES, len bytes) into out (at least len bytes).
+ * Returns the length of the compressed packet, or 0 if it would not be smaller or cannot be coded (thermocouple
+ * words, more than DAQ_CODEC_MAX_SAMPLES samples) -- send the packet as it is then.
+ */
+uint16_t daq_compress(const uint8_t *packet, uint16_t len, uint8_t *out) {
+	int32_t values[DAQ_CODEC_MAX_SAMPLES];
+	column_t columns[MAX_COLUMNS];
+	daq_header_t header;
+	bit_writer_t w;
+	uint16_t size;
+	uint8_t n_columns;
+
+	if ((daq_get_header(packet, len, &header) != (int32_t)len) || (header.type != PKT_TYPE_SAMPLES) ||
+		(header.count == 0U) || (header.count > DAQ_CODEC_MAX_SAMPLES)) {
+		return 0;
+	}
+	n_columns = columns_of(header.mask, columns);
+	if (n_columns == 0U) {
+		return 0;
+	}
+	size = daq_sample_size(header.mask);
+
+	w.out = out + PKT_HEADER_SIZE;
+	w.end = out + len - 1U; // Must come out smaller
+	w.acc = 0;
+	w.bits = 0;
+	w.full = 0;
+	for (uint8_t c = 0; (c < n_columns) && !w.full; c++) {
+		const uint8_t *p = packet + PKT_HEADER_SIZE + columns[c].offset;
+
+		for (uint16_t i = 0; i < header.count; i++, p += size) {
+			values[i] = get_value(p, &columns[c]);
+		}
+		put_column(&w, values, header.count, columns[c].width);
+	}
+	put_bits(&w, 0U, (uint8_t)((8U - w.bits) & 7U)); // Pad to a byte
+	if (w.full) {
+		return 0;
+	}
+
+	memcpy(out, packet, PKT_HEADER_SIZE);
+	daq_put_type(out, PKT_TYPE_COMPRESSED);
+	len = (uint16_t)(w.out - out);
+	daq_put_length(out, len);
+	return len;
+}
+
+
+// DECODER ////////////////////////////////////////////////////////////////////////////////////////
+
+// Reads n <= 24 bits -- zeros past the end (flagged)
+static uint32_t get_bits(bit_reader_t *r, uint8_t n) {
+	if (n == 0U) {
+		return 0;
+	}
+	while (r->bits < n) {
+		uint8_t byte = 0;
+
+		if (r->in == r->end) {
+			r->empty = 1U;
+		}
+		else {
+			byte = *r->in++;
+		}
+		r->acc = (r->acc << 8) | byte;
+		r->bits += 8U;
+	}
+	r->bits -= n;
+	return (r->acc >> r->bits) & ((1UL << n) - 1U);
+}
+
+static uint32_t get_long(bit_reader_t *r, uint8_t n) {
+	uint32_t high = 0;
+
+	if (n > 24U) {
+		high = get_bits(r, (uint8_t)(n - 24U)) << 24;
+		n = 24U;
+	}
+	return high | get_bits(r, n);
+}
+
+static int32_t get_rice(bit_reader_t *r, uint8_t k) {
+	uint32_t q = 0;
+	uint32_t u;
+
+	while ((q < DAQ_CODEC_ESCAPE) && get_bits(r, 1U) && !r->empty) {
+		q++;
+	}
+	u = (q == DAQ_CODEC_ESCAPE) ? get_long(r, DAQ_CODEC_ESCAPE_BITS) : ((q << k) | get_bits(r, k));
+	return (int32_t)(u >> 1) ^ -(int32_t)(u & 1U);
+}
+
+/**
+ * Expands a compressed packet (len bytes, as framed by daq_get_header) into the sample packet it was made from,
+ * written to out (size bytes). Returns the length of the sample packet, or -1 if the packet does not decode.
+ */
+int32_t daq_expand(const uint8_t *packet, uint32_t len, uint8_t *out, uint32_t size) {
+	column_t columns[MAX_COLUMNS];
+	daq_header_t header;
+	bit_reader_t r;
+	uint32_t expanded;
+	uint16_t sample_size;
+	uint8_t n_columns;
+
+	if ((daq_get_header(packet, len, &header) <= 0) || (header.type != PKT_TYPE_COMPRESSED)) {
+		return -1;
+	}
+	n_columns = columns_of(header.mask, columns);
+	sample_size = daq_sample_size(header.mask);
+	expanded = PKT_HEADER_SIZE + (uint32_t)header.count * sample_size;
+	if ((n_columns == 0U) || (expanded > size)) {
+		return -1;
+	}
+
+	r.in = packet + PKT_HEADER_SIZE;
+	r.end = packet + header.length;
+	r.acc = 0;
+	r.bits = 0;
+	r.empty = 0;
+	for (uint8_t c = 0; c < n_columns; c++) {
+		const column_t *column = &columns[c];
+		uint8_t *p = out + PKT_HEADER_SIZE + column->offset;
+		uint32_t mode = get_bits(&r, 8U);
+		uint8_t predictor = (uint8_t)(mode >> 5);
+		uint8_t k = (uint8_t)(mode & 0x1FU);
+		int32_t prev = 0;		// x[i-1]
+		int32_t prev2 = 0;		// x[i-2]
+
+		if (k > 24U) {
+			return -1;
+		}
+		for (uint16_t i = 0; i < header.count; i++, p += sample_size) {
+			int32_t value;
+
+			if ((predictor == DAQ_CODEC_VERBATIM) || (i == 0U) || ((predictor == DAQ_CODEC_LINEAR) && (i == 1U))) {
+				value = wrap(column, get_bits(&r, column->width));
+			}
+			else if (predictor == DAQ_CODEC_CONSTANT) {
+				value = prev;
+			}
+			else if (predictor == DAQ_CODEC_DELTA) {
+				value = wrap(column, (uint32_t)prev + (uint32_t)get_rice(&r, k));
+			}
+			else {
+				value = wrap(column, (uint32_t)get_rice(&r, k) + 2U * (uint32_t)prev - (uint32_t)prev2);
+			}
+			set_value(p, column, value);
+			prev2 = prev;
+			prev = value;
+		}
+		if (r.empty) {
+			return -1;
+		}
+	}
+
+	memcpy(out, packet, PKT_HEADER_SIZE);
+	daq_put_type(out, PKT_TYPE_SAMPLES);
+	daq_put_length(out, (uint16_t)expanded);
+	return (int32_t)expanded;
+}
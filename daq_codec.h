@@ -0,0 +1,51 @@
+/****************************************************************
+* LOSSLESS SAMPLE CODEC
+*
+* Optional compression of ADC sample packets, applied to a finished packet just before it is sent. Every packet is
+* one block coded on its own, so a lost packet costs only its own samples and the decoder needs no state.
+*
+* The samples are coded column by column: time delta, status word (if sent), then each channel. For every column
+* the encoder picks the predictor that leaves the smallest residuals and a Rice parameter k for them:
+*
+*  Verbatim	Values as they are (width bits each) -- noise-like columns that would not get smaller
+*  Constant	First value only -- every value equal (status words, idle channels)
+*  Delta		First value, then x[i] - x[i-1]
+*  Linear		First two values, then x[i] - 2 x[i-1] + x[i-2]
+*
+* Residuals are zigzag mapped (0, -1, 1, -2, ... -> 0, 1, 2, 3, ...) and Rice coded: quotient u >> k in unary (ones
+* ended by a zero), then the k low bits. A quotient of DAQ_CODEC_ESCAPE or more is sent as DAQ_CODEC_ESCAPE ones
+* and the value in DAQ_CODEC_ESCAPE_BITS bits, which bounds the cost of an outlier.
+*
+* Compressed packet: the header of the sample packet with Packet Type = PKT_TYPE_COMPRESSED and Packet Length the
+* compressed length, then a bit stream (MSB first, zero padded to a byte) with per column:
+*   predictor (3 bits) | k (5 bits) | first value(s) (width bits each) | residuals
+* Expanding gives back the sample packet byte for byte. Packets that would not get smaller are sent uncompressed.
+*
+* Shared by the firmware (encoder) and the host tools (decoder) -- no DAVE dependencies.
+***************************************************************/
+#ifndef DAQ_CODEC_H
+#define DAQ_CODEC_H
+
+#include <stdint.h>
+#include "daq_packet.h"
+
+	// PREDICTORS
+		#define DAQ_CODEC_VERBATIM		0U
+		#define DAQ_CODEC_CONSTANT		1U
+		#define DAQ_CODEC_DELTA			2U
+		#define DAQ_CODEC_LINEAR		3U
+
+	// RICE CODE
+		#define DAQ_CODEC_ESCAPE		23U		// Unary quotients this long are replaced by the raw value
+		#define DAQ_CODEC_ESCAPE_BITS	27U		// Largest zigzag residual: 24-bit values through the linear predictor
+
+	// LIMITS
+		#define DAQ_CODEC_MAX_SAMPLES	SAMPLES_PER_PACKET	// Encoder: larger packets are sent uncompressed
+
+	// PROTOTYPES -- encoder (firmware)
+		uint16_t daq_compress(const uint8_t *packet, uint16_t len, uint8_t *out);
+
+	// PROTOTYPES -- decoder (host)
+		int32_t daq_expand(const uint8_t *packet, uint32_t len, uint8_t *out, uint32_t size);
+
+#endif /* DAQ_CODEC_H */
@@ -0,0 +1,198 @@
+/****************************************************************
+* DATA PACKET ENCODER / DECODER (version 3) -- see daq_packet.h
+***************************************************************/
+#include "daq_packet.h"
+
+	#define TC_BITS			PKT_CH_TC
+	#define ADC_WORD_BITS	(PKT_CH_ADC(0) | PKT_CH_ADC(1) | PKT_CH_STATUS)
+
+	// Sample words are moved with the loads and stores of their width
+	PKT_STATIC_ASSERT(PKT_DELTA_BYTES == 2U, "time delta is read with pkt_get_be2");
+	PKT_STATIC_ASSERT(PKT_ADC_WORD_BYTES == 3U, "ADC words are read with pkt_get_be3");
+	PKT_STATIC_ASSERT(PKT_TC_WORD_BYTES == 4U, "thermocouple words are read with pkt_get_be4");
+
+
+static uint32_t bit_count(uint32_t x) {
+	uint32_t n = 0;
+
+	for (; x != 0; x &= x - 1U) {
+		n++;
+	}
+	return n;
+}
+
+// Packet length given by the header fields -- replies, telemetry and burst records carry count bytes, sample packets count samples
+static uint32_t packet_length(const daq_header_t *header) {
+	if ((header->type == PKT_TYPE_REPLY) || (header->type == PKT_TYPE_TELEMETRY) || (header->type == PKT_TYPE_BURST)) {
+		return PKT_HEADER_SIZE + (uint32_t)header->count;
+	}
+	return PKT_HEADER_SIZE + (uint32_t)header->count * daq_sample_size(header->mask);
+}
+
+
+// ENCODER ////////////////////////////////////////////////////////////////////////////////////////
+
+// Bytes per sample for a channel mask, including the time delta
+uint16_t daq_sample_size(uint16_t mask) {
+	return (uint16_t)(PKT_DELTA_BYTES + bit_count(mask & ADC_WORD_BITS) * PKT_ADC_WORD_BYTES +
+		bit_count(mask & TC_BITS) * PKT_TC_WORD_BYTES);
+}
+
+// Writes the header; length is filled in from the type, mask and count
+void daq_put_header(uint8_t *packet, const daq_header_t *header) {
+	daq_header_t h = *header;
+
+	h.length = (uint16_t)packet_length(header);
+	#define PUT_CONST(name, bytes, value)	pkt_put_be##bytes(packet + PKT_OFS_##name, value);
+	#define PUT_FIELD(name, member, bytes)	pkt_put_be##bytes(packet + PKT_OFS_##name, h.member);
+	PKT_HEADER_FIELDS(PUT_CONST, PUT_FIELD)
+	#undef PUT_CONST
+	#undef PUT_FIELD
+}
+
+// Appends one ADC frame (status | CH1 - CH4 | zeros, 3 bytes each) keeping the words selected by the mask
+uint8_t *daq_put_adc_sample(uint8_t *out, uint16_t mask, uint8_t adc, uint16_t delta_us, const uint8_t *frame) {
+	pkt_put_be2(out, delta_us);
+	out += PKT_DELTA_BYTES;
+
+	if (mask & PKT_CH_STATUS) {
+		out[0] = frame[0];
+		out[1] = frame[1];
+		out[2] = frame[2];
+		out += PKT_ADC_WORD_BYTES;
+	}
+	for (uint8_t ch = 0; ch < 4U; ch++) {
+		if (mask & (PKT_CH_IEPE0 << (4U * adc + ch))) {
+			const uint8_t *word = frame + PKT_ADC_WORD_BYTES * (ch + 1U);
+
+			out[0] = word[0];
+			out[1] = word[1];
+			out[2] = word[2];
+			out += PKT_ADC_WORD_BYTES;
+		}
+	}
+	return out;
+}
+
+// Appends one thermocouple read cycle (TC0 - TC3, 4 bytes each) keeping the words selected by the mask
+uint8_t *daq_put_tc_sample(uint8_t *out, uint16_t mask, uint16_t delta_us, const uint8_t *words) {
+	pkt_put_be2(out, delta_us);
+	out += PKT_DELTA_BYTES;
+
+	for (uint8_t tc = 0; tc < 4U; tc++) {
+		if (mask & (PKT_CH_TC0 << tc)) {
+			const uint8_t *word = words + PKT_TC_WORD_BYTES * tc;
+
+			out[0] = word[0];
+			out[1] = word[1];
+			out[2] = word[2];
+			out[3] = word[3];
+			out += PKT_TC_WORD_BYTES;
+		}
+	}
+	return out;
+}
+
+
+// DECODER ////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Parses the header at the start of data.
+ * Returns the packet length, 0 if more bytes are needed, or -1 if data does not start with a valid packet
+ * (wrong sync byte, version or type, or a length that does not match the mask and count -- compressed packets: not
+ * shorter than the samples they carry).
+ */
+int32_t daq_get_header(const uint8_t *data, uint32_t len, daq_header_t *header) {
+	if (len < PKT_HEADER_SIZE) {
+		return ((len > 0) && (data[PKT_OFS_SYNC] != PKT_SYNC)) ? -1 : 0;
+	}
+
+	uint32_t mismatch = 0;
+	#define GET_CONST(name, bytes, value)	mismatch |= (uint32_t)pkt_get_be##bytes(data + PKT_OFS_##name) ^ (value);
+	#define GET_FIELD(name, member, bytes)	header->member = pkt_get_be##bytes(data + PKT_OFS_##name);
+	PKT_HEADER_FIELDS(GET_CONST, GET_FIELD)
+	#undef GET_CONST
+	#undef GET_FIELD
+	if (mismatch) {
+		return -1; // Sync byte or version
+	}
+
+	if ((header->type > PKT_TYPE_BURST) || ((header->mask >> PKT_CH_COUNT) != 0U) ||
+		((header->type != PKT_TYPE_SAMPLES) && (header->type != PKT_TYPE_COMPRESSED) && (header->mask != 0U))) {
+		return -1;
+	}
+	if ((header->type == PKT_TYPE_COMPRESSED) ? ((header->length <= PKT_HEADER_SIZE) || (header->length >= packet_length(header))) :
+		(header->length != packet_length(header))) {
+		return -1; // Compressed packets are shorter than the samples they carry
+	}
+	return (len < header->length) ? 0 : (int32_t)header->length;
+}
+
+/**
+ * Unpacks sample i of a packet whose header was parsed by daq_get_header.
+ * values[] is indexed by mask bit (values[12] = status); ADC words are sign extended, thermocouple words are raw.
+ * Channels not in the mask read as 0.
+ */
+void daq_get_sample(const uint8_t *packet, const daq_header_t *header, uint16_t i, uint16_t *delta_us, int32_t values[PKT_CH_COUNT]) {
+	const uint8_t *p = packet + PKT_HEADER_SIZE + (uint32_t)i * daq_sample_size(header->mask);
+	uint16_t mask = header->mask;
+
+	*delta_us = pkt_get_be2(p);
+	p += PKT_DELTA_BYTES;
+
+	for (uint8_t bit = 0; bit < PKT_CH_COUNT; bit++) {
+		values[bit] = 0;
+	}
+	if (mask & PKT_CH_STATUS) {
+		values[PKT_CH_COUNT - 1U] = (int32_t)pkt_get_be3(p);
+		p += PKT_ADC_WORD_BYTES;
+	}
+	for (uint8_t bit = 0; bit < PKT_CH_COUNT - 1U; bit++) {
+		if (!(mask & (1U << bit))) {
+			continue;
+		}
+		if ((1U << bit) & TC_BITS) {
+			values[bit] = (int32_t)pkt_get_be4(p);
+			p += PKT_TC_WORD_BYTES;
+		}
+		else {
+			uint32_t raw = pkt_get_be3(p);
+
+			values[bit] = (int32_t)(raw ^ 0x800000U) - 0x800000; // Sign extend 24 bits
+			p += PKT_ADC_WORD_BYTES;
+		}
+	}
+}
+
+
+// COMMANDS ///////////////////////////////////////////////////////////////////////////////////////
+
+// Writes a command (host side), returns its size
+uint16_t daq_put_command(uint8_t *out, uint8_t opcode, uint8_t sequence, const uint8_t *payload, uint8_t len) {
+	out[CMD_OFS_SYNC] = CMD_SYNC;
+	out[CMD_OFS_OPCODE] = opcode;
+	out[CMD_OFS_SEQUENCE] = sequence;
+	out[CMD_OFS_LENGTH] = len;
+	for (uint8_t i = 0; i < len; i++) {
+		out[CMD_HEADER_SIZE + i] = payload[i];
+	}
+	return (uint16_t)(CMD_HEADER_SIZE + len);
+}
+
+/**
+ * Checks for a command at the start of data.
+ * Returns the command size, 0 if more bytes are needed, or -1 if data does not start with a command
+ * (wrong sync byte or a payload longer than CMD_MAX_PAYLOAD).
+ */
+int32_t daq_get_command(const uint8_t *data, uint32_t len) {
+	if ((len > 0) && (data[CMD_OFS_SYNC] != CMD_SYNC)) {
+		return -1;
+	}
+	if (len < CMD_HEADER_SIZE) {
+		return 0;
+	}
+	if (data[CMD_OFS_LENGTH] > CMD_MAX_PAYLOAD) {
+		return -1;
+	}
+	return (len < CMD_HEADER_SIZE + (uint32_t)data[CMD_OFS_LENGTH]) ? 0 : (int32_t)(CMD_HEADER_SIZE + data[CMD_OFS_LENGTH]);
+}
@@ -0,0 +1,254 @@
+/****************************************************************
+* DATA PACKET FORMAT (version 3)
+*
+* Every packet carries one source: a block of consecutive ADC0 or ADC1 samples, one thermocouple read cycle, or the
+* reply to a host command. The header is self-describing (sync byte, version, length), so packets can follow each
+* other back to back on the TCP stream or be grouped into UDP datagrams. All multi-byte values are MSB first.
+*
+* Commands travel the other way (host -> board) on the same connection, see COMMANDS below.
+*
+* Shared by the firmware (encoder) and the host-side tools (decoder) -- no DAVE dependencies.
+***************************************************************/
+#ifndef DAQ_PACKET_H
+#define DAQ_PACKET_H
+
+#include <stdint.h>
+
+	// HEADER -- the one description of the header layout: every field in wire order with its width in bytes. Offsets
+	// (PKT_OFS_*), the encoder (daq_put_header), the decoder (daq_get_header) and the single-field accessors
+	// (daq_get_<member> / daq_put_<member>) are expanded from it; the checks below fail the build on a mismatch.
+	//   PKT_CONST(name, bytes, value)		written as value, checked by the decoder
+	//   PKT_FIELD(name, member, bytes)		daq_header_t member of exactly that width
+		#define PKT_SYNC			0xDAU	// First byte of every packet
+		#define PKT_VERSION			3U
+		#define PKT_HEADER_SIZE		28U
+
+		#define PKT_HEADER_FIELDS(PKT_CONST, PKT_FIELD) \
+			PKT_CONST(SYNC,		1, PKT_SYNC)		/* Sync byte */ \
+			PKT_CONST(VERSION,	1, PKT_VERSION)		/* Format version */ \
+			PKT_FIELD(DEVICE,	device,		1)		/* DEVICE_ID */ \
+			PKT_FIELD(FAULTS,	faults,		1)		/* Faults/Fresh/Stale flags */ \
+			PKT_FIELD(LENGTH,	length,		2)		/* Packet length including the header */ \
+			PKT_FIELD(MASK,		mask,		2)		/* Channel mask */ \
+			PKT_FIELD(COUNT,	count,		2)		/* Sample count */ \
+			PKT_FIELD(DECIM,	decim,		1)		/* Decimation log2 -- samples are 2^n conversions apart */ \
+			PKT_FIELD(TYPE,		type,		1)		/* PKT_TYPE_* */ \
+			PKT_FIELD(PACKET,	packet,		4)		/* Packet counter */ \
+			PKT_FIELD(INDEX,	index,		4)		/* Index of the first sample, counted at the decimated rate */ \
+			PKT_FIELD(TIME,		time_us,	8)		/* Time of the first sample in us */
+
+	// PACKET TYPES
+		#define PKT_TYPE_SAMPLES	0U		// ADC or thermocouple samples, layout given by the mask
+		#define PKT_TYPE_REPLY		1U		// Command reply: mask 0, count = reply bytes after the header (CMD_REPLY_*)
+		#define PKT_TYPE_TELEMETRY	2U		// Telemetry: mask 0, count = payload bytes (TELEM_*), index = telemetry packet number
+		#define PKT_TYPE_COMPRESSED	3U		// ADC samples coded by daq_codec.h: header as PKT_TYPE_SAMPLES, shorter length
+		#define PKT_TYPE_BURST		4U		// Burst record announcement (BURST_*): mask 0, count = payload bytes,
+											// index = record number, time = trigger time
+
+	// CHANNEL MASK BITS
+		#define PKT_CH_IEPE0		0x0001U	// ADC0 CH1
+		#define PKT_CH_IEPE1		0x0002U	// ADC0 CH2
+		#define PKT_CH_IEPE2		0x0004U	// ADC0 CH3
+		#define PKT_CH_IEPE3		0x0008U	// ADC0 CH4
+		#define PKT_CH_FB0			0x0010U	// ADC1 CH1
+		#define PKT_CH_FB1			0x0020U	// ADC1 CH2
+		#define PKT_CH_CL0			0x0040U	// ADC1 CH3
+		#define PKT_CH_CL1			0x0080U	// ADC1 CH4
+		#define PKT_CH_TC0			0x0100U	// Thermocouple 0 .. 3
+		#define PKT_CH_TC1			0x0200U
+		#define PKT_CH_TC2			0x0400U
+		#define PKT_CH_TC3			0x0800U
+		#define PKT_CH_STATUS		0x1000U	// ADC status word of the ADC the packet belongs to
+
+		#define PKT_CH_ADC(adc)		(0x000FU << (4U * (adc)))	// All channels of ADC0 / ADC1
+		#define PKT_CH_TC			0x0F00U
+		#define PKT_CH_COUNT		13U		// Mask bits in use
+
+	// SAMPLE LAYOUT -- per sample: time delta (16 bits, us after the packet time), then for every mask bit that is set:
+	//   status (24 bits) first, then channels in ascending bit order -- ADC channels 24 bits, thermocouples 32 bits
+		#define PKT_DELTA_BYTES		2U
+		#define PKT_ADC_WORD_BYTES	3U
+		#define PKT_TC_WORD_BYTES	4U
+
+	// FAULT BITS
+		#define PKT_FAULT_OVERFLOW	0x01U	// Samples of this source were lost to a full ring since its previous packet
+		#define PKT_FAULT_MISSED	0x02U	// ADC packets: conversions dropped or read late since the previous packet
+		#define PKT_FAULT_ADC		0x04U	// ADC packets: a status word reported a STAT_1 fault (adc_status.h)
+		#define PKT_FAULT_SYNC		0x08U	// ADC packets: a status word was not a status response -- frame out of step
+		#define PKT_FRESH_TC(n)		(0x10U << (n))	// Thermocouple packets: TCn was read in this cycle (clear = stale)
+		#define PKT_FLAG_BURST		0x10U	// ADC packets: samples of the last announced burst record (adc_burst.h), not live
+
+	// SIZES
+		#define SAMPLES_PER_PACKET	40U		// Consecutive samples per ADC packet (two full ADC packets fit one UDP datagram)
+		#define PACKET_MAX_SIZE		(PKT_HEADER_SIZE + SAMPLES_PER_PACKET * (PKT_DELTA_BYTES + 5U * PKT_ADC_WORD_BYTES)) // Largest packet
+
+	// TELEMETRY -- PKT_TYPE_TELEMETRY payload (telemetry.h), everything counted since boot, 32-bit words big-endian:
+	//   cycles per us (8 bits) | histograms (8) | buckets (8) | counters (8) |
+	//   per histogram: bucket counts, max (cycles) | counters
+	// Bucket i counts durations of [2^i, 2^(i+1)) CPU cycles (bucket 0 also 0), the last bucket everything above.
+		#define TELEM_HIST_DRDY_TO_SPI	0U		// DRDY interrupt entry to the start of the frame's SPI read
+		#define TELEM_HIST_SPI			1U		// SPI read of an ADC frame
+		#define TELEM_HIST_LOOP			2U		// Main loop pass
+		#define TELEM_HIST_SEND			3U		// send_data call
+		#define TELEM_HIST_CODEC		4U		// Compression of an ADC packet (daq_codec.h), while enabled
+		#define TELEM_HIST_TX_QUEUE		5U		// Packet queued to its last byte handed to lwIP (tx_batch.h)
+		#define TELEM_HISTOGRAMS		6U
+		#define TELEM_BUCKETS			24U
+
+		#define TELEM_CTR_DROPPED0		0U		// ADC0 conversions not read (deadline missed, adc_capture.h)
+		#define TELEM_CTR_DROPPED1		1U
+		#define TELEM_CTR_OVERFLOW0		2U		// ADC0 frames lost to a full sample ring
+		#define TELEM_CTR_OVERFLOW1		3U
+		#define TELEM_CTR_OVERRUN0		4U		// ADC0 reads overrun by the next conversion (late)
+		#define TELEM_CTR_OVERRUN1		5U
+		#define TELEM_CTR_TC_MISSED		6U		// Thermocouple reads missed (tc_capture.h)
+		#define TELEM_CTR_RECONNECTS	7U		// TCP connections (re)opened
+		#define TELEM_CTR_TX_DROPPED	8U		// Packets dropped for lack of a connection or queue space
+		#define TELEM_CTR_STATUS0		9U		// ADC0 frames with a STAT_1 fault bit (adc_status.h)
+		#define TELEM_CTR_STATUS1		10U
+		#define TELEM_CTR_SYNC0			11U		// ADC0 frames whose status word was not a status response
+		#define TELEM_CTR_SYNC1			12U
+		#define TELEM_CTR_TX_FLUSHES	13U		// Writes handed to lwIP (tcp_write, UDP: datagrams)
+		#define TELEM_CTR_TX_BYTES		14U		// Bytes in them -- over TX_FLUSHES the mean flush size
+		#define TELEM_CTR_TX_DEADLINE	15U		// Flushes forced by the latency deadline before a batch filled
+		#define TELEM_CTR_BOOT_CONFIG	16U		// Not counts: us after boot both ADCs were configured and converting,
+		#define TELEM_CTR_BOOT_SAMPLE	17U		// and capture time of the first ADC frame (0 = not yet, as CMD_STATUS)
+		#define TELEM_COUNTERS			18U
+
+		#define TELEM_PAYLOAD_SIZE		(4U + 4U * (TELEM_HISTOGRAMS * (TELEM_BUCKETS + 1U) + TELEM_COUNTERS))
+
+	// BURST RECORD -- PKT_TYPE_BURST payload, multi-byte values big-endian:
+	//   cause (8 bits, BURST_TRIG_*) | trigger channel (8, mask bit) | flags (8) | 0 (8) | pre-trigger window (32, us) |
+	//   post-trigger window (32, us) | frames ADC0, ADC1 (32 each) | index of the first frame ADC0, ADC1 (32 each)
+	// The record's ADC packets follow, flagged PKT_FLAG_BURST, indices continuous from the first index per ADC.
+		#define BURST_FLAG_TRUNCATED	0x01U	// Record buffer full before the post-trigger window ended
+		#define BURST_INFO_SIZE			28U
+
+	typedef struct {
+		uint8_t device;				// DEVICE_ID
+		uint8_t faults;				// PKT_FAULT_*
+		uint16_t length;			// Packet length including the header
+		uint16_t mask;				// PKT_CH_*
+		uint16_t count;				// Samples in the packet
+		uint8_t decim;				// Decimation log2 (0 = full rate, always 0 for thermocouples)
+		uint8_t type;				// PKT_TYPE_*
+		uint32_t packet;			// Packet counter
+		uint32_t index;				// Index of the first sample
+		uint64_t time_us;			// Time of the first sample
+	} daq_header_t;
+
+
+	// HEADER LAYOUT -- expanded from PKT_HEADER_FIELDS
+		#ifdef __cplusplus
+			#define PKT_STATIC_ASSERT(cond, msg)	static_assert(cond, msg)
+		#else
+			#define PKT_STATIC_ASSERT(cond, msg)	_Static_assert(cond, msg)
+		#endif
+
+		// Big-endian loads and stores of every width used, unrolled
+		typedef uint8_t pkt_be1_t;
+		typedef uint16_t pkt_be2_t;
+		typedef uint32_t pkt_be3_t;
+		typedef uint32_t pkt_be4_t;
+		typedef uint64_t pkt_be8_t;
+
+		static inline pkt_be1_t pkt_get_be1(const uint8_t *p) { return p[0]; }
+		static inline pkt_be2_t pkt_get_be2(const uint8_t *p) { return (pkt_be2_t)(((uint32_t)p[0] << 8) | p[1]); }
+		static inline pkt_be3_t pkt_get_be3(const uint8_t *p) { return ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2]; }
+		static inline pkt_be4_t pkt_get_be4(const uint8_t *p) {
+			return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+		}
+		static inline pkt_be8_t pkt_get_be8(const uint8_t *p) { return ((uint64_t)pkt_get_be4(p) << 32) | pkt_get_be4(p + 4); }
+
+		static inline void pkt_put_be1(uint8_t *p, pkt_be1_t v) { p[0] = v; }
+		static inline void pkt_put_be2(uint8_t *p, pkt_be2_t v) { p[0] = (uint8_t)(v >> 8); p[1] = (uint8_t)v; }
+		static inline void pkt_put_be3(uint8_t *p, pkt_be3_t v) { p[0] = (uint8_t)(v >> 16); p[1] = (uint8_t)(v >> 8); p[2] = (uint8_t)v; }
+		static inline void pkt_put_be4(uint8_t *p, pkt_be4_t v) {
+			p[0] = (uint8_t)(v >> 24); p[1] = (uint8_t)(v >> 16); p[2] = (uint8_t)(v >> 8); p[3] = (uint8_t)v;
+		}
+		static inline void pkt_put_be8(uint8_t *p, pkt_be8_t v) { pkt_put_be4(p, (uint32_t)(v >> 32)); pkt_put_be4(p + 4, (uint32_t)v); }
+
+		// PKT_OFS_<name>: fields are packed in table order -- every offset follows from the widths before it
+		#define PKT_LAYOUT_CONST(name, bytes, value)	PKT_OFS_##name, PKT_LAST_##name = PKT_OFS_##name + (bytes) - 1,
+		#define PKT_LAYOUT_FIELD(name, member, bytes)	PKT_OFS_##name, PKT_LAST_##name = PKT_OFS_##name + (bytes) - 1,
+		enum { PKT_HEADER_FIELDS(PKT_LAYOUT_CONST, PKT_LAYOUT_FIELD) PKT_HEADER_END };
+		#undef PKT_LAYOUT_CONST
+		#undef PKT_LAYOUT_FIELD
+
+		// daq_get_<member>(packet) / daq_put_<member>(packet, value): one field of a packet in place
+		#define PKT_ACCESS_CONST(name, bytes, value)
+		#define PKT_ACCESS_FIELD(name, member, bytes) \
+			static inline pkt_be##bytes##_t daq_get_##member(const uint8_t *packet) { return pkt_get_be##bytes(packet + PKT_OFS_##name); } \
+			static inline void daq_put_##member(uint8_t *packet, pkt_be##bytes##_t value) { pkt_put_be##bytes(packet + PKT_OFS_##name, value); }
+		PKT_HEADER_FIELDS(PKT_ACCESS_CONST, PKT_ACCESS_FIELD)
+		#undef PKT_ACCESS_CONST
+		#undef PKT_ACCESS_FIELD
+
+		// The table must fill the header exactly, and every member must be as wide as its field
+		#define PKT_CHECK_CONST(name, bytes, value) \
+			PKT_STATIC_ASSERT((value) <= (pkt_be##bytes##_t)~(pkt_be##bytes##_t)0, "header constant " #name " does not fit its field");
+		#define PKT_CHECK_FIELD(name, member, bytes) \
+			PKT_STATIC_ASSERT(sizeof(((daq_header_t *)0)->member) == sizeof(pkt_be##bytes##_t), "daq_header_t." #member " is not " #bytes " bytes wide");
+		PKT_HEADER_FIELDS(PKT_CHECK_CONST, PKT_CHECK_FIELD)
+		#undef PKT_CHECK_CONST
+		#undef PKT_CHECK_FIELD
+		PKT_STATIC_ASSERT(PKT_HEADER_END == PKT_HEADER_SIZE, "PKT_HEADER_FIELDS does not add up to PKT_HEADER_SIZE");
+		PKT_STATIC_ASSERT(PKT_HEADER_SIZE + TELEM_PAYLOAD_SIZE <= PACKET_MAX_SIZE, "telemetry packet exceeds PACKET_MAX_SIZE");
+
+
+	// COMMANDS -- host -> board: sync | opcode | sequence | payload length | payload
+	//   Every command is answered by a PKT_TYPE_REPLY packet: opcode | sequence | result | reply data
+		#define CMD_SYNC			0xC5U
+		#define CMD_HEADER_SIZE		4U
+		#define CMD_MAX_PAYLOAD		16U
+		#define CMD_MAX_SIZE		(CMD_HEADER_SIZE + CMD_MAX_PAYLOAD)
+
+		#define CMD_OFS_SYNC		0U
+		#define CMD_OFS_OPCODE		1U
+		#define CMD_OFS_SEQUENCE	2U		// Echoed in the reply
+		#define CMD_OFS_LENGTH		3U		// Payload bytes
+
+		//	Opcode					  Payload							Reply data
+		#define CMD_REG_WRITE		0x01U	// adc, (addr, value) x n		adc, (addr, value, readback) x n
+		#define CMD_REG_READ		0x02U	// adc, addr x n				adc, (addr, value, readback) x n
+		#define CMD_STREAMS			0x03U	// channel mask (16 bits)		channel mask in effect
+		#define CMD_DECIMATE		0x04U	// adc, log2					adc, log2 in effect
+		#define CMD_STATUS			0x05U	// -							bring-up result ADC0, ADC1, ADCs configured at,
+											//								first sample at (32 bits each, us after boot)
+		#define CMD_DEADLINES		0x06U	// -							deadline misses: ADC0 dropped, ADC0 late,
+											//								ADC1 dropped, ADC1 late, TC (32 bits each)
+		#define CMD_COMPRESS		0x07U	// on (1) / off (0)				compression in effect
+		#define CMD_BURST			0x08U	// mode, trigger, channel,			settings in effect
+											// threshold (32 bits, signed code),
+											// pre ms, post ms (16 bits each)
+		#define CMD_TRIGGER			0x09U	// -							burst state after the trigger (CMD_ERR_INVALID
+											//								while burst capture is off)
+		#define CMD_TX_LATENCY		0x0AU	// latency (32 bits, us)		latency in effect (32 bits), batch target
+											//								(16 bits, bytes), ACK rate (32 bits, bytes/s)
+
+		#define CMD_REPLY_OPCODE	0U		// Reply data offsets
+		#define CMD_REPLY_SEQUENCE	1U
+		#define CMD_REPLY_RESULT	2U
+		#define CMD_REPLY_DATA		3U
+		#define CMD_REPLY_MAX		(CMD_REPLY_DATA + 1U + 3U * (CMD_MAX_PAYLOAD - 1U))
+
+		#define CMD_OK				0x00U
+		#define CMD_ERR_VERIFY		0x01U	// A register did not read back the value written
+		#define CMD_ERR_INVALID		0x02U	// Unknown opcode, bad length, or register/ADC out of range
+
+
+	// PROTOTYPES -- encoder (firmware)
+		uint16_t daq_sample_size(uint16_t mask);
+		void daq_put_header(uint8_t *packet, const daq_header_t *header);
+		uint8_t *daq_put_adc_sample(uint8_t *out, uint16_t mask, uint8_t adc, uint16_t delta_us, const uint8_t *frame);
+		uint8_t *daq_put_tc_sample(uint8_t *out, uint16_t mask, uint16_t delta_us, const uint8_t *words);
+
+	// PROTOTYPES -- decoder (host)
+		int32_t daq_get_header(const uint8_t *data, uint32_t len, daq_header_t *header);
+		void daq_get_sample(const uint8_t *packet, const daq_header_t *header, uint16_t i, uint16_t *delta_us, int32_t values[PKT_CH_COUNT]);
+
+	// PROTOTYPES -- commands (encoder on the host, decoder on the firmware)
+		uint16_t daq_put_command(uint8_t *out, uint8_t opcode, uint8_t sequence, const uint8_t *payload, uint8_t len);
+		int32_t daq_get_command(const uint8_t *data, uint32_t len);
+
+#endif /* DAQ_PACKET_H */
@@ -0,0 +1,69 @@
+/****************************************************************
+* CIC DECIMATOR -- see decimator.h
+***************************************************************/
+#include <string.h>
+#include "decimator.h"
+
+	#define OUT_MAX 8388607		// 24-bit output range
+	#define OUT_MIN -8388608
+
+
+/**
+ * @decim_init
+ *
+ * Clears the filter state and sets the decimation factor (2^log2, limited to DECIM_MAX_LOG2).
+ *
+ * */
+void decim_init(decim_t *d, uint8_t log2)
+{
+	memset(d, 0, sizeof(*d));
+	d->log2 = (log2 > DECIM_MAX_LOG2) ? DECIM_MAX_LOG2 : log2;
+}
+
+/**
+ * @decim_integrate
+ *
+ * Feeds one input sample of every channel through the integrators. Call for every input sample.
+ *
+ * */
+void decim_integrate(decim_t *d, const int32_t in[DECIM_CHANNELS])
+{
+	for (uint8_t ch = 0; ch < DECIM_CHANNELS; ch++) {
+		uint64_t *integ = d->integ[ch];
+
+		integ[0] += (uint64_t)(int64_t)in[ch];
+		integ[1] += integ[0];
+		integ[2] += integ[1];
+	}
+}
+
+/**
+ * @decim_output
+ *
+ * Runs the combs and returns one output sample per channel, rounded and scaled back to 24 bits.
+ * Call after every 2^log2-th decim_integrate.
+ *
+ * */
+void decim_output(decim_t *d, int32_t out[DECIM_CHANNELS])
+{
+	uint8_t shift = (uint8_t)(DECIM_STAGES * d->log2);
+
+	for (uint8_t ch = 0; ch < DECIM_CHANNELS; ch++) {
+		uint64_t *delay = d->delay[ch];
+		uint64_t x = d->integ[ch][DECIM_STAGES - 1U];
+		int64_t y;
+
+		for (uint8_t s = 0; s < DECIM_STAGES; s++) {
+			uint64_t c = x - delay[s];
+			delay[s] = x;
+			x = c;
+		}
+
+		// Comb output is the exact sum over the last 3 x 2^log2 inputs: fits 24 + shift bits, so the cast is safe
+		y = (int64_t)x;
+		if (shift != 0U) {
+			y = (y + ((int64_t)1 << (shift - 1U))) >> shift; // Round half up
+		}
+		out[ch] = (y > OUT_MAX) ? OUT_MAX : (y < OUT_MIN) ? OUT_MIN : (int32_t)y;
+	}
+}
@@ -0,0 +1,35 @@
+/****************************************************************
+* CIC DECIMATOR
+*
+* Fixed-point decimation by 2^log2 for one group of four channels (one ADC): a 3-stage CIC filter with integrators
+* running at the input rate and combs at the output rate. Integer arithmetic only (modulo 2^64, which the CIC
+* structure tolerates), so the firmware and host tools produce bit-identical output from the same input.
+*
+*  Gain		(2^log2)^3, removed by a rounding right shift -- output has the input's 24-bit scale
+*  Response	sinc^3 lowpass, first null at the output rate; about 10 dB of droop at 0.45 x the output rate
+*  Delay	3 x (2^log2 - 1) / 2 input samples
+*
+* No DAVE dependencies -- the same code is used by host-side tools.
+***************************************************************/
+#ifndef DECIMATOR_H
+#define DECIMATOR_H
+
+#include <stdint.h>
+
+	// LIMITS
+		#define DECIM_STAGES 3U
+		#define DECIM_CHANNELS 4U
+		#define DECIM_MAX_LOG2 10U		// Decimation up to 1024 (41.7Hz from 42.667kHz) -- 24 + 3 x 10 bits fit 64
+
+	typedef struct {
+		uint8_t log2;								// Decimation factor 2^log2
+		uint64_t integ[DECIM_CHANNELS][DECIM_STAGES];	// Integrator states
+		uint64_t delay[DECIM_CHANNELS][DECIM_STAGES];	// Comb delay elements
+	} decim_t;
+
+	// PROTOTYPES
+		void decim_init(decim_t *d, uint8_t log2);
+		void decim_integrate(decim_t *d, const int32_t in[DECIM_CHANNELS]);
+		void decim_output(decim_t *d, int32_t out[DECIM_CHANNELS]);
+
+#endif /* DECIMATOR_H */
@@ -0,0 +1,100 @@
+/****************************************************************
+* HARDWARE ABSTRACTION LAYER
+*
+* Thin layer between the application (main.c, adc_capture.c) and the DAVE APPs.
+*  Target build     -- hal_xmc.c maps every call onto the DAVE APIs, lwIP comes from DAVE.h
+*  Host build       -- HAL_SIM defined, sim/hal_sim.c simulates the ADCs, thermocouples, timers and interrupts and
+*                      sim/lwip_sim.c stands in for lwIP with a TCP sink (see sim/Makefile)
+***************************************************************/
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdint.h>
+
+#ifdef HAL_SIM
+	#include "lwip_sim.h"				// lwIP stand-in (sim/)
+#else
+	#include <DAVE.h>					// Declarations from DAVE Code Generation (includes SFR declaration)
+#endif
+
+	// STATUS
+		#define HAL_OK 0U
+
+	// TIMESTAMP TIMER -- TIMER_TIMESTAMP: CCU4 slice at 120MHz / 2, period 60000 = 1ms. CAPTURE_ADC0 / CAPTURE_ADC1
+	// are slices of the same CCU4 module with the same clock and period, started together with it, and capture on
+	// the rising DRDY edge, so their captured counts are timestamp timer counts (timebase.h)
+		#define HAL_TICKS_PER_US		60U
+		#define HAL_TICKS_PER_PERIOD	60000U
+
+	// CPU CLOCK -- 120MHz, counted by the DWT cycle counter (hal_cycles, telemetry.h)
+		#define HAL_CYCLES_PER_US		120U
+
+	// INTERRUPT SOURCES
+		typedef enum {
+			HAL_IRQ_ADC0_DRDY,		// ADC0 data ready pin -> ADC0_DRDY_INT
+			HAL_IRQ_ADC1_DRDY,		// ADC1 data ready pin -> ADC1_DRDY_INT
+			HAL_IRQ_TC_TIMER,		// 10Hz thermocouple timer -> TCIRQ
+			HAL_IRQ_TIMESTAMP,		// 1ms timestamp timer -> TimeStampIRQ
+			HAL_IRQ_ETH_TIMER		// Ethernet transmit timer -> ETHIRQ
+		} hal_irq_t;
+
+	// STARTUP
+		uint8_t hal_init(void);								// DAVE_Init -- HAL_OK on success
+		void hal_irq_enable(hal_irq_t irq);
+		void hal_irq_disable(hal_irq_t irq);
+		void hal_lwip_timer_start(void (*callback)(void *args), uint32_t period_us);
+		uint8_t hal_running(void);							// Main loop condition -- always 1 on the target
+		uint32_t hal_critical_enter(void);					// Masks interrupts, returns the previous state
+		void hal_critical_exit(uint32_t state);
+
+	// ADC SPI BUS (SPI_MASTER_ADC)
+		void hal_adc_select(uint8_t adc);					// 0 = ADC0, 1 = ADC1
+		void hal_adc_transfer(uint8_t *tx, uint8_t *rx, uint32_t len);
+		uint8_t hal_adc_busy(void);
+		void hal_adc_frame_length_continuous(void);			// Frame does not end after the DAVE word length
+
+	// THERMOCOUPLE SPI BUS (SPI_MASTER_TC)
+		void hal_tc_select(uint8_t tc);						// 0 - 3
+		void hal_tc_receive(uint8_t *rx, uint32_t len);
+		uint8_t hal_tc_busy(void);
+
+	// TIMERS
+		uint32_t hal_timestamp_ticks(void);					// Count of the timestamp timer, 0 ... HAL_TICKS_PER_PERIOD - 1
+		uint8_t hal_timestamp_pending(void);				// Period wrap not yet cleared by TimeStampIRQ
+		void hal_timestamp_clear_event(void);
+		uint32_t hal_drdy_capture(uint8_t adc);				// Timestamp timer count latched by the last DRDY edge
+		uint32_t hal_cycles(void);							// CPU cycle counter, wraps every 35s
+		void hal_tc_timer_clear_event(void);
+
+	// INDICATOR
+		void hal_led_toggle(void);
+
+	// BENCHMARK STAGES -- the host simulator times these paths separately (sim/sim_main.c); no code on the target
+		typedef enum {
+			HAL_STAGE_OTHER,		// Simulator models, timer and thermocouple interrupts, command handling
+			HAL_STAGE_LOOP,			// Main loop pass outside the stages below: polling and scheduling
+			HAL_STAGE_ACQUIRE,		// DRDY interrupt and ADC SPI frame handling (ADCx_DRDY_INT, ADC_SPI_RxDone)
+			HAL_STAGE_PACKETIZE,	// ADC packet assembly, compression included (packSamples)
+			HAL_STAGE_TRANSPORT,	// send_data, the sent callback and the lwIP calls they make
+			HAL_STAGE_SINK,			// Simulator only: the receiving end's decode and checks
+			HAL_STAGES
+		} hal_stage_t;
+
+	#ifdef HAL_SIM
+		hal_stage_t hal_stage_enter(hal_stage_t stage);		// Returns the stage that was running
+		void hal_stage_exit(hal_stage_t previous);
+	#else
+		#define hal_stage_enter(stage)		HAL_STAGE_OTHER
+		#define hal_stage_exit(previous)	((void)(previous))
+	#endif
+
+	// APPLICATION INTERRUPT HANDLERS -- names bound in the DAVE APPs, called by the simulator on the host
+		void TimeStampIRQ(void);
+		void TCIRQ(void);
+		void ADC0_DRDY_INT(void);
+		void ADC1_DRDY_INT(void);
+		void ETHIRQ(void);
+		void ADC_SPI_RxDone(void);
+		void TC_SPI_RxDone(void);
+
+#endif /* HAL_H */
@@ -0,0 +1,140 @@
+/****************************************************************
+* HAL -- XMC / DAVE implementation
+***************************************************************/
+#ifndef HAL_SIM
+#include "hal.h"
+
+	static const SPI_MASTER_SS_SIGNAL_t adc_slave[2] = {SPI_MASTER_SS_SIGNAL_0, SPI_MASTER_SS_SIGNAL_1};
+	static const SPI_MASTER_SS_SIGNAL_t tc_slave[4] = {SPI_MASTER_SS_SIGNAL_0, SPI_MASTER_SS_SIGNAL_1, SPI_MASTER_SS_SIGNAL_2, SPI_MASTER_SS_SIGNAL_3};
+
+#if (HAL_TICKS_PER_PERIOD > 0x10000U)
+#error "CCU4 slices count 16 bits -- HAL_TICKS_PER_PERIOD must fit"
+#endif
+
+
+// STARTUP ////////////////////////////////////////////////////////////////////////////////////////
+
+uint8_t hal_init(void) {
+	if (DAVE_Init() != DAVE_STATUS_SUCCESS) { // Initialization of DAVE APPs
+		XMC_DEBUG("DAVE APPs initialization failed\n");
+		return 1U;
+	}
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk; // Cycle counter for hal_cycles
+	DWT->CYCCNT = 0U;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	return HAL_OK;
+}
+
+void hal_irq_enable(hal_irq_t irq) {
+	switch (irq) {
+		case HAL_IRQ_ADC0_DRDY:	PIN_INTERRUPT_Enable(&PIN_INTERRUPT_ADC0);	break;
+		case HAL_IRQ_ADC1_DRDY:	PIN_INTERRUPT_Enable(&PIN_INTERRUPT_ADC1);	break;
+		case HAL_IRQ_TC_TIMER:	INTERRUPT_Enable(&INTERRUPT_TC);			break;
+		case HAL_IRQ_TIMESTAMP:	INTERRUPT_Enable(&INTERRUPT_TIMESTAMP);		break;
+		case HAL_IRQ_ETH_TIMER:	INTERRUPT_Enable(&INTERRUPT_ETH);			break;
+		default:														break;
+	}
+}
+
+void hal_irq_disable(hal_irq_t irq) {
+	switch (irq) {
+		case HAL_IRQ_ADC0_DRDY:	PIN_INTERRUPT_Disable(&PIN_INTERRUPT_ADC0);	break;
+		case HAL_IRQ_ADC1_DRDY:	PIN_INTERRUPT_Disable(&PIN_INTERRUPT_ADC1);	break;
+		case HAL_IRQ_TC_TIMER:	INTERRUPT_Disable(&INTERRUPT_TC);			break;
+		case HAL_IRQ_TIMESTAMP:	INTERRUPT_Disable(&INTERRUPT_TIMESTAMP);	break;
+		case HAL_IRQ_ETH_TIMER:	INTERRUPT_Disable(&INTERRUPT_ETH);			break;
+		default:														break;
+	}
+}
+
+void hal_lwip_timer_start(void (*callback)(void *args), uint32_t period_us) {
+	uint32_t timer = SYSTIMER_CreateTimer(period_us, SYSTIMER_MODE_PERIODIC, callback, 0);
+	SYSTIMER_StartTimer(timer);
+}
+
+uint8_t hal_running(void) {
+	return 1U;
+}
+
+uint32_t hal_critical_enter(void) {
+	uint32_t state = __get_PRIMASK();
+
+	__disable_irq();
+	return state;
+}
+
+void hal_critical_exit(uint32_t state) {
+	__set_PRIMASK(state);
+}
+
+
+// ADC SPI BUS ////////////////////////////////////////////////////////////////////////////////////
+
+void hal_adc_select(uint8_t adc) {
+	SPI_MASTER_EnableSlaveSelectSignal(&SPI_MASTER_ADC, adc_slave[adc & 0x01U]);
+}
+
+void hal_adc_transfer(uint8_t *tx, uint8_t *rx, uint32_t len) {
+	SPI_MASTER_Transfer(&SPI_MASTER_ADC, tx, rx, len);
+}
+
+uint8_t hal_adc_busy(void) {
+	return SPI_MASTER_IsRxBusy(&SPI_MASTER_ADC) ? 1U : 0U;
+}
+
+void hal_adc_frame_length_continuous(void) {
+	XMC_SPI_CH_SetFrameLength(XMC_SPI2_CH0, 64); // When set to 64, frame does not end based on DAVE App Configuration -- this allows us to grab all 144 bits of data out of the ADC during data collection
+}
+
+
+// THERMOCOUPLE SPI BUS ///////////////////////////////////////////////////////////////////////////
+
+void hal_tc_select(uint8_t tc) {
+	SPI_MASTER_EnableSlaveSelectSignal(&SPI_MASTER_TC, tc_slave[tc & 0x03U]);
+}
+
+void hal_tc_receive(uint8_t *rx, uint32_t len) {
+	SPI_MASTER_Receive(&SPI_MASTER_TC, rx, len);
+}
+
+uint8_t hal_tc_busy(void) {
+	return SPI_MASTER_IsRxBusy(&SPI_MASTER_TC) ? 1U : 0U;
+}
+
+
+// TIMERS /////////////////////////////////////////////////////////////////////////////////////////
+
+uint32_t hal_timestamp_ticks(void) {
+	return XMC_CCU4_SLICE_GetTimerValue(TIMER_TIMESTAMP.ccu4_slice_ptr); // Raw count -- no conversion in the interrupts
+}
+
+uint8_t hal_timestamp_pending(void) {
+	return TIMER_GetInterruptStatus(&TIMER_TIMESTAMP) ? 1U : 0U;
+}
+
+void hal_timestamp_clear_event(void) {
+	TIMER_ClearEvent(&TIMER_TIMESTAMP);
+}
+
+uint32_t hal_drdy_capture(uint8_t adc) {
+	const CAPTURE_t *capture = (adc == 0U) ? &CAPTURE_ADC0 : &CAPTURE_ADC1;
+
+	return XMC_CCU4_SLICE_GetCaptureRegisterValue(capture->ccu4_slice_ptr, 1U) & 0xFFFFU; // Timer value field of CC4yCV1
+}
+
+uint32_t hal_cycles(void) {
+	return DWT->CYCCNT;
+}
+
+void hal_tc_timer_clear_event(void) {
+	TIMER_ClearEvent(&TIMER_TC);
+}
+
+
+// INDICATOR //////////////////////////////////////////////////////////////////////////////////////
+
+void hal_led_toggle(void) {
+	DIGITAL_IO_ToggleOutput(&LED_INDICATOR);
+}
+
+#endif /* HAL_SIM */
@@ -0,0 +1,383 @@
+/****************************************************************
+* CAPTURE FILE (host library) -- see capture_file.h
+***************************************************************/
+#include "capture_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace daq {
+
+	const char *const kCaptureSeriesNames[kCaptureSeries] = {"adc0", "adc1", "tc"};
+	const char *const kCaptureColumnNames[kCaptureSeries][kCaptureColumns] = {
+		{"IEPE0", "IEPE1", "IEPE2", "IEPE3"}, {"FB0", "FB1", "CL0", "CL1"}, {"TC0", "TC1", "TC2", "TC3"}};
+
+	namespace {
+
+		const char kFileMagic[8] = "DAQCAP1";
+		const char kFooterMagic[8] = "DAQIDX1";
+
+		size_t chunk_blocks(uint32_t rows) {
+			return (rows + kCaptureBlockRows - 1) / kCaptureBlockRows;
+		}
+
+		size_t chunk_bytes(uint32_t rows) {
+			return sizeof(CaptureChunkHeader) + chunk_blocks(rows) * sizeof(CaptureBlock) +
+				rows * (sizeof(uint64_t) + kCaptureColumns * sizeof(float));
+		}
+
+	} // namespace
+
+	CaptureWriter::~CaptureWriter() {
+		close();
+	}
+
+	bool CaptureWriter::open(const char *path, unsigned chunk_rows) {
+		close();
+		file_ = std::fopen(path, "wb");
+		if (!file_) {
+			return false;
+		}
+		std::setvbuf(file_, nullptr, _IOFBF, 1 << 20);
+		chunk_rows_ = std::max(chunk_rows, 16U);
+		offset_ = 0;
+		out_of_order_ = 0;
+		restarts_ = 0;
+		shift_us_ = 0;
+		restart_ = false;
+		index_.clear();
+		for (Pending &p : series_) {
+			p = Pending();
+			p.time.resize(chunk_rows_);
+			for (std::vector<float> &c : p.column) {
+				c.resize(chunk_rows_);
+			}
+		}
+
+		CaptureFileHeader h = {};
+		std::memcpy(h.magic, kFileMagic, sizeof(h.magic));
+		h.version = 1;
+		h.chunk_rows = chunk_rows_;
+		h.series = kCaptureSeries;
+		h.columns = kCaptureColumns;
+		write(&h, sizeof(h));
+		return true;
+	}
+
+	void CaptureWriter::write(const void *data, size_t size) {
+		std::fwrite(data, 1, size, file_);
+		offset_ += size;
+	}
+
+	void CaptureWriter::append(unsigned series, size_t rows, const uint64_t *time_us, const float *const columns[kCaptureColumns]) {
+		Pending &p = series_[series];
+
+		if (!file_) {
+			return;
+		}
+		for (size_t i = 0; i < rows; i++) {
+			uint64_t t = time_us[i] + shift_us_;
+			bool stored = (p.rows != 0) || (p.fill != 0);
+
+			if (stored && (t < p.last_us)) {
+				if (!restart_ && (p.last_us - t <= kCaptureRestartUs)) {
+					out_of_order_.fetch_add(1, std::memory_order_relaxed);
+					continue;
+				}
+
+				// Board clock restarted -- continue after the latest row of any series
+				uint64_t latest = 0;
+				for (const Pending &s : series_) {
+					latest = std::max(latest, s.last_us);
+				}
+				shift_us_ = latest + 1U - time_us[i];
+				t = latest + 1U;
+				restarts_.fetch_add(1, std::memory_order_relaxed);
+			}
+			restart_ = restart_ && !stored;
+			p.time[p.fill] = t;
+			for (unsigned c = 0; c < kCaptureColumns; c++) {
+				p.column[c][p.fill] = columns[c] ? columns[c][i] : std::numeric_limits<float>::quiet_NaN();
+				p.present |= columns[c] ? uint8_t(1U << c) : 0U;
+			}
+			p.last_us = t;
+			if (++p.fill == chunk_rows_) {
+				flush(series);
+			}
+		}
+	}
+
+	// Time span and per-column min/max of rows [first, end), NaN left out
+	void CaptureWriter::summarize(const Pending &p, size_t first, size_t end, uint64_t &first_us, uint64_t &last_us,
+		float *min, float *max) const {
+		first_us = p.time[first];
+		last_us = p.time[end - 1];
+		for (unsigned c = 0; c < kCaptureColumns; c++) {
+			float lo = std::numeric_limits<float>::infinity();
+			float hi = -std::numeric_limits<float>::infinity();
+
+			for (size_t i = first; i < end; i++) {
+				float v = p.column[c][i];
+				if (v == v) {
+					lo = std::min(lo, v);
+					hi = std::max(hi, v);
+				}
+			}
+			min[c] = lo;
+			max[c] = hi;
+		}
+	}
+
+	void CaptureWriter::flush(unsigned series) {
+		Pending &p = series_[series];
+		CaptureIndexEntry e = {};
+
+		if (p.fill == 0) {
+			return;
+		}
+		e.offset = offset_;
+		e.chunk.magic = kCaptureChunkMagic;
+		e.chunk.series = uint8_t(series);
+		e.chunk.present = p.present;
+		e.chunk.rows = uint32_t(p.fill);
+		e.chunk.first_row = p.rows;
+		summarize(p, 0, p.fill, e.chunk.first_us, e.chunk.last_us, e.chunk.min, e.chunk.max);
+		blocks_.resize(chunk_blocks(uint32_t(p.fill)));
+		for (size_t b = 0; b < blocks_.size(); b++) {
+			CaptureBlock &k = blocks_[b];
+			summarize(p, b * kCaptureBlockRows, std::min<size_t>(p.fill, (b + 1) * kCaptureBlockRows), k.first_us, k.last_us, k.min, k.max);
+		}
+
+		write(&e.chunk, sizeof(e.chunk));
+		write(blocks_.data(), blocks_.size() * sizeof(CaptureBlock));
+		write(p.time.data(), p.fill * sizeof(uint64_t));
+		for (unsigned c = 0; c < kCaptureColumns; c++) {
+			write(p.column[c].data(), p.fill * sizeof(float));
+		}
+		index_.push_back(e);
+		p.rows += p.fill;
+		p.fill = 0;
+		p.present = 0;
+	}
+
+	bool CaptureWriter::close() {
+		if (!file_) {
+			return true;
+		}
+		for (unsigned s = 0; s < kCaptureSeries; s++) {
+			flush(s);
+		}
+
+		CaptureFooter footer = {};
+		footer.index_offset = offset_;
+		footer.entries = index_.size();
+		std::memcpy(footer.magic, kFooterMagic, sizeof(footer.magic));
+		write(index_.data(), index_.size() * sizeof(CaptureIndexEntry));
+		write(&footer, sizeof(footer));
+
+		bool ok = (std::ferror(file_) == 0);
+		ok = (std::fclose(file_) == 0) && ok;
+		file_ = nullptr;
+		return ok;
+	}
+
+
+	CaptureReader::~CaptureReader() {
+		if (data_) {
+			munmap(const_cast<uint8_t *>(data_), size_);
+		}
+		if (fd_ >= 0) {
+			::close(fd_);
+		}
+	}
+
+	// h: index entry, or the chunk's own header when recovering
+	bool CaptureReader::add_chunk(uint64_t offset, const CaptureChunkHeader *header) {
+		const CaptureChunkHeader &h = *header;
+
+		if ((h.magic != kCaptureChunkMagic) || (h.series >= kCaptureSeries) || (h.rows == 0) || (h.rows > chunk_rows_) ||
+			(offset + chunk_bytes(h.rows) > size_)) {
+			return false;
+		}
+		std::vector<Chunk> &list = chunks_[h.series];
+		if ((h.first_row != uint64_t(list.size()) * chunk_rows_) || (!list.empty() && (list.back().header->rows != chunk_rows_))) {
+			return false; // Only the last chunk of a series may be partial
+		}
+
+		Chunk c;
+		const uint8_t *p = data_ + offset;
+		c.header = header;			// Index entries sit together at the end: zoomed-out plots touch only those pages
+		p += sizeof(CaptureChunkHeader);
+		c.blocks = reinterpret_cast<const CaptureBlock *>(p);
+		p += chunk_blocks(h.rows) * sizeof(CaptureBlock);
+		c.time = reinterpret_cast<const uint64_t *>(p);
+		p += h.rows * sizeof(uint64_t);
+		for (unsigned col = 0; col < kCaptureColumns; col++) {
+			c.column[col] = reinterpret_cast<const float *>(p) + size_t(col) * h.rows;
+		}
+		list.push_back(c);
+		return true;
+	}
+
+	bool CaptureReader::open(const char *path) {
+		struct stat st;
+
+		fd_ = ::open(path, O_RDONLY);
+		if ((fd_ < 0) || (fstat(fd_, &st) < 0)) {
+			error_ = std::strerror(errno);
+			return false;
+		}
+		size_ = uint64_t(st.st_size);
+		if (size_ < sizeof(CaptureFileHeader)) {
+			error_ = "not a capture file";
+			return false;
+		}
+		void *map = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+		if (map == MAP_FAILED) {
+			error_ = std::strerror(errno);
+			return false;
+		}
+		data_ = static_cast<const uint8_t *>(map);
+
+		const CaptureFileHeader *h = reinterpret_cast<const CaptureFileHeader *>(data_);
+		if ((std::memcmp(h->magic, kFileMagic, sizeof(h->magic)) != 0) || (h->version != 1) ||
+			(h->series != kCaptureSeries) || (h->columns != kCaptureColumns) || (h->chunk_rows == 0)) {
+			error_ = "not a capture file";
+			return false;
+		}
+		chunk_rows_ = h->chunk_rows;
+
+		// Index from the footer ...
+		const CaptureFooter *f = reinterpret_cast<const CaptureFooter *>(data_ + size_ - sizeof(CaptureFooter));
+		bool indexed = (size_ >= sizeof(CaptureFileHeader) + sizeof(CaptureFooter)) &&
+			(std::memcmp(f->magic, kFooterMagic, sizeof(f->magic)) == 0) &&
+			(f->index_offset + f->entries * sizeof(CaptureIndexEntry) + sizeof(CaptureFooter) == size_);
+		if (indexed) {
+			const CaptureIndexEntry *e = reinterpret_cast<const CaptureIndexEntry *>(data_ + f->index_offset);
+			for (uint64_t i = 0; indexed && (i < f->entries); i++) {
+				indexed = add_chunk(e[i].offset, &e[i].chunk);
+			}
+		}
+		if (indexed) {
+			return true;
+		}
+
+		// ... or, cut short, from walking the chunks (up to the first incomplete one)
+		for (std::vector<Chunk> &list : chunks_) {
+			list.clear();
+		}
+		recovered_ = true;
+		uint64_t offset = sizeof(CaptureFileHeader);
+		while (offset + sizeof(CaptureChunkHeader) <= size_) {
+			const CaptureChunkHeader *c = reinterpret_cast<const CaptureChunkHeader *>(data_ + offset);
+			if (!add_chunk(offset, c)) {
+				break;
+			}
+			offset += chunk_bytes(c->rows);
+		}
+		return true;
+	}
+
+	uint64_t CaptureReader::rows(unsigned series) const {
+		const std::vector<Chunk> &list = chunks_[series];
+		return list.empty() ? 0 : list.back().header->first_row + list.back().header->rows;
+	}
+
+	uint64_t CaptureReader::lower_bound(unsigned series, uint64_t time_us) const {
+		const std::vector<Chunk> &list = chunks_[series];
+		auto it = std::lower_bound(list.begin(), list.end(), time_us,
+			[](const Chunk &c, uint64_t t) { return c.header->last_us < t; });
+
+		if (it == list.end()) {
+			return rows(series);
+		}
+		const uint64_t *row = std::lower_bound(it->time, it->time + it->header->rows, time_us);
+		return it->header->first_row + uint64_t(row - it->time);
+	}
+
+	size_t CaptureReader::read(unsigned series, unsigned column, uint64_t row, size_t n, float *values, uint64_t *time_us) const {
+		const std::vector<Chunk> &list = chunks_[series];
+		size_t done = 0;
+
+		while ((done < n) && (row < rows(series))) {
+			const Chunk &c = list[row / chunk_rows_];
+			size_t at = size_t(row - c.header->first_row);
+			size_t take = std::min<size_t>(n - done, c.header->rows - at);
+
+			if (values) {
+				std::memcpy(values + done, c.column[column] + at, take * sizeof(float));
+			}
+			if (time_us) {
+				std::memcpy(time_us + done, c.time + at, take * sizeof(uint64_t));
+			}
+			done += take;
+			row += take;
+		}
+		return done;
+	}
+
+	void CaptureReader::downsample(unsigned series, unsigned column, uint64_t from_us, uint64_t to_us, size_t buckets,
+		float *min, float *max) const {
+		const std::vector<Chunk> &list = chunks_[series];
+		const float nan = std::numeric_limits<float>::quiet_NaN();
+
+		std::fill(min, min + buckets, nan);
+		std::fill(max, max + buckets, nan);
+		if ((buckets == 0) || (to_us <= from_us)) {
+			return;
+		}
+		double width = double(to_us - from_us) / double(buckets);
+		auto bucket_of = [&](uint64_t t) { return std::min(buckets - 1, size_t(double(t - from_us) / width)); };
+		auto merge = [&](size_t b, float lo, float hi) {
+			min[b] = (min[b] == min[b]) ? std::min(min[b], lo) : lo;
+			max[b] = (max[b] == max[b]) ? std::max(max[b], hi) : hi;
+		};
+
+		auto it = std::lower_bound(list.begin(), list.end(), from_us,
+			[](const Chunk &c, uint64_t t) { return c.header->last_us < t; });
+		// A span inside [from, to) and inside one bucket is answered by its summary
+		auto whole = [&](uint64_t first, uint64_t last) {
+			return (first >= from_us) && (last < to_us) && (bucket_of(first) == bucket_of(last));
+		};
+
+		for (; (it != list.end()) && (it->header->first_us < to_us); ++it) {
+			const CaptureChunkHeader &h = *it->header;
+
+			if (whole(h.first_us, h.last_us)) {
+				if (h.min[column] <= h.max[column]) {
+					merge(bucket_of(h.first_us), h.min[column], h.max[column]);
+				}
+				continue;
+			}
+			for (size_t b = 0; b < chunk_blocks(h.rows); b++) {
+				const CaptureBlock &k = it->blocks[b];
+
+				if ((k.last_us < from_us) || (k.first_us >= to_us)) {
+					continue;
+				}
+				if (whole(k.first_us, k.last_us)) {
+					if (k.min[column] <= k.max[column]) {
+						merge(bucket_of(k.first_us), k.min[column], k.max[column]);
+					}
+					continue;
+				}
+				size_t end = std::min<size_t>(h.rows, (b + 1) * kCaptureBlockRows);
+				for (size_t i = b * kCaptureBlockRows; i < end; i++) {
+					float v = it->column[column][i];
+					if ((it->time[i] >= from_us) && (it->time[i] < to_us) && (v == v)) {
+						merge(bucket_of(it->time[i]), v, v);
+					}
+				}
+			}
+		}
+	}
+
+} // namespace daq
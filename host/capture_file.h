@@ -0,0 +1,193 @@
+/****************************************************************
+* CAPTURE FILE (host library)
+*
+* Columnar capture of long runs, read back without parsing the whole file. Rows belong to one of three series -- ADC0,
+* ADC1, thermocouples -- each with a time column (us, board time) and four value columns: IEPE0-3, FB0/FB1/CL0/CL1,
+* TC0-3 (volts or C, NaN where the channel was not streamed or the thermocouple faulted). A series is written in
+* chunks of a fixed number of rows; every chunk starts with its index record (rows, first/last time, per-column
+* min/max) and the same summary per block of kCaptureBlockRows rows, and the file ends with a copy of all the index
+* records.
+*
+*   file header | chunk header, block summaries, time[rows] u64, column 0..3 [rows] f32 | ... |
+*   index: (offset, chunk header) x n | footer
+*
+* Host byte order, every record 8-byte aligned so the mapped file is read in place. Chunks of a series are full except
+* its last one, so row r of a series is in its chunk r / chunk_rows. A file cut short (no footer) is indexed by
+* walking the chunk headers instead.
+*
+* The time column of every series only grows. When the board restarts its clock (a reboot after a watchdog or power
+* reset, seen as a new connection or as the time jumping back by more than kCaptureRestartUs), the rows from there on
+* form a new time segment, shifted by one offset shared by all series to continue 1us after the latest stored row.
+*
+* CaptureReader maps the file: a time seeks with two binary searches (chunk by last time, row within the chunk), and
+* downsample() gives min/max per plot column from the index where a whole chunk falls into one plot column, from the
+* block summaries where a block does, and reads samples only for blocks that straddle two plot columns.
+***************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace daq {
+
+	enum CaptureSeries { kSeriesAdc0, kSeriesAdc1, kSeriesTc, kCaptureSeries };
+	constexpr unsigned kCaptureColumns = 4;		// Value columns per series
+
+	// Column names by series, column
+	extern const char *const kCaptureColumnNames[kCaptureSeries][kCaptureColumns];
+	extern const char *const kCaptureSeriesNames[kCaptureSeries];
+
+	struct CaptureFileHeader {
+		char magic[8];					// "DAQCAP1"
+		uint32_t version;
+		uint32_t chunk_rows;
+		uint32_t series;				// kCaptureSeries
+		uint32_t columns;				// kCaptureColumns
+		uint64_t reserved;
+	};
+
+	struct CaptureChunkHeader {
+		uint32_t magic;					// kCaptureChunkMagic
+		uint8_t series;
+		uint8_t present;				// Columns holding data in this chunk (bit per column)
+		uint16_t reserved;
+		uint32_t rows;
+		uint32_t reserved2;
+		uint64_t first_row;				// Row of the series
+		uint64_t first_us;
+		uint64_t last_us;
+		float min[kCaptureColumns];		// NaN values left out; +inf / -inf if none
+		float max[kCaptureColumns];
+	};
+
+	// Summary of kCaptureBlockRows rows of a chunk (the last block may be shorter)
+	struct CaptureBlock {
+		uint64_t first_us;
+		uint64_t last_us;
+		float min[kCaptureColumns];
+		float max[kCaptureColumns];
+	};
+
+	struct CaptureIndexEntry {
+		uint64_t offset;				// Of the chunk header
+		CaptureChunkHeader chunk;
+	};
+
+	struct CaptureFooter {
+		uint64_t index_offset;
+		uint64_t entries;
+		char magic[8];					// "DAQIDX1"
+	};
+
+	constexpr uint32_t kCaptureChunkMagic = 0x4B4E4843;	// "CHNK"
+	constexpr unsigned kCaptureChunkRows = 4096;			// About 0.1 s of one ADC at full rate
+	constexpr unsigned kCaptureBlockRows = 256;
+	constexpr uint64_t kCaptureRestartUs = 1000000;		// Time stepping back further is a restarted board clock
+
+	class CaptureWriter {
+	public:
+		CaptureWriter() = default;
+		~CaptureWriter();
+
+		CaptureWriter(const CaptureWriter &) = delete;
+		CaptureWriter &operator=(const CaptureWriter &) = delete;
+
+		// false (errno set) if the file cannot be created
+		bool open(const char *path, unsigned chunk_rows = kCaptureChunkRows);
+
+		// rows of one series; columns[c] nullptr where the column has no data. Rows older than the series' last row
+		// are dropped and counted (the time column stays sorted), unless they start a new time segment.
+		void append(unsigned series, size_t rows, const uint64_t *time_us, const float *const columns[kCaptureColumns]);
+
+		// Next rows come from a new connection: a time step back starts a new segment, however small
+		void restart() { restart_ = true; }
+
+		// Writes the partial chunks, the index and the footer
+		bool close();
+
+		bool is_open() const { return file_ != nullptr; }
+		uint64_t rows(unsigned series) const { return series_[series].rows + series_[series].fill; }
+		uint64_t out_of_order() const { return out_of_order_.load(std::memory_order_relaxed); }
+		uint64_t restarts() const { return restarts_.load(std::memory_order_relaxed); }	// Time segments started after the first
+		uint64_t bytes() const { return offset_; }
+
+	private:
+		struct Pending {
+			uint64_t rows = 0;			// In chunks written
+			uint64_t last_us = 0;
+			size_t fill = 0;
+			uint8_t present = 0;
+			std::vector<uint64_t> time;
+			std::vector<float> column[kCaptureColumns];
+		};
+
+		void flush(unsigned series);
+		void write(const void *data, size_t size);
+		void summarize(const Pending &p, size_t first, size_t end, uint64_t &first_us, uint64_t &last_us,
+			float *min, float *max) const;
+
+		FILE *file_ = nullptr;
+		unsigned chunk_rows_ = kCaptureChunkRows;
+		uint64_t offset_ = 0;
+		std::atomic<uint64_t> out_of_order_{0};		// Read by other threads for live statistics
+		std::atomic<uint64_t> restarts_{0};
+		uint64_t shift_us_ = 0;					// Added to board time in the current segment
+		bool restart_ = false;
+		Pending series_[kCaptureSeries];
+		std::vector<CaptureIndexEntry> index_;
+		std::vector<CaptureBlock> blocks_;
+	};
+
+	class CaptureReader {
+	public:
+		struct Chunk {
+			const CaptureChunkHeader *header = nullptr;
+			const CaptureBlock *blocks = nullptr;		// (rows + kCaptureBlockRows - 1) / kCaptureBlockRows
+			const uint64_t *time = nullptr;
+			const float *column[kCaptureColumns] = {};
+		};
+
+		CaptureReader() = default;
+		~CaptureReader();
+
+		CaptureReader(const CaptureReader &) = delete;
+		CaptureReader &operator=(const CaptureReader &) = delete;
+
+		// Maps the file; false with a reason in error() if it is not a capture file
+		bool open(const char *path);
+		const std::string &error() const { return error_; }
+		bool recovered() const { return recovered_; }		// No footer: index rebuilt from the chunk headers
+
+		unsigned chunk_rows() const { return chunk_rows_; }
+		uint64_t rows(unsigned series) const;
+		size_t chunks(unsigned series) const { return chunks_[series].size(); }
+		const Chunk &chunk(unsigned series, size_t i) const { return chunks_[series][i]; }
+		uint64_t file_size() const { return size_; }
+
+		// First row with time >= time_us (rows() if none)
+		uint64_t lower_bound(unsigned series, uint64_t time_us) const;
+
+		// Rows [row, row + n) of one column and the time column (either output may be nullptr), returns rows read
+		size_t read(unsigned series, unsigned column, uint64_t row, size_t n, float *values, uint64_t *time_us) const;
+
+		// Min/max of a column in each of 'buckets' equal time spans of [from_us, to_us); NaN where a span is empty
+		void downsample(unsigned series, unsigned column, uint64_t from_us, uint64_t to_us, size_t buckets,
+			float *min, float *max) const;
+
+	private:
+		bool add_chunk(uint64_t offset, const CaptureChunkHeader *header);
+
+		int fd_ = -1;
+		const uint8_t *data_ = nullptr;
+		uint64_t size_ = 0;
+		unsigned chunk_rows_ = 0;
+		bool recovered_ = false;
+		std::string error_;
+		std::vector<Chunk> chunks_[kCaptureSeries];
+	};
+
+} // namespace daq
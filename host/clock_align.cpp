@@ -0,0 +1,83 @@
+/****************************************************************
+* BOARD CLOCK ALIGNMENT (host library) -- see clock_align.h
+***************************************************************/
+#include "clock_align.h"
+
+#include <cmath>
+
+namespace daq {
+
+	ClockAlign::ClockAlign(uint64_t window_us, unsigned windows) : window_us_(window_us), windows_(windows < 2 ? 2 : windows) {}
+
+	void ClockAlign::add(uint64_t board_us, int64_t host_us) {
+		if (started_ && (board_us + window_us_ < last_board_)) {
+			// Board time went back -- rebooted, its clock starts over
+			started_ = false;
+			points_.clear();
+			slope_ = 0.0;
+			restarts_++;
+		}
+
+		Point p;
+		p.delay = double(host_us - int64_t(board_us));
+		if (!started_) {
+			started_ = true;
+			origin_ = board_us;
+			last_board_ = board_us;
+			window_end_ = board_us + window_us_;
+			current_ = p;
+			intercept_ = p.delay;
+			return;
+		}
+		p.board = double(board_us - origin_);
+
+		if (board_us >= window_end_) {
+			points_.push_back(current_);
+			if (points_.size() > windows_) {
+				points_.pop_front();
+			}
+			fit();
+			current_ = p;
+			window_end_ = board_us + window_us_;
+		}
+		else if (p.delay < current_.delay) {
+			current_ = p;
+		}
+		if (points_.empty() && (current_.delay < intercept_)) {
+			intercept_ = current_.delay;
+		}
+		if (board_us > last_board_) {
+			last_board_ = board_us;
+		}
+	}
+
+	// Least squares line through the window minima
+	void ClockAlign::fit() {
+		double n = double(points_.size());
+		double mean_b = 0.0, mean_d = 0.0;
+
+		for (const Point &p : points_) {
+			mean_b += p.board;
+			mean_d += p.delay;
+		}
+		mean_b /= n;
+		mean_d /= n;
+
+		double sxx = 0.0, sxy = 0.0;
+		for (const Point &p : points_) {
+			sxx += (p.board - mean_b) * (p.board - mean_b);
+			sxy += (p.board - mean_b) * (p.delay - mean_d);
+		}
+		if (sxx > 0.0) {
+			slope_ = sxy / sxx;
+		}
+		intercept_ = mean_d - slope_ * mean_b;
+	}
+
+	int64_t ClockAlign::to_host(uint64_t board_us) const {
+		double board = double(int64_t(board_us - origin_));
+
+		return int64_t(board_us) + int64_t(std::llround(intercept_ + slope_ * board));
+	}
+
+} // namespace daq
@@ -0,0 +1,58 @@
+/****************************************************************
+* BOARD CLOCK ALIGNMENT (host library)
+*
+* Maps a board's packet times (its 64-bit timebase, us since it booted, timebase.h) onto the host clock, so the
+* streams of several boards share one timeline. Every packet gives a pair: board time of its newest sample, host time
+* it arrived. Arrival = board time + offset + drift x board time + transfer delay, and the delay is never negative, so
+* the lower envelope of the pairs is the clock relation plus the smallest delay. The minimum of (host - board) is taken
+* per window of board time and a line through the last window minima gives offset and drift. Queuing on the board,
+* the switch or the host only lifts pairs above the envelope and does not bias the line.
+*
+* What is left is the smallest transfer delay (tens of us on a LAN), about the same for boards on the same switch.
+* A board time far behind the latest one means the board rebooted: the fit starts over.
+***************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <deque>
+
+namespace daq {
+
+	class ClockAlign {
+	public:
+		explicit ClockAlign(uint64_t window_us = 100000, unsigned windows = 100);
+
+		// Board time of the newest sample of a packet, host time (us) the packet arrived
+		void add(uint64_t board_us, int64_t host_us);
+
+		// Host time of a board time. Until the first window closes: the smallest delay so far, no drift
+		int64_t to_host(uint64_t board_us) const;
+
+		bool valid() const { return started_; }
+		double drift_ppm() const { return slope_ * 1e6; }			// Board clock slower (+) / faster (-) than the host's
+		int64_t offset_us() const { return to_host(last_board_) - int64_t(last_board_); }	// Host - board, now
+		unsigned windows() const { return unsigned(points_.size()); }
+		uint64_t restarts() const { return restarts_; }
+
+	private:
+		struct Point {
+			double board = 0.0;		// Board time relative to origin_
+			double delay = 0.0;		// Host - board
+		};
+
+		void fit();
+
+		uint64_t window_us_;
+		unsigned windows_;
+		bool started_ = false;
+		uint64_t origin_ = 0;			// Board time of the first pair -- keeps the fit in exactly representable doubles
+		uint64_t last_board_ = 0;
+		uint64_t window_end_ = 0;
+		Point current_;					// Minimum of the window being collected
+		std::deque<Point> points_;		// Minima of the closed windows, oldest first
+		double intercept_ = 0.0;		// delay = intercept + slope x (board - origin)
+		double slope_ = 0.0;
+		uint64_t restarts_ = 0;
+	};
+
+} // namespace daq
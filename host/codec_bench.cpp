@@ -0,0 +1,218 @@
+/****************************************************************
+* CODEC BENCHMARK
+*
+* Compression ratio and speed of the lossless sample codec (daq_codec.h) on synthetic ADC packets laid out as the
+* board sends them (40 samples, status word on, 23/24 us time deltas), and a bit-exact round trip of every packet:
+*
+*  IEPE		ADC0: vibration (three tones at 10% of full scale) over ~20 codes of noise
+*  load cell	ADC1: slow drift over ~6 codes of noise, the FB/CL channels
+*  idle		ADC1 with the inputs shorted -- offset only
+*  noise		full-scale random codes -- channels sent verbatim, only the time and status columns shrink
+*
+* Encode speed here is the host's; the firmware's own cycles per packet are in the telemetry (TELEM_HIST_CODEC).
+*
+*   ./codec_bench [--packets N] [--seconds S]
+***************************************************************/
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "daq_packet.h"
+#include "daq_codec.h"
+}
+
+namespace {
+
+	using Clock = std::chrono::steady_clock;
+
+	constexpr double kRateHz = 42667.0;
+	constexpr double kFullScale = 8388607.0;
+	constexpr double kLinkBytesPerSecond = 100e6 / 8;
+
+	enum class Signal { Iepe, LoadCell, Idle, Noise };
+
+	struct Packet {
+		std::vector<uint8_t> raw;
+		std::vector<uint8_t> coded;		// Empty: sent uncompressed
+	};
+
+	void put24(uint8_t *p, int32_t code) {
+		p[0] = uint8_t(code >> 16);
+		p[1] = uint8_t(code >> 8);
+		p[2] = uint8_t(code);
+	}
+
+	// Channel codes of one conversion
+	void conversion(Signal signal, uint64_t n, std::mt19937 &rng, int32_t codes[4]) {
+		std::normal_distribution<double> iepe_noise(0.0, 20.0);
+		std::normal_distribution<double> cell_noise(0.0, 6.0);
+		std::uniform_int_distribution<int32_t> random(-8388608, 8388607);
+		double t = double(n) / kRateHz;
+
+		for (unsigned ch = 0; ch < 4; ch++) {
+			double v = 0.0;
+
+			switch (signal) {
+				case Signal::Iepe:
+					v = 0.1 * kFullScale * (0.5 * std::sin(2 * M_PI * 120.0 * t + ch) + 0.3 * std::sin(2 * M_PI * 1300.0 * t) +
+						0.2 * std::sin(2 * M_PI * 4700.0 * t + 2 * ch)) + iepe_noise(rng);
+					break;
+				case Signal::LoadCell:
+					v = 0.01 * kFullScale * std::sin(2 * M_PI * 0.2 * t + ch) + 1000.0 * ch + cell_noise(rng);
+					break;
+				case Signal::Idle:
+					v = -120.0 + 40.0 * ch;
+					break;
+				case Signal::Noise:
+					v = double(random(rng));
+					break;
+			}
+			codes[ch] = int32_t(std::lround(std::fmax(-8388608.0, std::fmin(kFullScale, v))));
+		}
+	}
+
+	std::vector<Packet> make_packets(Signal signal, uint8_t adc, size_t count) {
+		const uint16_t mask = uint16_t(PKT_CH_ADC(adc) | PKT_CH_STATUS);
+		std::vector<Packet> packets(count);
+		std::mt19937 rng(12345);
+		uint64_t n = 0;
+
+		for (size_t k = 0; k < count; k++) {
+			std::vector<uint8_t> &raw = packets[k].raw;
+			uint64_t first_us = n * 1000000 / uint64_t(kRateHz);
+			daq_header_t header = {};
+			uint8_t *out;
+
+			raw.resize(PACKET_MAX_SIZE);
+			out = raw.data() + PKT_HEADER_SIZE;
+			for (unsigned i = 0; i < SAMPLES_PER_PACKET; i++, n++) {
+				uint8_t frame[6 * PKT_ADC_WORD_BYTES] = {0x22, 0x00, 0x00};
+				int32_t codes[4];
+
+				conversion(signal, n, rng, codes);
+				for (unsigned ch = 0; ch < 4; ch++) {
+					put24(frame + PKT_ADC_WORD_BYTES * (ch + 1), codes[ch]);
+				}
+				out = daq_put_adc_sample(out, mask, adc, uint16_t(n * 1000000 / uint64_t(kRateHz) - first_us), frame);
+			}
+			header.mask = mask;
+			header.count = SAMPLES_PER_PACKET;
+			header.type = PKT_TYPE_SAMPLES;
+			header.packet = uint32_t(k);
+			header.index = uint32_t(k * SAMPLES_PER_PACKET);
+			header.time_us = first_us;
+			daq_put_header(raw.data(), &header);
+			raw.resize(size_t(out - raw.data()));
+		}
+		return packets;
+	}
+
+	// Runs fn until 'seconds' have passed, returns calls per second
+	template <typename Fn>
+	double rate(double seconds, Fn fn) {
+		uint64_t calls = 0;
+		auto start = Clock::now();
+		double elapsed = 0.0;
+
+		while (elapsed < seconds) {
+			fn();
+			calls++;
+			elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+		}
+		return double(calls) / elapsed;
+	}
+
+} // namespace
+
+int main(int argc, char **argv) {
+	size_t count = 2000;
+	double seconds = 0.5;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if ((arg == "--packets") && (i + 1 < argc)) count = size_t(std::atol(argv[++i]));
+		else if ((arg == "--seconds") && (i + 1 < argc)) seconds = std::atof(argv[++i]);
+		else {
+			std::printf("usage: %s [--packets N] [--seconds S]\n", argv[0]);
+			return (arg == "--help") ? 0 : 1;
+		}
+	}
+
+	struct Case {
+		const char *name;
+		Signal signal;
+		uint8_t adc;
+	};
+	const Case cases[] = {
+		{"IEPE", Signal::Iepe, 0}, {"load cell", Signal::LoadCell, 1}, {"idle", Signal::Idle, 1}, {"noise", Signal::Noise, 0},
+	};
+	double ratio_iepe = 1.0, ratio_cell = 1.0;
+	int failures = 0;
+
+	std::printf("%zu packets of %u samples per case, status word and 4 channels\n", count, SAMPLES_PER_PACKET);
+	for (const Case &c : cases) {
+		std::vector<Packet> packets = make_packets(c.signal, c.adc, count);
+		std::vector<uint8_t> out(PACKET_MAX_SIZE);
+		uint64_t raw_bytes = 0, sent_bytes = 0;
+		size_t coded = 0;
+		bool exact = true;
+
+		for (Packet &p : packets) {
+			uint16_t len = daq_compress(p.raw.data(), uint16_t(p.raw.size()), out.data());
+
+			raw_bytes += p.raw.size();
+			sent_bytes += (len != 0) ? len : p.raw.size();
+			if (len != 0) {
+				std::vector<uint8_t> back(PACKET_MAX_SIZE);
+				int32_t size = daq_expand(out.data(), len, back.data(), uint32_t(back.size()));
+
+				p.coded.assign(out.begin(), out.begin() + len);
+				exact = exact && (size == int32_t(p.raw.size())) && (std::memcmp(back.data(), p.raw.data(), p.raw.size()) == 0);
+				coded++;
+			}
+		}
+		failures += exact ? 0 : 1;
+
+		size_t k = 0;
+		double encode = rate(seconds, [&] {
+			const Packet &p = packets[k++ % count];
+			daq_compress(p.raw.data(), uint16_t(p.raw.size()), out.data());
+		});
+		double decode = 0.0;
+		if (coded != 0) {
+			k = 0;
+			while (packets[k % count].coded.empty()) {
+				k++;
+			}
+			decode = rate(seconds, [&] {
+				const Packet *p;
+				do {
+					p = &packets[k++ % count];
+				} while (p->coded.empty());
+				daq_expand(p->coded.data(), uint32_t(p->coded.size()), out.data(), uint32_t(out.size()));
+			});
+		}
+
+		double ratio = double(raw_bytes) / double(sent_bytes);
+		if (c.signal == Signal::Iepe) ratio_iepe = ratio;
+		if (c.signal == Signal::LoadCell) ratio_cell = ratio;
+		std::printf("%-10s ratio %5.2fx (%5.1f%% of packets coded)   encode %6.1f ns/sample   decode %6.1f ns/sample   %s\n",
+			c.name, ratio, 100.0 * double(coded) / double(count), 1e9 / (encode * SAMPLES_PER_PACKET),
+			(decode > 0.0) ? 1e9 / (decode * SAMPLES_PER_PACKET) : 0.0, exact ? "bit-exact" : "MISMATCH");
+	}
+
+	// One board: ADC0 (IEPE) and ADC1 (load cells), all channels at the full rate
+	double packet_bytes = PKT_HEADER_SIZE + SAMPLES_PER_PACKET * daq_sample_size(PKT_CH_ADC(0) | PKT_CH_STATUS);
+	double board_raw = 2.0 * kRateHz / SAMPLES_PER_PACKET * packet_bytes;
+	double board_coded = kRateHz / SAMPLES_PER_PACKET * packet_bytes * (1.0 / ratio_iepe + 1.0 / ratio_cell);
+	std::printf("board               %.3f MB/s raw, %.3f MB/s compressed -> %.0f boards per 100 Mbit link instead of %.0f\n",
+		board_raw / 1e6, board_coded / 1e6, std::floor(kLinkBytesPerSecond / board_coded), std::floor(kLinkBytesPerSecond / board_raw));
+	return (failures == 0) ? 0 : 1;
+}
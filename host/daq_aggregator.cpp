@@ -0,0 +1,596 @@
+/****************************************************************
+* DAQ AGGREGATOR
+*
+* TCP server for several boards at once (TCP_STREAMING in main.c, every board given this host as its server). Each
+* board connection is read and decoded on its own thread with the daq_stream library, its packet times are mapped
+* onto the host clock (clock_align.h: offset and drift per board), and the packets of all boards are merged into one
+* stream ordered by aligned time. The merged stream is the board packet format itself -- every packet as received,
+* Time rewritten to us on the aggregator's timeline (since it started), Device ID kept -- so the same decoders read
+* it (--out FILE).
+*
+* Ordering: a packet is released once every board still sending has delivered data up to its time plus --slack-ms
+* (ADC0 and ADC1 packets of one board overlap by up to a packet, thermocouple packets carry the cycle start). A board
+* that sends nothing for a second stops holding the others back; what it sends later than that is counted late.
+* Decoding scales with the boards, one core each; the merge is one thread moving whole packets.
+*
+* --simulate N starts N boards in-process that connect over loopback and stream full-rate ADC0/ADC1 packets with a
+* thermocouple packet every 100 ms in real time, each with its own device id, boot time and clock drift. The
+* alignment error against their true clocks is reported. --flood sends as fast as the sockets take it, to measure
+* throughput (board clocks then run ahead of the host and the alignment is meaningless).
+*
+*   ./daq_aggregator [--port 8080] [--seconds 0] [--interval 1] [--slack-ms 20] [--out FILE]
+*   ./daq_aggregator --simulate 4 --seconds 10 [--jitter-us 200]
+*   ./daq_aggregator --simulate 8 --flood --seconds 3
+***************************************************************/
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "clock_align.h"
+#include "daq_stream.h"
+
+namespace {
+
+	constexpr size_t kRecvBuffer = 256 * 1024;
+	constexpr int64_t kIdleUs = 1000000;			// A board silent this long no longer holds the merge back
+	constexpr size_t kBoardPending = 65536;			// Packets of one board waiting in the merge before its reader blocks
+	constexpr int64_t kNever = std::numeric_limits<int64_t>::min();
+
+	using Clock = std::chrono::steady_clock;
+	const Clock::time_point g_start = Clock::now();
+
+	// Aggregator timeline: us since start
+	int64_t host_us() {
+		return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - g_start).count();
+	}
+
+	// One packet on its way through the merge
+	struct Item {
+		int64_t time = 0;			// Aligned time of the first sample
+		uint64_t seq = 0;			// Arrival order within the board -- keeps equal times in order
+		unsigned board = 0;
+		std::vector<uint8_t> bytes;	// Packet, Time already rewritten
+	};
+
+	struct Later {
+		bool operator()(const Item &a, const Item &b) const {
+			return (a.time != b.time) ? (a.time > b.time) : ((a.board != b.board) ? (a.board > b.board) : (a.seq > b.seq));
+		}
+	};
+
+	struct MergeStats {
+		uint64_t packets = 0;
+		uint64_t bytes = 0;
+		uint64_t late = 0;				// Released after a packet with a later time
+		size_t waiting = 0;				// Packets held for ordering
+		int64_t latency_max_us = 0;		// Aligned sample time to release
+		double latency_sum_us = 0.0;
+	};
+
+	// Orders the packets of all boards by aligned time. Readers push batches, one thread releases them.
+	class Merger {
+	public:
+		Merger(int64_t slack_us, FILE *out) : slack_us_(slack_us), out_(out) {}
+
+		unsigned add_board() {
+			std::lock_guard<std::mutex> lock(mutex_);
+			Source s;
+			s.heard = host_us();
+			sources_.push_back(s);
+			return unsigned(sources_.size() - 1);
+		}
+
+		// Packets of one recv, and the aligned time the board has now delivered everything up to
+		void push(unsigned board, std::vector<Item> &items, int64_t latest) {
+			std::unique_lock<std::mutex> lock(mutex_);
+
+			room_.wait(lock, [&] { return (sources_[board].pending < kBoardPending) || stopping_; });
+			Source &s = sources_[board];
+			s.pending += items.size();
+			s.latest = std::max(s.latest, latest);
+			s.heard = host_us();
+			for (Item &item : items) {
+				incoming_.push_back(std::move(item));
+			}
+			items.clear();
+		}
+
+		void close_board(unsigned board) {
+			std::lock_guard<std::mutex> lock(mutex_);
+			sources_[board].open = false;
+		}
+
+		// Releases everything that is left and returns from run()
+		void stop() {
+			std::lock_guard<std::mutex> lock(mutex_);
+			stopping_ = true;
+			room_.notify_all();
+		}
+
+		MergeStats stats() const {
+			std::lock_guard<std::mutex> lock(mutex_);
+			return stats_;
+		}
+
+		void run() {
+			std::vector<Item> batch;
+			std::vector<size_t> released;
+
+			for (;;) {
+				int64_t watermark = std::numeric_limits<int64_t>::max();
+				bool stopping;
+
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+					int64_t now = host_us();
+
+					batch.swap(incoming_);
+					stopping = stopping_;
+					for (const Source &s : sources_) {
+						if (s.open && (now - s.heard < kIdleUs)) {
+							watermark = std::min(watermark, s.latest);
+						}
+					}
+					if ((watermark != kNever) && (watermark != std::numeric_limits<int64_t>::max())) {
+						watermark -= slack_us_;
+					}
+					released.assign(sources_.size(), 0);
+				}
+				if (stopping) {
+					watermark = std::numeric_limits<int64_t>::max();
+				}
+				for (Item &item : batch) {
+					heap_.push(std::move(item));
+				}
+				batch.clear();
+
+				int64_t now = host_us();
+				MergeStats delta;
+				while (!heap_.empty() && (heap_.top().time <= watermark)) {
+					const Item &item = heap_.top();
+
+					if (item.time < last_time_) {
+						delta.late++;
+					}
+					last_time_ = std::max(last_time_, item.time);
+					if (out_) {
+						std::fwrite(item.bytes.data(), 1, item.bytes.size(), out_);
+					}
+					delta.packets++;
+					delta.bytes += item.bytes.size();
+					delta.latency_sum_us += double(now - item.time);
+					delta.latency_max_us = std::max(delta.latency_max_us, now - item.time);
+					released[item.board]++;
+					heap_.pop();
+				}
+
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+					for (size_t b = 0; b < released.size(); b++) {
+						sources_[b].pending -= released[b];
+					}
+					stats_.packets += delta.packets;
+					stats_.bytes += delta.bytes;
+					stats_.late += delta.late;
+					stats_.latency_sum_us += delta.latency_sum_us;
+					stats_.latency_max_us = std::max(stats_.latency_max_us, delta.latency_max_us);
+					stats_.waiting = heap_.size() + incoming_.size();
+					if (stopping && heap_.empty() && incoming_.empty()) {
+						break;
+					}
+				}
+				room_.notify_all();
+				if (delta.packets == 0) {
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+			}
+			if (out_) {
+				std::fflush(out_);
+			}
+		}
+
+	private:
+		struct Source {
+			int64_t latest = kNever;	// Aligned time delivered up to
+			int64_t heard = 0;			// Host time of the last push
+			bool open = true;
+			size_t pending = 0;			// Packets in the merge
+		};
+
+		int64_t slack_us_;
+		FILE *out_;
+		mutable std::mutex mutex_;
+		std::condition_variable room_;
+		std::vector<Source> sources_;
+		std::vector<Item> incoming_;
+		bool stopping_ = false;
+		MergeStats stats_;
+		// Merge thread only
+		std::priority_queue<Item, std::vector<Item>, Later> heap_;
+		int64_t last_time_ = kNever;
+	};
+
+	// Simulated board clock: board time = boot + host time x (1 + drift)
+	struct SimClock {
+		uint64_t boot_us = 0;		// Board time when the aggregator started
+		double ppm = 0.0;
+
+		uint64_t board(int64_t host) const { return boot_us + uint64_t(double(host) * (1.0 + ppm * 1e-6)); }
+		double host(uint64_t board) const { return double(board - boot_us) / (1.0 + ppm * 1e-6); }
+	};
+
+	struct AlignError {
+		uint64_t count = 0;
+		double sum = 0.0;
+		double sum_sq = 0.0;
+		double max_abs = 0.0;
+	};
+
+	// Reader side of one board: decodes, aligns and batches its packets for the merge
+	class BoardLink : public daq::Handler {
+	public:
+		BoardLink(Merger &merger, const SimClock *truth) : merger_(merger), parser_(*this), truth_(truth) {
+			id_ = merger_.add_board();
+		}
+
+		unsigned id() const { return id_; }
+		std::mutex &mutex() { return mutex_; }
+		const daq::StreamParser &parser() const { return parser_; }
+		const daq::ClockAlign &align() const { return align_; }
+		const AlignError &error() const { return error_; }
+		uint8_t device() const { return device_; }
+
+		// One recv worth of stream, arrived at host time arrival
+		void received(const uint8_t *data, size_t len, int64_t arrival) {
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				arrival_ = arrival;
+				parser_.feed(data, len);
+			}
+			if (!batch_.empty()) {
+				merger_.push(id_, batch_, latest_);
+			}
+		}
+
+		void closed() { merger_.close_board(id_); }
+
+		void on_adc(const daq::AdcBlock &b) override {
+			if (b.count == 0) {
+				return;
+			}
+			newest_ = b.time_us[b.count - 1];
+			have_newest_ = true;
+			align_.add(newest_, arrival_);
+			if (truth_ && (align_.windows() >= 10)) {
+				double e = double(align_.to_host(b.time_us[0])) - truth_->host(b.time_us[0]);
+
+				error_.count++;
+				error_.sum += e;
+				error_.sum_sq += e * e;
+				error_.max_abs = std::max(error_.max_abs, std::fabs(e));
+			}
+		}
+
+		void on_raw_packet(const uint8_t *data, size_t len) override {
+			Item item;
+			uint64_t board = daq_get_time_us(data);
+
+			device_ = daq_get_device(data);
+			item.time = align_.valid() ? align_.to_host(board) : arrival_;
+			item.board = id_;
+			item.seq = seq_++;
+			item.bytes.assign(data, data + len);
+			daq_put_time_us(item.bytes.data(), uint64_t(std::max<int64_t>(item.time, 0)));
+			latest_ = std::max(latest_, have_newest_ ? align_.to_host(newest_) : item.time);
+			have_newest_ = false;
+			batch_.push_back(std::move(item));
+		}
+
+	private:
+		Merger &merger_;
+		unsigned id_ = 0;
+		std::mutex mutex_;			// Parser and alignment -- the reader updates them, the report reads them
+		daq::StreamParser parser_;
+		daq::ClockAlign align_;
+		const SimClock *truth_;
+		AlignError error_;
+		uint8_t device_ = 0;
+		int64_t arrival_ = 0;
+		uint64_t newest_ = 0;		// Board time of the newest sample of the ADC packet being parsed
+		bool have_newest_ = false;
+		int64_t latest_ = kNever;
+		uint64_t seq_ = 0;
+		std::vector<Item> batch_;
+	};
+
+	// Reader thread of one connection
+	void serve(int fd, BoardLink *link, const std::atomic<bool> *stop) {
+		std::unique_ptr<uint8_t[]> buffer(new uint8_t[kRecvBuffer]);
+
+		while (!*stop) {
+			pollfd p = {fd, POLLIN, 0};
+			if (poll(&p, 1, 100) <= 0) {
+				continue;
+			}
+			ssize_t n = recv(fd, buffer.get(), kRecvBuffer, 0);
+			if (n <= 0) {
+				break;
+			}
+			link->received(buffer.get(), size_t(n), host_us());
+		}
+		close(fd);
+		link->closed();
+	}
+
+	// Simulated board: full-rate ADC0/ADC1 packets (all channels + status), a thermocouple packet every 100 ms
+	void simulate_board(unsigned port, uint8_t device, SimClock clock, bool flood, double jitter_us, const std::atomic<bool> *stop) {
+		int fd = socket(AF_INET, SOCK_STREAM, 0);
+		sockaddr_in addr{};
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		addr.sin_port = htons(uint16_t(port));
+		if ((fd < 0) || (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0)) {
+			std::perror("simulated board: connect");
+			if (fd >= 0) {
+				close(fd);
+			}
+			return;
+		}
+		int on = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));	// As the firmware (tcp_nagle_disable)
+
+		std::mt19937 rng(device);
+		std::exponential_distribution<double> delay(jitter_us > 0.0 ? 1.0 / jitter_us : 1.0);
+		std::vector<uint8_t> out;
+		uint8_t frame[6 * PKT_ADC_WORD_BYTES] = {0x22};		// Status | CH1 - CH4 | Zeros
+		uint32_t packet_count = 0;
+		uint64_t first_us = clock.board(host_us());
+		uint32_t index = 0;
+		unsigned blocks_per_send = flood ? 64 : 1;
+
+		for (uint32_t block = 0; !*stop; block++) {
+			uint64_t time_us = first_us + uint64_t(double(index) * 1e6 / daq::kBoardRateHz);
+
+			for (uint8_t adc = 0; adc < 2; adc++) {
+				daq_header_t h = {};
+				size_t at = out.size();
+
+				out.resize(at + PACKET_MAX_SIZE);
+				uint8_t *p = out.data() + at + PKT_HEADER_SIZE;
+				h.device = device;
+				h.mask = uint16_t(PKT_CH_ADC(adc) | PKT_CH_STATUS);
+				h.count = SAMPLES_PER_PACKET;
+				h.packet = packet_count++;
+				h.index = index;
+				h.time_us = time_us;
+				for (uint32_t i = 0; i < SAMPLES_PER_PACKET; i++) {
+					for (unsigned w = 3; w < 15; w++) {
+						frame[w] = uint8_t((index + i) * (31U + device) + w * 7U);
+					}
+					p = daq_put_adc_sample(p, h.mask, adc, uint16_t(i * 1e6 / daq::kBoardRateHz), frame);
+				}
+				daq_put_header(out.data() + at, &h);
+				out.resize(size_t(p - out.data()));
+			}
+			if ((block % 107U) == 0) {
+				daq_header_t h = {};
+				uint8_t tc[16] = {0x01, 0x90, 0x19, 0x00};	// TC0 25C, cold junction 25C
+				size_t at = out.size();
+
+				out.resize(at + PACKET_MAX_SIZE);
+				h.device = device;
+				h.mask = PKT_CH_TC;
+				h.faults = uint8_t(PKT_FRESH_TC(0) | PKT_FRESH_TC(1) | PKT_FRESH_TC(2) | PKT_FRESH_TC(3));
+				h.count = 1;
+				h.packet = packet_count++;
+				h.index = block / 107U;
+				h.time_us = time_us;
+				uint8_t *p = daq_put_tc_sample(out.data() + at + PKT_HEADER_SIZE, h.mask, 0, tc);
+				daq_put_header(out.data() + at, &h);
+				out.resize(size_t(p - out.data()));
+			}
+			index += SAMPLES_PER_PACKET;
+
+			if (((block + 1) % blocks_per_send) != 0) {
+				continue;
+			}
+			if (!flood) {
+				// Sent once the newest sample is converted, plus a random queuing delay
+				double due = clock.host(time_us + uint64_t(double(SAMPLES_PER_PACKET - 1) * 1e6 / daq::kBoardRateHz));
+				if (jitter_us > 0.0) {
+					due += delay(rng);
+				}
+				std::this_thread::sleep_until(g_start + std::chrono::microseconds(int64_t(due)));
+			}
+			for (size_t sent = 0; sent < out.size(); ) {
+				ssize_t n = send(fd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+				if (n <= 0) {
+					close(fd);
+					return;
+				}
+				sent += size_t(n);
+			}
+			out.clear();
+		}
+		close(fd);
+	}
+
+	void usage(const char *name) {
+		std::printf("usage: %s [--port N] [--seconds S] [--interval S] [--slack-ms MS] [--out FILE]\n"
+			"          [--simulate N [--jitter-us US] [--flood]]\n"
+			"  --port N        TCP port to listen on (default 8080)\n"
+			"  --seconds S     stop after S seconds, 0 = run until interrupted (default 0, 10 with --simulate)\n"
+			"  --interval S    report period (default 1)\n"
+			"  --slack-ms MS   hold packets this long behind the slowest board for ordering (default 20)\n"
+			"  --out FILE      write the merged stream (board packet format, aligned times) to FILE\n"
+			"  --simulate N    start N simulated boards on loopback, report the alignment error against their clocks\n"
+			"  --jitter-us US  simulated boards: mean random send delay (default 100)\n"
+			"  --flood         simulated boards: send as fast as possible (throughput, no alignment)\n", name);
+	}
+
+	void report(const char *label, const MergeStats &s, const MergeStats &prev, double dt, unsigned boards) {
+		uint64_t packets = s.packets - prev.packets;
+
+		std::printf("%s boards %u | merged %8.3f MB/s %8.0f pkt/s | waiting %zu | late %llu | latency avg %.1f ms max %.1f ms\n",
+			label, boards, double(s.bytes - prev.bytes) / dt / 1e6, double(packets) / dt, s.waiting,
+			(unsigned long long)s.late, packets ? (s.latency_sum_us - prev.latency_sum_us) / double(packets) / 1e3 : 0.0,
+			double(s.latency_max_us) / 1e3);
+	}
+
+} // namespace
+
+int main(int argc, char **argv) {
+	unsigned port = 8080;
+	double seconds = -1.0;
+	double interval = 1.0;
+	double slack_ms = 20.0;
+	const char *out_path = nullptr;
+	unsigned simulate = 0;
+	double jitter_us = 100.0;
+	bool flood = false;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if ((arg == "--port") && (i + 1 < argc)) port = unsigned(std::atoi(argv[++i]));
+		else if ((arg == "--seconds") && (i + 1 < argc)) seconds = std::atof(argv[++i]);
+		else if ((arg == "--interval") && (i + 1 < argc)) interval = std::atof(argv[++i]);
+		else if ((arg == "--slack-ms") && (i + 1 < argc)) slack_ms = std::atof(argv[++i]);
+		else if ((arg == "--out") && (i + 1 < argc)) out_path = argv[++i];
+		else if ((arg == "--simulate") && (i + 1 < argc)) simulate = unsigned(std::atoi(argv[++i]));
+		else if ((arg == "--jitter-us") && (i + 1 < argc)) jitter_us = std::atof(argv[++i]);
+		else if (arg == "--flood") flood = true;
+		else { usage(argv[0]); return (arg == "--help") ? 0 : 1; }
+	}
+	if (seconds < 0.0) {
+		seconds = simulate ? 10.0 : 0.0;
+	}
+
+	FILE *out = nullptr;
+	if (out_path) {
+		out = std::fopen(out_path, "wb");
+		if (!out) {
+			std::perror(out_path);
+			return 1;
+		}
+		std::setvbuf(out, nullptr, _IOFBF, 1 << 20);
+	}
+
+	int listener = socket(AF_INET, SOCK_STREAM, 0);
+	if (listener < 0) {
+		std::perror("socket");
+		return 1;
+	}
+	int on = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	sockaddr_in addr{};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(uint16_t(port));
+	if ((bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) || (listen(listener, 64) < 0)) {
+		std::perror("bind");
+		return 1;
+	}
+
+	Merger merger(int64_t(slack_ms * 1000.0), out);
+	std::thread merge_thread(&Merger::run, &merger);
+	std::atomic<bool> stop_readers(false);
+	std::atomic<bool> stop_boards(false);
+	std::vector<std::unique_ptr<BoardLink>> links;
+	std::vector<std::thread> readers;
+	std::vector<SimClock> clocks(simulate);
+	std::vector<std::thread> boards;
+
+	// Boards booted at different times, crystals within +-50 ppm
+	for (unsigned n = 0; n < simulate; n++) {
+		clocks[n].boot_us = uint64_t(3.7e6 + 11.3e6 * n);
+		clocks[n].ppm = double(int((n * 37U + 11U) % 101U) - 50);
+		boards.emplace_back(simulate_board, port, uint8_t(n + 1), clocks[n], flood, jitter_us, &stop_boards);
+	}
+
+	MergeStats last;
+	auto start = Clock::now();
+	auto last_report = start;
+
+	for (;;) {
+		pollfd p = {listener, POLLIN, 0};
+		if ((poll(&p, 1, 100) > 0) && (p.revents & POLLIN)) {
+			int fd = accept(listener, nullptr, nullptr);
+			if (fd >= 0) {
+				int rcvbuf = 4 * 1024 * 1024;
+				setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+				// Simulated boards connect in order -- connection n is board n
+				const SimClock *truth = (!flood && (links.size() < clocks.size())) ? &clocks[links.size()] : nullptr;
+				links.emplace_back(new BoardLink(merger, truth));
+				readers.emplace_back(serve, fd, links.back().get(), &stop_readers);
+				std::printf("connection %zu\n", links.size());
+			}
+		}
+
+		auto now = Clock::now();
+		double dt = std::chrono::duration<double>(now - last_report).count();
+		if (dt >= interval) {
+			MergeStats s = merger.stats();
+			report("      ", s, last, dt, unsigned(links.size()));
+			last = s;
+			last_report = now;
+		}
+		if ((seconds > 0.0) && (std::chrono::duration<double>(now - start).count() >= seconds)) {
+			break;
+		}
+	}
+
+	stop_boards = true;
+	for (std::thread &t : boards) {
+		t.join();
+	}
+	stop_readers = true;
+	for (std::thread &t : readers) {
+		t.join();
+	}
+	merger.stop();
+	merge_thread.join();
+	close(listener);
+	if (out) {
+		std::fclose(out);
+	}
+
+	report("total:", merger.stats(), MergeStats{}, std::chrono::duration<double>(Clock::now() - start).count(), unsigned(links.size()));
+	for (size_t n = 0; n < links.size(); n++) {
+		BoardLink &link = *links[n];
+		std::lock_guard<std::mutex> lock(link.mutex());
+		const daq::StreamStats &s = link.parser().stats();
+
+		std::printf("  board %zu device %u | %.1f MB %llu packets lost %llu malformed %llu | drift %+.2f ppm offset %+.6f s",
+			n, link.device(), double(s.bytes) / 1e6, (unsigned long long)s.packets, (unsigned long long)link.parser().sequence().lost(),
+			(unsigned long long)s.malformed, link.align().drift_ppm(), double(link.align().offset_us()) / 1e6);
+		if (link.error().count) {
+			const AlignError &e = link.error();
+			std::printf(" | true drift %+.2f ppm, error mean %.1f us rms %.1f us max %.1f us",
+				-clocks[n].ppm / (1.0 + clocks[n].ppm * 1e-6), e.sum / double(e.count), std::sqrt(e.sum_sq / double(e.count)), e.max_abs);
+		}
+		std::printf("\n");
+	}
+	return 0;
+}
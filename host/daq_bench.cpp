@@ -0,0 +1,420 @@
+/****************************************************************
+* DAQ BENCHMARK SUITE
+*
+* Repeatable numbers for the whole chain on Linux, swept over ADC rate, streamed channels and transmit batching:
+*
+*  firmware	the simulator (sim/daq_sim --json) runs the firmware for --seconds of virtual time per point and reports,
+*			per benchmark stage (HAL_STAGE_* in hal.h), the host time of the firmware's own code: DRDY interrupt and
+*			SPI frame handling per frame, packet assembly per ADC packet, send_data / sent callback / lwIP stand-in
+*			per packet, the idle main loop per pass. End to end: samples delivered, sample latency (conversion to
+*			packet received), link rate, flush size, and how much faster than real time the whole board runs here
+*  host		the bytes the simulator's sink received are decoded again by daq::StreamParser: MB/s, ns per sample
+*
+* Virtual-time results are deterministic; host times are the best of --repeat runs. Every point is written as one
+* JSON object per line (--out). With --baseline the results are checked against a stored run, and a throughput below
+* or a latency / cost above the baseline by more than the tolerance is a regression (exit status 1): virtual time per
+* point (--sim-tolerance, any malformed packet), host times as the geometric mean of their ratios over all points
+* (--tolerance) -- a single point's host time moves by tens of percent between runs, the mean over the sweep much less.
+* --update writes the baseline instead. Host times only compare on the machine the baseline was taken on.
+*
+* Channels are the first N ADC channels (IEPE0-3, then FB0 FB1 CL0 CL1), thermocouples off. Batching is the
+* transmit latency of tx_batch.h.
+*
+*   ./daq_bench [--sim ../sim/daq_sim] [--seconds 1] [--repeat 3] [--rates 8000,42667] [--channels 1,4,8]
+*               [--latencies 0,2000,10000] [--out bench_results.jsonl] [--baseline FILE [--update]]
+*               [--tolerance 0.25] [--sim-tolerance 0.02]
+***************************************************************/
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "daq_stream.h"
+
+namespace {
+
+	using Clock = std::chrono::steady_clock;
+
+	// One sweep point's results in output order -- numbers, and the few strings (point, transport)
+	struct Result {
+		std::vector<std::pair<std::string, std::string>> fields;	// Key, JSON value text
+
+		void set(const std::string &key, const std::string &value) {
+			for (auto &f : fields) {
+				if (f.first == key) {
+					f.second = value;
+					return;
+				}
+			}
+			fields.emplace_back(key, value);
+		}
+		void set(const std::string &key, double value) {
+			char text[32];
+			std::snprintf(text, sizeof(text), "%.6g", value);
+			set(key, std::string(text));
+		}
+		bool has(const std::string &key) const {
+			for (const auto &f : fields) {
+				if (f.first == key) return true;
+			}
+			return false;
+		}
+		double num(const std::string &key) const {
+			for (const auto &f : fields) {
+				if (f.first == key) return std::atof(f.second.c_str());
+			}
+			return 0.0;
+		}
+		std::string str(const std::string &key) const {
+			for (const auto &f : fields) {
+				if ((f.first == key) && (f.second.size() >= 2) && (f.second[0] == '"')) {
+					return f.second.substr(1, f.second.size() - 2);
+				}
+			}
+			return std::string();
+		}
+		std::string json() const {
+			std::string out = "{";
+			for (size_t i = 0; i < fields.size(); i++) {
+				out += (i ? ", \"" : "\"") + fields[i].first + "\": " + fields[i].second;
+			}
+			return out + "}";
+		}
+	};
+
+	// Flat JSON object as written by daq_sim --json and Result::json -- no nesting, no escapes
+	bool parse_json(const std::string &line, Result &r) {
+		size_t pos = line.find('{');
+
+		if (pos == std::string::npos) {
+			return false;
+		}
+		for (;;) {
+			size_t k0 = line.find('"', pos + 1);
+			if (k0 == std::string::npos) break;
+			size_t k1 = line.find('"', k0 + 1);
+			size_t colon = line.find(':', k1);
+			if ((k1 == std::string::npos) || (colon == std::string::npos)) return false;
+			size_t v0 = line.find_first_not_of(' ', colon + 1);
+			if (v0 == std::string::npos) return false;
+			size_t v1 = (line[v0] == '"') ? line.find('"', v0 + 1) : line.find_first_of(",}", v0);
+			if (v1 == std::string::npos) return false;
+			v1 += (line[v0] == '"') ? 1U : 0U;
+			r.set(line.substr(k0 + 1, k1 - k0 - 1), line.substr(v0, v1 - v0));
+			pos = line.find_first_of(",}", v1);
+			if ((pos == std::string::npos) || (line[pos] == '}')) break;
+		}
+		return !r.fields.empty();
+	}
+
+	std::vector<double> parse_list(const char *arg) {
+		std::vector<double> out;
+		std::stringstream in(arg);
+		std::string item;
+
+		while (std::getline(in, item, ',')) {
+			out.push_back(std::atof(item.c_str()));
+		}
+		return out;
+	}
+
+	// Metrics checked against the baseline: +1 higher is better, -1 lower is better
+	struct Check {
+		const char *metric;
+		int better;
+		bool host;		// Host time (--tolerance), else virtual time (--sim-tolerance)
+	};
+
+	const Check kChecks[] = {
+		{"samples_per_s",			+1, false},
+		{"samples_delivered",		+1, false},
+		{"latency_mean_us",			-1, false},
+		{"latency_max_us",			-1, false},
+		{"malformed",				-1, false},
+		{"decode_malformed",		-1, false},
+		{"realtime_x",				+1, true},
+		{"acquire_ns_per_frame",	-1, true},
+		{"packetize_ns_per_packet",	-1, true},
+		{"transport_ns_per_packet",	-1, true},
+		{"loop_ns_per_pass",		-1, true},
+		{"decode_mb_per_s",			+1, true},
+	};
+
+	// Host times kept as the best of the repeats
+	bool host_metric(const std::string &key, int &better) {
+		for (const Check &c : kChecks) {
+			if (c.host && (key == c.metric)) {
+				better = c.better;
+				return true;
+			}
+		}
+		better = (key == "sink_ns_per_packet") ? -1 : 0;
+		return better != 0;
+	}
+
+	// Runs the simulator once, fills r from its JSON report
+	bool run_sim(const std::string &sim, double seconds, double rate, unsigned mask, double latency,
+		const std::string &record, Result &r) {
+		char cmd[512];
+		char line[4096];
+		std::string out;
+
+		std::snprintf(cmd, sizeof(cmd), "'%s' --seconds %g --rate %g --streams 0x%04X --tx-latency %.0f --json --record '%s'",
+			sim.c_str(), seconds, rate, mask, latency, record.c_str());
+		FILE *p = popen(cmd, "r");
+		if (p == nullptr) {
+			return false;
+		}
+		while (std::fgets(line, sizeof(line), p) != nullptr) {
+			out += line;
+		}
+		return (pclose(p) == 0) && parse_json(out, r);
+	}
+
+	// Decodes a recorded stream with daq::StreamParser until 'seconds' have passed
+	void decode(const std::string &path, double seconds, Result &r) {
+		std::ifstream in(path, std::ios::binary);
+		std::vector<uint8_t> stream((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+		uint64_t bytes = 0, samples = 0, malformed = 0;
+		auto start = Clock::now();
+		double elapsed = 0.0;
+
+		if (stream.empty()) {
+			r.set("decode_mb_per_s", 0.0);
+			r.set("decode_ns_per_sample", 0.0);
+			r.set("decode_malformed", 0.0);
+			return;
+		}
+		while (elapsed < seconds) {
+			daq::Handler sink;
+			daq::StreamParser parser(sink);
+
+			for (size_t pos = 0; pos < stream.size(); pos += 65536) {
+				parser.feed(stream.data() + pos, std::min<size_t>(65536, stream.size() - pos));
+			}
+			bytes += parser.stats().bytes;
+			samples += parser.stats().samples[0] + parser.stats().samples[1];
+			malformed = parser.stats().malformed;
+			elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+		}
+		r.set("decode_mb_per_s", double(bytes) / elapsed / 1e6);
+		r.set("decode_ns_per_sample", samples ? elapsed * 1e9 / double(samples) : 0.0);
+		r.set("decode_malformed", double(malformed));
+	}
+
+	bool worse(const Check &c, double value, double base, double tolerance) {
+		return (c.better > 0) ? (value < base * (1.0 - tolerance)) : (value > base * (1.0 + tolerance));
+	}
+
+	// Checks the virtual-time metrics of one point against its baseline, prints every regression, returns how many.
+	// Host times are summed up as log ratios (log_ratio, ratios) for the check over all points
+	unsigned compare(const Result &r, const Result &base, double sim_tolerance, std::vector<double> &log_ratio,
+		std::vector<unsigned> &ratios) {
+		unsigned regressions = 0;
+
+		for (size_t i = 0; i < sizeof(kChecks) / sizeof(kChecks[0]); i++) {
+			const Check &c = kChecks[i];
+			if (!r.has(c.metric) || !base.has(c.metric)) {
+				continue;
+			}
+			double v = r.num(c.metric), b = base.num(c.metric);
+
+			if (c.host) {
+				if ((v > 0.0) && (b > 0.0)) {
+					log_ratio[i] += std::log(v / b);
+					ratios[i]++;
+				}
+			}
+			else if (worse(c, v, b, sim_tolerance)) {
+				std::printf("  REGRESSION %-24s %12.6g -> %-12.6g (%+.1f%%, limit %.0f%%)\n", c.metric, b, v,
+					b ? 100.0 * (v - b) / b : 100.0, 100.0 * sim_tolerance);
+				regressions++;
+			}
+		}
+		return regressions;
+	}
+
+	void usage(const char *name) {
+		std::printf("usage: %s [options]\n"
+			"  --sim PATH         simulator binary (default ../sim/daq_sim)\n"
+			"  --seconds S        virtual time per point (default 1)\n"
+			"  --repeat N         runs per point, host times are the best of them (default 3)\n"
+			"  --rates LIST       ADC DRDY rates in Hz (default 8000,42667)\n"
+			"  --channels LIST    ADC channels streamed, 1-8 (default 1,4,8)\n"
+			"  --latencies LIST   transmit latencies in us, tx_batch.h (default 0,2000,10000)\n"
+			"  --decode-seconds S host decode time per point (default 0.2)\n"
+			"  --out FILE         results, one JSON object per point (default bench_results.jsonl)\n"
+			"  --baseline FILE    check the results against FILE, exit 1 on a regression\n"
+			"  --update           write the results to the --baseline FILE instead of checking\n"
+			"  --tolerance F      host time regression limit, fraction of the baseline (default 0.25)\n"
+			"  --sim-tolerance F  virtual time regression limit (default 0.02)\n", name);
+	}
+
+} // namespace
+
+int main(int argc, char **argv) {
+	std::string sim = "../sim/daq_sim";
+	std::string out_path = "bench_results.jsonl";
+	std::string baseline_path;
+	double seconds = 1.0;
+	double decode_seconds = 0.2;
+	double tolerance = 0.25;
+	double sim_tolerance = 0.02;
+	unsigned repeat = 3;
+	bool update = false;
+	std::vector<double> rates = {8000.0, 42667.0};
+	std::vector<double> channels = {1.0, 4.0, 8.0};
+	std::vector<double> latencies = {0.0, 2000.0, 10000.0};
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if ((arg == "--sim") && (i + 1 < argc)) sim = argv[++i];
+		else if ((arg == "--seconds") && (i + 1 < argc)) seconds = std::atof(argv[++i]);
+		else if ((arg == "--repeat") && (i + 1 < argc)) repeat = unsigned(std::max(1, std::atoi(argv[++i])));
+		else if ((arg == "--rates") && (i + 1 < argc)) rates = parse_list(argv[++i]);
+		else if ((arg == "--channels") && (i + 1 < argc)) channels = parse_list(argv[++i]);
+		else if ((arg == "--latencies") && (i + 1 < argc)) latencies = parse_list(argv[++i]);
+		else if ((arg == "--decode-seconds") && (i + 1 < argc)) decode_seconds = std::atof(argv[++i]);
+		else if ((arg == "--out") && (i + 1 < argc)) out_path = argv[++i];
+		else if ((arg == "--baseline") && (i + 1 < argc)) baseline_path = argv[++i];
+		else if (arg == "--update") update = true;
+		else if ((arg == "--tolerance") && (i + 1 < argc)) tolerance = std::atof(argv[++i]);
+		else if ((arg == "--sim-tolerance") && (i + 1 < argc)) sim_tolerance = std::atof(argv[++i]);
+		else { usage(argv[0]); return (arg == "--help") ? 0 : 1; }
+	}
+	if (update && baseline_path.empty()) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	// Baseline points by name
+	std::map<std::string, Result> baseline;
+	if (!baseline_path.empty() && !update) {
+		std::ifstream in(baseline_path);
+		std::string line;
+
+		if (!in) {
+			std::fprintf(stderr, "%s: cannot read\n", baseline_path.c_str());
+			return 2;
+		}
+		while (std::getline(in, line)) {
+			Result r;
+			if (parse_json(line, r) && r.has("point")) {
+				baseline[r.str("point")] = r;
+			}
+		}
+	}
+
+	char record[] = "/tmp/daq_bench_XXXXXX";
+	int fd = mkstemp(record);
+	if (fd < 0) {
+		std::perror("mkstemp");
+		return 2;
+	}
+	close(fd);
+
+	std::vector<Result> results;
+	unsigned regressions = 0;
+	unsigned compared = 0;
+	std::vector<double> log_ratio(sizeof(kChecks) / sizeof(kChecks[0]), 0.0);
+	std::vector<unsigned> ratios(log_ratio.size(), 0);
+
+	for (double rate : rates) {
+		for (double ch : channels) {
+			unsigned n = unsigned(std::min(8.0, std::max(1.0, ch)));
+			unsigned mask = (1U << n) - 1U;	// PKT_CH_IEPE0 ... PKT_CH_CL1
+
+			for (double latency : latencies) {
+				char name[64];
+				Result r;
+
+				std::snprintf(name, sizeof(name), "%.0fHz-%uch-%.0fus", rate, n, latency);
+				r.set("point", "\"" + std::string(name) + "\"");
+				r.set("channels", double(n));
+				for (unsigned k = 0; k < repeat; k++) {
+					Result run;
+
+					if (!run_sim(sim, seconds, rate, mask, latency, record, run)) {
+						std::fprintf(stderr, "%s: simulator run failed (%s)\n", name, sim.c_str());
+						unlink(record);
+						return 2;
+					}
+					for (const auto &f : run.fields) {
+						int better;
+						if ((k == 0) || !host_metric(f.first, better)) {
+							r.set(f.first, f.second);
+						}
+						else if ((better > 0) ? (run.num(f.first) > r.num(f.first)) : (run.num(f.first) < r.num(f.first))) {
+							r.set(f.first, f.second);
+						}
+					}
+				}
+				decode(record, decode_seconds, r);
+
+				std::printf("%-20s delivered %7.3f%% %8.0f samples/s latency %6.0f/%-6.0f us flush %5.0f B | ns: acquire %4.0f "
+					"packetize %5.0f transport %4.0f loop %4.0f | %5.1fx real time | decode %6.0f MB/s\n", name,
+					100.0 * r.num("samples_delivered"), r.num("samples_per_s"), r.num("latency_mean_us"),
+					r.num("latency_max_us"), r.num("flush_bytes"), r.num("acquire_ns_per_frame"),
+					r.num("packetize_ns_per_packet"), r.num("transport_ns_per_packet"), r.num("loop_ns_per_pass"),
+					r.num("realtime_x"), r.num("decode_mb_per_s"));
+				auto base = baseline.find(name);
+				if (base != baseline.end()) {
+					regressions += compare(r, base->second, sim_tolerance, log_ratio, ratios);
+					compared++;
+				}
+				else if (!baseline.empty()) {
+					std::printf("  no baseline for this point\n");
+				}
+				results.push_back(r);
+			}
+		}
+	}
+	unlink(record);
+
+	// Host times over all points
+	if (compared != 0) {
+		std::printf("host times, geometric mean over the points against the baseline:");
+		for (size_t i = 0; i < log_ratio.size(); i++) {
+			if (ratios[i] != 0) {
+				std::printf(" %s x%.2f", kChecks[i].metric, std::exp(log_ratio[i] / ratios[i]));
+			}
+		}
+		std::printf("\n");
+		for (size_t i = 0; i < log_ratio.size(); i++) {
+			double ratio = ratios[i] ? std::exp(log_ratio[i] / ratios[i]) : 1.0;
+
+			if (worse(kChecks[i], ratio, 1.0, tolerance)) {
+				std::printf("  REGRESSION %-24s x%.2f of the baseline (limit %.0f%%)\n", kChecks[i].metric, ratio,
+					100.0 * tolerance);
+				regressions++;
+			}
+		}
+	}
+
+	const std::string &path = update ? baseline_path : out_path;
+	std::ofstream out(path);
+	for (const Result &r : results) {
+		out << r.json() << "\n";
+	}
+	if (!out) {
+		std::fprintf(stderr, "%s: cannot write\n", path.c_str());
+		return 2;
+	}
+	std::printf("%zu points -> %s", results.size(), path.c_str());
+	if (!baseline.empty()) {
+		std::printf(" | %u compared with %s: %u regression%s", compared, baseline_path.c_str(), regressions,
+			(regressions == 1) ? "" : "s");
+	}
+	std::printf("\n");
+	return (regressions == 0) ? 0 : 1;
+}
@@ -0,0 +1,290 @@
+/****************************************************************
+* DAQ CAPTURE
+*
+* Reads capture files (capture_file.h, written by daq_ingest --out) through the memory-mapped reader: summary, a
+* time range of one column as rows, or min/max per plot column for any span. Times are seconds after the first
+* sample in the file.
+*
+*   ./daq_capture FILE                                       series, rows, time spans, chunks
+*   ./daq_capture FILE --column IEPE0 --from 3600 --to 3660 --points 1000
+*   ./daq_capture FILE --column TC0 --from 10 --to 11 --rows  time and value of every row
+*   ./daq_capture --bench FILE [--minutes 10]                writes a synthetic capture, times seeks and plots
+***************************************************************/
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "capture_file.h"
+#include "daq_stream.h"
+
+namespace {
+
+	using Clock = std::chrono::steady_clock;
+
+	void usage(const char *name) {
+		std::printf("usage: %s FILE [--column NAME [--from S] [--to S] [--points N | --rows]]\n"
+			"       %s --bench FILE [--minutes M]\n"
+			"  --column NAME  IEPE0-3, FB0, FB1, CL0, CL1, TC0-3\n"
+			"  --from S       start, seconds after the first sample (default 0)\n"
+			"  --to S         end (default: end of the file)\n"
+			"  --points N     min/max in N equal spans (default 20)\n"
+			"  --rows         print every row in the range instead\n"
+			"  --bench FILE   write M minutes of synthetic capture (both ADCs at full rate, thermocouples at 10 Hz)\n"
+			"                 to FILE and time seeks and plot downsampling against a full scan\n", name, name);
+	}
+
+	double seconds_since(Clock::time_point t) {
+		return std::chrono::duration<double>(Clock::now() - t).count();
+	}
+
+	// First sample of the file over all series
+	uint64_t file_start(const daq::CaptureReader &r) {
+		uint64_t t = std::numeric_limits<uint64_t>::max();
+		for (unsigned s = 0; s < daq::kCaptureSeries; s++) {
+			if (r.chunks(s)) {
+				t = std::min(t, r.chunk(s, 0).header->first_us);
+			}
+		}
+		return (t == std::numeric_limits<uint64_t>::max()) ? 0 : t;
+	}
+
+	uint64_t series_end(const daq::CaptureReader &r, unsigned s) {
+		return r.chunks(s) ? r.chunk(s, r.chunks(s) - 1).header->last_us + 1 : 0;
+	}
+
+	void summary(const daq::CaptureReader &r) {
+		uint64_t start = file_start(r);
+
+		std::printf("%.1f MB, %u rows per chunk%s\n", double(r.file_size()) / 1e6, r.chunk_rows(),
+			r.recovered() ? ", no index (file cut short): recovered from the chunks" : "");
+		for (unsigned s = 0; s < daq::kCaptureSeries; s++) {
+			if (!r.chunks(s)) {
+				continue;
+			}
+			uint8_t present = 0;
+			for (size_t i = 0; i < r.chunks(s); i++) {
+				present |= r.chunk(s, i).header->present;
+			}
+			std::printf("  %-4s %12llu rows %7zu chunks  %10.3f - %10.3f s |", daq::kCaptureSeriesNames[s],
+				(unsigned long long)r.rows(s), r.chunks(s), double(r.chunk(s, 0).header->first_us - start) / 1e6,
+				double(series_end(r, s) - 1 - start) / 1e6);
+			for (unsigned c = 0; c < daq::kCaptureColumns; c++) {
+				if (present & (1U << c)) {
+					std::printf(" %s", daq::kCaptureColumnNames[s][c]);
+				}
+			}
+			std::printf("\n");
+		}
+	}
+
+	// Synthetic capture: both ADCs at the board's rate (a tone per channel), thermocouples at 10 Hz
+	void write_synthetic(daq::CaptureWriter &w, double minutes) {
+		const size_t kRows = 4000;
+		std::vector<uint64_t> time(kRows);
+		std::vector<float> values[daq::kCaptureColumns];
+		uint64_t total = uint64_t(minutes * 60.0 * daq::kBoardRateHz);
+
+		for (std::vector<float> &v : values) {
+			v.resize(kRows);
+		}
+		for (uint64_t row = 0; row < total; row += kRows) {
+			size_t n = size_t(std::min<uint64_t>(kRows, total - row));
+			for (unsigned s = 0; s < daq::kAdcCount; s++) {
+				const float *columns[daq::kCaptureColumns];
+				for (size_t i = 0; i < n; i++) {
+					double t = double(row + i) / daq::kBoardRateHz;
+					time[i] = 1000000 + uint64_t(t * 1e6);
+					for (unsigned c = 0; c < daq::kCaptureColumns; c++) {
+						values[c][i] = float(0.5 * std::sin(t * 2.0 * M_PI * (10.0 + 100.0 * (4 * s + c))) + 0.01 * (t / 60.0));
+					}
+				}
+				for (unsigned c = 0; c < daq::kCaptureColumns; c++) {
+					columns[c] = values[c].data();
+				}
+				w.append(s, n, time.data(), columns);
+			}
+			// Thermocouple rows falling into this block
+			uint64_t tc_first = (row * 10 + uint64_t(daq::kBoardRateHz) - 1) / uint64_t(daq::kBoardRateHz);
+			uint64_t tc_end = ((row + n) * 10 + uint64_t(daq::kBoardRateHz) - 1) / uint64_t(daq::kBoardRateHz);
+			for (uint64_t k = tc_first; k < tc_end; k++) {
+				uint64_t t = 1000000 + k * 100000;
+				float temps[daq::kCaptureColumns] = {25.0f + float(k % 600) / 100.0f, 30.0f, std::nanf(""), 21.5f};
+				const float *columns[daq::kCaptureColumns] = {&temps[0], &temps[1], &temps[2], &temps[3]};
+				w.append(daq::kSeriesTc, 1, &t, columns);
+			}
+		}
+	}
+
+	int bench(const char *path, double minutes) {
+		daq::CaptureWriter w;
+		auto t0 = Clock::now();
+
+		if (!w.open(path)) {
+			std::perror(path);
+			return 1;
+		}
+		write_synthetic(w, minutes);
+		if (!w.close()) {
+			std::perror(path);
+			return 1;
+		}
+		double write_s = seconds_since(t0);
+
+		t0 = Clock::now();
+		daq::CaptureReader r;
+		if (!r.open(path)) {
+			std::printf("%s: %s\n", path, r.error().c_str());
+			return 1;
+		}
+		double open_s = seconds_since(t0);
+		summary(r);
+		std::printf("write               %.2f s (%.0f MB/s)\n", write_s, double(r.file_size()) / write_s / 1e6);
+		std::printf("open + index        %.3f ms\n", open_s * 1e3);
+
+		uint64_t start = r.chunk(daq::kSeriesAdc0, 0).header->first_us;
+		uint64_t end = series_end(r, daq::kSeriesAdc0);
+		std::mt19937_64 rng(1);
+		int errors = 0;
+
+		// Random seeks, each checked against its neighbours
+		const unsigned kSeeks = 100000;
+		t0 = Clock::now();
+		for (unsigned i = 0; i < kSeeks; i++) {
+			uint64_t t = start + rng() % (end - start);
+			uint64_t row = r.lower_bound(daq::kSeriesAdc0, t);
+			uint64_t here = 0, before = 0;
+			r.read(daq::kSeriesAdc0, 0, row, 1, nullptr, &here);
+			if (row > 0) {
+				r.read(daq::kSeriesAdc0, 0, row - 1, 1, nullptr, &before);
+			}
+			errors += ((here < t) || ((row > 0) && (before >= t))) ? 1 : 0;
+		}
+		double seek_s = seconds_since(t0);
+		std::printf("time seek           %.2f us per seek (%u random, %d wrong)\n", seek_s / kSeeks * 1e6, kSeeks, errors);
+
+		// Whole run to one plot width, from the index; a 1 s window, from the samples
+		const size_t kPoints = 2000;
+		std::vector<float> lo(kPoints), hi(kPoints), lo_scan(kPoints), hi_scan(kPoints);
+		t0 = Clock::now();
+		r.downsample(daq::kSeriesAdc0, 0, start, end, kPoints, lo.data(), hi.data());
+		double overview_s = seconds_since(t0);
+		uint64_t mid = start + (end - start) / 2;
+		t0 = Clock::now();
+		r.downsample(daq::kSeriesAdc0, 0, mid, mid + 1000000, kPoints, lo_scan.data(), hi_scan.data());
+		double window_s = seconds_since(t0);
+		std::printf("plot, whole run     %.3f ms for %zu points (chunk index)\n", overview_s * 1e3, kPoints);
+		std::printf("plot, 1 s window    %.3f ms for %zu points (samples)\n", window_s * 1e3, kPoints);
+
+		// The same overview by reading every sample of the column
+		std::vector<float> ref_lo(kPoints, std::nanf("")), ref_hi(kPoints, std::nanf(""));
+		double width = double(end - start) / double(kPoints);
+		t0 = Clock::now();
+		for (size_t i = 0; i < r.chunks(daq::kSeriesAdc0); i++) {
+			const daq::CaptureReader::Chunk &c = r.chunk(daq::kSeriesAdc0, i);
+			for (uint32_t k = 0; k < c.header->rows; k++) {
+				size_t b = std::min(kPoints - 1, size_t(double(c.time[k] - start) / width));
+				float v = c.column[0][k];
+				ref_lo[b] = (ref_lo[b] == ref_lo[b]) ? std::min(ref_lo[b], v) : v;
+				ref_hi[b] = (ref_hi[b] == ref_hi[b]) ? std::max(ref_hi[b], v) : v;
+			}
+		}
+		double scan_s = seconds_since(t0);
+		bool same = (std::memcmp(lo.data(), ref_lo.data(), kPoints * sizeof(float)) == 0) &&
+			(std::memcmp(hi.data(), ref_hi.data(), kPoints * sizeof(float)) == 0);
+		std::printf("plot, full scan     %.1f ms -> index %.0fx faster, %s\n", scan_s * 1e3, scan_s / overview_s,
+			same ? "identical" : "MISMATCH");
+		return (errors == 0) && same ? 0 : 1;
+	}
+
+} // namespace
+
+int main(int argc, char **argv) {
+	const char *path = nullptr;
+	const char *bench_path = nullptr;
+	std::string column;
+	double from = 0.0;
+	double to = -1.0;
+	size_t points = 20;
+	bool rows = false;
+	double minutes = 10.0;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if ((arg == "--column") && (i + 1 < argc)) column = argv[++i];
+		else if ((arg == "--from") && (i + 1 < argc)) from = std::atof(argv[++i]);
+		else if ((arg == "--to") && (i + 1 < argc)) to = std::atof(argv[++i]);
+		else if ((arg == "--points") && (i + 1 < argc)) points = size_t(std::max(1, std::atoi(argv[++i])));
+		else if (arg == "--rows") rows = true;
+		else if ((arg == "--bench") && (i + 1 < argc)) bench_path = argv[++i];
+		else if ((arg == "--minutes") && (i + 1 < argc)) minutes = std::atof(argv[++i]);
+		else if ((arg[0] != '-') && !path) path = argv[i];
+		else { usage(argv[0]); return (arg == "--help") ? 0 : 1; }
+	}
+	if (bench_path) {
+		return bench(bench_path, minutes);
+	}
+	if (!path) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	daq::CaptureReader r;
+	if (!r.open(path)) {
+		std::printf("%s: %s\n", path, r.error().c_str());
+		return 1;
+	}
+	if (column.empty()) {
+		summary(r);
+		return 0;
+	}
+
+	unsigned series = daq::kCaptureSeries, col = 0;
+	for (unsigned s = 0; s < daq::kCaptureSeries; s++) {
+		for (unsigned c = 0; c < daq::kCaptureColumns; c++) {
+			if (column == daq::kCaptureColumnNames[s][c]) {
+				series = s;
+				col = c;
+			}
+		}
+	}
+	if (series == daq::kCaptureSeries) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	uint64_t start = file_start(r);
+	uint64_t from_us = start + uint64_t(std::max(0.0, from) * 1e6);
+	uint64_t to_us = (to < 0.0) ? series_end(r, series) : start + uint64_t(to * 1e6);
+	if (to_us <= from_us) {
+		return 0;
+	}
+
+	if (rows) {
+		uint64_t row = r.lower_bound(series, from_us);
+		uint64_t end = r.lower_bound(series, to_us);
+		float value;
+		uint64_t t;
+
+		std::printf("time_s,%s\n", column.c_str());
+		for (; (row < end) && r.read(series, col, row, 1, &value, &t); row++) {
+			std::printf("%.6f,%g\n", double(t - start) / 1e6, value);
+		}
+		return 0;
+	}
+
+	std::vector<float> lo(points), hi(points);
+	r.downsample(series, col, from_us, to_us, points, lo.data(), hi.data());
+	std::printf("time_s,%s_min,%s_max\n", column.c_str(), column.c_str());
+	for (size_t i = 0; i < points; i++) {
+		std::printf("%.6f,%g,%g\n", double(from_us - start + (to_us - from_us) * i / points) / 1e6, lo[i], hi[i]);
+	}
+	return 0;
+}
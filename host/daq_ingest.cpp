@@ -0,0 +1,380 @@
+/****************************************************************
+* DAQ INGEST
+*
+* TCP server for the board's stream like daq_receiver, with the receive path run as a pipeline (ingest_pipeline.h):
+* the socket is read on this thread, decode + scale, analysis and storage each run on their own thread. Reports
+* per-stage throughput, queue depths, waits and drops, and per-channel mean / RMS / extremes of the interval.
+*
+* The store stage writes a capture file (capture_file.h, read back with daq_capture). With --spectra the analyze
+* stage keeps the IEPE channels' Welch PSD, RMS, peak and crest factor (spectrum.h); each report prints the latest
+* publication and its strongest PSD peaks, --psd writes it as CSV (replaced whole, for a live plot to reread).
+*
+*   ./daq_ingest [--port 8080] [--seconds 0] [--interval 1] [--out FILE] [--drop] [--blocks N]
+*   ./daq_ingest --spectra [--fft 4096] [--publish-ms 1000] [--psd FILE]
+*   ./daq_ingest --bench 5 --pace 20 --stall-ms 500 --stall-every 2000 --drop   synthetic stream at 20 boards' rate
+***************************************************************/
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <thread>
+#include <vector>
+
+#include "ingest_pipeline.h"
+
+namespace {
+
+	using Clock = std::chrono::steady_clock;
+
+	const char *const kStageNames[daq::kIngestStages] = {"read", "decode", "analyze", "store"};
+
+	void usage(const char *name) {
+		std::printf("usage: %s [--port N] [--seconds S] [--interval S] [--out FILE] [--drop] [--blocks N] [--channels]\n"
+			"          [--spectra [--fft N] [--publish-ms MS] [--psd FILE]] [--stall-ms MS --stall-every MS] [--bench S [--pace X]]\n"
+			"  --port N         TCP port to listen on (default 8080)\n"
+			"  --seconds S      stop after S seconds, 0 = run until interrupted (default 0)\n"
+			"  --interval S     report period (default 1)\n"
+			"  --out FILE       store the scaled samples and temperatures in a capture file (capture_file.h)\n"
+			"  --drop           drop samples while no block is free instead of holding the socket back\n"
+			"  --blocks N       block pool size (default 8192, about 3.8 s of both ADCs at full rate)\n"
+			"  --channels       print per-channel mean / RMS / min / max every report\n"
+			"  --spectra        IEPE spectra: RMS, peak, crest factor and the strongest PSD peaks every report\n"
+			"  --fft N          spectrum segment length, a power of two (default 4096, 50%% overlap)\n"
+			"  --publish-ms MS  spectra published this often (default 1000)\n"
+			"  --psd FILE       write the latest published PSD of IEPE0-3 as CSV every report\n"
+			"  --stall-ms MS    stall the store stage MS every --stall-every MS (disk hiccup)\n"
+			"  --bench S        feed a synthetic stream for S seconds instead of listening\n"
+			"  --pace X         bench rate in boards' worth of data, 0 = as fast as possible (default 0)\n", name);
+	}
+
+	void report(const char *label, const daq::IngestStats &s, const daq::IngestStats &prev, double dt, bool capture) {
+		std::printf("%s packets %llu lost %llu malformed %llu gaps %llu | dropped %llu samples | free chunks %zu blocks %zu",
+			label, (unsigned long long)s.packets, (unsigned long long)s.lost, (unsigned long long)s.malformed,
+			(unsigned long long)s.index_gaps, (unsigned long long)s.dropped_samples, s.free_chunks, s.free_blocks);
+		if (capture) {
+			std::printf(" | capture restarts %llu out of order %llu", (unsigned long long)s.restarts,
+				(unsigned long long)s.out_of_order);
+		}
+		std::printf("\n");
+		for (unsigned i = 0; i < daq::kIngestStages; i++) {
+			const daq::IngestStats::Stage &a = s.stage[i];
+			const daq::IngestStats::Stage &b = prev.stage[i];
+
+			std::printf("   %-8s %9.3f MB/s %9.0f %s/s | waits %llu", kStageNames[i], double(a.bytes - b.bytes) / dt / 1e6,
+				double(a.items - b.items) / dt, (i <= daq::kStageDecode) ? "chunks" : "blocks", (unsigned long long)(a.waits - b.waits));
+			if (a.capacity) {
+				std::printf(" | queue %zu max %zu of %zu", a.depth, a.max_depth, a.capacity);
+			}
+			std::printf("\n");
+		}
+		std::fflush(stdout);
+	}
+
+	void print_channels(daq::IngestPipeline &pipeline) {
+		std::array<daq::ChannelSummary, daq::kIngestChannels> summary = pipeline.take_summary();
+
+		for (unsigned ch = 0; ch < daq::kIngestChannels; ch++) {
+			const daq::ChannelSummary &c = summary[ch];
+			if (c.count) {
+				std::printf("   %-6s mean %+11.6f rms %11.6f min %+11.6f max %+11.6f (%llu samples)\n", daq::kChannelNames[ch], c.mean, c.rms,
+					c.min, c.max, (unsigned long long)c.count);
+			}
+		}
+	}
+
+	// Latest published spectra; the strongest local maxima of each PSD, above DC
+	void print_spectra(const std::array<daq::ChannelSpectrum, daq::kAdcChannels> &spectra) {
+		const unsigned kPeaks = 3;
+
+		for (unsigned ch = 0; ch < daq::kAdcChannels; ch++) {
+			const daq::ChannelSpectrum &s = spectra[ch];
+			if (!s.samples) {
+				continue;
+			}
+			std::printf("   %-6s rms %11.6f peak %11.6f crest %6.3f", daq::kChannelNames[ch], s.rms, s.peak, s.crest);
+			std::pair<float, size_t> top[kPeaks] = {};
+			for (size_t k = 2; k + 1 < s.psd.size(); k++) {
+				if ((s.psd[k] > s.psd[k - 1]) && (s.psd[k] >= s.psd[k + 1]) && (s.psd[k] > top[kPeaks - 1].first)) {
+					top[kPeaks - 1] = {s.psd[k], k};
+					std::sort(top, top + kPeaks, [](const std::pair<float, size_t> &a, const std::pair<float, size_t> &b) {
+						return a.first > b.first;
+					});
+				}
+			}
+			if (s.segments) {
+				std::printf(" | %u segments, %.1f Hz bins, peaks", s.segments, s.bin_hz);
+				for (unsigned i = 0; i < kPeaks; i++) {
+					if (top[i].first > 0.0f) {
+						std::printf(" %.0f Hz %.3g/Hz", double(top[i].second) * s.bin_hz, double(top[i].first));
+					}
+				}
+			}
+			std::printf("\n");
+		}
+	}
+
+	// Moves the bench stream on by one pass of itself: packet numbers, indices and times carry on from where the last
+	// pass ended, so the decoder and the capture file see one continuous board rather than the same second again
+	void advance_stream(std::vector<uint8_t> &stream) {
+		uint32_t packets = 0, tc_packets = 0, adc_samples = 0;
+		daq_header_t h;
+
+		for (size_t pos = 0; daq_get_header(&stream[pos], uint32_t(stream.size() - pos), &h) > 0; pos += h.length) {
+			packets++;
+			if (h.mask & PKT_CH_TC) {
+				tc_packets++;
+			}
+			else if (h.mask & PKT_CH_ADC(0)) {
+				adc_samples += h.count;
+			}
+			if (pos + h.length >= stream.size()) {
+				break;
+			}
+		}
+
+		uint64_t span_us = uint64_t(adc_samples * 1e6 / daq::kBoardRateHz);
+		for (size_t pos = 0; daq_get_header(&stream[pos], uint32_t(stream.size() - pos), &h) > 0; pos += h.length) {
+			h.packet += packets;
+			h.index += (h.mask & PKT_CH_TC) ? tc_packets : adc_samples;
+			h.time_us += span_us;
+			daq_put_header(&stream[pos], &h);
+			if (pos + h.length >= stream.size()) {
+				break;
+			}
+		}
+	}
+
+	// Written beside the file and renamed over it: a reader never sees half a spectrum
+	bool write_psd(const char *path, const std::array<daq::ChannelSpectrum, daq::kAdcChannels> &spectra) {
+		std::string tmp = std::string(path) + ".tmp";
+		FILE *f = std::fopen(tmp.c_str(), "w");
+		size_t bins = 0;
+		double bin_hz = 0.0;
+
+		if (!f) {
+			return false;
+		}
+		for (const daq::ChannelSpectrum &s : spectra) {
+			if (s.psd.size() > bins) {
+				bins = s.psd.size();
+				bin_hz = s.bin_hz;
+			}
+		}
+		std::fprintf(f, "hz");
+		for (unsigned ch = 0; ch < daq::kAdcChannels; ch++) {
+			std::fprintf(f, ",%s", daq::kChannelNames[ch]);
+		}
+		std::fprintf(f, "\n");
+		for (size_t k = 0; k < bins; k++) {
+			std::fprintf(f, "%.3f", double(k) * bin_hz);
+			for (const daq::ChannelSpectrum &s : spectra) {
+				if (k < s.psd.size()) {
+					std::fprintf(f, ",%.6g", double(s.psd[k]));
+				}
+				else {
+					std::fprintf(f, ",");
+				}
+			}
+			std::fprintf(f, "\n");
+		}
+		bool ok = (std::fclose(f) == 0);
+		return ok && (std::rename(tmp.c_str(), path) == 0);
+	}
+
+} // namespace
+
+int main(int argc, char **argv) {
+	unsigned port = 8080;
+	double seconds = 0.0;
+	double interval = 1.0;
+	double bench = 0.0;
+	double pace = 0.0;
+	bool channels = false;
+	const char *out_path = nullptr;
+	const char *psd_path = nullptr;
+	daq::IngestConfig config;
+	daq::CaptureWriter capture;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if ((arg == "--port") && (i + 1 < argc)) port = unsigned(std::atoi(argv[++i]));
+		else if ((arg == "--seconds") && (i + 1 < argc)) seconds = std::atof(argv[++i]);
+		else if ((arg == "--interval") && (i + 1 < argc)) interval = std::atof(argv[++i]);
+		else if ((arg == "--out") && (i + 1 < argc)) out_path = argv[++i];
+		else if (arg == "--drop") config.overflow = daq::Overflow::Drop;
+		else if ((arg == "--blocks") && (i + 1 < argc)) config.blocks = size_t(std::atol(argv[++i]));
+		else if (arg == "--channels") channels = true;
+		else if (arg == "--spectra") config.spectra = true;
+		else if ((arg == "--fft") && (i + 1 < argc)) config.spectrum.fft_size = size_t(std::atol(argv[++i]));
+		else if ((arg == "--publish-ms") && (i + 1 < argc)) config.publish_ms = unsigned(std::atoi(argv[++i]));
+		else if ((arg == "--psd") && (i + 1 < argc)) { psd_path = argv[++i]; config.spectra = true; }
+		else if ((arg == "--stall-ms") && (i + 1 < argc)) config.stall_ms = unsigned(std::atoi(argv[++i]));
+		else if ((arg == "--stall-every") && (i + 1 < argc)) config.stall_every_ms = unsigned(std::atoi(argv[++i]));
+		else if ((arg == "--bench") && (i + 1 < argc)) bench = std::atof(argv[++i]);
+		else if ((arg == "--pace") && (i + 1 < argc)) pace = std::atof(argv[++i]);
+		else { usage(argv[0]); return (arg == "--help") ? 0 : 1; }
+	}
+	if (config.blocks < 16) {
+		config.blocks = 16;
+	}
+
+	if (out_path) {
+		if (!capture.open(out_path)) {
+			std::perror(out_path);
+			return 1;
+		}
+		config.capture = &capture;
+	}
+
+	int listener = -1;
+	if (bench <= 0.0) {
+		listener = socket(AF_INET, SOCK_STREAM, 0);
+		if (listener < 0) {
+			std::perror("socket");
+			return 1;
+		}
+		int on = 1;
+		setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+		sockaddr_in addr{};
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_ANY);
+		addr.sin_port = htons(uint16_t(port));
+		if ((bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) || (listen(listener, 4) < 0)) {
+			std::perror("bind");
+			return 1;
+		}
+	}
+
+	// One second of board data, fed in recv-sized pieces -- at the board's rate x pace, or flat out -- and moved on by a
+	// second after each pass
+	std::vector<uint8_t> stream;
+	if (bench > 0.0) {
+		stream = daq::synthetic_stream(1.0);
+		seconds = bench;
+	}
+
+	daq::IngestPipeline pipeline(config);
+	daq::IngestStats last;
+	std::array<daq::ChannelSpectrum, daq::kAdcChannels> spectra;
+	uint64_t spectra_seen = 0;
+	auto show_spectra = [&] {
+		uint64_t publications = pipeline.spectra(spectra);
+		if (publications == spectra_seen) {
+			return;
+		}
+		spectra_seen = publications;
+		print_spectra(spectra);
+		if (psd_path && !write_psd(psd_path, spectra)) {
+			std::perror(psd_path);
+		}
+	};
+	int conn = -1;
+	size_t pos = 0;
+	uint64_t fed = 0;
+	auto start = Clock::now();
+	auto last_report = start;
+
+	for (;;) {
+		if (bench > 0.0) {
+			size_t n = std::min(daq::kChunkBytes, stream.size() - pos);
+			daq::Chunk *chunk = pipeline.chunk();
+
+			std::memcpy(chunk->data, stream.data() + pos, n);
+			chunk->len = n;
+			pipeline.submit(chunk);
+			pos = (pos + n) % stream.size();
+			fed += n;
+			if (pos == 0) {
+				advance_stream(stream);
+			}
+			if (pace > 0.0) {
+				std::this_thread::sleep_until(start + std::chrono::duration<double>(double(fed) / (double(stream.size()) * pace)));
+			}
+		}
+		else {
+			pollfd fds[2] = {{listener, POLLIN, 0}, {conn, POLLIN, 0}};
+			int ready = poll(fds, (conn >= 0) ? 2 : 1, 100);
+
+			if ((ready > 0) && (fds[0].revents & POLLIN)) {
+				int fd = accept(listener, nullptr, nullptr);
+				if (fd >= 0) {
+					int rcvbuf = 4 * 1024 * 1024;
+					setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+					if (conn >= 0) {
+						close(conn); // Board reconnected -- the old connection is dead
+					}
+					conn = fd;
+					pipeline.reset();
+					std::printf("connection\n");
+				}
+			}
+			if ((ready > 0) && (conn >= 0) && (fds[1].revents & (POLLIN | POLLHUP | POLLERR))) {
+				daq::Chunk *chunk = pipeline.chunk();	// Waits while every chunk is downstream: back-pressure
+				ssize_t n = recv(conn, chunk->data, daq::kChunkBytes, 0);
+
+				chunk->len = (n > 0) ? size_t(n) : 0;
+				pipeline.submit(chunk);
+				if (n <= 0) {
+					close(conn);
+					conn = -1;
+				}
+			}
+		}
+
+		auto now = Clock::now();
+		double dt = std::chrono::duration<double>(now - last_report).count();
+		if (dt >= interval) {
+			daq::IngestStats s = pipeline.stats();
+			report("      ", s, last, dt, capture.is_open());
+			if (channels) {
+				print_channels(pipeline);
+			}
+			if (config.spectra) {
+				show_spectra();
+			}
+			last = s;
+			last_report = now;
+		}
+		if ((seconds > 0.0) && (std::chrono::duration<double>(now - start).count() >= seconds)) {
+			break;
+		}
+	}
+
+	pipeline.finish();
+	report("total:", pipeline.stats(), daq::IngestStats{}, std::chrono::duration<double>(Clock::now() - start).count(),
+		capture.is_open());
+	if (config.spectra) {
+		show_spectra();
+	}
+	if (conn >= 0) {
+		close(conn);
+	}
+	if (listener >= 0) {
+		close(listener);
+	}
+	if (capture.is_open()) {
+		uint64_t rows[daq::kCaptureSeries] = {capture.rows(daq::kSeriesAdc0), capture.rows(daq::kSeriesAdc1), capture.rows(daq::kSeriesTc)};
+		uint64_t out_of_order = capture.out_of_order();
+		uint64_t restarts = capture.restarts();
+
+		if (!capture.close()) {
+			std::perror(out_path);
+			return 1;
+		}
+		std::printf("capture: %s, rows ADC0 %llu ADC1 %llu TC %llu, out of order %llu, clock restarts %llu\n", out_path,
+			(unsigned long long)rows[0], (unsigned long long)rows[1], (unsigned long long)rows[2],
+			(unsigned long long)out_of_order, (unsigned long long)restarts);
+	}
+	return 0;
+}
@@ -0,0 +1,454 @@
+/****************************************************************
+* DAQ RECEIVER
+*
+* TCP server for the board's stream (TCP_STREAMING in main.c): accepts the connection on the server port, decodes
+* every packet with the daq_stream library and reports throughput, packet counter gaps, lost conversions and the
+* latest thermocouple temperatures (* = stale: the board missed that converter's read and repeated the previous one).
+* The board reconnects after errors; a new connection replaces the old one.
+* Commands given on the command line are sent once the board has connected, and their replies are printed.
+*
+*   ./daq_receiver [--port 8080] [--seconds 0] [--interval 1] [--gaps N] [--telemetry]
+*   ./daq_receiver --reg 1:0x0E=0x48 --read 1:0x0D --streams 0x1F0F --decim 0:2 --status --deadlines --compress 1
+*   ./daq_receiver --burst level:0:0x333333:10:12      burst capture, records printed as they arrive
+*   ./daq_receiver --bench 3        decode speed on one core vs the board's data rate
+***************************************************************/
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "daq_stream.h"
+
+namespace {
+
+	constexpr size_t kRecvBuffer = 256 * 1024;
+	constexpr double kLinkBytesPerSecond = 12.5e6;	// 100 Mbit Ethernet
+
+	using Clock = std::chrono::steady_clock;
+
+	const char *const kTriggers[] = {"host", "level", "slope", "?"};	// BURST_TRIG_* (adc_burst.h)
+
+	// Keeps the latest thermocouple reading and prints the first few gaps
+	class Monitor : public daq::Handler {
+	public:
+		Monitor(unsigned gap_lines, bool telemetry) : gap_lines_(gap_lines), print_telemetry_(telemetry) {}
+
+		void on_thermocouples(const daq::TcReading &r) override {
+			tc_ = r;
+			have_tc_ = true;
+		}
+
+		void on_reply(const daq::CommandReply &r) override {
+			static const char *const results[] = {"ok", "verify failed", "refused"};
+			const char *result = (r.result <= CMD_ERR_INVALID) ? results[r.result] : "?";
+
+			std::printf("reply: command %u opcode %u %s", r.sequence, r.opcode, result);
+			for (unsigned i = 0; i < r.registers; i++) {
+				std::printf(" | ADC%u 0x%02X = 0x%02X (read 0x%02X)", r.adc, r.reg[i].addr, r.reg[i].value, r.reg[i].readback);
+			}
+			if ((r.opcode == CMD_STREAMS) && (r.length == 2)) {
+				std::printf(" | mask 0x%04X", (r.data[0] << 8) | r.data[1]);
+			}
+			if ((r.opcode == CMD_DECIMATE) && (r.length == 2)) {
+				std::printf(" | ADC%u decimation %u", r.data[0], 1U << r.data[1]);
+			}
+			if ((r.opcode == CMD_COMPRESS) && (r.length == 1)) {
+				std::printf(" | compression %s", r.data[0] ? "on" : "off");
+			}
+			if ((r.opcode == CMD_BURST) && (r.length == 11)) {
+				int32_t threshold = int32_t((uint32_t(r.data[3]) << 24) | (uint32_t(r.data[4]) << 16) | (uint32_t(r.data[5]) << 8) | r.data[6]);
+
+				std::printf(" | burst %s, trigger %s channel %u threshold %d, %u ms before %u ms after", r.data[0] ? "on" : "off",
+					kTriggers[std::min<unsigned>(r.data[1], 3)], r.data[2], threshold, (r.data[7] << 8) | r.data[8],
+					(r.data[9] << 8) | r.data[10]);
+			}
+			if ((r.opcode == CMD_TRIGGER) && (r.length == 1)) {
+				static const char *const states[] = {"off", "armed", "recording", "draining"};
+				std::printf(" | burst %s", states[r.data[0] & 3]);
+			}
+			if ((r.opcode == CMD_STATUS) && (r.length == 10)) {
+				uint32_t configured = (uint32_t(r.data[2]) << 24) | (uint32_t(r.data[3]) << 16) | (uint32_t(r.data[4]) << 8) | r.data[5];
+				uint32_t first = (uint32_t(r.data[6]) << 24) | (uint32_t(r.data[7]) << 16) | (uint32_t(r.data[8]) << 8) | r.data[9];
+
+				std::printf(" | bring-up ADC0 0x%02X ADC1 0x%02X | configured %.3f ms, first sample %.3f ms after boot",
+					r.data[0], r.data[1], configured / 1e3, first / 1e3);
+			}
+			if ((r.opcode == CMD_DEADLINES) && (r.length == 20)) {
+				uint32_t misses[5];
+
+				for (unsigned i = 0; i < 5; i++) {
+					const uint8_t *p = r.data + 4 * i;
+					misses[i] = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+				}
+				std::printf(" | deadline misses ADC0 dropped %u late %u, ADC1 dropped %u late %u, thermocouples %u",
+					misses[0], misses[1], misses[2], misses[3], misses[4]);
+			}
+			if ((r.opcode == CMD_TX_LATENCY) && (r.length == 10)) {
+				uint32_t latency = (uint32_t(r.data[0]) << 24) | (uint32_t(r.data[1]) << 16) | (uint32_t(r.data[2]) << 8) | r.data[3];
+				uint32_t rate = (uint32_t(r.data[6]) << 24) | (uint32_t(r.data[7]) << 16) | (uint32_t(r.data[8]) << 8) | r.data[9];
+
+				std::printf(" | transmit latency %u us, batch %u bytes, ACK rate %.3f MB/s", latency, (r.data[4] << 8) | r.data[5],
+					rate / 1e6);
+			}
+			std::printf("\n");
+		}
+
+		// Latencies and losses over the interval since the previous telemetry packet (the first: since boot)
+		void on_telemetry(const daq::Telemetry &t) override {
+			static const char *const names[TELEM_HISTOGRAMS] = {"DRDY->SPI", "SPI", "loop", "send", "codec",
+				"tx queue"};
+			const daq::Telemetry *prev = have_telemetry_ ? &telemetry_ : nullptr;
+
+			if (print_telemetry_) {
+				std::printf("telemetry %u: us p50/p99/max", t.sequence);
+				for (unsigned id = 0; id < TELEM_HISTOGRAMS; id++) {
+					const daq::LatencyHistogram &h = t.hist[id];
+					const daq::LatencyHistogram *earlier = prev ? &prev->hist[id] : nullptr;
+
+					std::printf(" | %s <%.3g <%.3g %.3g", names[id],
+						double(h.percentile_cycles(0.50, earlier)) / t.cycles_per_us,
+						double(h.percentile_cycles(0.99, earlier)) / t.cycles_per_us, double(h.max_cycles) / t.cycles_per_us);
+				}
+				auto delta = [&](unsigned c) { return t.counter[c] - (prev ? prev->counter[c] : 0U); };
+				uint32_t flushes = delta(TELEM_CTR_TX_FLUSHES);
+				std::printf(" | dropped %u %u overflow %u %u overrun %u %u TC missed %u reconnects %u tx dropped %u"
+					" | status faults %u %u sync %u %u | tx flushes %u mean %u bytes, %u at the deadline\n",
+					delta(TELEM_CTR_DROPPED0), delta(TELEM_CTR_DROPPED1), delta(TELEM_CTR_OVERFLOW0), delta(TELEM_CTR_OVERFLOW1),
+					delta(TELEM_CTR_OVERRUN0), delta(TELEM_CTR_OVERRUN1), delta(TELEM_CTR_TC_MISSED),
+					delta(TELEM_CTR_RECONNECTS), delta(TELEM_CTR_TX_DROPPED), delta(TELEM_CTR_STATUS0),
+					delta(TELEM_CTR_STATUS1), delta(TELEM_CTR_SYNC0), delta(TELEM_CTR_SYNC1), flushes,
+					flushes ? delta(TELEM_CTR_TX_BYTES) / flushes : 0U, delta(TELEM_CTR_TX_DEADLINE));
+			}
+			if ((!prev || (t.counter[TELEM_CTR_BOOT_SAMPLE] != prev->counter[TELEM_CTR_BOOT_SAMPLE])) &&
+				(t.counter[TELEM_CTR_BOOT_SAMPLE] != 0U)) {
+				std::printf("boot: ADCs configured at %.1f ms, first sample at %.1f ms\n",
+					t.counter[TELEM_CTR_BOOT_CONFIG] / 1e3, t.counter[TELEM_CTR_BOOT_SAMPLE] / 1e3);
+			}
+			telemetry_ = t;
+			have_telemetry_ = true;
+		}
+
+		void on_burst(const daq::BurstRecord &r) override {
+			std::printf("burst %u: %s trigger on channel %u at %.6f s, %.1f ms before %.1f ms after%s | ADC0 %u samples from %u"
+				" | ADC1 %u samples from %u\n", r.number, kTriggers[std::min<unsigned>(r.cause, 3)], r.channel,
+				r.trigger_us / 1e6, r.pre_us / 1e3, r.post_us / 1e3, r.truncated ? " (truncated)" : "", r.frames[0],
+				r.first_index[0], r.frames[1], r.first_index[1]);
+		}
+
+		void on_packet_gap(uint32_t expected, uint32_t received) override {
+			if (gap_lines_ > 0) {
+				gap_lines_--;
+				std::printf("gap: packets %u - %u missing\n", expected, received - 1U);
+			}
+		}
+
+		void on_index_gap(uint8_t adc, uint32_t expected, uint32_t received) override {
+			if (gap_lines_ > 0) {
+				gap_lines_--;
+				std::printf("gap: ADC%u conversions %u - %u missing\n", adc, expected, received - 1U);
+			}
+		}
+
+		bool have_tc() const { return have_tc_; }
+		const daq::TcReading &tc() const { return tc_; }
+
+	private:
+		unsigned gap_lines_;
+		bool print_telemetry_;
+		bool have_tc_ = false;
+		daq::TcReading tc_;
+		bool have_telemetry_ = false;
+		daq::Telemetry telemetry_;
+	};
+
+	struct Command {
+		uint8_t opcode;
+		std::vector<uint8_t> payload;
+	};
+
+	// "ADC:ADDR" or "ADC:ADDR=VALUE" (decimal or 0x hex), false if malformed
+	bool parse_register(const char *arg, bool with_value, std::vector<uint8_t> &payload) {
+		char *end;
+		unsigned long adc = std::strtoul(arg, &end, 0);
+		if (*end != ':') return false;
+		unsigned long addr = std::strtoul(end + 1, &end, 0);
+		if ((adc > 0xFF) || (addr > 0xFF)) return false;
+		payload = {uint8_t(adc), uint8_t(addr)};
+		if (!with_value) return *end == '\0';
+		if (*end != '=') return false;
+		unsigned long value = std::strtoul(end + 1, &end, 0);
+		payload.push_back(uint8_t(value));
+		return (*end == '\0') && (value <= 0xFF);
+	}
+
+	// "off" or TRIGGER:CH:THRESHOLD[:PRE:POST] -- trigger host/level/slope, mask bit, code, windows in ms
+	bool parse_burst(const char *arg, std::vector<uint8_t> &payload) {
+		std::string text = arg;
+		size_t colon = text.find(':');
+		std::string trigger = text.substr(0, colon);
+		unsigned long pre = 10, post = 12;
+		char *end;
+
+		if (text == "off") {
+			payload.assign(11, 0);
+			payload[8] = uint8_t(pre);
+			payload[10] = uint8_t(post);
+			return true;
+		}
+		uint8_t type = (trigger == "host") ? 0 : (trigger == "level") ? 1 : (trigger == "slope") ? 2 : 0xFF;
+		if ((type == 0xFF) || (colon == std::string::npos)) return false;
+		unsigned long channel = std::strtoul(arg + colon + 1, &end, 0);
+		if ((*end != ':') || (channel > 7)) return false;
+		long threshold = std::strtol(end + 1, &end, 0);
+		if (*end == ':') {
+			pre = std::strtoul(end + 1, &end, 0);
+			if (*end != ':') return false;
+			post = std::strtoul(end + 1, &end, 0);
+		}
+		if ((*end != '\0') || (pre > 0xFFFF) || (post > 0xFFFF)) return false;
+		payload = {1, type, uint8_t(channel), uint8_t(uint32_t(threshold) >> 24), uint8_t(uint32_t(threshold) >> 16),
+			uint8_t(uint32_t(threshold) >> 8), uint8_t(threshold), uint8_t(pre >> 8), uint8_t(pre), uint8_t(post >> 8), uint8_t(post)};
+		return true;
+	}
+
+	// Sends the commands in one write; replies arrive in the stream
+	void send_commands(int fd, const std::vector<Command> &commands) {
+		std::vector<uint8_t> out;
+		uint8_t cmd[CMD_MAX_SIZE];
+
+		for (size_t i = 0; i < commands.size(); i++) {
+			size_t n = daq::make_command(cmd, commands[i].opcode, uint8_t(i), commands[i].payload);
+			out.insert(out.end(), cmd, cmd + n);
+		}
+		if (!out.empty() && (send(fd, out.data(), out.size(), MSG_NOSIGNAL) != ssize_t(out.size()))) {
+			std::perror("send");
+		}
+	}
+
+	void usage(const char *name) {
+		std::printf("usage: %s [--port N] [--seconds S] [--interval S] [--gaps N] [--telemetry] [--bench S] [commands]\n"
+			"  --port N       TCP port to listen on (default 8080)\n"
+			"  --seconds S    stop after S seconds, 0 = run until interrupted (default 0)\n"
+			"  --interval S   report period (default 1)\n"
+			"  --gaps N       print the first N gaps (default 20)\n"
+			"  --telemetry    print the board's telemetry packets: latencies and losses per period\n"
+			"  --bench S      decode a synthetic stream for S seconds and report the speed, no network\n"
+			"commands, sent in order once the board connects (numbers decimal or 0x hex):\n"
+			"  --reg A:R=V    write V to register R of ADC A, restarts the ADC and reads it back\n"
+			"  --read A:R     read register R of ADC A\n"
+			"  --streams M    channel mask (PKT_CH_* in daq_packet.h)\n"
+			"  --decim A:N    decimate ADC A by 2^N (0 = full rate)\n"
+			"  --status       bring-up result and boot-to-first-sample time\n"
+			"  --deadlines    SPI deadline misses per source since boot\n"
+			"  --compress N   lossless compression of the ADC packets on (1) or off (0)\n"
+			"  --burst B      burst capture instead of streaming: off, or TRIGGER:CH:THRESHOLD[:PRE_MS:POST_MS] with\n"
+			"                 TRIGGER host/level/slope, CH the trigger channel's mask bit, THRESHOLD a 24-bit code\n"
+			"  --trigger      trigger a burst record now\n"
+			"  --tx-latency US longest a packet waits on the board for a transmit batch to fill (0 = write at once)\n", name);
+	}
+
+	void report(const char *label, const daq::StreamParser &parser, const daq::StreamStats &prev, const Monitor &monitor, double dt) {
+		const daq::StreamStats &s = parser.stats();
+		const daq::SequenceTracker &seq = parser.sequence();
+
+		std::printf("%s %7.3f MB/s %7.0f pkt/s | ADC0 %7.0f/s ADC1 %7.0f/s | packets %llu lost %llu | index gaps %llu %llu | overflow %llu %llu | malformed %llu",
+			label,
+			double(s.bytes - prev.bytes) / dt / 1e6,
+			double(s.packets - prev.packets) / dt,
+			double(s.samples[0] - prev.samples[0]) / dt,
+			double(s.samples[1] - prev.samples[1]) / dt,
+			(unsigned long long)seq.received(), (unsigned long long)seq.lost(),
+			(unsigned long long)s.index_gaps[0], (unsigned long long)s.index_gaps[1],
+			(unsigned long long)s.overflow_flags[0], (unsigned long long)s.overflow_flags[1],
+			(unsigned long long)s.malformed);
+		if ((s.missed_flags[0] | s.missed_flags[1] | s.adc_fault_flags[0] | s.adc_fault_flags[1] |
+			s.sync_flags[0] | s.sync_flags[1]) != 0) {
+			std::printf(" | flagged missed %llu %llu ADC fault %llu %llu sync %llu %llu",
+				(unsigned long long)s.missed_flags[0], (unsigned long long)s.missed_flags[1],
+				(unsigned long long)s.adc_fault_flags[0], (unsigned long long)s.adc_fault_flags[1],
+				(unsigned long long)s.sync_flags[0], (unsigned long long)s.sync_flags[1]);
+		}
+		if ((s.status_faults[0] | s.status_faults[1]) != 0) {
+			std::printf(" | status word faults %llu %llu",
+				(unsigned long long)s.status_faults[0], (unsigned long long)s.status_faults[1]);
+		}
+		if (s.compressed != 0) {
+			std::printf(" | compressed %llu (%.2fx)", (unsigned long long)s.compressed,
+				double(s.expanded_bytes) / double(s.compressed_bytes));
+		}
+		if (s.bursts != 0) {
+			std::printf(" | bursts %llu (samples %llu %llu)", (unsigned long long)s.bursts,
+				(unsigned long long)s.burst_samples[0], (unsigned long long)s.burst_samples[1]);
+		}
+		if (s.replies != prev.replies) {
+			std::printf(" | replies %llu", (unsigned long long)(s.replies - prev.replies));
+		}
+		if (monitor.have_tc()) {
+			std::printf(" | TC");
+			for (const daq::Thermocouple &t : monitor.tc().tc) {
+				if (!t.present) std::printf("    -  ");
+				else if (t.fault) std::printf("  FAULT");
+				else std::printf(" %6.2f%s", t.temperature_c, t.fresh ? "" : "*");
+			}
+		}
+		std::printf("\n");
+		std::fflush(stdout);
+	}
+
+	// Decode speed on one core, fed in recv-sized chunks that split packets like TCP does
+	int bench(double seconds) {
+		std::vector<uint8_t> stream = daq::synthetic_stream(1.0);
+		double board_bytes = double(stream.size());		// One second of board data
+		uint64_t bytes = 0;
+		uint64_t samples = 0;
+		uint64_t malformed = 0;
+		auto start = Clock::now();
+		double elapsed = 0.0;
+
+		while (elapsed < seconds) {
+			Monitor monitor(0, false);
+			daq::StreamParser parser(monitor);
+
+			for (size_t pos = 0; pos < stream.size(); pos += 65000) {
+				parser.feed(stream.data() + pos, std::min<size_t>(65000, stream.size() - pos));
+			}
+			bytes += parser.stats().bytes;
+			samples += parser.stats().samples[0] + parser.stats().samples[1];
+			malformed += parser.stats().malformed + parser.sequence().lost();
+			elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+		}
+
+		double rate = double(bytes) / elapsed;
+		std::printf("decode              %.1f MB/s, %.1f M samples/s, errors %llu\n", rate / 1e6, double(samples) / elapsed / 1e6,
+			(unsigned long long)malformed);
+		std::printf("board data rate     %.3f MB/s (2 ADCs at %.0f Hz, all channels) -> %.0fx\n", board_bytes / 1e6, daq::kBoardRateHz, rate / board_bytes);
+		std::printf("100 Mbit link       %.3f MB/s -> %.1fx\n", kLinkBytesPerSecond / 1e6, rate / kLinkBytesPerSecond);
+		return (malformed == 0) ? 0 : 1;
+	}
+
+} // namespace
+
+int main(int argc, char **argv) {
+	unsigned port = 8080;
+	double seconds = 0.0;
+	double interval = 1.0;
+	unsigned gaps = 20;
+	bool telemetry = false;
+	std::vector<Command> commands;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		std::vector<uint8_t> payload;
+		if ((arg == "--port") && (i + 1 < argc)) port = unsigned(std::atoi(argv[++i]));
+		else if ((arg == "--seconds") && (i + 1 < argc)) seconds = std::atof(argv[++i]);
+		else if ((arg == "--interval") && (i + 1 < argc)) interval = std::atof(argv[++i]);
+		else if ((arg == "--gaps") && (i + 1 < argc)) gaps = unsigned(std::atoi(argv[++i]));
+		else if (arg == "--telemetry") telemetry = true;
+		else if ((arg == "--bench") && (i + 1 < argc)) return bench(std::atof(argv[++i]));
+		else if ((arg == "--reg") && (i + 1 < argc) && parse_register(argv[++i], true, payload)) commands.push_back({CMD_REG_WRITE, payload});
+		else if ((arg == "--read") && (i + 1 < argc) && parse_register(argv[++i], false, payload)) commands.push_back({CMD_REG_READ, payload});
+		else if ((arg == "--streams") && (i + 1 < argc)) {
+			unsigned long mask = std::strtoul(argv[++i], nullptr, 0);
+			commands.push_back({CMD_STREAMS, {uint8_t(mask >> 8), uint8_t(mask)}});
+		}
+		else if ((arg == "--decim") && (i + 1 < argc) && parse_register(argv[++i], false, payload)) commands.push_back({CMD_DECIMATE, payload});
+		else if (arg == "--status") commands.push_back({CMD_STATUS, {}});
+		else if (arg == "--deadlines") commands.push_back({CMD_DEADLINES, {}});
+		else if ((arg == "--compress") && (i + 1 < argc)) commands.push_back({CMD_COMPRESS, {uint8_t(std::atoi(argv[++i]) != 0)}});
+		else if ((arg == "--burst") && (i + 1 < argc) && parse_burst(argv[++i], payload)) commands.push_back({CMD_BURST, payload});
+		else if (arg == "--trigger") commands.push_back({CMD_TRIGGER, {}});
+		else if ((arg == "--tx-latency") && (i + 1 < argc)) {
+			uint32_t us = uint32_t(std::strtoul(argv[++i], nullptr, 0));
+			commands.push_back({CMD_TX_LATENCY, {uint8_t(us >> 24), uint8_t(us >> 16), uint8_t(us >> 8), uint8_t(us)}});
+		}
+		else { usage(argv[0]); return (arg == "--help") ? 0 : 1; }
+	}
+
+	int listener = socket(AF_INET, SOCK_STREAM, 0);
+	if (listener < 0) {
+		std::perror("socket");
+		return 1;
+	}
+	int on = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	sockaddr_in addr{};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(uint16_t(port));
+	if ((bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) || (listen(listener, 4) < 0)) {
+		std::perror("bind");
+		return 1;
+	}
+
+	Monitor monitor(gaps, telemetry);
+	daq::StreamParser parser(monitor);
+	daq::StreamStats last;
+	std::unique_ptr<uint8_t[]> buffer(new uint8_t[kRecvBuffer]);
+	int conn = -1;
+	unsigned connections = 0;
+	auto start = Clock::now();
+	auto last_report = start;
+
+	for (;;) {
+		pollfd fds[2] = {{listener, POLLIN, 0}, {conn, POLLIN, 0}};
+		int ready = poll(fds, (conn >= 0) ? 2 : 1, 100);
+
+		if ((ready > 0) && (fds[0].revents & POLLIN)) {
+			int fd = accept(listener, nullptr, nullptr);
+			if (fd >= 0) {
+				int rcvbuf = 4 * 1024 * 1024;
+				setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+				if (conn >= 0) {
+					close(conn); // Board reconnected -- the old connection is dead
+				}
+				conn = fd;
+				connections++;
+				parser.reset();
+				std::printf("connection %u\n", connections);
+				if (connections == 1) {
+					send_commands(conn, commands); // Settings stay on the board across reconnects
+				}
+			}
+		}
+		if ((ready > 0) && (conn >= 0) && (fds[1].revents & (POLLIN | POLLHUP | POLLERR))) {
+			ssize_t n = recv(conn, buffer.get(), kRecvBuffer, 0);
+			if (n > 0) {
+				parser.feed(buffer.get(), size_t(n));
+			}
+			else {
+				close(conn);
+				conn = -1;
+			}
+		}
+
+		auto now = Clock::now();
+		double dt = std::chrono::duration<double>(now - last_report).count();
+		if (dt >= interval) {
+			report("      ", parser, last, monitor, dt);
+			last = parser.stats();
+			last_report = now;
+		}
+		if ((seconds > 0.0) && (std::chrono::duration<double>(now - start).count() >= seconds)) {
+			break;
+		}
+	}
+
+	report("total:", parser, daq::StreamStats{}, monitor, std::chrono::duration<double>(Clock::now() - start).count());
+	if (conn >= 0) {
+		close(conn);
+	}
+	close(listener);
+	return 0;
+}
@@ -0,0 +1,747 @@
+/****************************************************************
+* DAQ REPLAY
+*
+* Records the board's stream and plays it back at a multiple of real time, from many virtual boards at once, to load
+* test a receiver (daq_aggregator, daq_ingest, udp_receiver, ...) on loopback or another host.
+*
+* --record: the server the board streams to (TCP_STREAMING, or UDP_STREAMING with --udp). Every recv / datagram is
+* written with its receive time:
+*
+*   file header (magic "DAQREC1", version, transport) | (receive time us, length, bytes) x n
+*
+* --replay FILE / --synthetic S: the recording (packets framed again, each timed by the recv that completed it) or
+* S seconds of daq::synthetic_stream (timed by the packet times) is sent by --boards N virtual boards, each a
+* connection of its own with device id --device + board. A board continues its stream across loops of the source --
+* packet counter, first index and time are rewritten -- so receivers see one unbroken stream per board.
+*
+* Timing: --speed X sends at X times the recorded rate (1 = as recorded), 0 as fast as the connection takes it.
+* A virtual board behaves like the firmware when the receiver falls behind: TCP packets go into a transmit queue the
+* size of the board's (TX_QUEUE_PACKETS packets plus the lwIP send buffer) that the socket drains, and are dropped
+* (and counted, the packet counter still advancing) when it is full -- the host's own socket buffer adds slack, so
+* a receiver shows up once it falls behind for longer than a moment; UDP datagrams are packed up to UDP_PAYLOAD_MAX and never wait, the receiving
+* socket's overflows are read from the kernel (Udp RcvbufErrors). --ramp doubles the speed every --step seconds until
+* something is dropped and reports the last speed the receiver kept up with.
+*
+*   ./daq_replay --record FILE [--port 8080] [--udp] [--seconds 0]
+*   ./daq_replay --replay FILE [--host 127.0.0.1] [--port 8080] [--udp] [--boards 1] [--speed 1] [--seconds 10]
+*   ./daq_replay --synthetic 2 --boards 8 --ramp [--step 3]
+***************************************************************/
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "daq_stream.h"
+
+namespace {
+
+	using Clock = std::chrono::steady_clock;
+
+	constexpr size_t kDatagramPayload = 1472;					// UDP_PAYLOAD_MAX in main.c
+	constexpr size_t kBoardQueue = 16 * PACKET_MAX_SIZE + 5840;	// TX_QUEUE_PACKETS in main.c + lwIP TCP_SND_BUF
+	constexpr int64_t kSleepUs = 200;							// Packets due sooner than this are sent now
+	constexpr size_t kRecvBuffer = 64 * 1024;
+
+	constexpr char kRecordMagic[8] = "DAQREC1";
+
+	struct RecordHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t transport;				// 0 TCP stream, 1 UDP datagrams
+		uint64_t reserved;
+	};
+
+	struct RecordEntry {
+		uint64_t time_us;				// Since the recording started
+		uint32_t len;
+		uint32_t reserved;
+	};
+
+	// Sources whose index and time continue across loops of the replay
+	enum Source { kSourceAdc0, kSourceAdc1, kSourceTc, kSources, kSourceOther = kSources };
+
+	struct Packet {
+		size_t offset;
+		uint16_t len;
+		uint8_t source;
+		uint64_t time_us;				// Send time, since the first packet
+	};
+
+	// Packets to send, and how one loop of them advances every board's stream
+	struct Replay {
+		std::vector<uint8_t> bytes;
+		std::vector<Packet> packets;
+		uint64_t duration_us = 0;		// Send time of one loop
+		uint64_t board_span_us = 0;		// Board time of one loop
+		uint32_t index_step[kSources] = {};
+		uint64_t bytes_per_loop = 0;
+	};
+
+	uint8_t source_of(const daq_header_t &h) {
+		if ((h.type != PKT_TYPE_SAMPLES) && (h.type != PKT_TYPE_COMPRESSED)) {
+			return kSourceOther;
+		}
+		if (h.mask & PKT_CH_ADC(0)) {
+			return kSourceAdc0;
+		}
+		if (h.mask & PKT_CH_ADC(1)) {
+			return kSourceAdc1;
+		}
+		return (h.mask & PKT_CH_TC) ? kSourceTc : kSourceOther;
+	}
+
+	// Frames the packets of data (a stream or one datagram), each sent at time_us; skips bytes that are no packet
+	void frame(Replay &r, const uint8_t *data, size_t len, uint64_t time_us, std::vector<uint8_t> &pending) {
+		pending.insert(pending.end(), data, data + len);
+		size_t used = 0;
+
+		while (used < pending.size()) {
+			daq_header_t h;
+			int32_t size = daq_get_header(pending.data() + used, uint32_t(pending.size() - used), &h);
+
+			if (size == 0) {
+				break;
+			}
+			if (size < 0) {
+				used++;
+				continue;
+			}
+			r.packets.push_back({r.bytes.size(), uint16_t(size), source_of(h), time_us});
+			r.bytes.insert(r.bytes.end(), pending.begin() + long(used), pending.begin() + long(used) + size);
+			used += size_t(size);
+		}
+		pending.erase(pending.begin(), pending.begin() + long(used));
+	}
+
+	// Loop length in send time, board time and indices
+	void finish(Replay &r) {
+		uint64_t first = r.packets.front().time_us;
+		uint64_t last = r.packets.back().time_us;
+		size_t n = r.packets.size();
+		uint32_t first_index[kSources] = {}, end_index[kSources] = {};
+		uint64_t first_board = UINT64_MAX, last_board = 0;
+		bool seen[kSources] = {};
+		uint8_t adc_decim = 0;
+
+		for (Packet &p : r.packets) {
+			daq_header_t h;
+			daq_get_header(r.bytes.data() + p.offset, p.len, &h);
+			p.time_us -= first;
+			r.bytes_per_loop += p.len;
+			if (p.source == kSourceOther) {
+				continue;
+			}
+			if (!seen[p.source]) {
+				first_index[p.source] = h.index;
+				seen[p.source] = true;
+			}
+			end_index[p.source] = h.index + ((p.source == kSourceTc) ? 1U : h.count);
+			if (p.source != kSourceTc) {
+				adc_decim = h.decim;
+			}
+			first_board = std::min(first_board, h.time_us);
+			last_board = std::max(last_board, h.time_us);
+		}
+		for (unsigned s = 0; s < kSources; s++) {
+			r.index_step[s] = end_index[s] - first_index[s];
+		}
+		// A loop lasts as long as the board took to convert it; without ADC packets, one packet spacing longer than
+		// first to last
+		unsigned adc = seen[kSourceAdc0] ? kSourceAdc0 : kSourceAdc1;
+		if (seen[adc]) {
+			r.board_span_us = uint64_t(double(r.index_step[adc]) * double(1U << adc_decim) * 1e6 / daq::kBoardRateHz + 0.5);
+		}
+		else if (last_board > first_board) {
+			r.board_span_us = (last_board - first_board) * n / (n - 1);
+		}
+		r.duration_us = r.board_span_us ? std::max(r.board_span_us, last - first) : ((n > 1) ? (last - first) * n / (n - 1) : 1000);
+	}
+
+	bool load_recording(const char *path, Replay &r) {
+		FILE *f = std::fopen(path, "rb");
+		if (!f) {
+			std::perror(path);
+			return false;
+		}
+		RecordHeader h;
+		if ((std::fread(&h, sizeof(h), 1, f) != 1) || (std::memcmp(h.magic, kRecordMagic, sizeof(h.magic)) != 0)) {
+			std::fprintf(stderr, "%s: not a recording\n", path);
+			std::fclose(f);
+			return false;
+		}
+		RecordEntry e;
+		std::vector<uint8_t> data, pending;
+		while (std::fread(&e, sizeof(e), 1, f) == 1) {
+			data.resize(e.len);
+			if (std::fread(data.data(), 1, e.len, f) != e.len) {
+				break; // Cut short
+			}
+			if (h.transport == 1) {
+				pending.clear(); // A datagram holds whole packets
+			}
+			frame(r, data.data(), data.size(), e.time_us, pending);
+		}
+		std::fclose(f);
+		if (r.packets.empty()) {
+			std::fprintf(stderr, "%s: no packets\n", path);
+			return false;
+		}
+		finish(r);
+		return true;
+	}
+
+	// Synthetic packets are sent at their own time
+	void load_synthetic(double seconds, Replay &r) {
+		std::vector<uint8_t> stream = daq::synthetic_stream(seconds), pending;
+		size_t used = 0;
+
+		while (used < stream.size()) {
+			daq_header_t h;
+			int32_t size = daq_get_header(stream.data() + used, uint32_t(stream.size() - used), &h);
+			if (size <= 0) {
+				break;
+			}
+			frame(r, stream.data() + used, size_t(size), h.time_us, pending);
+			used += size_t(size);
+		}
+		finish(r);
+	}
+
+	// Kernel count of UDP datagrams dropped for a full receive buffer (all sockets of this host)
+	uint64_t udp_rcvbuf_errors() {
+		std::ifstream snmp("/proc/net/snmp");
+		std::string names, values;
+
+		while (std::getline(snmp, names) && std::getline(snmp, values)) {
+			if (names.compare(0, 4, "Udp:") != 0) {
+				continue;
+			}
+			std::istringstream n(names), v(values);
+			std::string name, value;
+			while ((n >> name) && (v >> value)) {
+				if (name == "RcvbufErrors") {
+					return std::strtoull(value.c_str(), nullptr, 10);
+				}
+			}
+		}
+		return 0;
+	}
+
+	struct Options {
+		std::string host = "127.0.0.1";
+		unsigned port = 8080;
+		bool udp = false;
+		unsigned boards = 1;
+		unsigned device = 0;
+		double speed = 1.0;
+		double seconds = 0.0;
+		double interval = 1.0;
+		bool ramp = false;
+		double step = 3.0;
+		double max_speed = 4096.0;
+	};
+
+	// Counted by the boards, read by the report
+	struct BoardStats {
+		std::atomic<uint64_t> due_bytes{0};			// Of every packet whose time came, sent or dropped
+		std::atomic<uint64_t> sent_bytes{0};
+		std::atomic<uint64_t> sent_packets{0};
+		std::atomic<uint64_t> dropped_packets{0};	// Transmit queue full
+		std::atomic<uint64_t> send_errors{0};		// UDP datagrams the host's own stack refused
+		std::atomic<int64_t> max_late_us{0};		// Behind schedule -- the replay host itself not keeping up
+		std::atomic<bool> closed{false};
+	};
+
+	// Shared by the boards: speed changes start a new schedule from where each board is
+	struct Control {
+		std::atomic<bool> stop{false};
+		std::atomic<unsigned> generation{0};
+		std::atomic<double> speed{1.0};
+	};
+
+	void note_late(BoardStats &s, int64_t late_us) {
+		int64_t seen = s.max_late_us.load(std::memory_order_relaxed);
+		while ((late_us > seen) && !s.max_late_us.compare_exchange_weak(seen, late_us, std::memory_order_relaxed)) {
+		}
+	}
+
+	int connect_board(const Options &o) {
+		int fd = socket(AF_INET, o.udp ? SOCK_DGRAM : SOCK_STREAM, 0);
+		sockaddr_in addr{};
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(uint16_t(o.port));
+		if ((fd < 0) || (inet_pton(AF_INET, o.host.c_str(), &addr.sin_addr) != 1) ||
+			(connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0)) {
+			std::perror("virtual board: connect");
+			if (fd >= 0) {
+				close(fd);
+			}
+			return -1;
+		}
+		if (!o.udp) {
+			int on = 1;
+			setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));	// As the firmware (tcp_nagle_disable)
+		}
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+		return fd;
+	}
+
+	// One virtual board: the replay with its own device id, counters and schedule
+	void run_board(const Replay &r, const Options &o, unsigned board, BoardStats &stats, Control &control) {
+		int fd = connect_board(o);
+		if (fd < 0) {
+			stats.closed = true;
+			return;
+		}
+
+		std::vector<uint8_t> queue;			// TCP: transmit queue, UDP: datagram being filled
+		size_t queued = 0;					// TCP: bytes of queue already written
+		uint32_t packet_count = 0;
+		uint64_t loop = 0;
+		size_t next = 0;
+		unsigned generation = ~0U;
+		double speed = 0.0;
+		Clock::time_point anchor;
+		uint64_t anchor_us = 0;				// Replay time at anchor
+
+		queue.reserve(std::max(kBoardQueue, kDatagramPayload));
+
+		// Writes what the socket takes; false once the connection is gone
+		auto flush = [&]() {
+			if (o.udp) {
+				if (!queue.empty()) {
+					if (send(fd, queue.data(), queue.size(), 0) < 0) {
+						stats.send_errors++;
+					}
+					else {
+						stats.sent_bytes += queue.size();
+					}
+					queue.clear();
+				}
+				return true;
+			}
+			while (queued < queue.size()) {
+				ssize_t n = send(fd, queue.data() + queued, queue.size() - queued, MSG_NOSIGNAL);
+				if (n < 0) {
+					return (errno == EAGAIN) || (errno == EWOULDBLOCK);
+				}
+				queued += size_t(n);
+				stats.sent_bytes += size_t(n);
+			}
+			queue.clear();
+			queued = 0;
+			return true;
+		};
+
+		while (!control.stop) {
+			if (control.generation != generation) {
+				generation = control.generation;
+				speed = control.speed;
+				anchor = Clock::now();
+				anchor_us = loop * r.duration_us + r.packets[next].time_us;
+			}
+			const Packet &p = r.packets[next];
+			uint64_t at_us = loop * r.duration_us + p.time_us;
+
+			if (speed > 0.0) {
+				auto due = anchor + std::chrono::microseconds(int64_t(double(at_us - anchor_us) / speed));
+				int64_t wait_us = std::chrono::duration_cast<std::chrono::microseconds>(due - Clock::now()).count();
+
+				if (wait_us > kSleepUs) {
+					// Nothing due: push out what is queued (UDP: the datagram, as the firmware's timer tick does)
+					if (!flush()) {
+						break;
+					}
+					pollfd pfd = {fd, POLLOUT, 0};
+					if (!queue.empty()) {
+						poll(&pfd, 1, int(std::min<int64_t>(wait_us / 1000, 10)));
+					}
+					else {
+						std::this_thread::sleep_for(std::chrono::microseconds(std::min<int64_t>(wait_us, 10000)));
+					}
+					continue;
+				}
+				note_late(stats, -wait_us);
+			}
+
+			// The packet as this board sends it
+			uint8_t packet[PACKET_MAX_SIZE];
+			std::memcpy(packet, r.bytes.data() + p.offset, p.len);
+			daq_put_device(packet, uint8_t(o.device + board));
+			daq_put_packet(packet, packet_count++);
+			if (p.source != kSourceOther) {
+				daq_put_index(packet, daq_get_index(packet) + uint32_t(loop * r.index_step[p.source]));
+				daq_put_time_us(packet, daq_get_time_us(packet) + loop * r.board_span_us);
+			}
+			stats.due_bytes += p.len;
+
+			if (o.udp) {
+				if (queue.size() + p.len > kDatagramPayload) {
+					flush();
+				}
+				queue.insert(queue.end(), packet, packet + p.len);
+				stats.sent_packets++;
+			}
+			else {
+				if ((speed <= 0.0) && (queue.size() - queued + p.len > kBoardQueue)) {
+					// Flat out: wait for the socket instead of dropping
+					while (!control.stop && (queue.size() - queued + p.len > kBoardQueue)) {
+						pollfd pfd = {fd, POLLOUT, 0};
+						poll(&pfd, 1, 10);
+						if (!flush()) {
+							break;
+						}
+					}
+				}
+				if (queued != 0) {
+					queue.erase(queue.begin(), queue.begin() + long(queued)); // Written bytes leave the queue
+					queued = 0;
+				}
+				if (queue.size() + p.len <= kBoardQueue) {
+					queue.insert(queue.end(), packet, packet + p.len);
+					stats.sent_packets++;
+				}
+				else {
+					stats.dropped_packets++; // Receiver not keeping up -- queue full
+				}
+				if ((queue.size() - queued >= 1400) && !flush()) {	// About a segment, as the board batches (tx_batch.h)
+					break;
+				}
+			}
+
+			if (++next == r.packets.size()) {
+				next = 0;
+				loop++;
+			}
+		}
+		if (!control.stop) {
+			std::fprintf(stderr, "virtual board %u: connection lost\n", board);
+		}
+		stats.closed = true;
+		close(fd);
+	}
+
+	struct Totals {
+		uint64_t due_bytes = 0;
+		uint64_t sent_bytes = 0;
+		uint64_t sent_packets = 0;
+		uint64_t dropped_packets = 0;
+		uint64_t send_errors = 0;
+		uint64_t rcvbuf_errors = 0;
+		int64_t max_late_us = 0;			// Since the previous call (reset)
+		unsigned closed = 0;
+	};
+
+	Totals totals_of(std::vector<std::unique_ptr<BoardStats>> &stats) {
+		Totals t;
+		for (auto &s : stats) {
+			t.due_bytes += s->due_bytes;
+			t.sent_bytes += s->sent_bytes;
+			t.sent_packets += s->sent_packets;
+			t.dropped_packets += s->dropped_packets;
+			t.send_errors += s->send_errors;
+			t.max_late_us = std::max<int64_t>(t.max_late_us, s->max_late_us.exchange(0));
+			t.closed += s->closed ? 1U : 0U;
+		}
+		t.rcvbuf_errors = udp_rcvbuf_errors();
+		return t;
+	}
+
+	// Receiver-side losses in a span: board queue drops (TCP), socket overflows (UDP), or boards whose connection the
+	// receiver closed -- each of those loses the rest of its stream
+	uint64_t losses(const Totals &now, const Totals &prev) {
+		return (now.dropped_packets - prev.dropped_packets) + (now.rcvbuf_errors - prev.rcvbuf_errors) +
+			(now.send_errors - prev.send_errors) + (now.closed - prev.closed);
+	}
+
+	void report(const char *label, const Totals &now, const Totals &prev, double dt) {
+		std::printf("%s due %8.3f MB/s sent %8.3f MB/s %9.0f packets/s | dropped %llu packets (board queue) | "
+			"UDP rcvbuf errors %llu send errors %llu | late max %.1f ms\n", label,
+			double(now.due_bytes - prev.due_bytes) / dt / 1e6, double(now.sent_bytes - prev.sent_bytes) / dt / 1e6,
+			double(now.sent_packets - prev.sent_packets) / dt, (unsigned long long)(now.dropped_packets - prev.dropped_packets),
+			(unsigned long long)(now.rcvbuf_errors - prev.rcvbuf_errors), (unsigned long long)(now.send_errors - prev.send_errors),
+			double(now.max_late_us) / 1000.0);
+		std::fflush(stdout);
+	}
+
+	// Recording: the board's server, every recv / datagram written with its receive time
+	int record(const char *path, const Options &o) {
+		int listener = socket(AF_INET, o.udp ? SOCK_DGRAM : SOCK_STREAM, 0);
+		if (listener < 0) {
+			std::perror("socket");
+			return 1;
+		}
+		int on = 1;
+		setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+		int rcvbuf = 4 * 1024 * 1024;
+		setsockopt(listener, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+		sockaddr_in addr{};
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_ANY);
+		addr.sin_port = htons(uint16_t(o.port));
+		if ((bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) || (!o.udp && (listen(listener, 1) < 0))) {
+			std::perror("bind");
+			return 1;
+		}
+
+		FILE *out = std::fopen(path, "wb");
+		if (!out) {
+			std::perror(path);
+			return 1;
+		}
+		RecordHeader h{};
+		std::memcpy(h.magic, kRecordMagic, sizeof(h.magic));
+		h.version = 1;
+		h.transport = o.udp ? 1 : 0;
+		std::fwrite(&h, sizeof(h), 1, out);
+
+		std::vector<uint8_t> buffer(kRecvBuffer);
+		int fd = o.udp ? listener : -1;
+		uint64_t records = 0, bytes = 0;
+		auto start = Clock::now();
+		bool started = false;
+
+		std::printf("recording %s on port %u\n", o.udp ? "datagrams" : "the TCP stream", o.port);
+		std::fflush(stdout);
+		for (;;) {
+			auto now = Clock::now();
+			if ((o.seconds > 0.0) && started && (std::chrono::duration<double>(now - start).count() >= o.seconds)) {
+				break;
+			}
+			if (fd < 0) {
+				pollfd p = {listener, POLLIN, 0};
+				if ((poll(&p, 1, 100) > 0) && ((fd = accept(listener, nullptr, nullptr)) >= 0)) {
+					setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+					std::printf("connection\n");
+				}
+				continue;
+			}
+			pollfd p = {fd, POLLIN, 0};
+			if (poll(&p, 1, 100) <= 0) {
+				continue;
+			}
+			ssize_t n = recv(fd, buffer.data(), buffer.size(), 0);
+			if (n <= 0) {
+				if (!o.udp) {
+					break; // The board closed: a recording is one connection
+				}
+				continue;
+			}
+			now = Clock::now();
+			if (!started) {
+				start = now; // Times count from the first data
+				started = true;
+			}
+			RecordEntry e{};
+			e.time_us = uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(now - start).count());
+			e.len = uint32_t(n);
+			std::fwrite(&e, sizeof(e), 1, out);
+			std::fwrite(buffer.data(), 1, size_t(n), out);
+			records++;
+			bytes += uint64_t(n);
+		}
+		if ((fd >= 0) && (fd != listener)) {
+			close(fd);
+		}
+		close(listener);
+		if (std::fclose(out) != 0) {
+			std::perror(path);
+			return 1;
+		}
+		std::printf("%s: %llu %s, %.3f MB in %.1f s\n", path, (unsigned long long)records, o.udp ? "datagrams" : "reads",
+			double(bytes) / 1e6, std::chrono::duration<double>(Clock::now() - start).count());
+		return 0;
+	}
+
+	void usage(const char *name) {
+		std::printf("usage: %s --record FILE [--port N] [--udp] [--seconds S]\n"
+			"       %s --replay FILE | --synthetic S  [--host ADDR] [--port N] [--udp] [--boards N] [--device D]\n"
+			"          [--speed X] [--seconds S] [--interval S] [--ramp [--step S] [--max-speed X]]\n"
+			"  --record FILE    be the board's server and record its stream with receive times\n"
+			"  --replay FILE    send a recording\n"
+			"  --synthetic S    send S seconds of synthetic full-rate ADC packets with thermocouple cycles\n"
+			"  --host ADDR      receiver address (default 127.0.0.1)\n"
+			"  --port N         server port (default 8080)\n"
+			"  --udp            datagrams instead of the TCP stream (UDP_STREAMING)\n"
+			"  --boards N       virtual boards, one connection each (default 1)\n"
+			"  --device D       device id of the first board, the others count up (default 0)\n"
+			"  --speed X        times the recorded rate, 0 = as fast as the connections take it (default 1)\n"
+			"  --seconds S      stop after S seconds (default: record until the board disconnects, replay 10)\n"
+			"  --interval S     report period (default 1)\n"
+			"  --ramp           double the speed every --step seconds until the receiver drops\n"
+			"  --step S         seconds per ramp step (default 3)\n"
+			"  --max-speed X    ramp limit (default 4096)\n", name, name);
+	}
+
+} // namespace
+
+int main(int argc, char **argv) {
+	Options o;
+	const char *record_path = nullptr;
+	const char *replay_path = nullptr;
+	double synthetic = 0.0;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if ((arg == "--record") && (i + 1 < argc)) record_path = argv[++i];
+		else if ((arg == "--replay") && (i + 1 < argc)) replay_path = argv[++i];
+		else if ((arg == "--synthetic") && (i + 1 < argc)) synthetic = std::atof(argv[++i]);
+		else if ((arg == "--host") && (i + 1 < argc)) o.host = argv[++i];
+		else if ((arg == "--port") && (i + 1 < argc)) o.port = unsigned(std::atoi(argv[++i]));
+		else if (arg == "--udp") o.udp = true;
+		else if ((arg == "--boards") && (i + 1 < argc)) o.boards = unsigned(std::atoi(argv[++i]));
+		else if ((arg == "--device") && (i + 1 < argc)) o.device = unsigned(std::atoi(argv[++i]));
+		else if ((arg == "--speed") && (i + 1 < argc)) o.speed = std::atof(argv[++i]);
+		else if ((arg == "--seconds") && (i + 1 < argc)) o.seconds = std::atof(argv[++i]);
+		else if ((arg == "--interval") && (i + 1 < argc)) o.interval = std::atof(argv[++i]);
+		else if (arg == "--ramp") o.ramp = true;
+		else if ((arg == "--step") && (i + 1 < argc)) o.step = std::atof(argv[++i]);
+		else if ((arg == "--max-speed") && (i + 1 < argc)) o.max_speed = std::atof(argv[++i]);
+		else { usage(argv[0]); return (arg == "--help") ? 0 : 1; }
+	}
+	if (record_path) {
+		return record(record_path, o);
+	}
+	if (!replay_path && (synthetic <= 0.0)) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	Replay r;
+	if (replay_path ? !load_recording(replay_path, r) : (load_synthetic(synthetic, r), false)) {
+		return 1;
+	}
+	if (o.boards == 0) {
+		o.boards = 1;
+	}
+	if (o.ramp && (o.speed <= 0.0)) {
+		o.speed = 1.0;
+	}
+	if ((o.seconds <= 0.0) && !o.ramp) {
+		o.seconds = 10.0;
+	}
+	double loop_rate = double(r.bytes_per_loop) / (double(r.duration_us) / 1e6);
+	std::printf("%zu packets, %.3f MB per loop of %.3f s (%.3f MB/s per board as recorded), %u board%s over %s to %s:%u\n",
+		r.packets.size(), double(r.bytes_per_loop) / 1e6, double(r.duration_us) / 1e6, loop_rate / 1e6, o.boards,
+		(o.boards == 1) ? "" : "s", o.udp ? "UDP" : "TCP", o.host.c_str(), o.port);
+	std::fflush(stdout);
+
+	Control control;
+	control.speed = o.speed;
+	std::vector<std::unique_ptr<BoardStats>> stats;
+	std::vector<std::thread> boards;
+	for (unsigned b = 0; b < o.boards; b++) {
+		stats.push_back(std::make_unique<BoardStats>());
+	}
+	for (unsigned b = 0; b < o.boards; b++) {
+		boards.emplace_back(run_board, std::cref(r), std::cref(o), b, std::ref(*stats[b]), std::ref(control));
+	}
+
+	Totals first = totals_of(stats);		// The kernel's UDP counter runs since boot
+	Totals last = first, step_start = first;
+	auto start = Clock::now();
+	auto last_report = start, step_time = start;
+	int64_t worst_late_us = 0;
+	double kept_up = 0.0;		// Ramp: fastest step without losses
+	double dropped_at = 0.0;
+	int status = 0;
+
+	while (true) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		auto now = Clock::now();
+		double dt = std::chrono::duration<double>(now - last_report).count();
+
+		if (dt >= o.interval) {
+			Totals t = totals_of(stats);
+			char label[32];
+			std::snprintf(label, sizeof(label), "%7.5gx", control.speed.load());
+			report(label, t, last, dt);
+			worst_late_us = std::max(worst_late_us, t.max_late_us);
+			last = t;
+			last_report = now;
+			if (t.closed == o.boards) {
+				std::printf("all boards disconnected\n");
+				if (o.ramp) {
+					dropped_at = control.speed; // The receiver closed them during this step
+				}
+				status = 1;
+				break;
+			}
+		}
+		if (o.ramp && (std::chrono::duration<double>(now - step_time).count() >= o.step)) {
+			Totals t = totals_of(stats);
+			worst_late_us = std::max(worst_late_us, t.max_late_us);
+			double speed = control.speed;
+			double span = std::chrono::duration<double>(now - step_time).count();
+			double due = double(t.due_bytes - step_start.due_bytes) / span;
+			double sent = double(t.sent_bytes - step_start.sent_bytes) / span;
+
+			std::printf("step %gx: %u boards x %.3f MB/s due %.3f MB/s, sent %.3f MB/s, losses %llu (connections lost %u), "
+				"late max %.1f ms\n", speed, o.boards, loop_rate * speed / 1e6, due / 1e6, sent / 1e6,
+				(unsigned long long)losses(t, step_start), t.closed - step_start.closed, double(t.max_late_us) / 1000.0);
+			if (losses(t, step_start) != 0) {
+				dropped_at = speed;
+				break;
+			}
+			if (double(t.max_late_us) > 0.5e6 * o.step || sent < 0.9 * double(o.boards) * loop_rate * speed) {
+				std::printf("the replay itself fell behind at %gx -- this host cannot load the receiver harder\n", speed);
+				kept_up = speed;
+				break;
+			}
+			kept_up = speed;
+			if (speed * 2.0 > o.max_speed) {
+				break;
+			}
+			control.speed = speed * 2.0;
+			control.generation++;
+			step_start = totals_of(stats);
+			step_time = Clock::now();
+		}
+		if ((o.seconds > 0.0) && (std::chrono::duration<double>(now - start).count() >= o.seconds)) {
+			break;
+		}
+	}
+
+	control.stop = true;
+	for (std::thread &t : boards) {
+		t.join();
+	}
+	Totals t = totals_of(stats);
+	t.max_late_us = std::max(t.max_late_us, worst_late_us);
+	report("total:  ", t, first, std::chrono::duration<double>(Clock::now() - start).count());
+	if (o.ramp) {
+		if (kept_up > 0.0) {
+			std::printf("receiver kept up with %u board%s at %gx (%.3f MB/s)", o.boards, (o.boards == 1) ? "" : "s", kept_up,
+				double(o.boards) * loop_rate * kept_up / 1e6);
+		}
+		else {
+			std::printf("receiver dropped from the first step");
+		}
+		if (dropped_at > 0.0) {
+			std::printf(", drops from %gx (%.3f MB/s)\n", dropped_at, double(o.boards) * loop_rate * dropped_at / 1e6);
+		}
+		else {
+			std::printf(", no drops up to the limit\n");
+		}
+	}
+	return status;
+}
@@ -0,0 +1,497 @@
+/****************************************************************
+* DAQ STREAM DECODER (host library) -- see daq_stream.h
+***************************************************************/
+#include "daq_stream.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace daq {
+
+	const char *const kChannelNames[PKT_CH_COUNT] = {
+		"IEPE0", "IEPE1", "IEPE2", "IEPE3",
+		"FB0", "FB1", "CL0", "CL1",
+		"TC0", "TC1", "TC2", "TC3",
+		"STATUS"
+	};
+
+	namespace {
+
+		inline uint32_t get_u24(const uint8_t *p) {
+			return (uint32_t(p[0]) << 16) | (uint32_t(p[1]) << 8) | uint32_t(p[2]);
+		}
+
+		inline uint32_t get_u32(const uint8_t *p) {
+			return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+		}
+
+		// ADC the mask belongs to, -1 if it is a thermocouple packet, -2 if it mixes sources
+		int source_of(uint16_t mask) {
+			bool adc0 = (mask & PKT_CH_ADC(0)) != 0;
+			bool adc1 = (mask & PKT_CH_ADC(1)) != 0;
+			bool tc = (mask & PKT_CH_TC) != 0;
+
+			if (adc0 + adc1 + tc != 1) {
+				return -2;
+			}
+			if (tc) {
+				return (mask & PKT_CH_STATUS) ? -2 : -1;
+			}
+			return adc0 ? 0 : 1;
+		}
+
+	} // namespace
+
+
+	// MAX31855: 31:18 thermocouple (signed, 0.25C), 16 fault, 15:4 internal (signed, 0.0625C), 2:0 SCV/SCG/OC
+	Thermocouple decode_max31855(uint32_t raw) {
+		Thermocouple t;
+
+		t.present = true;
+		t.raw = raw;
+		t.temperature_c = double(int32_t(raw) >> 18) * 0.25;
+		t.internal_c = double(int32_t(raw << 16) >> 20) * 0.0625;
+		t.fault = (raw & 0x00010000U) != 0;
+		t.short_vcc = (raw & 0x4U) != 0;
+		t.short_gnd = (raw & 0x2U) != 0;
+		t.open_circuit = (raw & 0x1U) != 0;
+		return t;
+	}
+
+	// 24-bit status word: 23:16 0x22 (status response), 15:8 STAT_1, 7:0 zero
+	AdcStatus decode_adc_status(uint32_t word) {
+		AdcStatus s;
+
+		s.sync = ((word >> 16) & 0xFFU) == 0x22U;
+		if (s.sync) {
+			s.stat1 = uint8_t(word >> 8);
+			s.f_check = (s.stat1 & 0x01U) != 0;
+			s.f_drdy = (s.stat1 & 0x02U) != 0;
+			s.f_resync = (s.stat1 & 0x04U) != 0;
+			s.f_wdt = (s.stat1 & 0x08U) != 0;
+			s.f_adcin = (s.stat1 & 0x10U) != 0;
+			s.f_spi = (s.stat1 & 0x20U) != 0;
+			s.f_opc = (s.stat1 & 0x40U) != 0;
+		}
+		return s;
+	}
+
+
+	uint32_t SequenceTracker::add(uint32_t seq) {
+		received_++;
+		if (!started_) {
+			started_ = true;
+			highest_ = seq;
+			seen_.set(seq % kWindow);
+			return 0;
+		}
+
+		int32_t ahead = int32_t(seq - highest_);
+		if (ahead > 0) {
+			for (uint32_t s = highest_ + 1; s != seq; s++) {
+				seen_.reset(s % kWindow);
+			}
+			seen_.set(seq % kWindow);
+			lost_ += uint64_t(ahead - 1);
+			highest_ = seq;
+			return uint32_t(ahead - 1);
+		}
+		if ((-ahead < int32_t(kWindow)) && seen_.test(seq % kWindow)) {
+			duplicates_++;
+			return 0;
+		}
+		if (-ahead < int32_t(kWindow)) {
+			seen_.set(seq % kWindow);
+		}
+		reordered_++;
+		if (lost_ > 0) {
+			lost_--;
+		}
+		return 0;
+	}
+
+
+	size_t make_command(uint8_t *out, uint8_t opcode, uint8_t sequence, const std::vector<uint8_t> &payload) {
+		size_t len = std::min<size_t>(payload.size(), CMD_MAX_PAYLOAD);
+		return daq_put_command(out, opcode, sequence, payload.data(), uint8_t(len));
+	}
+
+	std::vector<uint8_t> synthetic_stream(double seconds) {
+		std::vector<uint8_t> stream;
+		uint8_t packet[PACKET_MAX_SIZE];
+		uint8_t frame[6 * PKT_ADC_WORD_BYTES] = {0x22};		// Status (a valid response, STAT_1 clear) | CH1 - CH4 | Zeros
+		uint32_t packet_count = 0;
+		uint32_t index[2] = {1, 1};
+		uint32_t blocks = uint32_t(seconds * kBoardRateHz / SAMPLES_PER_PACKET);
+
+		for (uint32_t b = 0; b < blocks; b++) {
+			for (uint8_t adc = 0; adc < 2; adc++) {
+				daq_header_t h = {};
+				uint8_t *out = packet + PKT_HEADER_SIZE;
+
+				h.mask = uint16_t(PKT_CH_ADC(adc) | PKT_CH_STATUS);
+				h.count = SAMPLES_PER_PACKET;
+				h.packet = packet_count++;
+				h.index = index[adc];
+				h.time_us = uint64_t(index[adc] * 1e6 / kBoardRateHz);
+				for (uint32_t i = 0; i < SAMPLES_PER_PACKET; i++) {
+					for (unsigned w = PKT_ADC_WORD_BYTES; w < sizeof(frame); w++) {
+						frame[w] = uint8_t((index[adc] + i) * 31U + w * 7U);
+					}
+					out = daq_put_adc_sample(out, h.mask, adc, uint16_t(i * 1e6 / kBoardRateHz), frame);
+				}
+				index[adc] += SAMPLES_PER_PACKET;
+				daq_put_header(packet, &h);
+				stream.insert(stream.end(), packet, out);
+			}
+			if ((b % 107U) == 0) {
+				daq_header_t h = {};
+				uint8_t tc[16] = {0x01, 0x90, 0x19, 0x00};	// TC0 25C, cold junction 25C
+
+				h.mask = PKT_CH_TC;
+				h.faults = uint8_t(PKT_FRESH_TC(0) | PKT_FRESH_TC(1) | PKT_FRESH_TC(2) | PKT_FRESH_TC(3));
+				h.count = 1;
+				h.packet = packet_count++;
+				h.index = b / 107U;
+				h.time_us = uint64_t(index[0] * 1e6 / kBoardRateHz);
+				uint8_t *out = daq_put_tc_sample(packet + PKT_HEADER_SIZE, h.mask, 0, tc);
+				daq_put_header(packet, &h);
+				stream.insert(stream.end(), packet, out);
+			}
+		}
+		return stream;
+	}
+
+
+	StreamParser::StreamParser(Handler &handler) : handler_(handler) {
+		pending_.reserve(2 * 65536);
+		expanded_.resize(PKT_HEADER_SIZE + kMaxSamples * daq_sample_size(PKT_CH_ADC(0) | PKT_CH_ADC(1) | PKT_CH_STATUS));
+	}
+
+	void StreamParser::reset() {
+		pending_.clear();
+	}
+
+	void StreamParser::feed(const uint8_t *data, size_t len) {
+		stats_.bytes += len;
+
+		// Fast path: nothing pending, parse straight from the caller's buffer and keep only the tail
+		if (pending_.empty()) {
+			size_t used = parse(data, len);
+			pending_.assign(data + used, data + len);
+			return;
+		}
+
+		pending_.insert(pending_.end(), data, data + len);
+		size_t used = parse(pending_.data(), pending_.size());
+		pending_.erase(pending_.begin(), pending_.begin() + ptrdiff_t(used));
+	}
+
+	void StreamParser::feed_datagram(const uint8_t *data, size_t len) {
+		stats_.bytes += len;
+		if ((len == 0) || (parse(data, len) != len)) {
+			stats_.malformed++; // Empty, or truncated packet at the end
+		}
+	}
+
+	// Parses whole packets, skipping to the next sync byte after a bad header. Returns the bytes consumed.
+	size_t StreamParser::parse(const uint8_t *data, size_t len) {
+		size_t used = 0;
+		daq_header_t header;
+
+		while (used < len) {
+			size_t avail = std::min<size_t>(len - used, 0xFFFFFFFFU);
+			int32_t size = daq_get_header(data + used, uint32_t(avail), &header);
+
+			if (size == 0) {
+				break;
+			}
+			bool valid = (header.type == PKT_TYPE_REPLY) ?
+				((header.count >= CMD_REPLY_DATA) && (header.count <= CMD_REPLY_MAX)) :
+				(header.type == PKT_TYPE_TELEMETRY) ? (header.count == TELEM_PAYLOAD_SIZE) :
+				(header.type == PKT_TYPE_BURST) ? (header.count == BURST_INFO_SIZE) :
+				((header.count <= kMaxSamples) && (source_of(header.mask) != -2));
+
+			if ((size < 0) || !valid) {
+				const uint8_t *next = static_cast<const uint8_t *>(std::memchr(data + used + 1, PKT_SYNC, len - used - 1));
+				size_t skip = next ? size_t(next - (data + used)) : len - used;
+
+				stats_.malformed++;
+				stats_.skipped_bytes += skip;
+				used += skip;
+				continue;
+			}
+			if (header.type == PKT_TYPE_COMPRESSED) {
+				// Lossless codec (daq_codec.h) -- expanded back into the sample packet it was made from
+				int32_t expanded = daq_expand(data + used, uint32_t(size), expanded_.data(), uint32_t(expanded_.size()));
+
+				if ((expanded < 0) || (daq_get_header(expanded_.data(), uint32_t(expanded), &header) != expanded)) {
+					stats_.malformed++;
+					used += size_t(size);
+					continue;
+				}
+				stats_.compressed++;
+				stats_.compressed_bytes += uint64_t(size);
+				stats_.expanded_bytes += uint64_t(expanded);
+				packet(expanded_.data(), header);
+			}
+			else {
+				packet(data + used, header);
+			}
+			handler_.on_raw_packet(data + used, size_t(size));
+			used += size_t(size);
+		}
+		return used;
+	}
+
+	void StreamParser::packet(const uint8_t *data, const daq_header_t &header) {
+		uint32_t missing = sequence_.add(header.packet);
+
+		stats_.packets++;
+		if (missing != 0) {
+			handler_.on_packet_gap(header.packet - missing, header.packet);
+		}
+
+		int source = source_of(header.mask);
+		if (header.type == PKT_TYPE_REPLY) {
+			reply_packet(data, header);
+		}
+		else if (header.type == PKT_TYPE_TELEMETRY) {
+			telemetry_packet(data, header);
+		}
+		else if (header.type == PKT_TYPE_BURST) {
+			burst_packet(data, header);
+		}
+		else if (source < 0) {
+			tc_packet(data, header);
+		}
+		else {
+			adc_packet(data, header, uint8_t(source));
+		}
+	}
+
+	void StreamParser::adc_packet(const uint8_t *data, const daq_header_t &header, uint8_t adc) {
+		const uint32_t size = daq_sample_size(header.mask);
+		const bool status = (header.mask & PKT_CH_STATUS) != 0;
+		int32_t *channels[kAdcChannels];
+		unsigned n_channels = 0;
+		const uint8_t *p = data + PKT_HEADER_SIZE;
+		AdcBlock &b = block_;
+
+		b.device = header.device;
+		b.adc = adc;
+		b.faults = header.faults;
+		b.mask = header.mask;
+		b.packet = header.packet;
+		b.first_index = header.index;
+		b.count = header.count;
+		b.decim = header.decim;
+		b.burst = (header.faults & PKT_FLAG_BURST) != 0;
+
+		for (unsigned ch = 0; ch < kAdcChannels; ch++) {
+			if (b.has_channel(ch)) {
+				channels[n_channels++] = b.channel[ch];
+			}
+			else {
+				std::memset(b.channel[ch], 0, header.count * sizeof(int32_t));
+			}
+		}
+		if (!status) {
+			std::memset(b.status, 0, header.count * sizeof(uint32_t));
+		}
+
+		// Sample times and status words
+		for (uint32_t i = 0; i < header.count; i++, p += size) {
+			b.time_us[i] = header.time_us + ((uint32_t(p[0]) << 8) | p[1]);
+			if (status) {
+				b.status[i] = get_u24(p + PKT_DELTA_BYTES);
+				if (decode_adc_status(b.status[i]).fault()) {
+					stats_.status_faults[adc]++;
+				}
+			}
+		}
+
+		// Channel words -- word layout is fixed for the whole packet
+		b.words.data = data + PKT_HEADER_SIZE + PKT_DELTA_BYTES + (status ? PKT_ADC_WORD_BYTES : 0);
+		b.words.stride = size;
+		b.words.count = header.count;
+		b.words.channels = n_channels;
+		unpack_i32(b.words, channels);
+
+		// Continuity of the sample index (late UDP packets are not counted as gaps) -- restarts when the rate changes
+		if (header.decim != decim_[adc]) {
+			index_valid_[adc] = false;
+			decim_[adc] = header.decim;
+		}
+		if (index_valid_[adc] && (header.index != next_index_[adc])) {
+			int32_t skipped = int32_t(header.index - next_index_[adc]);
+			if (skipped > 0) {
+				stats_.index_gaps[adc] += uint64_t(uint32_t(skipped)) << header.decim;
+				handler_.on_index_gap(adc, next_index_[adc], header.index);
+			}
+		}
+		if (!index_valid_[adc] || (int32_t(header.index + header.count - next_index_[adc]) > 0)) {
+			next_index_[adc] = header.index + header.count;
+		}
+		index_valid_[adc] = true;
+
+		stats_.adc_packets[adc]++;
+		stats_.samples[adc] += header.count;
+		if (b.burst) {
+			stats_.burst_samples[adc] += header.count;
+		}
+		if (header.faults & PKT_FAULT_OVERFLOW) {
+			stats_.overflow_flags[adc]++;
+		}
+		if (header.faults & PKT_FAULT_MISSED) {
+			stats_.missed_flags[adc]++;
+		}
+		if (header.faults & PKT_FAULT_ADC) {
+			stats_.adc_fault_flags[adc]++;
+		}
+		if (header.faults & PKT_FAULT_SYNC) {
+			stats_.sync_flags[adc]++;
+		}
+		handler_.on_adc(b);
+	}
+
+	void StreamParser::tc_packet(const uint8_t *data, const daq_header_t &header) {
+		const uint8_t *w = data + PKT_HEADER_SIZE + PKT_DELTA_BYTES; // First (only) sample
+		TcReading &r = reading_;
+
+		r.device = header.device;
+		r.faults = header.faults;
+		r.packet = header.packet;
+		r.cycle = header.index;
+		r.time_us = header.time_us;
+		for (unsigned tc = 0; tc < kTcCount; tc++) {
+			if (header.mask & (PKT_CH_TC0 << tc)) {
+				r.tc[tc] = decode_max31855(get_u32(w));
+				r.tc[tc].fresh = (header.faults & PKT_FRESH_TC(tc)) != 0;
+				w += PKT_TC_WORD_BYTES;
+			}
+			else {
+				r.tc[tc] = Thermocouple();
+			}
+		}
+
+		stats_.tc_packets++;
+		if (header.count != 0) {
+			handler_.on_thermocouples(r);
+		}
+	}
+
+	void StreamParser::reply_packet(const uint8_t *data, const daq_header_t &header) {
+		const uint8_t *p = data + PKT_HEADER_SIZE;
+		CommandReply &r = reply_;
+
+		r.device = header.device;
+		r.packet = header.packet;
+		r.time_us = header.time_us;
+		r.opcode = p[CMD_REPLY_OPCODE];
+		r.sequence = p[CMD_REPLY_SEQUENCE];
+		r.result = p[CMD_REPLY_RESULT];
+		r.length = uint8_t(header.count - CMD_REPLY_DATA);
+		std::memcpy(r.data, p + CMD_REPLY_DATA, r.length);
+
+		// Register replies: adc, (addr, value, readback) x n
+		r.adc = (r.length > 0) ? r.data[0] : 0;
+		r.registers = 0;
+		if ((r.opcode == CMD_REG_WRITE) || (r.opcode == CMD_REG_READ)) {
+			for (unsigned i = 1; (i + 3 <= r.length) && (r.registers < CMD_MAX_PAYLOAD); i += 3) {
+				RegisterReadback &reg = r.reg[r.registers++];
+
+				reg.addr = r.data[i];
+				reg.value = r.data[i + 1];
+				reg.readback = r.data[i + 2];
+			}
+		}
+
+		stats_.replies++;
+		handler_.on_reply(r);
+	}
+
+	void StreamParser::telemetry_packet(const uint8_t *data, const daq_header_t &header) {
+		const uint8_t *p = data + PKT_HEADER_SIZE;
+		Telemetry &t = telemetry_;
+
+		// Layout must match this build's (TELEMETRY in daq_packet.h)
+		if ((p[1] != TELEM_HISTOGRAMS) || (p[2] != TELEM_BUCKETS) || (p[3] != TELEM_COUNTERS)) {
+			stats_.malformed++;
+			return;
+		}
+		t.device = header.device;
+		t.packet = header.packet;
+		t.sequence = header.index;
+		t.time_us = header.time_us;
+		t.cycles_per_us = p[0] ? p[0] : 1;
+		p += 4;
+		for (LatencyHistogram &h : t.hist) {
+			for (uint32_t &c : h.count) {
+				c = get_u32(p);
+				p += 4;
+			}
+			h.max_cycles = get_u32(p);
+			p += 4;
+		}
+		for (uint32_t &c : t.counter) {
+			c = get_u32(p);
+			p += 4;
+		}
+
+		stats_.telemetry++;
+		handler_.on_telemetry(t);
+	}
+
+	void StreamParser::burst_packet(const uint8_t *data, const daq_header_t &header) {
+		const uint8_t *p = data + PKT_HEADER_SIZE;
+		BurstRecord &r = burst_;
+
+		r.device = header.device;
+		r.packet = header.packet;
+		r.number = header.index;
+		r.trigger_us = header.time_us;
+		r.cause = p[0];
+		r.channel = p[1];
+		r.truncated = (p[2] & BURST_FLAG_TRUNCATED) != 0;
+		r.pre_us = get_u32(p + 4);
+		r.post_us = get_u32(p + 8);
+		for (unsigned adc = 0; adc < kAdcCount; adc++) {
+			r.frames[adc] = get_u32(p + 12 + 4 * adc);
+			r.first_index[adc] = get_u32(p + 20 + 4 * adc);
+
+			// The record's blocks carry their own (older) indices -- continuity restarts at its first frame
+			index_valid_[adc] = r.frames[adc] != 0;
+			next_index_[adc] = r.first_index[adc];
+		}
+
+		stats_.bursts++;
+		handler_.on_burst(r);
+	}
+
+	uint64_t LatencyHistogram::total() const {
+		uint64_t n = 0;
+		for (uint32_t c : count) n += c;
+		return n;
+	}
+
+	uint64_t LatencyHistogram::percentile_cycles(double fraction, const LatencyHistogram *earlier) const {
+		uint64_t diff[TELEM_BUCKETS];
+		uint64_t total = 0;
+
+		for (unsigned i = 0; i < TELEM_BUCKETS; i++) {
+			diff[i] = uint32_t(count[i] - (earlier ? earlier->count[i] : 0U)); // Counts wrap at 32 bits
+			total += diff[i];
+		}
+		uint64_t target = uint64_t(double(total) * fraction);
+		uint64_t seen = 0;
+		for (unsigned i = 0; i < TELEM_BUCKETS; i++) {
+			seen += diff[i];
+			if (seen > target) {
+				return uint64_t(2) << i;
+			}
+		}
+		return 0;
+	}
+
+} // namespace daq
@@ -0,0 +1,270 @@
+/****************************************************************
+* DAQ STREAM DECODER (host library)
+*
+* Parses the packet stream the firmware emits (format in daq_packet.h / bottom of main.c) into per-packet blocks:
+* ADC blocks in channel-major arrays with absolute sample times, and thermocouple read cycles converted to
+* temperatures, and command replies (CMD_* in daq_packet.h). Packet counter and sample index continuity are checked
+* as the stream is parsed. Compressed ADC packets (daq_codec.h) are expanded first. Burst records (adc_burst.h) arrive
+* as an announcement followed by ordinary ADC blocks flagged PKT_FLAG_BURST.
+*
+* The parser owns no I/O: feed it bytes from a TCP stream (any split) or whole UDP datagrams.
+***************************************************************/
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "unpack24.h"
+
+extern "C" {
+#include "daq_packet.h"
+#include "daq_codec.h"
+}
+
+namespace daq {
+
+	constexpr unsigned kAdcCount = 2;
+	constexpr unsigned kAdcChannels = 4;
+	constexpr unsigned kTcCount = 4;
+	constexpr unsigned kMaxSamples = 1024;		// Largest sample count accepted in one packet
+
+	// Channel names by mask bit (PKT_CH_*)
+	extern const char *const kChannelNames[PKT_CH_COUNT];
+
+	// One ADC packet: up to kMaxSamples consecutive conversions. Channels not in the mask are left at 0.
+	struct AdcBlock {
+		uint8_t device = 0;
+		uint8_t adc = 0;
+		uint8_t faults = 0;
+		uint16_t mask = 0;
+		uint32_t packet = 0;
+		uint32_t first_index = 0;		// Counted at the block's rate
+		uint32_t count = 0;
+		uint8_t decim = 0;				// Decimation log2 -- samples are 2^decim conversions apart (decimator.h)
+		bool burst = false;				// Samples of the last announced burst record (PKT_FLAG_BURST), not live
+		uint64_t time_us[kMaxSamples];						// Absolute sample times
+		uint32_t status[kMaxSamples];						// Raw ADC status word (if PKT_CH_STATUS is set)
+		int32_t channel[kAdcChannels][kMaxSamples];			// Sign extended 24-bit codes, CH1 - CH4
+		SampleRecords words;		// Packed channel words of the packet (valid during the callback) -- for unpack_f32
+
+		bool has_channel(unsigned ch) const { return (mask & (PKT_CH_IEPE0 << (4 * adc + ch))) != 0; }
+	};
+
+	// MAX31855 word
+	struct Thermocouple {
+		bool present = false;			// Selected by the mask
+		bool fresh = false;				// Read in this cycle (PKT_FRESH_TC) -- else the board repeated the previous reading
+		uint32_t raw = 0;
+		double temperature_c = 0.0;		// Thermocouple junction, 0.25C
+		double internal_c = 0.0;		// Cold junction, 0.0625C
+		bool fault = false;
+		bool open_circuit = false;
+		bool short_gnd = false;
+		bool short_vcc = false;
+	};
+
+	struct TcReading {
+		uint8_t device = 0;
+		uint8_t faults = 0;
+		uint32_t packet = 0;
+		uint32_t cycle = 0;
+		uint64_t time_us = 0;
+		std::array<Thermocouple, kTcCount> tc;
+	};
+
+	Thermocouple decode_max31855(uint32_t raw);
+
+	// ADS131A04 status word (PKT_CH_STATUS sample word): response to NULL = 0x22 | STAT_1 (adc_status.h)
+	struct AdcStatus {
+		bool sync = false;				// Word is a status response -- else the frame was out of step
+		uint8_t stat1 = 0;				// STAT_1 fault bits (valid when sync)
+		bool f_check = false;
+		bool f_drdy = false;			// Conversion read after the next one was ready
+		bool f_resync = false;
+		bool f_wdt = false;
+		bool f_adcin = false;
+		bool f_spi = false;
+		bool f_opc = false;
+
+		bool fault() const { return !sync || (stat1 & 0x7F) != 0; }
+	};
+
+	AdcStatus decode_adc_status(uint32_t word);
+
+	// Register entry of a CMD_REG_WRITE / CMD_REG_READ reply
+	struct RegisterReadback {
+		uint8_t addr = 0;
+		uint8_t value = 0;				// Value in the board's table (written)
+		uint8_t readback = 0;			// Value read from the ADC
+	};
+
+	// Answer to a command (PKT_TYPE_REPLY packet)
+	struct CommandReply {
+		uint8_t device = 0;
+		uint32_t packet = 0;
+		uint64_t time_us = 0;
+		uint8_t opcode = 0;
+		uint8_t sequence = 0;			// As sent with the command
+		uint8_t result = CMD_OK;		// CMD_OK / CMD_ERR_*
+		uint8_t length = 0;				// Bytes in data
+		uint8_t data[CMD_REPLY_MAX - CMD_REPLY_DATA];	// Opcode specific, see daq_packet.h
+		uint8_t adc = 0;				// Register and decimation replies
+		unsigned registers = 0;			// Register replies: entries in reg
+		RegisterReadback reg[CMD_MAX_PAYLOAD];
+	};
+
+	// Burst record announcement (PKT_TYPE_BURST) -- its ADC blocks follow, flagged burst
+	struct BurstRecord {
+		uint8_t device = 0;
+		uint32_t packet = 0;
+		uint32_t number = 0;			// Records since the board booted
+		uint64_t trigger_us = 0;		// Trigger time
+		uint8_t cause = 0;				// BURST_TRIG_* (adc_burst.h): 0 host, 1 level, 2 slope
+		uint8_t channel = 0;			// Trigger channel (mask bit)
+		bool truncated = false;			// Board buffer filled before the post-trigger window ended
+		uint32_t pre_us = 0;
+		uint32_t post_us = 0;
+		uint32_t frames[kAdcCount] = {0, 0};		// Samples of each ADC in the record
+		uint32_t first_index[kAdcCount] = {0, 0};	// Index of the first of them
+	};
+
+	// Latency histogram of a telemetry packet (TELEM_HIST_*), counted since the board booted
+	struct LatencyHistogram {
+		uint32_t count[TELEM_BUCKETS] = {};	// Bucket i: [2^i, 2^(i+1)) CPU cycles
+		uint32_t max_cycles = 0;
+
+		uint64_t total() const;
+		// Upper bucket edge in cycles below which the given fraction of the durations in (*this - earlier) fell
+		uint64_t percentile_cycles(double fraction, const LatencyHistogram *earlier = nullptr) const;
+	};
+
+	// Telemetry packet (PKT_TYPE_TELEMETRY): firmware latencies and loss counters since boot
+	struct Telemetry {
+		uint8_t device = 0;
+		uint32_t packet = 0;
+		uint32_t sequence = 0;			// Telemetry packet number
+		uint64_t time_us = 0;
+		uint8_t cycles_per_us = 1;
+		LatencyHistogram hist[TELEM_HISTOGRAMS];
+		uint32_t counter[TELEM_COUNTERS] = {};	// TELEM_CTR_*
+	};
+
+	// Builds a command into out (CMD_MAX_SIZE bytes), returns its size
+	size_t make_command(uint8_t *out, uint8_t opcode, uint8_t sequence, const std::vector<uint8_t> &payload);
+
+	// Board's full ADC rate: CLK2 0x4E, see adc_config.c
+	constexpr double kBoardRateHz = 42667.0;
+
+	// Synthetic stream for benches: full ADC packets (all channels + status) of both ADCs at kBoardRateHz with a
+	// thermocouple packet every 100 ms
+	std::vector<uint8_t> synthetic_stream(double seconds);
+
+	// Loss/reorder accounting on a 32-bit sequence number. A number missing when a later one arrives counts as
+	// lost until it shows up (then it counts as reordered instead).
+	class SequenceTracker {
+	public:
+		// Returns the number of sequence numbers skipped by this one (0 if in order, late or duplicate)
+		uint32_t add(uint32_t seq);
+
+		uint64_t received() const { return received_; }
+		uint64_t lost() const { return lost_; }
+		uint64_t reordered() const { return reordered_; }
+		uint64_t duplicates() const { return duplicates_; }
+
+		void reset() { *this = SequenceTracker(); }
+
+	private:
+		static constexpr unsigned kWindow = 4096;	// History for late/duplicate detection
+
+		bool started_ = false;
+		uint32_t highest_ = 0;
+		std::bitset<kWindow> seen_;
+		uint64_t received_ = 0;
+		uint64_t lost_ = 0;
+		uint64_t reordered_ = 0;
+		uint64_t duplicates_ = 0;
+	};
+
+	// Callbacks for decoded packets. The blocks are only valid during the call.
+	class Handler {
+	public:
+		virtual ~Handler() = default;
+		virtual void on_adc(const AdcBlock &) {}
+		virtual void on_thermocouples(const TcReading &) {}
+		virtual void on_reply(const CommandReply &) {}
+		virtual void on_telemetry(const Telemetry &) {}
+		virtual void on_burst(const BurstRecord &) {}
+		// Every valid packet as received (compressed ones still compressed), after its decoded callback
+		virtual void on_raw_packet(const uint8_t * /*data*/, size_t /*len*/) {}
+		virtual void on_packet_gap(uint32_t /*expected*/, uint32_t /*received*/) {}
+		virtual void on_index_gap(uint8_t /*adc*/, uint32_t /*expected*/, uint32_t /*received*/) {}	// Indices at the ADC's current rate
+	};
+
+	struct StreamStats {
+		uint64_t bytes = 0;
+		uint64_t packets = 0;
+		uint64_t adc_packets[kAdcCount] = {0, 0};
+		uint64_t tc_packets = 0;
+		uint64_t replies = 0;
+		uint64_t telemetry = 0;
+		uint64_t bursts = 0;			// Burst records announced
+		uint64_t burst_samples[kAdcCount] = {0, 0};	// Samples received in burst blocks (also in samples)
+		uint64_t samples[kAdcCount] = {0, 0};
+		uint64_t index_gaps[kAdcCount] = {0, 0};	// Conversions missing according to the sample index
+		uint64_t overflow_flags[kAdcCount] = {0, 0};	// Packets flagged with a device ring overflow
+		uint64_t missed_flags[kAdcCount] = {0, 0};		// Packets flagged with conversions dropped or read late
+		uint64_t adc_fault_flags[kAdcCount] = {0, 0};	// Packets flagged with an ADC status fault
+		uint64_t sync_flags[kAdcCount] = {0, 0};		// Packets flagged with a status word out of step
+		uint64_t status_faults[kAdcCount] = {0, 0};		// Samples whose status word shows a fault (PKT_CH_STATUS)
+		uint64_t compressed = 0;		// Compressed ADC packets (daq_codec.h)
+		uint64_t compressed_bytes = 0;	// Their length as received
+		uint64_t expanded_bytes = 0;	// Their length expanded
+		uint64_t malformed = 0;			// Bad headers (bytes skipped to resync), truncated datagrams, packets that do not expand
+		uint64_t skipped_bytes = 0;
+	};
+
+	class StreamParser {
+	public:
+		explicit StreamParser(Handler &handler);
+
+		// TCP: any split of the byte stream. Partial packets are kept until the rest arrives.
+		void feed(const uint8_t *data, size_t len);
+
+		// UDP: one datagram of whole packets
+		void feed_datagram(const uint8_t *data, size_t len);
+
+		// New connection -- drop the partial packet. Continuity checks carry on: the packet counter and sample
+		// indices run across connections, so what was lost in between shows up as gaps.
+		void reset();
+
+		const StreamStats &stats() const { return stats_; }
+		const SequenceTracker &sequence() const { return sequence_; }
+
+	private:
+		size_t parse(const uint8_t *data, size_t len);
+		void packet(const uint8_t *data, const daq_header_t &header);
+		void adc_packet(const uint8_t *data, const daq_header_t &header, uint8_t adc);
+		void tc_packet(const uint8_t *data, const daq_header_t &header);
+		void reply_packet(const uint8_t *data, const daq_header_t &header);
+		void telemetry_packet(const uint8_t *data, const daq_header_t &header);
+		void burst_packet(const uint8_t *data, const daq_header_t &header);
+
+		Handler &handler_;
+		std::vector<uint8_t> pending_;		// Unparsed tail of the TCP stream
+		std::vector<uint8_t> expanded_;		// Compressed packet expanded
+		StreamStats stats_;
+		SequenceTracker sequence_;
+		bool index_valid_[kAdcCount] = {false, false};
+		uint32_t next_index_[kAdcCount] = {0, 0};
+		uint8_t decim_[kAdcCount] = {0, 0};			// Decimation the index continuity refers to
+		AdcBlock block_;
+		TcReading reading_;
+		CommandReply reply_;
+		Telemetry telemetry_;
+		BurstRecord burst_;
+	};
+
+} // namespace daq
@@ -0,0 +1,120 @@
+/****************************************************************
+* DECIMATOR TEST
+*
+* Checks the CIC decimator (decimator.c, the object the firmware and host tools share) bit for bit against its
+* definition: every output is the input convolved with three boxes of 2^log2 ones, taken at every 2^log2-th input,
+* rounded half up by 3 x log2 bits and clamped to 24 bits.
+*
+* Each decimation log2 = 0 .. DECIM_MAX_LOG2 runs on four channels of full-scale input: random codes over the whole
+* 24-bit range, a constant +FS, a constant -FS and a +FS / -FS square wave at the output rate. The integrators of the
+* longer runs wrap modulo 2^64.
+*
+*   ./decimator_test [--outputs N]
+***************************************************************/
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "decimator.h"
+}
+
+namespace {
+
+	constexpr int32_t kFsMax = 8388607;
+	constexpr int32_t kFsMin = -8388608;
+
+	// Impulse response of the 3-stage CIC: three boxes of r ones convolved, 3r - 2 taps
+	std::vector<int64_t> box3(uint32_t r) {
+		std::vector<int64_t> h(1, 1);
+
+		for (uint32_t stage = 0; stage < DECIM_STAGES; stage++) {
+			std::vector<int64_t> next(h.size() + r - 1U, 0);
+
+			for (size_t i = 0; i < h.size(); i++) {
+				for (uint32_t j = 0; j < r; j++) {
+					next[i + j] += h[i];
+				}
+			}
+			h.swap(next);
+		}
+		return h;
+	}
+
+	// Output taken after input m: convolution with zeros before the first input, rounded and clamped like decim_output
+	int32_t reference(const std::vector<int32_t> &x, size_t m, const std::vector<int64_t> &h, uint32_t shift) {
+		int64_t y = 0;
+
+		for (size_t j = 0; (j < h.size()) && (j <= m); j++) {
+			y += h[j] * int64_t(x[m - j]);
+		}
+		if (shift != 0U) {
+			y = (y + (int64_t(1) << (shift - 1U))) >> shift;
+		}
+		return (y > kFsMax) ? kFsMax : (y < kFsMin) ? kFsMin : int32_t(y);
+	}
+
+} // namespace
+
+int main(int argc, char **argv) {
+	size_t outputs = 64;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if ((arg == "--outputs") && (i + 1 < argc)) outputs = size_t(std::atol(argv[++i]));
+		else {
+			std::printf("usage: %s [--outputs N]\n", argv[0]);
+			return (arg == "--help") ? 0 : 1;
+		}
+	}
+
+	std::mt19937 rng(7);
+	std::uniform_int_distribution<int32_t> code(kFsMin, kFsMax);
+	size_t failures = 0;
+
+	for (uint8_t log2 = 0; log2 <= DECIM_MAX_LOG2; log2++) {
+		uint32_t r = 1U << log2;
+		size_t inputs = outputs * r;
+		std::vector<int32_t> x[DECIM_CHANNELS];
+		std::vector<int64_t> h = box3(r);
+		decim_t d;
+		size_t mismatches = 0;
+
+		for (uint32_t ch = 0; ch < DECIM_CHANNELS; ch++) {
+			x[ch].resize(inputs);
+		}
+		for (size_t n = 0; n < inputs; n++) {
+			x[0][n] = code(rng);
+			x[1][n] = kFsMax;
+			x[2][n] = kFsMin;
+			x[3][n] = ((n / r) & 1U) ? kFsMin : kFsMax;
+		}
+
+		decim_init(&d, log2);
+		for (size_t n = 0; n < inputs; n++) {
+			int32_t in[DECIM_CHANNELS] = {x[0][n], x[1][n], x[2][n], x[3][n]};
+
+			decim_integrate(&d, in);
+			if (((n + 1U) % r) != 0U) {
+				continue;
+			}
+
+			int32_t out[DECIM_CHANNELS];
+			decim_output(&d, out);
+			for (uint32_t ch = 0; ch < DECIM_CHANNELS; ch++) {
+				if (out[ch] != reference(x[ch], n, h, DECIM_STAGES * log2)) {
+					mismatches++;
+				}
+			}
+		}
+
+		std::printf("log2 %2u  decimation %4u  %zu inputs x %u channels  %zu mismatches\n", unsigned(log2), r, inputs,
+			DECIM_CHANNELS, mismatches);
+		failures += mismatches;
+	}
+	std::printf("%s\n", failures ? "NOT bit-exact" : "bit-exact");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,491 @@
+/****************************************************************
+* INGEST PIPELINE (host library) -- see ingest_pipeline.h
+***************************************************************/
+#include "ingest_pipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <memory>
+
+namespace daq {
+
+	namespace {
+
+		using Clock = std::chrono::steady_clock;
+
+		// Nothing to do: spin briefly, then sleep -- latency stays well under a packet at the board's rate
+		void idle(unsigned &spins) {
+			if (++spins < 64) {
+				std::this_thread::yield();
+			}
+			else {
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+			}
+		}
+
+		template <typename A>
+		void merge(A &to, const A &from) {
+			if (from.count == 0) {
+				return;
+			}
+			to.min = (to.count == 0) ? from.min : std::min(to.min, from.min);
+			to.max = (to.count == 0) ? from.max : std::max(to.max, from.max);
+			to.count += from.count;
+			to.sum += from.sum;
+			to.sum_sq += from.sum_sq;
+		}
+
+	} // namespace
+
+	// Decode stage: parses chunks and scales the ADC packets into blocks
+	class IngestPipeline::Decoder : public Handler {
+	public:
+		explicit Decoder(IngestPipeline &p) : p_(p), parser_(*this) {
+			batch_.reserve(p.blocks_.count());
+		}
+
+		void feed(const Chunk &chunk) {
+			if (chunk.reset) {
+				parser_.reset();
+				restart_ = true;
+			}
+			parser_.feed(chunk.data, chunk.len);
+			flush();
+
+			const StreamStats &s = parser_.stats();
+			p_.packets_.store(s.packets, std::memory_order_relaxed);
+			p_.lost_.store(parser_.sequence().lost(), std::memory_order_relaxed);
+			p_.malformed_.store(s.malformed, std::memory_order_relaxed);
+			p_.index_gaps_.store(s.index_gaps[0] + s.index_gaps[1], std::memory_order_relaxed);
+		}
+
+		void on_adc(const AdcBlock &b) override {
+			for (uint32_t first = 0; first < b.count; first += kBlockSamples) {
+				uint32_t count = std::min<uint32_t>(kBlockSamples, b.count - first);
+				ScaledBlock *block = take(count);
+				if (!block) {
+					continue;
+				}
+
+				block->device = b.device;
+				block->adc = b.adc;
+				block->faults = b.faults;
+				block->decim = b.decim;
+				block->restart = take_restart();
+				block->mask = b.mask;
+				block->packet = b.packet;
+				block->first_index = b.first_index + first;
+				block->count = count;
+				std::memcpy(block->time_us, b.time_us + first, count * sizeof(uint64_t));
+
+				// Packed words hold the ADC's channels in the mask, in order
+				ChannelCal cal[kAdcChannels];
+				float *out[kAdcChannels];
+				unsigned n = 0;
+				for (unsigned ch = 0; ch < kAdcChannels; ch++) {
+					if (b.has_channel(ch)) {
+						cal[n] = p_.config_.cal[kAdcChannels * b.adc + ch];
+						out[n] = block->value[n];
+						n++;
+					}
+				}
+				block->channels = uint16_t(n);
+				SampleRecords words = b.words;
+				words.data += size_t(first) * words.stride;
+				words.count = count;
+				if (n) {
+					unpack_f32(words, cal, out);
+				}
+				batch_.push_back(block);
+			}
+		}
+
+		void on_thermocouples(const TcReading &r) override {
+			ScaledBlock *block = take(1);
+			if (!block) {
+				return;
+			}
+
+			block->device = r.device;
+			block->adc = kTcSource;
+			block->faults = r.faults;
+			block->decim = 0;
+			block->restart = take_restart();
+			block->mask = 0;
+			block->packet = r.packet;
+			block->first_index = r.cycle;
+			block->count = 1;
+			block->time_us[0] = r.time_us;
+			unsigned n = 0;
+			for (unsigned t = 0; t < kTcCount; t++) {
+				if (r.tc[t].present) {
+					block->mask |= uint16_t(PKT_CH_TC0 << t);
+					block->value[n++][0] = r.tc[t].fault ? std::numeric_limits<float>::quiet_NaN() : float(r.tc[t].temperature_c);
+				}
+			}
+			block->channels = uint16_t(n);
+			batch_.push_back(block);
+		}
+
+	private:
+		bool take_restart() {
+			bool restart = restart_;
+
+			restart_ = false;
+			return restart;
+		}
+
+		// A free block, or nullptr when dropping
+		ScaledBlock *take(uint32_t samples) {
+			unsigned spins = 0;
+
+			for (;;) {
+				ScaledBlock *block = p_.blocks_.take();
+				if (block) {
+					return block;
+				}
+				if (p_.config_.overflow == Overflow::Drop) {
+					p_.dropped_blocks_.fetch_add(1, std::memory_order_relaxed);
+					p_.dropped_samples_.fetch_add(samples, std::memory_order_relaxed);
+					return nullptr;
+				}
+				flush(); // Blocks held here must move on for any to come back
+				p_.counters_[kStageDecode].waits.fetch_add(1, std::memory_order_relaxed);
+				idle(spins);
+			}
+		}
+
+		void flush() {
+			size_t sent = 0;
+			unsigned spins = 0;
+
+			while (sent < batch_.size()) {
+				sent += p_.to_analyze_.push(batch_.data() + sent, batch_.size() - sent);
+				if (sent < batch_.size()) {
+					idle(spins); // Not expected: the queues hold the whole pool
+				}
+			}
+			batch_.clear();
+		}
+
+		IngestPipeline &p_;
+		StreamParser parser_;
+		std::vector<ScaledBlock *> batch_;
+		bool restart_ = false;			// New connection -- the next block is marked
+	};
+
+	IngestPipeline::IngestPipeline(const IngestConfig &config) :
+		config_(config), chunks_(config.chunks), blocks_(config.blocks), to_decode_(config.chunks),
+		to_analyze_(config.blocks), to_store_(config.blocks) {
+		decode_thread_ = std::thread(&IngestPipeline::decode_stage, this);
+		analyze_thread_ = std::thread(&IngestPipeline::analyze_stage, this);
+		store_thread_ = std::thread(&IngestPipeline::store_stage, this);
+	}
+
+	IngestPipeline::~IngestPipeline() {
+		finish();
+	}
+
+	void IngestPipeline::note_depth(Counters &c, size_t depth) {
+		if (depth > c.max_depth.load(std::memory_order_relaxed)) {
+			c.max_depth.store(depth, std::memory_order_relaxed);
+		}
+	}
+
+	Chunk *IngestPipeline::chunk() {
+		unsigned spins = 0;
+
+		for (;;) {
+			Chunk *c = chunks_.take();
+			if (c) {
+				c->len = 0;
+				c->reset = reset_;
+				reset_ = false;
+				return c;
+			}
+			counters_[kStageRead].waits.fetch_add(1, std::memory_order_relaxed);
+			idle(spins);
+		}
+	}
+
+	void IngestPipeline::submit(Chunk *c) {
+		counters_[kStageRead].items.fetch_add(1, std::memory_order_relaxed);
+		counters_[kStageRead].bytes.fetch_add(c->len, std::memory_order_relaxed);
+		to_decode_.push(c); // Always fits: the queue holds the whole pool
+	}
+
+	void IngestPipeline::feed(const uint8_t *data, size_t len) {
+		while (len > 0) {
+			Chunk *c = chunk();
+			c->len = std::min(len, kChunkBytes);
+			std::memcpy(c->data, data, c->len);
+			data += c->len;
+			len -= c->len;
+			submit(c);
+		}
+	}
+
+	void IngestPipeline::finish() {
+		if (finished_) {
+			return;
+		}
+		finished_ = true;
+		read_done_.store(true, std::memory_order_release);
+		decode_thread_.join();
+		analyze_thread_.join();
+		store_thread_.join();
+	}
+
+	void IngestPipeline::decode_stage() {
+		Decoder decoder(*this);
+		Counters &c = counters_[kStageDecode];
+		unsigned spins = 0;
+
+		for (;;) {
+			Chunk *chunk;
+			bool done = read_done_.load(std::memory_order_acquire);
+
+			note_depth(c, to_decode_.size());
+			if (!to_decode_.pop(chunk)) {
+				if (done) {
+					break;
+				}
+				idle(spins);
+				continue;
+			}
+			spins = 0;
+			decoder.feed(*chunk);
+			c.items.fetch_add(1, std::memory_order_relaxed);
+			c.bytes.fetch_add(chunk->len, std::memory_order_relaxed);
+			chunks_.give(chunk);
+		}
+		decode_done_.store(true, std::memory_order_release);
+	}
+
+	void IngestPipeline::analyze_stage() {
+		Counters &c = counters_[kStageAnalyze];
+		std::array<Accumulator, kIngestChannels> local;
+		ScaledBlock *batch[kBatch];
+		auto published = Clock::now();
+		unsigned spins = 0;
+
+		// Spectra of the IEPE channels: analyzer and ping-pong buffers set up here, swapped with the published ones
+		std::unique_ptr<SpectrumAnalyzer> analyzer;
+		std::array<ChannelSpectrum, kAdcChannels> fresh;
+		uint32_t next_index[kAdcChannels] = {};
+		bool index_valid[kAdcChannels] = {};
+		auto spectra_published = published;
+		if (config_.spectra) {
+			analyzer.reset(new SpectrumAnalyzer(kAdcChannels, config_.spectrum));
+		}
+		auto publish_spectra = [&] {
+			for (unsigned ch = 0; ch < kAdcChannels; ch++) {
+				analyzer->take(ch, fresh[ch]);
+			}
+			std::lock_guard<std::mutex> lock(spectra_mutex_);
+			spectra_.swap(fresh);
+			publications_++;
+		};
+
+		for (;;) {
+			bool done = decode_done_.load(std::memory_order_acquire);
+
+			note_depth(c, to_analyze_.size());
+			size_t n = to_analyze_.pop(batch, kBatch);
+			if (n == 0) {
+				if (done) {
+					break;
+				}
+				idle(spins);
+				continue;
+			}
+			spins = 0;
+
+			uint64_t bytes = 0;
+			for (size_t i = 0; i < n; i++) {
+				const ScaledBlock &b = *batch[i];
+				unsigned k = 0;
+
+				for (unsigned ch = 0; ch < kAdcChannels; ch++) {
+					if (!(b.mask & (PKT_CH_IEPE0 << (kAdcChannels * b.adc + ch)))) {
+						continue;
+					}
+					Accumulator &a = local[kAdcChannels * b.adc + ch];
+					const float *v = b.value[k++];
+					float lo = v[0], hi = v[0];
+					double sum = 0.0, sum_sq = 0.0;
+
+					if (b.adc == kTcSource) {
+						if (v[0] != v[0]) {
+							continue; // Faulted thermocouple
+						}
+					}
+					for (uint32_t s = 0; s < b.count; s++) {
+						sum += v[s];
+						sum_sq += double(v[s]) * v[s];
+						lo = std::min(lo, v[s]);
+						hi = std::max(hi, v[s]);
+					}
+					a.min = (a.count == 0) ? lo : std::min(a.min, lo);
+					a.max = (a.count == 0) ? hi : std::max(a.max, hi);
+					a.count += b.count;
+					a.sum += sum;
+					a.sum_sq += sum_sq;
+				}
+				bytes += uint64_t(b.count) * b.channels * sizeof(float);
+
+				// Live IEPE samples; a channel's segment restarts where its sample index skips
+				if (analyzer && (b.adc == 0) && !(b.faults & PKT_FLAG_BURST)) {
+					double rate_hz = kBoardRateHz / double(1U << b.decim);
+					k = 0;
+					for (unsigned ch = 0; ch < kAdcChannels; ch++) {
+						if (!(b.mask & (PKT_CH_IEPE0 << ch))) {
+							index_valid[ch] = false;
+							continue;
+						}
+						bool contiguous = index_valid[ch] && (b.first_index == next_index[ch]);
+						analyzer->add(ch, b.value[k++], b.count, rate_hz, contiguous);
+						next_index[ch] = b.first_index + b.count;
+						index_valid[ch] = true;
+					}
+				}
+			}
+
+			size_t sent = 0;
+			while (sent < n) {
+				sent += to_store_.push(batch + sent, n - sent);
+			}
+			c.items.fetch_add(n, std::memory_order_relaxed);
+			c.bytes.fetch_add(bytes, std::memory_order_relaxed);
+
+			auto now = Clock::now();
+			if (now - published >= std::chrono::milliseconds(50)) {
+				std::lock_guard<std::mutex> lock(summary_mutex_);
+				for (unsigned ch = 0; ch < kIngestChannels; ch++) {
+					merge(summary_[ch], local[ch]);
+				}
+				local.fill(Accumulator());
+				published = now;
+			}
+			if (analyzer && (now - spectra_published >= std::chrono::milliseconds(config_.publish_ms))) {
+				publish_spectra();
+				spectra_published = now;
+			}
+		}
+
+		if (analyzer) {
+			publish_spectra();
+		}
+		std::lock_guard<std::mutex> lock(summary_mutex_);
+		for (unsigned ch = 0; ch < kIngestChannels; ch++) {
+			merge(summary_[ch], local[ch]);
+		}
+		analyze_done_.store(true, std::memory_order_release);
+	}
+
+	void IngestPipeline::store_stage() {
+		Counters &c = counters_[kStageStore];
+		ScaledBlock *batch[kBatch];
+		auto next_stall = Clock::now() + std::chrono::milliseconds(config_.stall_every_ms);
+		unsigned spins = 0;
+
+		for (;;) {
+			bool done = analyze_done_.load(std::memory_order_acquire);
+
+			note_depth(c, to_store_.size());
+			size_t n = to_store_.pop(batch, kBatch);
+			if (n == 0) {
+				if (done) {
+					break;
+				}
+				idle(spins);
+				continue;
+			}
+			spins = 0;
+
+			uint64_t bytes = 0;
+			for (size_t i = 0; i < n; i++) {
+				const ScaledBlock &b = *batch[i];
+
+				if (config_.capture) {
+					const float *columns[kCaptureColumns];
+					unsigned k = 0;
+
+					if (b.restart) {
+						config_.capture->restart();
+					}
+					for (unsigned ch = 0; ch < kCaptureColumns; ch++) {
+						columns[ch] = (b.mask & (PKT_CH_IEPE0 << (kAdcChannels * b.adc + ch))) ? b.value[k++] : nullptr;
+					}
+					config_.capture->append(b.adc, b.count, b.time_us, columns);
+				}
+				bytes += uint64_t(b.count) * b.channels * sizeof(float);
+			}
+			blocks_.give(batch, n);
+			c.items.fetch_add(n, std::memory_order_relaxed);
+			c.bytes.fetch_add(bytes, std::memory_order_relaxed);
+
+			if (config_.stall_ms && config_.stall_every_ms && (Clock::now() >= next_stall)) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(config_.stall_ms));
+				next_stall = Clock::now() + std::chrono::milliseconds(config_.stall_every_ms);
+			}
+		}
+	}
+
+	IngestStats IngestPipeline::stats() const {
+		IngestStats s;
+		const size_t depth[kIngestStages] = {0, to_decode_.size(), to_analyze_.size(), to_store_.size()};
+		const size_t capacity[kIngestStages] = {0, to_decode_.capacity(), to_analyze_.capacity(), to_store_.capacity()};
+
+		for (unsigned i = 0; i < kIngestStages; i++) {
+			s.stage[i].items = counters_[i].items.load(std::memory_order_relaxed);
+			s.stage[i].bytes = counters_[i].bytes.load(std::memory_order_relaxed);
+			s.stage[i].waits = counters_[i].waits.load(std::memory_order_relaxed);
+			s.stage[i].depth = depth[i];
+			s.stage[i].max_depth = counters_[i].max_depth.load(std::memory_order_relaxed);
+			s.stage[i].capacity = capacity[i];
+		}
+		s.free_chunks = chunks_.available();
+		s.free_blocks = blocks_.available();
+		s.dropped_blocks = dropped_blocks_.load(std::memory_order_relaxed);
+		s.dropped_samples = dropped_samples_.load(std::memory_order_relaxed);
+		s.packets = packets_.load(std::memory_order_relaxed);
+		s.lost = lost_.load(std::memory_order_relaxed);
+		s.malformed = malformed_.load(std::memory_order_relaxed);
+		s.index_gaps = index_gaps_.load(std::memory_order_relaxed);
+		if (config_.capture) {
+			s.restarts = config_.capture->restarts();
+			s.out_of_order = config_.capture->out_of_order();
+		}
+		return s;
+	}
+
+	std::array<ChannelSummary, kIngestChannels> IngestPipeline::take_summary() {
+		std::array<ChannelSummary, kIngestChannels> out;
+		std::lock_guard<std::mutex> lock(summary_mutex_);
+
+		for (unsigned ch = 0; ch < kIngestChannels; ch++) {
+			const Accumulator &a = summary_[ch];
+			if (a.count) {
+				out[ch].count = a.count;
+				out[ch].mean = a.sum / double(a.count);
+				out[ch].rms = std::sqrt(a.sum_sq / double(a.count));
+				out[ch].min = a.min;
+				out[ch].max = a.max;
+			}
+		}
+		summary_.fill(Accumulator());
+		return out;
+	}
+
+	uint64_t IngestPipeline::spectra(std::array<ChannelSpectrum, kAdcChannels> &out) const {
+		std::lock_guard<std::mutex> lock(spectra_mutex_);
+
+		out = spectra_;
+		return publications_;
+	}
+
+} // namespace daq
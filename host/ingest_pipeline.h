@@ -0,0 +1,198 @@
+/****************************************************************
+* INGEST PIPELINE (host library)
+*
+* The receive path split into stages on their own threads, so a slow stage no longer stalls the socket:
+*
+*   read (caller) --chunks--> decode + scale --blocks--> analyze --blocks--> store
+*
+* Stages are joined by SPSC queues (spsc_queue.h) and hand over whole batches: every chunk of stream read by one
+* recv, every block decoded from one chunk, up to kBatch blocks at a time after that. Chunks and blocks come from
+* pools allocated up front -- the steady state allocates nothing.
+*
+* Back-pressure: the reader waits for a free chunk (the stream stays intact: TCP holds the board back and its sample
+* rings take the rest). Decode waits for a free block (Overflow::Block) or drops the packet's samples and counts them
+* (Overflow::Drop), so a stalled disk holds blocks until the pool runs dry and then either slows the reader or loses
+* samples -- never silently. Every stage counts what it moved and how often it waited, every queue its depth.
+*
+* Blocks are scaled with the unpack kernels (unpack24.h) and calibration; thermocouple readings travel as one-sample
+* blocks of temperatures. Analyze keeps per-channel mean, RMS and extremes and, when enabled, the streaming spectra of
+* the IEPE channels (spectrum.h): Welch PSD, RMS, peak and crest factor, published every publish_ms for spectra() to
+* read while the stream runs. Store appends the blocks to a capture file (capture_file.h), or discards them.
+***************************************************************/
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "capture_file.h"
+#include "daq_stream.h"
+#include "spectrum.h"
+#include "spsc_queue.h"
+#include "unpack24.h"
+
+namespace daq {
+
+	constexpr size_t kChunkBytes = 64 * 1024;		// One recv
+	constexpr unsigned kBlockSamples = 256;			// Larger packets are split over blocks
+	constexpr size_t kBatch = 256;					// Blocks moved per handoff after decode
+	constexpr uint8_t kTcSource = kAdcCount;		// ScaledBlock::adc of thermocouple readings
+	constexpr unsigned kIngestChannels = kAdcCount * kAdcChannels + kTcCount;	// Mask bit order, PKT_CH_IEPE0 - PKT_CH_TC3
+
+	struct Chunk {
+		size_t len = 0;
+		bool reset = false;				// First bytes of a new connection
+		uint8_t data[kChunkBytes];
+	};
+
+	// Samples of one ADC packet, scaled, or one thermocouple reading (adc = kTcSource, values in C, NaN if faulted)
+	struct ScaledBlock {
+		uint8_t device = 0;
+		uint8_t adc = 0;				// Channel c of the block is mask bit 4 x adc + c
+		uint8_t faults = 0;				// As in the packet, PKT_FLAG_BURST included
+		uint8_t decim = 0;
+		bool restart = false;			// First block of a new connection
+		uint16_t mask = 0;
+		uint16_t channels = 0;			// Channels of the source in the mask, in mask order
+		uint32_t packet = 0;
+		uint32_t first_index = 0;
+		uint32_t count = 0;
+		uint64_t time_us[kBlockSamples];
+		float value[kAdcChannels][kBlockSamples];
+	};
+
+	enum class Overflow {
+		Block,		// Decode waits for a free block: back-pressure up to the socket
+		Drop		// Decode drops samples while no block is free, counted
+	};
+
+	struct IngestConfig {
+		size_t chunks = 64;				// 4 MiB of stream in flight
+		size_t blocks = 8192;			// About 3.8 s of both ADCs at full rate
+		Overflow overflow = Overflow::Block;
+		ChannelCal cal[kAdcCount * kAdcChannels];	// Mask bit order: IEPE0-3, FB0, FB1, CL0, CL1
+		CaptureWriter *capture = nullptr;	// Store stage output, open (nullptr: discard)
+		unsigned stall_ms = 0;			// Store stage stalls this long ...
+		unsigned stall_every_ms = 0;	// ... this often -- a disk hiccup, for testing
+		bool spectra = false;			// Analyze stage keeps the IEPE channels' spectra (live ADC0 blocks only)
+		SpectrumConfig spectrum;
+		unsigned publish_ms = 1000;		// Spectra published this often, each over the samples since the previous one
+	};
+
+	enum IngestStage { kStageRead, kStageDecode, kStageAnalyze, kStageStore, kIngestStages };
+
+	struct IngestStats {
+		struct Stage {
+			uint64_t items = 0;			// Chunks (read, decode) or blocks (analyze, store) passed on
+			uint64_t bytes = 0;			// Stream bytes (read, decode) or sample bytes (analyze, store)
+			uint64_t waits = 0;			// Times the stage waited for a buffer downstream
+			size_t depth = 0;			// Queue into the stage now
+			size_t max_depth = 0;
+			size_t capacity = 0;
+		} stage[kIngestStages];
+		size_t free_chunks = 0;
+		size_t free_blocks = 0;
+		uint64_t dropped_blocks = 0;	// Overflow::Drop
+		uint64_t dropped_samples = 0;
+		uint64_t packets = 0;			// Decoder: packets, lost (counter gaps), malformed, conversions missing
+		uint64_t lost = 0;
+		uint64_t malformed = 0;
+		uint64_t index_gaps = 0;
+		uint64_t restarts = 0;			// Capture: time segments started by a restarted board clock
+		uint64_t out_of_order = 0;		// Capture: rows dropped as older than their series' last row
+	};
+
+	struct ChannelSummary {
+		uint64_t count = 0;
+		double mean = 0.0;
+		double rms = 0.0;
+		float min = 0.0f;
+		float max = 0.0f;
+	};
+
+	class IngestPipeline {
+	public:
+		explicit IngestPipeline(const IngestConfig &config);
+		~IngestPipeline();
+
+		IngestPipeline(const IngestPipeline &) = delete;
+		IngestPipeline &operator=(const IngestPipeline &) = delete;
+
+		// Read stage (the caller's thread): a free chunk to fill, waiting while all are in use, then hand it on
+		Chunk *chunk();
+		void submit(Chunk *chunk);
+
+		// Copies into chunks
+		void feed(const uint8_t *data, size_t len);
+
+		// Next bytes come from a new connection
+		void reset() { reset_ = true; }
+
+		// Processes everything submitted and stops the stages
+		void finish();
+
+		IngestStats stats() const;
+
+		// Per-channel figures (mask bit order) since the previous call
+		std::array<ChannelSummary, kIngestChannels> take_summary();
+
+		// Latest published spectra of IEPE0-3 (out's buffers are reused); returns the number of publications so far,
+		// 0 while there is nothing to read
+		uint64_t spectra(std::array<ChannelSpectrum, kAdcChannels> &out) const;
+
+	private:
+		struct Counters {
+			std::atomic<uint64_t> items{0};
+			std::atomic<uint64_t> bytes{0};
+			std::atomic<uint64_t> waits{0};
+			std::atomic<size_t> max_depth{0};
+		};
+
+		struct Accumulator {
+			uint64_t count = 0;
+			double sum = 0.0;
+			double sum_sq = 0.0;
+			float min = 0.0f;
+			float max = 0.0f;
+		};
+
+		class Decoder;
+
+		void decode_stage();
+		void analyze_stage();
+		void store_stage();
+		static void note_depth(Counters &c, size_t depth);
+
+		IngestConfig config_;
+		BufferPool<Chunk> chunks_;
+		BufferPool<ScaledBlock> blocks_;
+		SpscQueue<Chunk *> to_decode_;
+		SpscQueue<ScaledBlock *> to_analyze_;
+		SpscQueue<ScaledBlock *> to_store_;
+		Counters counters_[kIngestStages];
+		std::atomic<uint64_t> dropped_blocks_{0};
+		std::atomic<uint64_t> dropped_samples_{0};
+		std::atomic<uint64_t> packets_{0};
+		std::atomic<uint64_t> lost_{0};
+		std::atomic<uint64_t> malformed_{0};
+		std::atomic<uint64_t> index_gaps_{0};
+		std::atomic<bool> read_done_{false};
+		std::atomic<bool> decode_done_{false};
+		std::atomic<bool> analyze_done_{false};
+		bool reset_ = false;
+		bool finished_ = false;
+		std::mutex summary_mutex_;		// Published summary only -- not on the data path
+		std::array<Accumulator, kIngestChannels> summary_;
+		mutable std::mutex spectra_mutex_;	// Published spectra only
+		std::array<ChannelSpectrum, kAdcChannels> spectra_;
+		uint64_t publications_ = 0;
+		std::thread decode_thread_;
+		std::thread analyze_thread_;
+		std::thread store_thread_;
+	};
+
+} // namespace daq
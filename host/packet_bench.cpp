@@ -0,0 +1,270 @@
+/****************************************************************
+* PACKET HEADER BENCHMARK
+*
+* Speed of the header encoder and decoder expanded from PKT_HEADER_FIELDS (daq_packet.h) against two hand-written
+* versions of the same layout: byte shifts at literal offsets, and the MSB-first byte loops daq_packet.c used
+* before. Every header of the set is encoded and decoded by all three and compared byte for byte / field for field.
+*
+* The references are kept out of line like daq_put_header / daq_get_header, which live in daq_packet.o.
+*
+*   ./packet_bench [--headers N] [--seconds S]
+***************************************************************/
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "daq_packet.h"
+}
+
+namespace {
+
+	using Clock = std::chrono::steady_clock;
+
+	// Packet length as daq_packet.c computes it
+	uint32_t length_of(const daq_header_t &h) {
+		if ((h.type == PKT_TYPE_REPLY) || (h.type == PKT_TYPE_TELEMETRY) || (h.type == PKT_TYPE_BURST)) {
+			return PKT_HEADER_SIZE + h.count;
+		}
+		return PKT_HEADER_SIZE + uint32_t(h.count) * daq_sample_size(h.mask);
+	}
+
+	bool valid(const daq_header_t &h) {
+		if ((h.type > PKT_TYPE_BURST) || ((h.mask >> PKT_CH_COUNT) != 0U) ||
+			((h.type != PKT_TYPE_SAMPLES) && (h.type != PKT_TYPE_COMPRESSED) && (h.mask != 0U))) {
+			return false;
+		}
+		return (h.type == PKT_TYPE_COMPRESSED) ? ((h.length > PKT_HEADER_SIZE) && (h.length < length_of(h))) :
+			(h.length == length_of(h));
+	}
+
+	// Byte shifts at the documented offsets (main.c, FORMAT OF dataArray)
+	__attribute__((noinline)) void shifts_put(uint8_t *p, const daq_header_t *h) {
+		uint16_t length = uint16_t(length_of(*h));
+
+		p[0] = PKT_SYNC;
+		p[1] = PKT_VERSION;
+		p[2] = h->device;
+		p[3] = h->faults;
+		p[4] = uint8_t(length >> 8);
+		p[5] = uint8_t(length);
+		p[6] = uint8_t(h->mask >> 8);
+		p[7] = uint8_t(h->mask);
+		p[8] = uint8_t(h->count >> 8);
+		p[9] = uint8_t(h->count);
+		p[10] = h->decim;
+		p[11] = h->type;
+		p[12] = uint8_t(h->packet >> 24);
+		p[13] = uint8_t(h->packet >> 16);
+		p[14] = uint8_t(h->packet >> 8);
+		p[15] = uint8_t(h->packet);
+		p[16] = uint8_t(h->index >> 24);
+		p[17] = uint8_t(h->index >> 16);
+		p[18] = uint8_t(h->index >> 8);
+		p[19] = uint8_t(h->index);
+		for (unsigned i = 0; i < 8; i++) {
+			p[20 + i] = uint8_t(h->time_us >> (56 - 8 * i));
+		}
+	}
+
+	__attribute__((noinline)) int32_t shifts_get(const uint8_t *p, uint32_t len, daq_header_t *h) {
+		if (len < PKT_HEADER_SIZE) {
+			return ((len > 0) && (p[0] != PKT_SYNC)) ? -1 : 0;
+		}
+		if ((p[0] != PKT_SYNC) || (p[1] != PKT_VERSION)) {
+			return -1;
+		}
+		h->device = p[2];
+		h->faults = p[3];
+		h->length = uint16_t((p[4] << 8) | p[5]);
+		h->mask = uint16_t((p[6] << 8) | p[7]);
+		h->count = uint16_t((p[8] << 8) | p[9]);
+		h->decim = p[10];
+		h->type = p[11];
+		h->packet = (uint32_t(p[12]) << 24) | (uint32_t(p[13]) << 16) | (uint32_t(p[14]) << 8) | p[15];
+		h->index = (uint32_t(p[16]) << 24) | (uint32_t(p[17]) << 16) | (uint32_t(p[18]) << 8) | p[19];
+		h->time_us = 0;
+		for (unsigned i = 0; i < 8; i++) {
+			h->time_us = (h->time_us << 8) | p[20 + i];
+		}
+		if (!valid(*h)) {
+			return -1;
+		}
+		return (len < h->length) ? 0 : int32_t(h->length);
+	}
+
+	// MSB-first loops over a byte count, as daq_packet.c had them
+	void put_be(uint8_t *p, uint64_t value, uint8_t bytes) {
+		for (uint8_t i = 0; i < bytes; i++) {
+			p[i] = uint8_t(value >> (8U * (bytes - 1U - i)));
+		}
+	}
+
+	uint64_t get_be(const uint8_t *p, uint8_t bytes) {
+		uint64_t value = 0;
+
+		for (uint8_t i = 0; i < bytes; i++) {
+			value = (value << 8) | p[i];
+		}
+		return value;
+	}
+
+	__attribute__((noinline)) void loops_put(uint8_t *p, const daq_header_t *h) {
+		p[0] = PKT_SYNC;
+		p[1] = PKT_VERSION;
+		p[2] = h->device;
+		p[3] = h->faults;
+		put_be(p + 4, length_of(*h), 2);
+		put_be(p + 6, h->mask, 2);
+		put_be(p + 8, h->count, 2);
+		p[10] = h->decim;
+		p[11] = h->type;
+		put_be(p + 12, h->packet, 4);
+		put_be(p + 16, h->index, 4);
+		put_be(p + 20, h->time_us, 8);
+	}
+
+	__attribute__((noinline)) int32_t loops_get(const uint8_t *p, uint32_t len, daq_header_t *h) {
+		if (len < PKT_HEADER_SIZE) {
+			return ((len > 0) && (p[0] != PKT_SYNC)) ? -1 : 0;
+		}
+		if ((p[0] != PKT_SYNC) || (p[1] != PKT_VERSION)) {
+			return -1;
+		}
+		h->device = p[2];
+		h->faults = p[3];
+		h->length = uint16_t(get_be(p + 4, 2));
+		h->mask = uint16_t(get_be(p + 6, 2));
+		h->count = uint16_t(get_be(p + 8, 2));
+		h->decim = p[10];
+		h->type = p[11];
+		h->packet = uint32_t(get_be(p + 12, 4));
+		h->index = uint32_t(get_be(p + 16, 4));
+		h->time_us = get_be(p + 20, 8);
+		if (!valid(*h)) {
+			return -1;
+		}
+		return (len < h->length) ? 0 : int32_t(h->length);
+	}
+
+	bool same(const daq_header_t &a, const daq_header_t &b) {
+		return (a.device == b.device) && (a.faults == b.faults) && (a.length == b.length) && (a.mask == b.mask) &&
+			(a.count == b.count) && (a.decim == b.decim) && (a.type == b.type) && (a.packet == b.packet) &&
+			(a.index == b.index) && (a.time_us == b.time_us);
+	}
+
+	// Runs fn over all headers until 'seconds' have passed, returns ns per header
+	template <typename Fn>
+	double ns_per_header(double seconds, size_t headers, Fn fn) {
+		uint64_t passes = 0;
+		auto start = Clock::now();
+		double elapsed = 0.0;
+
+		while (elapsed < seconds) {
+			fn();
+			passes++;
+			elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+		}
+		return elapsed * 1e9 / (double(passes) * double(headers));
+	}
+
+} // namespace
+
+int main(int argc, char **argv) {
+	size_t count = 4096;
+	double seconds = 0.5;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if ((arg == "--headers") && (i + 1 < argc)) count = size_t(std::atol(argv[++i]));
+		else if ((arg == "--seconds") && (i + 1 < argc)) seconds = std::atof(argv[++i]);
+		else {
+			std::printf("usage: %s [--headers N] [--seconds S]\n", argv[0]);
+			return (arg == "--help") ? 0 : 1;
+		}
+	}
+	if (count == 0) {
+		count = 1;
+	}
+
+	// The mix the stream carries: ADC packets of either ADC, thermocouple cycles, command replies
+	std::vector<daq_header_t> headers(count);
+	std::mt19937_64 rng(12345);
+	for (size_t i = 0; i < count; i++) {
+		daq_header_t &h = headers[i];
+		unsigned kind = unsigned(rng() % 8);
+
+		h = daq_header_t{};
+		h.device = uint8_t(rng());
+		h.faults = uint8_t(rng());
+		h.decim = uint8_t(rng() % 8);
+		h.packet = uint32_t(rng());
+		h.index = uint32_t(rng());
+		h.time_us = rng();
+		if (kind < 6) {
+			h.mask = uint16_t(PKT_CH_ADC(kind & 1) | PKT_CH_STATUS);
+			h.count = SAMPLES_PER_PACKET;
+		}
+		else if (kind == 6) {
+			h.mask = PKT_CH_TC;
+			h.count = 1;
+			h.decim = 0;
+		}
+		else {
+			h.type = PKT_TYPE_REPLY;
+			h.count = uint16_t(CMD_REPLY_DATA + rng() % 16);
+			h.decim = 0;
+		}
+		h.length = uint16_t(length_of(h));
+	}
+
+	// Bit-exact: every encoder gives the same bytes, every decoder the same fields
+	std::vector<uint8_t> generated(count * PKT_HEADER_SIZE), shifts(count * PKT_HEADER_SIZE), loops(count * PKT_HEADER_SIZE);
+	size_t mismatches = 0;
+	for (size_t i = 0; i < count; i++) {
+		uint8_t *g = &generated[i * PKT_HEADER_SIZE];
+		daq_header_t a, b, c;
+
+		daq_put_header(g, &headers[i]);
+		shifts_put(&shifts[i * PKT_HEADER_SIZE], &headers[i]);
+		loops_put(&loops[i * PKT_HEADER_SIZE], &headers[i]);
+		int32_t ra = daq_get_header(g, PKT_HEADER_SIZE, &a);
+		int32_t rb = shifts_get(g, PKT_HEADER_SIZE, &b);
+		int32_t rc = loops_get(g, PKT_HEADER_SIZE, &c);
+		if ((ra != rb) || (ra != rc) || !same(a, headers[i]) || !same(b, a) || !same(c, a) ||
+			(std::memcmp(g, &shifts[i * PKT_HEADER_SIZE], PKT_HEADER_SIZE) != 0) ||
+			(std::memcmp(g, &loops[i * PKT_HEADER_SIZE], PKT_HEADER_SIZE) != 0)) {
+			mismatches++;
+		}
+	}
+
+	volatile uint64_t sink = 0;
+	auto encode = [&](void (*put)(uint8_t *, const daq_header_t *), std::vector<uint8_t> &out) {
+		return ns_per_header(seconds, count, [&] {
+			for (size_t i = 0; i < count; i++) {
+				put(&out[i * PKT_HEADER_SIZE], &headers[i]);
+			}
+		});
+	};
+	auto decode = [&](int32_t (*get)(const uint8_t *, uint32_t, daq_header_t *)) {
+		return ns_per_header(seconds, count, [&] {
+			daq_header_t h;
+			for (size_t i = 0; i < count; i++) {
+				sink = sink + uint64_t(get(&generated[i * PKT_HEADER_SIZE], PKT_HEADER_SIZE, &h)) + h.time_us;
+			}
+		});
+	};
+
+	std::printf("%zu headers (ADC, thermocouple and reply packets), %u bytes each\n", count, PKT_HEADER_SIZE);
+	std::printf("%-22s encode %6.2f ns   decode %6.2f ns\n", "PKT_HEADER_FIELDS", encode(daq_put_header, generated),
+		decode(daq_get_header));
+	std::printf("%-22s encode %6.2f ns   decode %6.2f ns\n", "hand-written shifts", encode(shifts_put, shifts), decode(shifts_get));
+	std::printf("%-22s encode %6.2f ns   decode %6.2f ns\n", "byte loops (previous)", encode(loops_put, loops), decode(loops_get));
+	std::printf("%s (%zu mismatches)\n", mismatches ? "NOT bit-exact" : "bit-exact", mismatches);
+	return mismatches ? 1 : 0;
+}
@@ -0,0 +1,213 @@
+/****************************************************************
+* PACKET ROUND-TRIP TEST
+*
+* Packs random ADC and thermocouple packets with the firmware's encoder (daq_packet.c) and reads them back with the
+* decoder the host tools use:
+*
+*   round trip  -- every header field and every sample word comes back, the length matches the bytes written
+*   truncation  -- a packet cut anywhere short of its length asks for more bytes (0), never reads as valid or bad
+*   bad sync    -- a wrong sync byte is rejected from the first byte on, a wrong version once the header is in
+*
+*   ./packet_test [--packets N]
+***************************************************************/
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "adc_ring.h"
+#include "daq_packet.h"
+}
+
+namespace {
+
+	struct Packet {
+		daq_header_t header;
+		std::vector<uint8_t> bytes;
+		std::vector<uint16_t> deltas;
+		std::vector<uint8_t> words;		// ADC frames (ADC_FRAME_BYTES) or thermocouple cycles (4 words) as packed
+	};
+
+	constexpr uint32_t kTcCycleBytes = 4U * PKT_TC_WORD_BYTES;
+
+	Packet make_packet(std::mt19937_64 &rng) {
+		Packet p;
+		daq_header_t &h = p.header;
+		bool tc = (rng() % 4) == 0;
+
+		h = daq_header_t{};
+		h.device = uint8_t(rng());
+		h.faults = uint8_t(rng());
+		h.type = PKT_TYPE_SAMPLES;
+		h.packet = uint32_t(rng());
+		h.index = uint32_t(rng());
+		h.time_us = rng();
+		if (tc) {
+			h.mask = uint16_t(PKT_CH_TC0 << (rng() % 4));
+			h.mask |= uint16_t(rng() & PKT_CH_TC);
+			h.count = 1;
+		}
+		else {
+			uint8_t adc = uint8_t(rng() % 2);
+
+			h.mask = uint16_t(PKT_CH_IEPE0 << (4U * adc + rng() % 4));
+			h.mask |= uint16_t(rng() & (PKT_CH_ADC(adc) | PKT_CH_STATUS));
+			h.count = uint16_t(1U + rng() % SAMPLES_PER_PACKET);
+			h.decim = uint8_t(rng() % 8);
+		}
+
+		uint32_t source_bytes = tc ? kTcCycleBytes : ADC_FRAME_BYTES;
+		uint8_t adc = (h.mask & PKT_CH_ADC(1)) ? 1U : 0U;
+
+		p.bytes.resize(PACKET_MAX_SIZE);
+		p.deltas.resize(h.count);
+		p.words.resize(size_t(h.count) * source_bytes);
+		uint8_t *out = p.bytes.data() + PKT_HEADER_SIZE;
+		for (uint16_t i = 0; i < h.count; i++) {
+			uint8_t *source = &p.words[size_t(i) * source_bytes];
+
+			p.deltas[i] = uint16_t(rng());
+			for (uint32_t b = 0; b < source_bytes; b++) {
+				source[b] = uint8_t(rng());
+			}
+			out = tc ? daq_put_tc_sample(out, h.mask, p.deltas[i], source) :
+				daq_put_adc_sample(out, h.mask, adc, p.deltas[i], source);
+		}
+		daq_put_header(p.bytes.data(), &h);
+		p.bytes.resize(size_t(out - p.bytes.data()));
+		return p;
+	}
+
+	uint32_t be(const uint8_t *p, uint32_t bytes) {
+		uint32_t value = 0;
+
+		for (uint32_t i = 0; i < bytes; i++) {
+			value = (value << 8) | p[i];
+		}
+		return value;
+	}
+
+	// Words sample i should decode to, indexed by mask bit as daq_get_sample returns them
+	void expected_values(const Packet &p, uint16_t i, int32_t values[PKT_CH_COUNT]) {
+		uint16_t mask = p.header.mask;
+
+		for (uint32_t bit = 0; bit < PKT_CH_COUNT; bit++) {
+			values[bit] = 0;
+		}
+		if (mask & PKT_CH_TC) {
+			const uint8_t *cycle = &p.words[size_t(i) * kTcCycleBytes];
+
+			for (uint32_t tc = 0; tc < 4U; tc++) {
+				if (mask & (PKT_CH_TC0 << tc)) {
+					values[8U + tc] = int32_t(be(cycle + PKT_TC_WORD_BYTES * tc, PKT_TC_WORD_BYTES));
+				}
+			}
+			return;
+		}
+
+		const uint8_t *frame = &p.words[size_t(i) * ADC_FRAME_BYTES];
+		uint32_t adc = (mask & PKT_CH_ADC(1)) ? 1U : 0U;
+		if (mask & PKT_CH_STATUS) {
+			values[PKT_CH_COUNT - 1U] = int32_t(be(frame, PKT_ADC_WORD_BYTES));
+		}
+		for (uint32_t ch = 0; ch < 4U; ch++) {
+			if (mask & (PKT_CH_IEPE0 << (4U * adc + ch))) {
+				uint32_t raw = be(frame + PKT_ADC_WORD_BYTES * (ch + 1U), PKT_ADC_WORD_BYTES);
+
+				values[4U * adc + ch] = int32_t(raw << 8) >> 8;
+			}
+		}
+	}
+
+	bool same_header(const daq_header_t &a, const daq_header_t &b) {
+		return (a.device == b.device) && (a.faults == b.faults) && (a.mask == b.mask) && (a.count == b.count) &&
+			(a.decim == b.decim) && (a.type == b.type) && (a.packet == b.packet) && (a.index == b.index) &&
+			(a.time_us == b.time_us);
+	}
+
+	bool round_trip(const Packet &p) {
+		daq_header_t h;
+
+		if ((daq_get_header(p.bytes.data(), uint32_t(p.bytes.size()), &h) != int32_t(p.bytes.size())) ||
+			!same_header(h, p.header) || (h.length != p.bytes.size())) {
+			return false;
+		}
+		for (uint16_t i = 0; i < h.count; i++) {
+			int32_t values[PKT_CH_COUNT], expected[PKT_CH_COUNT];
+			uint16_t delta;
+
+			daq_get_sample(p.bytes.data(), &h, i, &delta, values);
+			expected_values(p, i, expected);
+			if (delta != p.deltas[i]) {
+				return false;
+			}
+			for (uint32_t bit = 0; bit < PKT_CH_COUNT; bit++) {
+				if (values[bit] != expected[bit]) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	// Every length short of the packet asks for more bytes
+	bool truncation(const Packet &p) {
+		daq_header_t h;
+
+		for (uint32_t len = 0; len < p.bytes.size(); len++) {
+			if (daq_get_header(p.bytes.data(), len, &h) != 0) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Any sync byte but PKT_SYNC is rejected as soon as it is seen, any version but PKT_VERSION with the header
+	bool bad_sync(const Packet &p, std::mt19937_64 &rng) {
+		std::vector<uint8_t> bytes = p.bytes;
+		uint32_t full = uint32_t(bytes.size());
+		daq_header_t h;
+
+		bytes[0] = uint8_t(PKT_SYNC ^ (1U + rng() % 255U));
+		if ((daq_get_header(bytes.data(), 1, &h) != -1) || (daq_get_header(bytes.data(), full, &h) != -1)) {
+			return false;
+		}
+		bytes[0] = PKT_SYNC;
+		bytes[1] = uint8_t(PKT_VERSION ^ (1U + rng() % 255U));
+		return (daq_get_header(bytes.data(), PKT_HEADER_SIZE - 1U, &h) == 0) &&
+			(daq_get_header(bytes.data(), full, &h) == -1);
+	}
+
+} // namespace
+
+int main(int argc, char **argv) {
+	size_t count = 200000;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if ((arg == "--packets") && (i + 1 < argc)) count = size_t(std::atol(argv[++i]));
+		else {
+			std::printf("usage: %s [--packets N]\n", argv[0]);
+			return (arg == "--help") ? 0 : 1;
+		}
+	}
+
+	std::mt19937_64 rng(2024);
+	size_t round_trip_errors = 0, truncation_errors = 0, sync_errors = 0, samples = 0;
+	for (size_t n = 0; n < count; n++) {
+		Packet p = make_packet(rng);
+
+		samples += p.header.count;
+		round_trip_errors += round_trip(p) ? 0U : 1U;
+		truncation_errors += truncation(p) ? 0U : 1U;
+		sync_errors += bad_sync(p, rng) ? 0U : 1U;
+	}
+
+	std::printf("round trip  %zu packets, %zu samples -- %zu errors\n", count, samples, round_trip_errors);
+	std::printf("truncation  every length short of each packet -- %zu errors\n", truncation_errors);
+	std::printf("bad sync    sync byte and version -- %zu errors\n", sync_errors);
+	return (round_trip_errors || truncation_errors || sync_errors) ? 1 : 0;
+}
@@ -0,0 +1,167 @@
+/****************************************************************
+* ADC SAMPLE RING TEST
+*
+* Drives the firmware's sample ring (adc_ring.h) from two threads, as the DRDY / SPI interrupts and the main loop do
+* on the board: the producer claims a slot, fills the frame and commits it at the full DRDY rate (42.667kHz, paced
+* against the host clock), the consumer takes up to SAMPLES_PER_PACKET frames at a time like packSamples.
+*
+* Every frame carries its conversion number in the index, time and all 18 data bytes, so the consumer sees a torn or
+* reordered frame as a content error. Frames may only go missing when the ring was full: each gap in the indices the
+* consumer sees must be covered by the ring's overflow count, and frames received + overflows = frames produced.
+*
+*   1. paced     -- consumer draining as fast as it can
+*   2. stalled   -- consumer pausing 8ms (longer than the ring's 6ms of headroom) every 100ms, so the ring fills,
+*                   overflows and has to recover
+*
+*   ./ring_test [--seconds S]
+***************************************************************/
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+extern "C" {
+#include "adc_ring.h"
+#include "daq_packet.h"
+}
+
+namespace {
+
+	using Clock = std::chrono::steady_clock;
+
+	constexpr double kDrdyHz = 42667.0;
+	constexpr uint64_t kTicksPerFrame = 1406;	// Timebase ticks between DRDY edges (60 per us)
+
+	// Frame content derived from the conversion number
+	uint8_t frame_byte(uint32_t index, uint32_t i) {
+		return uint8_t((index * 131U) + (i * 29U) + (index >> 8));
+	}
+
+	struct Result {
+		uint64_t produced = 0;
+		uint64_t received = 0;
+		uint64_t overflows = 0;
+		uint64_t gaps = 0;			// Frames missing from the indices the consumer saw
+		uint64_t content_errors = 0;
+		uint64_t packets = 0;
+		double seconds = 0.0;
+	};
+
+	// Runs one producer/consumer pass at the DRDY rate. stall_ms > 0 makes the consumer sleep that long every 100ms.
+	Result run(uint64_t frames, uint32_t stall_ms) {
+		static adc_ring_t ring;
+		std::atomic<bool> done(false);
+		Result result;
+
+		ring.head = 0;
+		ring.tail = 0;
+		ring.overflows = 0;
+
+		auto start = Clock::now();
+
+		std::thread producer([&] {
+			for (uint64_t n = 0; n < frames; n++) {
+				auto due = start + std::chrono::nanoseconds(uint64_t(double(n) * 1e9 / kDrdyHz));
+				while (Clock::now() < due) {
+					std::this_thread::yield();
+				}
+
+				adc_frame_t *frame = adc_ring_claim(&ring);
+				if (frame == 0) {
+					continue; // Conversion lost, counted by the ring
+				}
+				frame->index = uint32_t(n);
+				frame->time = n * kTicksPerFrame;
+				for (uint32_t i = 0; i < ADC_FRAME_BYTES; i++) {
+					frame->data[i] = frame_byte(uint32_t(n), i);
+				}
+				adc_ring_commit(&ring);
+			}
+			done.store(true, std::memory_order_release);
+		});
+
+		// Consumer -- the main loop
+		uint64_t expected = 0;
+		auto next_stall = start + std::chrono::milliseconds(100);
+		for (;;) {
+			bool finished = done.load(std::memory_order_acquire);
+			uint32_t count = adc_ring_count(&ring);
+
+			if (count == 0U) {
+				if (finished) {
+					break;
+				}
+				std::this_thread::yield();
+				continue;
+			}
+			if (count > SAMPLES_PER_PACKET) {
+				count = SAMPLES_PER_PACKET;
+			}
+			for (uint32_t k = 0; k < count; k++) {
+				const adc_frame_t *frame = adc_ring_peek(&ring, k);
+				bool ok = (frame->index >= expected) && (frame->time == uint64_t(frame->index) * kTicksPerFrame);
+
+				for (uint32_t i = 0; ok && (i < ADC_FRAME_BYTES); i++) {
+					ok = (frame->data[i] == frame_byte(frame->index, i));
+				}
+				if (!ok) {
+					result.content_errors++;
+					continue;
+				}
+				result.gaps += frame->index - expected;
+				expected = uint64_t(frame->index) + 1U;
+			}
+			adc_ring_release(&ring, count);
+			result.received += count;
+			result.packets++;
+			if ((stall_ms != 0U) && (Clock::now() >= next_stall)) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(stall_ms));
+				next_stall += std::chrono::milliseconds(100);
+			}
+		}
+		producer.join();
+
+		result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		result.produced = frames;
+		result.gaps += frames - expected; // Lost at the end
+		result.overflows = ring.overflows;
+		return result;
+	}
+
+	bool check(const char *name, const Result &r, bool expect_overflows) {
+		bool accounted = (r.gaps == r.overflows) && ((r.received + r.overflows) == r.produced);
+		bool ok = accounted && (r.content_errors == 0U) && (!expect_overflows || (r.overflows != 0U));
+
+		std::printf("%-8s %8llu frames in %.2f s (%.0f Hz), packets %llu, received %llu, overflows %llu, gaps %llu, "
+			"content errors %llu -- %s\n", name, (unsigned long long)r.produced, r.seconds, double(r.produced) / r.seconds,
+			(unsigned long long)r.packets, (unsigned long long)r.received, (unsigned long long)r.overflows,
+			(unsigned long long)r.gaps, (unsigned long long)r.content_errors, ok ? "ok" : "FAILED");
+		return ok;
+	}
+
+} // namespace
+
+int main(int argc, char **argv) {
+	double seconds = 1.0;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if ((arg == "--seconds") && (i + 1 < argc)) seconds = std::atof(argv[++i]);
+		else {
+			std::printf("usage: %s [--seconds S]\n", argv[0]);
+			return (arg == "--help") ? 0 : 1;
+		}
+	}
+
+	uint64_t frames = uint64_t(seconds * kDrdyHz);
+	if (frames == 0U) {
+		frames = 1;
+	}
+
+	bool ok = check("paced", run(frames, 0), false);
+	ok = check("stalled", run(frames, 8), true) && ok;
+	return ok ? 0 : 1;
+}
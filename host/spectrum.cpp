@@ -0,0 +1,313 @@
+/****************************************************************
+* SPECTRUM (host library) -- see spectrum.h
+*
+* The real FFT packs even/odd samples into one complex sequence z[m] = x[2m] + i x[2m+1] (windowed and bit
+* reversed in the same pass), runs an iterative radix-2 decimation-in-time FFT of n/2 points on split re/im arrays,
+* and untangles bin k of the real input from Z[k] and Z[n/2 - k]:
+*
+*   X[k] = (Z[k] + conj Z[n/2-k]) / 2 - i e^(-2 pi i k / n) (Z[k] - conj Z[n/2-k]) / 2
+*
+* The AVX2 kernels do the butterflies of every stage of span 8 and up and the untangling eight bins at a time, with
+* the same operations in the same order as the scalar code (no FMA), so the results are bit-identical.
+***************************************************************/
+#include "spectrum.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SPECTRUM_X86 1
+#include <immintrin.h>
+#endif
+
+namespace daq {
+
+	namespace {
+
+		// One stage of butterflies: blocks of 2 x span, twiddles w[j], j < span
+		void scalar_stage(float *re, float *im, size_t m, size_t span, const float *w_re, const float *w_im) {
+			for (size_t start = 0; start < m; start += 2 * span) {
+				float *ar = re + start, *ai = im + start;
+				float *br = ar + span, *bi = ai + span;
+
+				for (size_t j = 0; j < span; j++) {
+					float tr = w_re[j] * br[j] - w_im[j] * bi[j];
+					float ti = w_re[j] * bi[j] + w_im[j] * br[j];
+
+					br[j] = ar[j] - tr;
+					bi[j] = ai[j] - ti;
+					ar[j] = ar[j] + tr;
+					ai[j] = ai[j] + ti;
+				}
+			}
+		}
+
+		// Bin k of the real input from Z[k] (zr, zi) and Z[m - k] (rr, ri), twiddle e^(-2 pi i k / n) (wr, wi)
+		inline void untangle_bin(float zr, float zi, float rr, float ri, float wr, float wi, float &xr, float &xi) {
+			float er = (zr + rr) * 0.5f;
+			float ei = (zi - ri) * 0.5f;
+			float or_ = (zi + ri) * 0.5f;
+			float oi = (rr - zr) * 0.5f;
+
+			xr = er + (wr * or_ - wi * oi);
+			xi = ei + (wr * oi + wi * or_);
+		}
+
+#ifdef SPECTRUM_X86
+
+		__attribute__((target("avx2")))
+		void avx2_stage(float *re, float *im, size_t m, size_t span, const float *w_re, const float *w_im) {
+			for (size_t start = 0; start < m; start += 2 * span) {
+				float *ar = re + start, *ai = im + start;
+				float *br = ar + span, *bi = ai + span;
+
+				for (size_t j = 0; j < span; j += 8) {
+					__m256 wr = _mm256_loadu_ps(w_re + j), wi = _mm256_loadu_ps(w_im + j);
+					__m256 xr = _mm256_loadu_ps(br + j), xi = _mm256_loadu_ps(bi + j);
+					__m256 yr = _mm256_loadu_ps(ar + j), yi = _mm256_loadu_ps(ai + j);
+					__m256 tr = _mm256_sub_ps(_mm256_mul_ps(wr, xr), _mm256_mul_ps(wi, xi));
+					__m256 ti = _mm256_add_ps(_mm256_mul_ps(wr, xi), _mm256_mul_ps(wi, xr));
+
+					_mm256_storeu_ps(br + j, _mm256_sub_ps(yr, tr));
+					_mm256_storeu_ps(bi + j, _mm256_sub_ps(yi, ti));
+					_mm256_storeu_ps(ar + j, _mm256_add_ps(yr, tr));
+					_mm256_storeu_ps(ai + j, _mm256_add_ps(yi, ti));
+				}
+			}
+		}
+
+		// power[k] += |X[k]|^2 for k = first, first + 8, ... while k + 8 <= m; returns the first bin not done
+		__attribute__((target("avx2")))
+		size_t avx2_power(const float *re, const float *im, size_t m, const float *w_re, const float *w_im, float *power) {
+			const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+			const __m256 half = _mm256_set1_ps(0.5f);
+			size_t k = 1;
+
+			for (; k + 8 <= m; k += 8) {
+				__m256 zr = _mm256_loadu_ps(re + k), zi = _mm256_loadu_ps(im + k);
+				__m256 rr = _mm256_permutevar8x32_ps(_mm256_loadu_ps(re + m - k - 7), reverse);
+				__m256 ri = _mm256_permutevar8x32_ps(_mm256_loadu_ps(im + m - k - 7), reverse);
+				__m256 wr = _mm256_loadu_ps(w_re + k), wi = _mm256_loadu_ps(w_im + k);
+
+				__m256 er = _mm256_mul_ps(_mm256_add_ps(zr, rr), half);
+				__m256 ei = _mm256_mul_ps(_mm256_sub_ps(zi, ri), half);
+				__m256 or_ = _mm256_mul_ps(_mm256_add_ps(zi, ri), half);
+				__m256 oi = _mm256_mul_ps(_mm256_sub_ps(rr, zr), half);
+				__m256 xr = _mm256_add_ps(er, _mm256_sub_ps(_mm256_mul_ps(wr, or_), _mm256_mul_ps(wi, oi)));
+				__m256 xi = _mm256_add_ps(ei, _mm256_add_ps(_mm256_mul_ps(wr, oi), _mm256_mul_ps(wi, or_)));
+				__m256 p = _mm256_add_ps(_mm256_mul_ps(xr, xr), _mm256_mul_ps(xi, xi));
+
+				_mm256_storeu_ps(power + k, _mm256_add_ps(_mm256_loadu_ps(power + k), p));
+			}
+			return k;
+		}
+
+#endif /* SPECTRUM_X86 */
+
+		size_t power_of_two(size_t n) {
+			size_t p = 16;
+			while (p < n) {
+				p <<= 1;
+			}
+			return p;
+		}
+
+	} // namespace
+
+
+	RealFft::RealFft(size_t n, Kernel kernel) : n_(power_of_two(n)), half_(n_ / 2) {
+		if (kernel == Kernel::Auto) {
+			kernel = best_kernel();
+		}
+		kernel_ = ((kernel == Kernel::Avx2) && kernel_supported(kernel)) ? Kernel::Avx2 : Kernel::Scalar;
+
+		unsigned bits = 0;
+		while ((size_t(1) << bits) < half_) {
+			bits++;
+		}
+		reverse_.resize(half_);
+		for (size_t m = 0; m < half_; m++) {
+			uint32_t r = 0;
+			for (unsigned b = 0; b < bits; b++) {
+				r |= uint32_t((m >> b) & 1U) << (bits - 1 - b);
+			}
+			reverse_[m] = r;
+		}
+
+		twiddle_re_.resize(half_);
+		twiddle_im_.resize(half_);
+		for (size_t span = 1; span < half_; span *= 2) {
+			for (size_t j = 0; j < span; j++) {
+				double a = -M_PI * double(j) / double(span);
+				twiddle_re_[span - 1 + j] = float(std::cos(a));
+				twiddle_im_[span - 1 + j] = float(std::sin(a));
+			}
+		}
+		split_re_.resize(half_ + 1);
+		split_im_.resize(half_ + 1);
+		for (size_t k = 0; k <= half_; k++) {
+			double a = -2.0 * M_PI * double(k) / double(n_);
+			split_re_[k] = float(std::cos(a));
+			split_im_[k] = float(std::sin(a));
+		}
+		re_.resize(half_);
+		im_.resize(half_);
+		bin_re_.resize(bins());
+		bin_im_.resize(bins());
+	}
+
+	void RealFft::transform(const float *in, const float *window) {
+		for (size_t m = 0; m < half_; m++) {
+			uint32_t r = reverse_[m];
+			re_[r] = window ? in[2 * m] * window[2 * m] : in[2 * m];
+			im_[r] = window ? in[2 * m + 1] * window[2 * m + 1] : in[2 * m + 1];
+		}
+		for (size_t span = 1; span < half_; span *= 2) {
+			const float *w_re = twiddle_re_.data() + span - 1;
+			const float *w_im = twiddle_im_.data() + span - 1;
+#ifdef SPECTRUM_X86
+			if ((kernel_ == Kernel::Avx2) && (span >= 8)) {
+				avx2_stage(re_.data(), im_.data(), half_, span, w_re, w_im);
+				continue;
+			}
+#endif
+			scalar_stage(re_.data(), im_.data(), half_, span, w_re, w_im);
+		}
+	}
+
+	void RealFft::untangle(size_t k, float &re, float &im) const {
+		size_t j = k % half_;				// Z[m] = Z[0]
+		size_t r = (half_ - k) % half_;
+
+		untangle_bin(re_[j], im_[j], re_[r], im_[r], split_re_[k], split_im_[k], re, im);
+	}
+
+	void RealFft::forward(const float *in, const float *window, float *re, float *im) {
+		transform(in, window);
+		for (size_t k = 0; k <= half_; k++) {
+			untangle(k, re[k], im[k]);
+		}
+	}
+
+	void RealFft::accumulate_power(const float *in, const float *window, float *power) {
+		size_t k = 1;
+
+		transform(in, window);
+#ifdef SPECTRUM_X86
+		if (kernel_ == Kernel::Avx2) {
+			k = avx2_power(re_.data(), im_.data(), half_, split_re_.data(), split_im_.data(), power);
+		}
+#endif
+		for (size_t b : {size_t(0), half_}) {
+			float xr, xi;
+			untangle(b, xr, xi);
+			power[b] += xr * xr + xi * xi;
+		}
+		for (; k < half_; k++) {
+			float xr, xi;
+			untangle(k, xr, xi);
+			power[k] += xr * xr + xi * xi;
+		}
+	}
+
+
+	SpectrumAnalyzer::SpectrumAnalyzer(unsigned channels, const SpectrumConfig &config) :
+		fft_(config.fft_size, config.kernel), channels_(channels) {
+		size_t n = fft_.size();
+		double overlap = std::min(std::max(config.overlap, 0.0), 0.95);
+
+		hop_ = std::max<size_t>(1, size_t(double(n) * (1.0 - overlap) + 0.5));
+		window_.resize(n);
+		for (size_t i = 0; i < n; i++) {
+			window_[i] = float(0.5 - 0.5 * std::cos(2.0 * M_PI * double(i) / double(n)));	// Periodic Hann
+			window_power_ += double(window_[i]) * window_[i];
+		}
+		for (Channel &c : channels_) {
+			c.segment.resize(n);
+			c.power.assign(fft_.bins(), 0.0f);
+		}
+	}
+
+	void SpectrumAnalyzer::add(unsigned channel, const float *v, size_t n, double rate_hz, bool contiguous) {
+		Channel &c = channels_[channel];
+		size_t size = fft_.size();
+
+		if (rate_hz != c.rate_hz) {
+			// Bins of another width: the spectrum so far does not add up with what follows
+			std::fill(c.power.begin(), c.power.end(), 0.0f);
+			c.segments = 0;
+			c.rate_hz = rate_hz;
+			contiguous = false;
+		}
+		if (!contiguous) {
+			c.fill = 0;
+		}
+		if (n == 0) {
+			return;
+		}
+
+		float lo = v[0], hi = v[0];
+		double sum = 0.0, sum_sq = 0.0;
+		for (size_t i = 0; i < n; i++) {
+			sum += v[i];
+			sum_sq += double(v[i]) * v[i];
+			lo = std::min(lo, v[i]);
+			hi = std::max(hi, v[i]);
+		}
+		c.min = (c.count == 0) ? lo : std::min(c.min, lo);
+		c.max = (c.count == 0) ? hi : std::max(c.max, hi);
+		c.count += n;
+		c.sum += sum;
+		c.sum_sq += sum_sq;
+
+		while (n > 0) {
+			size_t take = std::min(n, size - c.fill);
+
+			std::memcpy(c.segment.data() + c.fill, v, take * sizeof(float));
+			c.fill += take;
+			v += take;
+			n -= take;
+			if (c.fill == size) {
+				fft_.accumulate_power(c.segment.data(), window_.data(), c.power.data());
+				c.segments++;
+				std::memmove(c.segment.data(), c.segment.data() + hop_, (size - hop_) * sizeof(float));
+				c.fill = size - hop_;
+			}
+		}
+	}
+
+	void SpectrumAnalyzer::take(unsigned channel, ChannelSpectrum &out) {
+		Channel &c = channels_[channel];
+
+		out.samples = c.count;
+		out.segments = c.segments;
+		out.rate_hz = c.rate_hz;
+		out.bin_hz = c.rate_hz / double(fft_.size());
+		out.mean = c.count ? c.sum / double(c.count) : 0.0;
+		out.rms = c.count ? std::sqrt(std::max(0.0, c.sum_sq / double(c.count) - out.mean * out.mean)) : 0.0;
+		out.peak = c.count ? std::max(double(c.max) - out.mean, out.mean - double(c.min)) : 0.0;
+		out.crest = (out.rms > 0.0) ? out.peak / out.rms : 0.0;
+
+		if (c.segments) {
+			// One-sided: every bin but DC and Nyquist also holds the negative frequency
+			double scale = 1.0 / (c.rate_hz * window_power_ * double(c.segments));
+			size_t last = fft_.bins() - 1;
+
+			out.psd.resize(fft_.bins());
+			for (size_t k = 0; k <= last; k++) {
+				out.psd[k] = float(double(c.power[k]) * scale * (((k == 0) || (k == last)) ? 1.0 : 2.0));
+			}
+		}
+		else {
+			out.psd.clear();
+		}
+
+		std::fill(c.power.begin(), c.power.end(), 0.0f);
+		c.segments = 0;
+		c.count = 0;
+		c.sum = 0.0;
+		c.sum_sq = 0.0;
+	}
+
+} // namespace daq
@@ -0,0 +1,112 @@
+/****************************************************************
+* SPECTRUM (host library)
+*
+* Streaming vibration analytics for the IEPE channels: Welch power spectral density over overlapping Hann-windowed
+* segments, and RMS, peak and crest factor, updated as sample blocks arrive and taken (and restarted) whenever the
+* caller publishes -- nothing is kept for a second pass.
+*
+* RealFft is planned once per size (power of two): twiddles, bit reversal and work arrays are allocated up front,
+* a transform allocates nothing. A real input of n samples runs as an n/2-point complex FFT on split re/im arrays;
+* the butterflies and the power accumulation have scalar and AVX2 kernels (Kernel as in unpack24.h, picked at run
+* time; Ssse3 runs the scalar code) that give bit-identical results.
+*
+* PSD is one-sided, in (input units)^2 / Hz: the sum of psd x bin_hz over all bins is the mean square of the input.
+* RMS, peak and crest factor are of the signal with its mean removed (accelerometer AC content).
+***************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "unpack24.h"
+
+namespace daq {
+
+	class RealFft {
+	public:
+		explicit RealFft(size_t n, Kernel kernel = Kernel::Auto);
+
+		size_t size() const { return n_; }
+		size_t bins() const { return n_ / 2 + 1; }
+		Kernel kernel() const { return kernel_; }
+
+		// re/im[k], k = 0 .. n/2, of in[i] x window[i] (window may be nullptr)
+		void forward(const float *in, const float *window, float *re, float *im);
+
+		// power[k] += |X[k]|^2 of the windowed input
+		void accumulate_power(const float *in, const float *window, float *power);
+
+	private:
+		void transform(const float *in, const float *window);	// Complex FFT of the packed input into re_, im_
+		void untangle(size_t k, float &re, float &im) const;		// Real-input bin k from the complex FFT
+
+		size_t n_;
+		size_t half_;
+		Kernel kernel_;
+		std::vector<uint32_t> reverse_;			// Bit reversal of the half-size indices
+		std::vector<float> twiddle_re_;			// Per stage, contiguous: stage of span s at [s - 1, 2s - 1)
+		std::vector<float> twiddle_im_;
+		std::vector<float> split_re_;			// e^(-2 pi i k / n), k < half: turns the packed FFT into the real one
+		std::vector<float> split_im_;
+		std::vector<float> re_;
+		std::vector<float> im_;
+		std::vector<float> bin_re_;
+		std::vector<float> bin_im_;
+	};
+
+	struct SpectrumConfig {
+		size_t fft_size = 4096;			// 96 ms segments, 10.4 Hz bins at the full rate
+		double overlap = 0.5;			// Of consecutive segments
+		Kernel kernel = Kernel::Auto;
+	};
+
+	// One channel's figures since the previous take
+	struct ChannelSpectrum {
+		uint64_t samples = 0;
+		uint32_t segments = 0;			// Welch segments in psd
+		double rate_hz = 0.0;
+		double bin_hz = 0.0;
+		double mean = 0.0;
+		double rms = 0.0;
+		double peak = 0.0;				// Largest |x - mean|
+		double crest = 0.0;				// peak / rms
+		std::vector<float> psd;			// bins() values, empty until a segment completed
+	};
+
+	class SpectrumAnalyzer {
+	public:
+		SpectrumAnalyzer(unsigned channels, const SpectrumConfig &config = SpectrumConfig());
+
+		size_t bins() const { return fft_.bins(); }
+		Kernel kernel() const { return fft_.kernel(); }
+
+		// n consecutive samples of a channel taken at rate_hz; a new rate or a gap (contiguous = false) restarts the
+		// channel's segment, the figures so far are kept
+		void add(unsigned channel, const float *v, size_t n, double rate_hz, bool contiguous = true);
+
+		// The channel's figures since the previous take (out's buffers are reused)
+		void take(unsigned channel, ChannelSpectrum &out);
+
+	private:
+		struct Channel {
+			double rate_hz = 0.0;
+			size_t fill = 0;				// Samples in segment
+			std::vector<float> segment;
+			std::vector<float> power;		// Sum of |X|^2 over the segments
+			uint32_t segments = 0;
+			uint64_t count = 0;
+			double sum = 0.0;
+			double sum_sq = 0.0;
+			float min = 0.0f;
+			float max = 0.0f;
+		};
+
+		RealFft fft_;
+		size_t hop_;
+		std::vector<float> window_;
+		double window_power_ = 0.0;			// Sum of window^2
+		std::vector<Channel> channels_;
+	};
+
+} // namespace daq
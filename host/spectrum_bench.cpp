@@ -0,0 +1,164 @@
+/****************************************************************
+* SPECTRUM BENCHMARK
+*
+* Accuracy and speed of the streaming spectral analytics (spectrum.h):
+*
+*  accuracy	real FFT against a double-precision DFT on random input, every kernel bit for bit against the scalar one
+*  tone		1 kHz sine of amplitude 1 over noise through the analyzer: RMS, peak, crest factor, the PSD peak and its
+*			integral (the mean square)
+*  speed		one FFT per kernel, and the analyzer on four channels against the IEPE rate of a board
+*
+*   ./spectrum_bench [--fft N] [--overlap F] [--seconds S]
+***************************************************************/
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "daq_stream.h"
+#include "spectrum.h"
+
+namespace {
+
+	using Clock = std::chrono::steady_clock;
+
+	// Runs fn until 'seconds' have passed, returns seconds per call
+	template <typename Fn>
+	double time_per_call(double seconds, Fn fn) {
+		uint64_t calls = 0;
+		auto start = Clock::now();
+		double elapsed = 0.0;
+
+		while (elapsed < seconds) {
+			fn();
+			calls++;
+			elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+		}
+		return elapsed / double(calls);
+	}
+
+} // namespace
+
+int main(int argc, char **argv) {
+	daq::SpectrumConfig config;
+	double seconds = 0.5;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if ((arg == "--fft") && (i + 1 < argc)) config.fft_size = size_t(std::atol(argv[++i]));
+		else if ((arg == "--overlap") && (i + 1 < argc)) config.overlap = std::atof(argv[++i]);
+		else if ((arg == "--seconds") && (i + 1 < argc)) seconds = std::atof(argv[++i]);
+		else {
+			std::printf("usage: %s [--fft N] [--overlap F] [--seconds S]\n", argv[0]);
+			return (arg == "--help") ? 0 : 1;
+		}
+	}
+
+	std::mt19937 rng(12345);
+	std::normal_distribution<float> noise(0.0f, 1.0f);
+	daq::RealFft scalar(config.fft_size, daq::Kernel::Scalar);
+	const size_t n = scalar.size();
+	std::vector<float> x(n), re(scalar.bins()), im(scalar.bins());
+	bool ok = true;
+
+	for (float &v : x) {
+		v = noise(rng);
+	}
+
+	// Against the DFT, relative to the largest bin
+	scalar.forward(x.data(), nullptr, re.data(), im.data());
+	double max_err = 0.0, max_mag = 0.0;
+	for (size_t k = 0; k < scalar.bins(); k++) {
+		double sr = 0.0, si = 0.0;
+		for (size_t i = 0; i < n; i++) {
+			double a = -2.0 * M_PI * double((k * i) % n) / double(n);
+			sr += x[i] * std::cos(a);
+			si += x[i] * std::sin(a);
+		}
+		max_err = std::max(max_err, std::hypot(sr - re[k], si - im[k]));
+		max_mag = std::max(max_mag, std::hypot(sr, si));
+	}
+	std::printf("%zu-point real FFT, max error vs DFT %.2e of the largest bin\n", n, max_err / max_mag);
+	ok = ok && (max_err / max_mag < 1e-5);
+
+	// Every kernel bit for bit
+	std::vector<float> power_ref(scalar.bins(), 0.0f);
+	scalar.accumulate_power(x.data(), nullptr, power_ref.data());
+	for (daq::Kernel k : {daq::Kernel::Ssse3, daq::Kernel::Avx2}) {
+		if (!daq::kernel_supported(k)) {
+			continue;
+		}
+		daq::RealFft fft(n, k);
+		std::vector<float> r(fft.bins()), i(fft.bins()), power(fft.bins(), 0.0f);
+		fft.forward(x.data(), nullptr, r.data(), i.data());
+		fft.accumulate_power(x.data(), nullptr, power.data());
+		bool exact = (r == re) && (i == im) && (power == power_ref);
+		std::printf("%-6s %s\n", daq::kernel_name(k), exact ? "bit-exact" : "DIFFERS from scalar");
+		ok = ok && exact;
+	}
+
+	// A tone through the analyzer, in blocks of one packet
+	{
+		const double rate = daq::kBoardRateHz;
+		const size_t samples = size_t(rate * 2.0);
+		std::vector<float> tone(samples);
+		std::normal_distribution<float> small(0.0f, 0.01f);
+		for (size_t i = 0; i < samples; i++) {
+			tone[i] = float(std::sin(2.0 * M_PI * 1000.0 * double(i) / rate)) + small(rng) + 0.25f;
+		}
+		daq::SpectrumAnalyzer analyzer(1, config);
+		for (size_t i = 0; i < samples; i += SAMPLES_PER_PACKET) {
+			analyzer.add(0, tone.data() + i, std::min<size_t>(SAMPLES_PER_PACKET, samples - i), rate);
+		}
+		daq::ChannelSpectrum s;
+		analyzer.take(0, s);
+		size_t peak = 1;
+		double integral = 0.0;
+		double mean_square = s.rms * s.rms + s.mean * s.mean;
+		for (size_t k = 0; k < s.psd.size(); k++) {
+			peak = ((k > 0) && (s.psd[k] > s.psd[peak])) ? k : peak;
+			integral += double(s.psd[k]) * s.bin_hz;
+		}
+		std::printf("tone   1000 Hz, amplitude 1, offset 0.25: rms %.4f peak %.4f crest %.3f | PSD peak %.1f Hz, "
+			"integral %.4f (mean square %.4f) over %u segments\n", s.rms, s.peak, s.crest, double(peak) * s.bin_hz, integral,
+			mean_square, s.segments);
+		ok = ok && (std::fabs(s.rms - M_SQRT1_2) < 0.01) && (std::fabs(double(peak) * s.bin_hz - 1000.0) <= s.bin_hz) &&
+			(std::fabs(integral - mean_square) < 0.01 * mean_square);
+	}
+
+	// Speed
+	for (daq::Kernel k : {daq::Kernel::Scalar, daq::Kernel::Avx2}) {
+		if (!daq::kernel_supported(k)) {
+			continue;
+		}
+		daq::RealFft fft(n, k);
+		std::vector<float> power(fft.bins(), 0.0f);
+		double t = time_per_call(seconds, [&] { fft.accumulate_power(x.data(), nullptr, power.data()); });
+		std::printf("%-6s FFT + power %8.2f us (%.2f ns per sample)\n", daq::kernel_name(k), t * 1e6, t * 1e9 / double(n));
+	}
+
+	const size_t block = 40 * 64;
+	std::vector<float> stream(block);
+	for (float &v : stream) {
+		v = noise(rng);
+	}
+	daq::SpectrumAnalyzer analyzer(4, config);
+	daq::ChannelSpectrum s;
+	double t = time_per_call(seconds, [&] {
+		for (unsigned ch = 0; ch < 4; ch++) {
+			analyzer.add(ch, stream.data(), block, daq::kBoardRateHz);
+		}
+	});
+	analyzer.take(0, s);
+	double rate = 4.0 * double(block) / t;
+	std::printf("analyzer %s, %zu-point segments, %.0f%% overlap: %.1f M samples/s -> %.0fx the IEPE rate of a board "
+		"(4 x %.0f Hz)\n", daq::kernel_name(analyzer.kernel()), n, 100.0 * config.overlap, rate / 1e6,
+		rate / (4.0 * daq::kBoardRateHz), daq::kBoardRateHz);
+
+	std::printf("%s\n", ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,113 @@
+/****************************************************************
+* SPSC QUEUE AND BUFFER POOL (host library)
+*
+* Bounded single-producer single-consumer queue, the host counterpart of the firmware's sample rings (adc_ring.h):
+* free-running head and tail, power-of-two capacity, no locks. Each side keeps a cached copy of the other side's
+* index and reloads it only when the queue looks full (producer) or empty (consumer), and a batch costs one release
+* store however many items it moves.
+*
+* BufferPool preallocates every buffer a pipeline stage hands on. Buffers go back through an SPSC queue, so exactly
+* one thread may take them and exactly one thread may give them back.
+***************************************************************/
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace daq {
+
+	template <typename T>
+	class SpscQueue {
+	public:
+		explicit SpscQueue(size_t capacity) {
+			size_t n = 2;
+			while (n < capacity) {
+				n *= 2;
+			}
+			slots_.resize(n);
+			mask_ = n - 1;
+		}
+
+		SpscQueue(const SpscQueue &) = delete;
+		SpscQueue &operator=(const SpscQueue &) = delete;
+
+		// Producer: appends up to n items, returns how many fit
+		size_t push(const T *items, size_t n) {
+			size_t head = head_.load(std::memory_order_relaxed);
+
+			if (capacity() - (head - tail_cache_) < n) {
+				tail_cache_ = tail_.load(std::memory_order_acquire);
+			}
+			n = std::min(n, capacity() - (head - tail_cache_));
+			for (size_t i = 0; i < n; i++) {
+				slots_[(head + i) & mask_] = items[i];
+			}
+			head_.store(head + n, std::memory_order_release);
+			return n;
+		}
+
+		bool push(const T &item) { return push(&item, 1) == 1; }
+
+		// Consumer: removes up to max items, returns how many
+		size_t pop(T *items, size_t max) {
+			size_t tail = tail_.load(std::memory_order_relaxed);
+
+			if (head_cache_ - tail < max) {
+				head_cache_ = head_.load(std::memory_order_acquire);
+			}
+			size_t n = std::min(max, head_cache_ - tail);
+			for (size_t i = 0; i < n; i++) {
+				items[i] = slots_[(tail + i) & mask_];
+			}
+			tail_.store(tail + n, std::memory_order_release);
+			return n;
+		}
+
+		bool pop(T &item) { return pop(&item, 1) == 1; }
+
+		// Either side (a snapshot)
+		size_t size() const { return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire); }
+		size_t capacity() const { return mask_ + 1; }
+
+	private:
+		std::vector<T> slots_;
+		size_t mask_ = 0;
+		alignas(64) std::atomic<size_t> head_{0};	// Written by the producer
+		size_t tail_cache_ = 0;						// Producer's copy of tail_
+		alignas(64) std::atomic<size_t> tail_{0};	// Written by the consumer
+		size_t head_cache_ = 0;						// Consumer's copy of head_
+	};
+
+	template <typename T>
+	class BufferPool {
+	public:
+		explicit BufferPool(size_t count) : buffers_(new T[count]), free_(count), count_(count) {
+			for (size_t i = 0; i < count; i++) {
+				T *buffer = &buffers_[i];
+				free_.push(buffer);
+			}
+		}
+
+		// Taking thread: nullptr when every buffer is in use
+		T *take() {
+			T *buffer = nullptr;
+			return free_.pop(buffer) ? buffer : nullptr;
+		}
+
+		// Returning thread
+		void give(T *buffer) { free_.push(buffer); }
+		void give(T *const *buffers, size_t n) { free_.push(buffers, n); }
+
+		size_t available() const { return free_.size(); }
+		size_t count() const { return count_; }
+
+	private:
+		std::unique_ptr<T[]> buffers_;
+		SpscQueue<T *> free_;
+		size_t count_;
+	};
+
+} // namespace daq
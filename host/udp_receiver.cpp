@@ -0,0 +1,147 @@
+/****************************************************************
+* UDP RECEIVER
+*
+* Companion to the firmware UDP transport (UDP_STREAMING in main.c). Receives the datagrams on the server port,
+* checks the packet counter of every packet they carry and reports loss, reordering and throughput.
+*
+*   ./udp_receiver [--port 8080] [--seconds 0] [--interval 1]
+***************************************************************/
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "daq_stream.h"
+
+namespace {
+
+	constexpr unsigned kBatch = 64;			// Datagrams per recvmmsg
+	constexpr unsigned kDatagramMax = 2048;
+
+	struct Totals {
+		uint64_t datagrams = 0;
+		uint64_t bytes = 0;
+		uint64_t samples[2] = {0, 0};
+		uint64_t malformed = 0;		// Datagrams that are not a whole number of valid packets
+	};
+
+	Totals totals_of(const daq::StreamParser &parser, uint64_t datagrams) {
+		Totals t;
+
+		t.datagrams = datagrams;
+		t.bytes = parser.stats().bytes;
+		t.samples[0] = parser.stats().samples[0];
+		t.samples[1] = parser.stats().samples[1];
+		t.malformed = parser.stats().malformed;
+		return t;
+	}
+
+	void usage(const char *name) {
+		std::printf("usage: %s [--port N] [--seconds S] [--interval S]\n"
+			"  --port N       UDP port to listen on (default 8080)\n"
+			"  --seconds S    stop after S seconds, 0 = run until interrupted (default 0)\n"
+			"  --interval S   report period (default 1)\n", name);
+	}
+
+	void report(const char *label, const daq::SequenceTracker &seq, const Totals &now, const Totals &prev, double dt) {
+		uint64_t expected = seq.received() + seq.lost();
+
+		std::printf("%s %8.3f MB/s %8.0f dgram/s %9.0f samples/s | packets %llu lost %llu (%.4f%%) reordered %llu dup %llu malformed %llu\n",
+			label,
+			double(now.bytes - prev.bytes) / dt / 1e6,
+			double(now.datagrams - prev.datagrams) / dt,
+			double(now.samples[0] + now.samples[1] - prev.samples[0] - prev.samples[1]) / dt,
+			(unsigned long long)seq.received(), (unsigned long long)seq.lost(),
+			expected ? 100.0 * double(seq.lost()) / double(expected) : 0.0,
+			(unsigned long long)seq.reordered(), (unsigned long long)seq.duplicates(),
+			(unsigned long long)now.malformed);
+		std::fflush(stdout);
+	}
+
+} // namespace
+
+int main(int argc, char **argv) {
+	unsigned port = 8080;
+	double seconds = 0.0;
+	double interval = 1.0;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if ((arg == "--port") && (i + 1 < argc)) port = unsigned(std::atoi(argv[++i]));
+		else if ((arg == "--seconds") && (i + 1 < argc)) seconds = std::atof(argv[++i]);
+		else if ((arg == "--interval") && (i + 1 < argc)) interval = std::atof(argv[++i]);
+		else { usage(argv[0]); return (arg == "--help") ? 0 : 1; }
+	}
+
+	int fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0) {
+		std::perror("socket");
+		return 1;
+	}
+	int rcvbuf = 16 * 1024 * 1024;
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+	timeval tv{0, 100000};
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	sockaddr_in addr{};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(uint16_t(port));
+	if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+		std::perror("bind");
+		return 1;
+	}
+
+	std::vector<uint8_t> buffers(kBatch * kDatagramMax);
+	std::vector<iovec> iov(kBatch);
+	std::vector<mmsghdr> msgs(kBatch);
+	for (unsigned i = 0; i < kBatch; i++) {
+		iov[i] = {buffers.data() + i * kDatagramMax, kDatagramMax};
+		msgs[i] = {};
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	daq::Handler ignore;						// Only the parser's counters are reported
+	daq::StreamParser parser(ignore);
+	const daq::SequenceTracker &seq = parser.sequence();
+	uint64_t datagrams = 0;
+	Totals totals, last;
+	auto start = std::chrono::steady_clock::now();
+	auto last_report = start;
+
+	for (;;) {
+		int n = recvmmsg(fd, msgs.data(), kBatch, MSG_WAITFORONE, nullptr);
+		for (int i = 0; i < n; i++) {
+			const uint8_t *data = buffers.data() + i * kDatagramMax;
+			uint32_t len = msgs[i].msg_len;
+
+			datagrams++;
+			parser.feed_datagram(data, len);
+		}
+		totals = totals_of(parser, datagrams);
+
+		auto now = std::chrono::steady_clock::now();
+		double dt = std::chrono::duration<double>(now - last_report).count();
+		if (dt >= interval) {
+			report("      ", seq, totals, last, dt);
+			last = totals;
+			last_report = now;
+		}
+		if ((seconds > 0.0) && (std::chrono::duration<double>(now - start).count() >= seconds)) {
+			break;
+		}
+	}
+
+	report("total:", seq, totals, Totals{}, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,238 @@
+/****************************************************************
+* 24-BIT SAMPLE UNPACK KERNELS (host library) -- see unpack24.h
+*
+* Vector kernels load 16 bytes per record (12 used), shuffle every word into the top three bytes of a 32-bit lane
+* and shift it back down arithmetically, which sign extends. Four records are then transposed so each vector holds
+* one channel. The 4 extra bytes read belong to the next record, so the last record is always done by the scalar
+* loop and nothing past the end of the data is touched.
+*
+* The SSSE3/AVX2 code is compiled with target attributes and picked at run time, so the tools build with the
+* default compiler flags and still run on any x86-64 (or non-x86) machine.
+***************************************************************/
+#include "unpack24.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define UNPACK24_X86 1
+#include <immintrin.h>
+#endif
+
+namespace daq {
+
+	namespace {
+
+		inline int32_t get_s24(const uint8_t *p) {
+			return int32_t((uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8)) >> 8;
+		}
+
+		void scalar_i32(const SampleRecords &r, size_t first, int32_t *const out[]) {
+			for (size_t i = first; i < r.count; i++) {
+				const uint8_t *p = r.data + i * r.stride;
+				for (unsigned c = 0; c < r.channels; c++) {
+					out[c][i] = get_s24(p + 3 * c);
+				}
+			}
+		}
+
+		void scalar_f32(const SampleRecords &r, size_t first, const ChannelCal cal[], float *const out[]) {
+			for (size_t i = first; i < r.count; i++) {
+				const uint8_t *p = r.data + i * r.stride;
+				for (unsigned c = 0; c < r.channels; c++) {
+					out[c][i] = float(get_s24(p + 3 * c)) * cal[c].gain + cal[c].offset;
+				}
+			}
+		}
+
+#ifdef UNPACK24_X86
+
+		// Word c (bytes 3c..3c+2, MSB first) -> bytes 1..3 of lane c, byte 0 cleared
+		#define UNPACK24_SHUFFLE -128, 2, 1, 0, -128, 5, 4, 3, -128, 8, 7, 6, -128, 11, 10, 9
+
+		// Four records -> four channels of four samples
+		__attribute__((target("ssse3")))
+		inline void ssse3_load4(const uint8_t *p, size_t stride, __m128i ch[4]) {
+			const __m128i shuffle = _mm_setr_epi8(UNPACK24_SHUFFLE);
+			__m128i r0 = _mm_srai_epi32(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + 0 * stride)), shuffle), 8);
+			__m128i r1 = _mm_srai_epi32(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + 1 * stride)), shuffle), 8);
+			__m128i r2 = _mm_srai_epi32(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + 2 * stride)), shuffle), 8);
+			__m128i r3 = _mm_srai_epi32(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + 3 * stride)), shuffle), 8);
+			__m128i t0 = _mm_unpacklo_epi32(r0, r1);
+			__m128i t1 = _mm_unpacklo_epi32(r2, r3);
+			__m128i t2 = _mm_unpackhi_epi32(r0, r1);
+			__m128i t3 = _mm_unpackhi_epi32(r2, r3);
+
+			ch[0] = _mm_unpacklo_epi64(t0, t1);
+			ch[1] = _mm_unpackhi_epi64(t0, t1);
+			ch[2] = _mm_unpacklo_epi64(t2, t3);
+			ch[3] = _mm_unpackhi_epi64(t2, t3);
+		}
+
+		__attribute__((target("ssse3")))
+		size_t ssse3_i32(const SampleRecords &r, int32_t *const out[]) {
+			size_t i = 0;
+
+			for (; i + 4 < r.count; i += 4) {
+				__m128i ch[4];
+				ssse3_load4(r.data + i * r.stride, r.stride, ch);
+				for (unsigned c = 0; c < 4; c++) {
+					_mm_storeu_si128((__m128i *)(out[c] + i), ch[c]);
+				}
+			}
+			return i;
+		}
+
+		__attribute__((target("ssse3")))
+		size_t ssse3_f32(const SampleRecords &r, const ChannelCal cal[], float *const out[]) {
+			__m128 gain[4], offset[4];
+			size_t i = 0;
+
+			for (unsigned c = 0; c < 4; c++) {
+				gain[c] = _mm_set1_ps(cal[c].gain);
+				offset[c] = _mm_set1_ps(cal[c].offset);
+			}
+			for (; i + 4 < r.count; i += 4) {
+				__m128i ch[4];
+				ssse3_load4(r.data + i * r.stride, r.stride, ch);
+				for (unsigned c = 0; c < 4; c++) {
+					_mm_storeu_ps(out[c] + i, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(ch[c]), gain[c]), offset[c]));
+				}
+			}
+			return i;
+		}
+
+		// Eight records -> four channels of eight samples (records 0-3 in the low lane, 4-7 in the high lane)
+		__attribute__((target("avx2")))
+		inline __m256i avx2_record_pair(const uint8_t *p, size_t stride, const __m256i &shuffle) {
+			__m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)p)),
+				_mm_loadu_si128((const __m128i *)(p + 4 * stride)), 1);
+			return _mm256_srai_epi32(_mm256_shuffle_epi8(v, shuffle), 8);
+		}
+
+		__attribute__((target("avx2")))
+		inline void avx2_load8(const uint8_t *p, size_t stride, __m256i ch[4]) {
+			const __m256i shuffle = _mm256_setr_epi8(UNPACK24_SHUFFLE, UNPACK24_SHUFFLE);
+			__m256i r0 = avx2_record_pair(p + 0 * stride, stride, shuffle);
+			__m256i r1 = avx2_record_pair(p + 1 * stride, stride, shuffle);
+			__m256i r2 = avx2_record_pair(p + 2 * stride, stride, shuffle);
+			__m256i r3 = avx2_record_pair(p + 3 * stride, stride, shuffle);
+			__m256i t0 = _mm256_unpacklo_epi32(r0, r1);
+			__m256i t1 = _mm256_unpacklo_epi32(r2, r3);
+			__m256i t2 = _mm256_unpackhi_epi32(r0, r1);
+			__m256i t3 = _mm256_unpackhi_epi32(r2, r3);
+
+			ch[0] = _mm256_unpacklo_epi64(t0, t1);
+			ch[1] = _mm256_unpackhi_epi64(t0, t1);
+			ch[2] = _mm256_unpacklo_epi64(t2, t3);
+			ch[3] = _mm256_unpackhi_epi64(t2, t3);
+		}
+
+		__attribute__((target("avx2")))
+		size_t avx2_i32(const SampleRecords &r, int32_t *const out[]) {
+			size_t i = 0;
+
+			for (; i + 8 < r.count; i += 8) {
+				__m256i ch[4];
+				avx2_load8(r.data + i * r.stride, r.stride, ch);
+				for (unsigned c = 0; c < 4; c++) {
+					_mm256_storeu_si256((__m256i *)(out[c] + i), ch[c]);
+				}
+			}
+			return i;
+		}
+
+		// Multiply and add stay separate (no FMA) so the result matches the scalar kernel bit for bit
+		__attribute__((target("avx2")))
+		size_t avx2_f32(const SampleRecords &r, const ChannelCal cal[], float *const out[]) {
+			__m256 gain[4], offset[4];
+			size_t i = 0;
+
+			for (unsigned c = 0; c < 4; c++) {
+				gain[c] = _mm256_set1_ps(cal[c].gain);
+				offset[c] = _mm256_set1_ps(cal[c].offset);
+			}
+			for (; i + 8 < r.count; i += 8) {
+				__m256i ch[4];
+				avx2_load8(r.data + i * r.stride, r.stride, ch);
+				for (unsigned c = 0; c < 4; c++) {
+					_mm256_storeu_ps(out[c] + i, _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(ch[c]), gain[c]), offset[c]));
+				}
+			}
+			return i;
+		}
+
+		#undef UNPACK24_SHUFFLE
+
+#endif /* UNPACK24_X86 */
+
+		// Vector kernels handle the four-channel layout only
+		Kernel resolve(const SampleRecords &r, Kernel kernel) {
+			if (kernel == Kernel::Auto) {
+				kernel = best_kernel();
+			}
+			if ((r.channels != 4) || (r.stride < 12) || !kernel_supported(kernel)) {
+				return Kernel::Scalar;
+			}
+			return kernel;
+		}
+
+	} // namespace
+
+
+	bool kernel_supported(Kernel kernel) {
+		switch (kernel) {
+			case Kernel::Auto:
+			case Kernel::Scalar:
+				return true;
+#ifdef UNPACK24_X86
+			case Kernel::Ssse3:
+				return __builtin_cpu_supports("ssse3");
+			case Kernel::Avx2:
+				return __builtin_cpu_supports("avx2");
+#endif
+			default:
+				return false;
+		}
+	}
+
+	Kernel best_kernel() {
+		static const Kernel best = kernel_supported(Kernel::Avx2) ? Kernel::Avx2 :
+			kernel_supported(Kernel::Ssse3) ? Kernel::Ssse3 : Kernel::Scalar;
+		return best;
+	}
+
+	const char *kernel_name(Kernel kernel) {
+		switch (kernel) {
+			case Kernel::Auto:		return "auto";
+			case Kernel::Scalar:	return "scalar";
+			case Kernel::Ssse3:		return "ssse3";
+			case Kernel::Avx2:		return "avx2";
+		}
+		return "?";
+	}
+
+	void unpack_i32(const SampleRecords &records, int32_t *const out[], Kernel kernel) {
+		size_t done = 0;
+
+		switch (resolve(records, kernel)) {
+#ifdef UNPACK24_X86
+			case Kernel::Ssse3:	done = ssse3_i32(records, out);	break;
+			case Kernel::Avx2:	done = avx2_i32(records, out);	break;
+#endif
+			default:			break;
+		}
+		scalar_i32(records, done, out);
+	}
+
+	void unpack_f32(const SampleRecords &records, const ChannelCal cal[], float *const out[], Kernel kernel) {
+		size_t done = 0;
+
+		switch (resolve(records, kernel)) {
+#ifdef UNPACK24_X86
+			case Kernel::Ssse3:	done = ssse3_f32(records, cal, out);	break;
+			case Kernel::Avx2:	done = avx2_f32(records, cal, out);		break;
+#endif
+			default:			break;
+		}
+		scalar_f32(records, done, cal, out);
+	}
+
+} // namespace daq
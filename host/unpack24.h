@@ -0,0 +1,53 @@
+/****************************************************************
+* 24-BIT SAMPLE UNPACK KERNELS (host library)
+*
+* Turn the packed ADC words of a packet (3-byte big-endian two's complement, see daq_packet.h) into channel-major
+* int32 codes or calibrated floats. The float kernels fuse the per-channel gain/offset into the same pass.
+*
+* Samples are read as records: 'count' records 'stride' bytes apart, each starting with 'channels' consecutive
+* 24-bit words. For an ADC packet the records are the samples, starting after the time delta and status word.
+* Vector kernels need all four channels; other layouts use the scalar kernel. All kernels give bit-identical results.
+***************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace daq {
+
+	// ADC full scale: +-VREF over 2^23 codes, VREF = 2.442V internal reference (write_A_SYS_CFG in main.c)
+	constexpr double kAdcVrefVolts = 2.442;
+	constexpr double kAdcVoltsPerCode = kAdcVrefVolts / 8388608.0;
+
+	enum class Kernel {
+		Auto,		// Best one the CPU supports
+		Scalar,
+		Ssse3,		// 4 records per step
+		Avx2		// 8 records per step
+	};
+
+	// value = code * gain + offset
+	struct ChannelCal {
+		float gain = float(kAdcVoltsPerCode);	// Default: volts at the ADC input
+		float offset = 0.0f;
+	};
+
+	struct SampleRecords {
+		const uint8_t *data = nullptr;	// First word of the first record
+		size_t stride = 0;				// Bytes from one record to the next (>= 3 x channels)
+		size_t count = 0;
+		unsigned channels = 4;			// Consecutive words per record (1 - 4)
+	};
+
+	// out[c][i] = word c of record i
+	void unpack_i32(const SampleRecords &records, int32_t *const out[], Kernel kernel = Kernel::Auto);
+
+	// out[c][i] = word c of record i * cal[c].gain + cal[c].offset
+	void unpack_f32(const SampleRecords &records, const ChannelCal cal[], float *const out[], Kernel kernel = Kernel::Auto);
+
+	// Kernel that Auto resolves to on this CPU, and whether a kernel can run here
+	Kernel best_kernel();
+	bool kernel_supported(Kernel kernel);
+	const char *kernel_name(Kernel kernel);
+
+} // namespace daq
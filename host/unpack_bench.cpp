@@ -0,0 +1,137 @@
+/****************************************************************
+* UNPACK BENCHMARK
+*
+* Speed of the 24-bit unpack kernels (unpack24.h) on ADC sample records laid out like a full ADC packet
+* (time delta | status | CH1 - CH4), and a bit-exact comparison of every kernel against the scalar one.
+*
+*   ./unpack_bench [--records N] [--seconds S]
+***************************************************************/
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "unpack24.h"
+
+extern "C" {
+#include "daq_packet.h"
+}
+
+namespace {
+
+	using Clock = std::chrono::steady_clock;
+
+	constexpr size_t kStride = PKT_DELTA_BYTES + 5 * PKT_ADC_WORD_BYTES;	// Sample with status + 4 channels
+	constexpr size_t kWordsOffset = PKT_DELTA_BYTES + PKT_ADC_WORD_BYTES;
+
+	struct Buffers {
+		std::vector<int32_t> i32[4];
+		std::vector<float> f32[4];
+		int32_t *i32_out[4];
+		float *f32_out[4];
+
+		explicit Buffers(size_t n) {
+			for (unsigned c = 0; c < 4; c++) {
+				i32[c].assign(n, 0);
+				f32[c].assign(n, 0.0f);
+				i32_out[c] = i32[c].data();
+				f32_out[c] = f32[c].data();
+			}
+		}
+	};
+
+	// Runs fn until 'seconds' have passed, returns channel samples per second
+	template <typename Fn>
+	double rate(double seconds, size_t samples_per_call, Fn fn) {
+		uint64_t calls = 0;
+		auto start = Clock::now();
+		double elapsed = 0.0;
+
+		while (elapsed < seconds) {
+			fn();
+			calls++;
+			elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+		}
+		return double(calls) * double(samples_per_call) / elapsed;
+	}
+
+} // namespace
+
+int main(int argc, char **argv) {
+	size_t records = 65536;
+	double seconds = 0.5;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if ((arg == "--records") && (i + 1 < argc)) records = size_t(std::atol(argv[++i]));
+		else if ((arg == "--seconds") && (i + 1 < argc)) seconds = std::atof(argv[++i]);
+		else {
+			std::printf("usage: %s [--records N] [--seconds S]\n", argv[0]);
+			return (arg == "--help") ? 0 : 1;
+		}
+	}
+
+	// Random words, including full-scale codes to exercise the sign extension
+	std::vector<uint8_t> data(records * kStride);
+	std::mt19937 rng(12345);
+	for (uint8_t &b : data) {
+		b = uint8_t(rng());
+	}
+	for (size_t i = 0; i < records && i < 8; i++) {
+		std::memset(&data[i * kStride + kWordsOffset], (i & 1) ? 0x80 : 0x7F, 3);
+	}
+
+	daq::SampleRecords r;
+	r.data = data.data() + kWordsOffset;
+	r.stride = kStride;
+	r.count = records;
+	r.channels = 4;
+
+	// IEPE-like calibration: volts -> g at 100 mV/g, small offsets
+	daq::ChannelCal cal[4];
+	for (unsigned c = 0; c < 4; c++) {
+		cal[c].gain = float(daq::kAdcVoltsPerCode / 0.1);
+		cal[c].offset = 0.01f * float(c + 1);
+	}
+
+	Buffers reference(records);
+	daq::unpack_i32(r, reference.i32_out, daq::Kernel::Scalar);
+	daq::unpack_f32(r, cal, reference.f32_out, daq::Kernel::Scalar);
+
+	const size_t samples = records * 4;
+	const daq::Kernel kernels[] = {daq::Kernel::Scalar, daq::Kernel::Ssse3, daq::Kernel::Avx2};
+	double scalar_i32 = 0.0, scalar_f32 = 0.0;
+	int failures = 0;
+
+	std::printf("%zu records x 4 channels, stride %zu bytes, auto = %s\n", records, kStride, daq::kernel_name(daq::best_kernel()));
+	for (daq::Kernel k : kernels) {
+		if (!daq::kernel_supported(k)) {
+			std::printf("%-8s not supported on this CPU\n", daq::kernel_name(k));
+			continue;
+		}
+
+		Buffers out(records);
+		daq::unpack_i32(r, out.i32_out, k);
+		daq::unpack_f32(r, cal, out.f32_out, k);
+		bool exact = true;
+		for (unsigned c = 0; c < 4; c++) {
+			exact = exact && (std::memcmp(out.i32[c].data(), reference.i32[c].data(), records * sizeof(int32_t)) == 0);
+			exact = exact && (std::memcmp(out.f32[c].data(), reference.f32[c].data(), records * sizeof(float)) == 0);
+		}
+		failures += exact ? 0 : 1;
+
+		double i32 = rate(seconds, samples, [&] { daq::unpack_i32(r, out.i32_out, k); });
+		double f32 = rate(seconds, samples, [&] { daq::unpack_f32(r, cal, out.f32_out, k); });
+		if (k == daq::Kernel::Scalar) {
+			scalar_i32 = i32;
+			scalar_f32 = f32;
+		}
+		std::printf("%-8s int32 %8.1f M samples/s (%4.1fx)   float+cal %8.1f M samples/s (%4.1fx)   %s\n",
+			daq::kernel_name(k), i32 / 1e6, i32 / scalar_i32, f32 / 1e6, f32 / scalar_f32, exact ? "bit-exact" : "MISMATCH");
+	}
+	return (failures == 0) ? 0 : 1;
+}
@@ -1,40 +1,81 @@
 /****************************************************************
 * HEADER FILES
 ***************************************************************/
-#include <DAVE.h>                 //Declarations from DAVE Code Generation (includes SFR declaration)
+#include "hal.h"					// Hardware abstraction (DAVE APPs on the target, simulator on the host)
+#include <string.h>
+#include "daq_packet.h"				// Packet format (encoder shared with the host tools)
+#include "adc_capture.h"			// ADC frame capture into the ISR -> main loop sample rings
+#include "adc_decimate.h"			// Optional per-ADC decimation between the sample rings and the packets
+#include "adc_config.h"				// ADC register tables, written and verified at boot and on command
+#include "command.h"				// Host commands received on the data connection
+#include "timebase.h"				// 64-bit tick clock shared by every time stamp
+#include "tc_capture.h"				// Thermocouple read cycles, chained on the TC SPI bus from the interrupts
+#include "telemetry.h"				// Hot path latency histograms, sent as telemetry packets
+#include "adc_status.h"				// ADC status word checks (sync, STAT_1 faults)
+#include "daq_codec.h"				// Optional lossless compression of the ADC packets
+#include "adc_burst.h"				// Optional triggered burst capture in place of streaming
+#include "tx_batch.h"				// When queued packets are handed to lwIP: full batch or latency deadline
 
 	// GENERAL
-		#define PACKET_SIZE 72 			// How large data packet is to be sent out over Ethernet
 		uint32_t packet_count = 0; 		// Packet counter to check for lost packets
 
+		/* Channels sent to the host (PKT_CH_* in daq_packet.h) -- disabled channels are left out of the packets entirely
+		 * IEPE0-3 | FB0 FB1 CL0 CL1 | TC0-3 | ADC status word
+		 * Boot value, changed at run time with CMD_STREAMS */
+		#ifndef CHANNEL_ENABLE
+		#define CHANNEL_ENABLE (PKT_CH_ADC(0) | PKT_CH_ADC(1) | PKT_CH_TC | PKT_CH_STATUS)
+		#endif
+		uint16_t channel_enable = CHANNEL_ENABLE;
+
+		/* Lossless compression of the ADC packets (daq_codec.h) -- 1 = on. Boot value, changed with CMD_COMPRESS.
+		 * Packets that would not get smaller are sent uncompressed either way */
+		#ifndef COMPRESSION
+		#define COMPRESSION 0U
+		#endif
+		uint8_t compression = COMPRESSION;
+		uint8_t codec_buffer[PACKET_MAX_SIZE];	// Compressed packet, copied over the sample packet
+
+		/* Triggered burst capture of the ADCs (adc_burst.h) -- 1 = on, host trigger until CMD_BURST sets a level or
+		 * slope trigger. Boot value, changed with CMD_BURST */
+		#ifndef BURST_MODE
+		#define BURST_MODE 0U
+		#endif
+		burst_record_t burstRecord;				// Record being announced
+
+		/* Partial packets of a decimated ADC are held until their oldest sample is this old, so a slow ADC still sends
+		 * several samples per packet -- bounds its latency and keeps the 16-bit sample time deltas in range */
+		#ifndef PACKET_MAX_AGE_MS
+		#define PACKET_MAX_AGE_MS 10U
+		#endif
+		/* Partial packets of a full-rate ADC: sent once their oldest sample is this old (a full packet takes 0.94ms
+		 * at 42.667kHz, so this only matters at lower conversion rates) */
+		#define PACKET_FULL_RATE_AGE_US 1000U
+
 
 	// TIMING
 		uint32_t millisec = 0;		// Value to capture the amount of milliseconds that have passed since program start
-		uint32_t TC_ms = 0;
-		uint32_t TC_us = 0;
-		uint32_t ADC0_ms = 0;
-		uint32_t ADC0_us = 0;
-		uint32_t ADC1_ms = 0;
-		uint32_t ADC1_us = 0;
+		uint32_t ADC0_index = 0;	// DRDY edges seen on ADC0 -- index of the conversion being read
+		uint32_t ADC1_index = 0;	// DRDY edges seen on ADC1
 
 	// FLAGS FOR READING
-		uint8_t ReadTC = 0x00;		// Flag for Thermocouple read
-		uint8_t ReadADC0 = 0x00;	// Flag for ADC0 Read -- Interrupt
-		uint8_t ReadADC1 = 0x00;	// Flag for ADC1 Read -- Interrupt
-
-	// FLAGS FOR WRITING
-		uint8_t tx_flag = 0; // Ethernet data transmit flag
+		// ADC reads are requested through adc_capture_drdy (see adc_capture.h), thermocouple reads through
+		// tc_capture_tick (tc_capture.h)
 
 	// ADC VARIABLES
-		uint8_t configArray[56] = {0x00}; // Note: overwritten by each ADC, so put a breakpoint after each ADC config if you want to read the data for an individal ADC
+		uint8_t config_failed[ADC_COUNT] = {0}; // Boot: bit i set if register table entry i did not read back, ADC_FAIL_NOT_READY (adc_config.h)
+		uint8_t adc_ready = 0;				// Bring-up finished, capture running
 
-	// THERMOCOUPLE VARIABLES
-		uint8_t thermocouple_ss = 0; // Determines which slave select is active for thermocouples
+	// BOOT TIMING -- microseconds since the timestamp timer started (end of DAVE_Init), 0 = not yet
+		uint32_t boot_config_us = 0;		// Both ADCs configured and converting
+		uint32_t boot_first_sample_us = 0;	// Capture time of the first ADC frame
 
 	// FUNCTION PROTOTYPES
-		void adc_register_config();
-		void xmc_ADC_setup();
-		void parseTime(uint8_t data[]);
+		uint16_t packSamples(uint8_t data[], uint8_t adc, adc_ring_t *ring);
+		uint16_t packThermocouples(uint8_t data[], const tc_cycle_t *tc);
+		uint16_t packTelemetry(uint8_t data[]);
+		uint16_t packBurst(uint8_t data[], const burst_record_t *record);
+		void sendPacket(uint8_t data[], uint16_t len);
+		uint16_t runCommand(uint8_t data[], const uint8_t cmd[]);
 
 // ETHERNET CONFIG ////////////////////////////////////////////////////////////////////////////////////////////////////////
 		/****************************************************************
@@ -62,6 +103,31 @@
 		 * (0 = Device#1; 1 = Device #2) */
 		#define DEVICE_ID 0U
 
+		/* Transport mode
+		 * 1 = Streaming: one persistent connection, packets are queued and several are handed to lwIP per tcp_write,
+		 *     reconnect only after client_err
+		 * 0 = Legacy: connection is closed and re-opened after every packet */
+		#ifndef TCP_STREAMING
+		#define TCP_STREAMING 1U
+		#endif
+
+		/* Streaming queue
+		 * TX_QUEUE_PACKETS - packets that can wait for free lwIP send buffer before new ones are dropped
+		 * When the queue is written is up to tx_batch.h: a full batch or the latency deadline (TX_LATENCY_US) */
+		#define TX_QUEUE_PACKETS 16U
+
+		/* Connection watchdog -- send attempts without a ready connection before the PCB is reset */
+		#define CONNECT_WD_LIMIT 10U
+
+		/* UDP transport
+		 * 1 = packets are grouped into datagrams of up to UDP_PAYLOAD_MAX bytes sent to the same server port: no
+		 *     connection, no retransmits, a lost datagram shows up as a gap in the packet counter of the packets it carried
+		 * 0 = TCP (see TCP_STREAMING) */
+		#ifndef UDP_STREAMING
+		#define UDP_STREAMING 0U
+		#endif
+		#define UDP_PAYLOAD_MAX 1472U		// 1500 byte Ethernet MTU - IP and UDP headers
+
 		/****************************************************************
 		* PROTOTYPES
 		***************************************************************/
@@ -70,7 +136,15 @@
 		err_t client_connected(void *arg, struct tcp_pcb *pcb, err_t err);
 		void client_close(struct tcp_pcb *pcb);
 		err_t client_sent(void *arg, struct tcp_pcb *pcb, u16_t len);
-		void send_data(uint8_t data[64]);
+		err_t client_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err);
+		void client_udp_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, ip_addr_t *addr, u16_t port);
+		void send_data(uint8_t data[], uint16_t len);
+		uint8_t *send_buffer(uint8_t data[]);
+		uint8_t send_room(void);
+		void send_poll(void);
+		void client_service(void);
+		void client_flush(struct tcp_pcb *pcb);
+		void client_udp_flush(uint8_t deadline);
 
 		/****************************************************************
 		* LOCAL DATA
@@ -85,6 +159,32 @@
 		/* Connection status */
 		uint8_t connection_ready=0,pcb_valid=0;
 
+		/* Streaming transmit queue -- bytes not yet accepted by tcp_write
+		 * Packets vary in length, so their sizes are kept alongside to count what is dropped on a reset */
+		uint8_t tx_queue[TX_QUEUE_PACKETS * PACKET_MAX_SIZE];
+		uint32_t tx_queue_len = 0;
+		uint16_t tx_queue_sizes[TX_QUEUE_PACKETS];	// Sizes of the queued packets, oldest first
+		uint64_t tx_queue_times[TX_QUEUE_PACKETS];	// Time each was queued (timebase ticks) -- deadline and queueing delay
+		uint32_t tx_queue_packets = 0;				// Packets (partly) in the queue
+		uint32_t tx_queue_written = 0;				// Bytes of the oldest packet already written
+		volatile uint8_t tx_queue_reset = 0;		// Connection failed (client_err) -- queue discarded by the main loop
+		volatile uint32_t tx_acked = 0;				// Bytes acknowledged (client_sent), free-running -- read by the main loop
+
+		/* UDP protocol control block and datagram buffers
+		 * Packets are built in place in the active buffer and handed to lwIP by reference (PBUF_REF), so the data is
+		 * not copied again on the way out. Two buffers alternate so the next datagram can be filled while lwIP still
+		 * holds the previous one. */
+		struct udp_pcb *pcb_udp;
+		uint8_t udp_datagram[2][UDP_PAYLOAD_MAX];
+		uint8_t udp_active = 0;			// Buffer being filled
+		uint32_t udp_fill = 0;			// Bytes in the active buffer
+		uint32_t udp_packets = 0;		// Packets in the active buffer
+		uint64_t udp_first = 0;			// Time the first of them was built (timebase ticks)
+
+		/* Transport statistics */
+		uint32_t tx_dropped = 0;		// Packets dropped because there was no connection or no queue space
+		uint32_t tx_reconnects = 0;		// Connections (re)opened by client_init
+
 
 		/****************************************************************
 		* API IMPLEMENTATION
@@ -93,6 +193,10 @@
 		 * @client_err
 		 *
 		 * Error callback, called by lwip. Invalidates global protocol control block pointer in case of connection resets.
+		 * In streaming mode any error ends the connection: lwip has already freed the PCB, so the pointers are cleared
+		 * (must not be aborted again) and the queued bytes are discarded, because a partially written packet would
+		 * misalign the stream on the next connection. lwIP calls this from interrupts, so the queue is only marked here
+		 * and discarded by the main loop (client_service), which also reconnects through client_init.
 		 *
 		 * @input  : none
 		 *
@@ -103,8 +207,16 @@
 		 * */
 		void client_err(void *arg, err_t err)
 		{
+		#if TCP_STREAMING
+		  pcb_send=0;
+		  pcb_open=0;
+		  connection_ready=0;
+		  pcb_valid=0;
+		  tx_queue_reset=1;
+		#else
 		  if (err == ERR_RST)
 			pcb_valid=0;
+		#endif
 		  return;
 		}
 
@@ -127,6 +239,25 @@
 		  struct ip_addr dest;
 		  IP4_ADDR(&dest, SERVER_IP_ADDR0, SERVER_IP_ADDR1, SERVER_IP_ADDR2, SERVER_IP_ADDR3);
 
+		#if UDP_STREAMING
+		  /* No handshake -- the PCB is ready as soon as it is bound and the destination is set */
+		  if (pcb_udp==0)
+		  {
+			pcb_udp = udp_new();
+			udp_bind(pcb_udp, IP_ADDR_ANY, SERVER_HTTP_PORT);
+			udp_recv(pcb_udp, client_udp_recv, NULL); // Commands from the server
+		  }
+		  udp_connect(pcb_udp, &dest, SERVER_HTTP_PORT);
+		  connection_ready=1;
+		  pcb_valid=1;
+		  tx_reconnects++;
+		  return;
+		#endif
+
+		#if TCP_STREAMING
+		  client_service(); // Old connection's queue goes before the new one can write
+		#endif
+		  command_reset(); // Partial command of the previous connection never completes
 		  if (pcb_open!=0)
 			tcp_abort(pcb_open);
 		  pcb_open = tcp_new();
@@ -134,6 +265,10 @@
 		  tcp_bind(pcb_open, IP_ADDR_ANY, SERVER_HTTP_PORT); //server port for incoming connection
 		  tcp_arg(pcb_open, NULL);
 		  tcp_connect(pcb_open, &dest, SERVER_HTTP_PORT, client_connected); //server port for incoming connection
+		#if TCP_STREAMING
+		  pcb_valid=1; // Connecting -- keeps the main loop from re-initializing until client_connected/client_err
+		#endif
+		  tx_reconnects++;
 		}
 
 		/**
@@ -158,6 +293,12 @@
 			connection_ready=1;
 			pcb_valid=1;
 			pcb_send=pcb;
+			tcp_recv(pcb, client_recv); // Commands from the server
+		#if TCP_STREAMING
+			/* Packets are batched by send_data, so segments should leave as soon as they are written */
+			tcp_nagle_disable(pcb);
+			tcp_sent(pcb, client_sent);
+		#endif
 		  }
 		  else
 		  {
@@ -188,10 +329,13 @@
 		}
 
 		/**
-		 * @client_close
+		 * @client_sent
 		 *
 		 * Confirmation callback, called by lwip when data was sent.
-		 * Invalidate protocol control block and re-initialize connection for next transfer.
+		 * Streaming: only counts the acknowledged bytes -- lwIP calls this from interrupts, while the main loop may be
+		 * appending to the queue or running the batching policy. The main loop hands them to the ACK rate of the
+		 * policy (client_service, tx_batch.h) and its next send_poll uses the freed send buffer space.
+		 * Legacy: invalidate protocol control block and re-initialize connection for next transfer.
 		 *
 		 * @input  : pcb - protocl control block
 		 *           len - length
@@ -203,54 +347,364 @@
 		 * */
 		err_t client_sent(void *arg, struct tcp_pcb *pcb, u16_t len)
 		{
+		#if TCP_STREAMING
+		  tx_acked += len;
+		#else
 		  /* Sending succeeded; Close protocol control block */
 		  client_close(pcb);
 		  pcb_valid=0;
 		  /* Prepare already connection for next transfer */
 		  client_init();
+		#endif
 		  return ERR_OK;
 		}
 
 		/**
-		 * @client_close
+		 * @client_recv
+		 *
+		 * Receive callback, called by lwip. Hands the bytes to the command channel (command.h); the commands are
+		 * executed by the main loop. A closed connection (p = NULL) is aborted so the main loop reconnects.
+		 *
+		 * @input  : pcb - protocol control block
+		 *           p - received data, NULL if the server closed the connection
+		 *
+		 * @output : none
+		 *
+		 * @return : err_t error type
+		 *
+		 * */
+		err_t client_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+		{
+		  struct pbuf *q;
+
+		  if (p==0)
+		  {
+			client_close(pcb);
+			connection_ready=0;
+			pcb_valid=0;
+			return ERR_ABRT;
+		  }
+		  for (q=p; q!=0; q=q->next)
+			command_receive((const uint8_t*)q->payload, q->len);
+		  tcp_recved(pcb, p->tot_len);
+		  pbuf_free(p);
+		  return ERR_OK;
+		}
+
+		/**
+		 * @client_udp_recv
+		 *
+		 * UDP receive callback, called by lwip. Every datagram carries whole commands.
+		 *
+		 * @input  : p - received datagram
+		 *
+		 * @output : none
+		 *
+		 * @return : none
+		 *
+		 * */
+		void client_udp_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, ip_addr_t *addr, u16_t port)
+		{
+		  struct pbuf *q;
+
+		  for (q=p; q!=0; q=q->next)
+			command_receive((const uint8_t*)q->payload, q->len);
+		  command_reset(); // A command cut short by the datagram end is not continued by the next one
+		  pbuf_free(p);
+		}
+
+		/**
+		 * @client_service
+		 *
+		 * Main loop side of the streaming callbacks: discards the transmit queue of a connection that client_err ended
+		 * and feeds the bytes acknowledged since the last call (client_sent) to the batching policy. The queue and the
+		 * policy are only touched by the main loop, so an interrupt never sees them half updated.
+		 *
+		 * @input  : none
+		 *
+		 * @output : none
+		 *
+		 * @return : none
+		 *
+		 * */
+		void client_service(void)
+		{
+		  static uint32_t acked_seen=0;
+		  uint32_t acked=tx_acked;
+
+		  if (acked!=acked_seen)
+		  {
+			tx_batch_acked(acked - acked_seen, timebase_now());
+			acked_seen=acked;
+		  }
+		  if (tx_queue_reset)
+		  {
+			tx_queue_reset=0;
+			tx_dropped += tx_queue_packets;
+			tx_queue_len=0;
+			tx_queue_packets=0;
+			tx_queue_written=0;
+		  }
+		}
+
+		/**
+		 * @client_flush
+		 *
+		 * Hands the streaming queue to lwip once the batching policy says so (tx_batch_due: a full batch, or the oldest
+		 * packet at the latency deadline), as much as its send buffer accepts (flow control through tcp_sndbuf).
+		 * Bytes that are held or do not fit stay queued until the next packet or main loop pass. Main loop only.
+		 *
+		 * @input  : pcb - protocol control block
+		 *
+		 * @output : none
+		 *
+		 * @return : none
+		 *
+		 * */
+		void client_flush(struct tcp_pcb *pcb)
+		{
+		  uint64_t now;
+		  uint32_t len;
+		  uint8_t deadline;
+
+		  if ((pcb==0)||(tx_queue_len==0))
+			return;
+		  now = timebase_now();
+		  len = tx_batch_due(tx_queue_len, tcp_sndbuf(pcb), now - tx_queue_times[0], now, &deadline);
+		  if (len==0)
+			return; // Batch not full yet, or send buffer full -- client_sent or the next pass will call again
+
+		  if (tcp_write(pcb, tx_queue, (u16_t)len, TCP_WRITE_FLAG_COPY) == ERR_OK)
+		  {
+			tx_queue_len -= len;
+			memmove(tx_queue, tx_queue + len, tx_queue_len);
+			tcp_output(pcb);
+			tx_batch_sent(len, deadline);
+
+			/* Retire the packets that are now completely written */
+			tx_queue_written += len;
+			while ((tx_queue_packets > 0) && (tx_queue_written >= tx_queue_sizes[0]))
+			{
+			  tx_batch_waited(now - tx_queue_times[0]);
+			  tx_queue_written -= tx_queue_sizes[0];
+			  tx_queue_packets--;
+			  memmove(tx_queue_sizes, tx_queue_sizes + 1, tx_queue_packets * sizeof(tx_queue_sizes[0]));
+			  memmove(tx_queue_times, tx_queue_times + 1, tx_queue_packets * sizeof(tx_queue_times[0]));
+			}
+		  }
+		}
+
+		/**
+		 * @send_data
 		 *
-		 * Send data header to computer
+		 * Send data packet to computer
+		 * Streaming: packet is appended to the transmit queue, which is written when the batching policy says so
+		 * (client_flush). Packets are dropped (and counted) while disconnected or when the queue is full.
+		 * UDP: the datagram is sent once the next packet might not fit it, or at the deadline (send_poll).
+		 * Legacy: packet is written directly if the connection is ready, otherwise dropped.
 		 *
 		 * @input  : data - data to be sent
+		 *           len  - packet length
 		 *
 		 * @output : none
 		 *
 		 * @return : none
 		 *
 		 * */
-		void send_data(uint8_t data[])
+		void send_data(uint8_t data[], uint16_t len)
 		{
+		#if !UDP_STREAMING
 		  static uint32_t connect_WD=0;
+		#endif
+		#if UDP_STREAMING
+		  /* data was built in place by send_buffer -- just account for it */
+		  if (udp_packets==0)
+			udp_first = timebase_now();
+		  udp_fill += len;
+		  udp_packets++;
+		  if (udp_fill + PACKET_MAX_SIZE > UDP_PAYLOAD_MAX)
+			client_udp_flush(0); // The next packet might not fit
+		#elif TCP_STREAMING
+		  client_service();
+		  if ((connection_ready==1)&&(pcb_send!=0))
+		  {
+			connect_WD=0;
+			if ((tx_queue_len + len <= sizeof(tx_queue)) && (tx_queue_packets < TX_QUEUE_PACKETS))
+			{
+			  memcpy(tx_queue + tx_queue_len, data, len);
+			  tx_queue_len += len;
+			  tx_queue_sizes[tx_queue_packets] = len;
+			  tx_queue_times[tx_queue_packets++] = timebase_now();
+			}
+			else
+			{
+			  tx_dropped++; // Host is not keeping up -- queue full
+			}
+
+			client_flush(pcb_send);
+		  }
+		  else
+		  {
+			tx_dropped++;
+			/* Connection watchdog triggered while still connecting
+			 * --> abort and let the main loop start over
+			 */
+			connect_WD++;
+			if ((connect_WD>=CONNECT_WD_LIMIT)&&(pcb_open!=0))
+			{
+			  connect_WD=0;
+			  client_close(pcb_open);
+			  pcb_open=0;
+			  pcb_valid=0;
+			}
+		  }
+		#else
 		  if ((connection_ready==1)&&(pcb_send!=0))
 		  {
 			connection_ready=0;
 			connect_WD=0;
 			tcp_sent(pcb_send, client_sent);
-			tcp_write(pcb_send, (uint8_t*)data, PACKET_SIZE, 0);
+			tcp_write(pcb_send, (uint8_t*)data, len, 0);
 			tcp_output(pcb_send);
 
 		  }
 		  else
 		  {
+			tx_dropped++;
 			/* Connection watchdog triggered
 			 * --> reset Protocol Control Block
 			 */
 			connect_WD++;
-			if (connect_WD==10)
+			if (connect_WD==CONNECT_WD_LIMIT)
 			{
 			  client_close(pcb_send);
 			  pcb_valid=0;
 			}
 		  }
+		#endif
 		}
 
 
 
+		/**
+		 * @send_buffer
+		 *
+		 * Where the next packet is built
+		 * UDP: directly in the active datagram buffer, TCP: the caller's packet buffer
+		 *
+		 * @input  : data - caller's packet buffer
+		 *
+		 * @output : none
+		 *
+		 * @return : buffer of PACKET_MAX_SIZE bytes to build the packet in, then pass to send_data
+		 *
+		 * */
+		uint8_t *send_buffer(uint8_t data[])
+		{
+		#if UDP_STREAMING
+		  return udp_datagram[udp_active] + udp_fill;
+		#else
+		  return data;
+		#endif
+		}
+
+		/**
+		 * @send_room
+		 *
+		 * Whether a packet passed to send_data now would go out rather than be dropped. Burst records are only sent
+		 * while this holds -- they wait, the live stream does not.
+		 * UDP: always, while the socket is up (no flow control). TCP streaming: the transmit queue has space for a
+		 * largest packet. Legacy: the connection is ready for its one packet.
+		 *
+		 * @input  : none
+		 *
+		 * @output : none
+		 *
+		 * @return : 1 = room for a packet, 0 = none
+		 *
+		 * */
+		uint8_t send_room(void)
+		{
+		#if UDP_STREAMING
+		  return connection_ready;
+		#elif TCP_STREAMING
+		  return ((connection_ready==1)&&(pcb_send!=0)&&(tx_queue_len + PACKET_MAX_SIZE <= sizeof(tx_queue))&&
+			(tx_queue_packets < TX_QUEUE_PACKETS)) ? 1U : 0U;
+		#else
+		  return ((connection_ready==1)&&(pcb_send!=0)) ? 1U : 0U;
+		#endif
+		}
+
+		/**
+		 * @send_poll
+		 *
+		 * Called on every main loop pass. Writes packets still waiting for a full batch once the oldest reaches the
+		 * latency deadline (tx_batch.h), which bounds the latency when the stream is slow, and whatever the send buffer
+		 * space freed by acknowledgements (client_sent) now takes.
+		 *
+		 * @input  : none
+		 *
+		 * @output : none
+		 *
+		 * @return : none
+		 *
+		 * */
+		void send_poll(void)
+		{
+		#if UDP_STREAMING
+		  if ((udp_packets!=0) && ((timebase_now() - udp_first) >= (uint64_t)tx_batch_latency() * HAL_TICKS_PER_US))
+			client_udp_flush(1);
+		#elif TCP_STREAMING
+		  client_service();
+		  if (connection_ready==1)
+			client_flush(pcb_send);
+		#endif
+		}
+
+		/**
+		 * @client_udp_flush
+		 *
+		 * Sends the active datagram buffer. The pbuf only references the buffer (PBUF_REF); lwIP prepends its headers
+		 * in a separate pbuf and the Ethernet driver copies the frame, so the buffer is free again once udp_send returns.
+		 * A datagram that cannot be sent is dropped and its packets counted in tx_dropped.
+		 *
+		 * @input  : deadline - 1 if sent at the latency deadline rather than full (tx_batch.h statistics)
+		 *
+		 * @output : none
+		 *
+		 * @return : none
+		 *
+		 * */
+		void client_udp_flush(uint8_t deadline)
+		{
+		#if UDP_STREAMING
+		  struct pbuf *p;
+
+		  if (udp_fill==0)
+			return;
+
+		  tx_batch_sent(udp_fill, deadline);
+		  tx_batch_waited(timebase_now() - udp_first); // The datagram's first packet waited longest
+
+		  p = pbuf_alloc(PBUF_TRANSPORT, (u16_t)udp_fill, PBUF_REF);
+		  if (p!=0)
+		  {
+			p->payload = udp_datagram[udp_active];
+			if (udp_send(pcb_udp, p) != ERR_OK)
+			  tx_dropped += udp_packets;
+			pbuf_free(p);
+		  }
+		  else
+		  {
+			tx_dropped += udp_packets;
+		  }
+
+		  udp_active ^= 1U;
+		  udp_fill = 0;
+		  udp_packets = 0;
+		#endif
+		}
+
 		/**
 		 * @tim_sys_check_timeouts_wrap
 		 *
@@ -280,161 +734,154 @@
 */
 int main(void) {
 	// VARIABLES
-	DAVE_STATUS_t status;
-	uint32_t timer_systimer_lwip; 				// Timer for Ethernet Checkouts???
-	uint8_t dataArray[PACKET_SIZE] = {0x00}; 	// Create data packet
-	uint8_t null[18] = {0x00}; 					// Null packet to "send" during ADC Transfers
+	uint8_t status;
+	uint8_t dataArray[PACKET_MAX_SIZE] = {0x00}; 	// Create data packet
+	tc_cycle_t tcCycle;							// Thermocouple words (TC0 - TC3) of the last read cycle
+	uint32_t pass_stamp;						// Start of the main loop pass, CPU cycles (telemetry)
 
 	//DAVE STARTUP
-		status = DAVE_Init(); /* Initialization of DAVE APPs  */
-		if(status != DAVE_STATUS_SUCCESS) {
+		status = hal_init(); /* Initialization of DAVE APPs  */
+		if(status != HAL_OK) {
 			/* Placeholder for error handler code.
 			* The while loop below can be replaced with an user error handler. */
-			XMC_DEBUG("DAVE APPs initialization failed\n");
 			while(1U) {
 			}
 		}
 
-	//Initialize ADCs
-		//Unlock / Config
-			// ADC0
-				SPI_MASTER_EnableSlaveSelectSignal(&SPI_MASTER_ADC,  SPI_MASTER_SS_SIGNAL_0); // Change slave
-				for (int i = 0; i <9000; i++){} // Dumb Delay (Remove?)
-				adc_register_config();
-			// ADC 1
-				SPI_MASTER_EnableSlaveSelectSignal(&SPI_MASTER_ADC,  SPI_MASTER_SS_SIGNAL_1); // Change slave
-				for (int i = 0; i <9000; i++){} // Dumb Delay (Remove?)
-				adc_register_config();
-
-		// Turn on ADCs
-			// ADC0
-				SPI_MASTER_EnableSlaveSelectSignal(&SPI_MASTER_ADC,  SPI_MASTER_SS_SIGNAL_0); // Change slave
-				for (int i = 0; i <9000; i++){} // Dumb Delay (Remove?)
-				xmc_ADC_setup();
-			// ADC 1
-				SPI_MASTER_EnableSlaveSelectSignal(&SPI_MASTER_ADC,  SPI_MASTER_SS_SIGNAL_1); // Change slave
-				for (int i = 0; i <9000; i++){} // Dumb Delay (Remove?)
-				xmc_ADC_setup();
-
-		// RETURN TO ADC0
-			SPI_MASTER_EnableSlaveSelectSignal(&SPI_MASTER_ADC,  SPI_MASTER_SS_SIGNAL_0); // Change slave
-			for (int i = 0; i <9000; i++){} // Dumb Delay (Remove?)
+	// Timestamps first -- the ADC bring-up and the boot timing run on them
+		hal_irq_enable(HAL_IRQ_TIMESTAMP);	// Millisecond Timestamping Interrupt Enabled
 
+	//Initialize ADCs -- wait for power-on reset, unlock, write and verify the register tables (adc_config.c), start
+	//conversions. Both ADCs at once, stepped by the main loop, so Ethernet comes up in the meantime
+		for (uint8_t adc = 0; adc < ADC_COUNT; adc++) {
+			adc_config_begin(adc, ADC_BEGIN_POWER_UP | ADC_BEGIN_WAKEUP, millisec);
+		}
 
 	// Initialize and start lwip system timer
-		timer_systimer_lwip = SYSTIMER_CreateTimer(10000, SYSTIMER_MODE_PERIODIC, tim_sys_check_timeouts_wrap,0); // WAS  //1000000
-		SYSTIMER_StartTimer(timer_systimer_lwip);
+		hal_lwip_timer_start(tim_sys_check_timeouts_wrap, 10000); // WAS  //1000000
 
 
 
 	// Define out packet to be sent -- dummy data to see if it's changing with our code
-		for (int i = 0; i < PACKET_SIZE; i++) {
+		for (int i = 0; i < PACKET_MAX_SIZE; i++) {
 			dataArray[i] = i;
 		}
 
-	// Enable interrupts once configuration complete
-		PIN_INTERRUPT_Enable(&PIN_INTERRUPT_ADC0); 	// ADC0 DRDY Interrupt
-		PIN_INTERRUPT_Enable(&PIN_INTERRUPT_ADC1); 	// ADC1 DRDY Interrupt
-		INTERRUPT_Enable(&INTERRUPT_TC);			// Thermocouple Timer Interrupt
-		INTERRUPT_Enable(&INTERRUPT_TIMESTAMP);		// Millisecond Timestamping Interrupt Enabled
+	// Output rate of each ADC (decimation 2^log2, 0 = full rate)
+		adc_decimate_set(0, DECIM_LOG2_ADC0);
+		adc_decimate_set(1, DECIM_LOG2_ADC1);
 
-		INTERRUPT_Enable(&INTERRUPT_ETH);			// Ethernet Timer Interrupt -- NOT INTENDED FOR FINAL CODE XXXXXXXXXXXXXXXXXXXXXXXXXX
+	// Streaming or burst capture (host trigger until CMD_BURST says otherwise)
+		{
+			burst_config_t burst = *adc_burst_config();
 
-	while(1) {
+			burst.mode = BURST_MODE;
+			adc_burst_set(&burst);
+		}
 
-		// Thermocouple SPI Transfers
-			if(ReadTC == 1){ // Does timer say we should transfer?
-				if ( !SPI_MASTER_IsRxBusy(&SPI_MASTER_TC) ) { // Check if SPI is not busy
-						switch(thermocouple_ss) { // Slave selection
+	// Enable interrupts -- the ADC DRDY interrupts follow once the bring-up is done (main loop)
+		hal_irq_enable(HAL_IRQ_TC_TIMER);	// Thermocouple Timer Interrupt
 
-							case 0: // Slave 0
-								SPI_MASTER_EnableSlaveSelectSignal(&SPI_MASTER_TC, SPI_MASTER_SS_SIGNAL_0);
-								SPI_MASTER_Receive(&SPI_MASTER_TC, dataArray, 4U);
-							break;
+	pass_stamp = TELEM_STAMP();
+	while(hal_running()) { // Always true on the target -- the simulator ends the run here
 
-							case 1: // Slave 1
-								SPI_MASTER_EnableSlaveSelectSignal(&SPI_MASTER_TC, SPI_MASTER_SS_SIGNAL_1);
-								SPI_MASTER_Receive(&SPI_MASTER_TC, dataArray+4, 4U);
-							break;
+		// Main loop pass time -- from the start of the previous pass to this one
+			TELEM_RECORD(TELEM_HIST_LOOP, pass_stamp);
+			pass_stamp = TELEM_STAMP();
 
-							case 2: // Slave 2
-								SPI_MASTER_EnableSlaveSelectSignal(&SPI_MASTER_TC, SPI_MASTER_SS_SIGNAL_2);
-								SPI_MASTER_Receive(&SPI_MASTER_TC, dataArray+8, 4U);
-							break;
+		// ADC bring-up -- one configuration frame per pass, capture starts when both ADCs are done
+			if (!adc_ready && adc_config_poll(millisec)) {
+				for (uint8_t adc = 0; adc < ADC_COUNT; adc++) {
+					config_failed[adc] = adc_config_result(adc);
+				}
+				boot_config_us = (uint32_t)timebase_us(timebase_now());
+				adc_capture_start();		// ADC0/ADC1 DRDY Interrupts
+				adc_ready = 1;
+			}
 
-							case 3: // Slave 3
-								SPI_MASTER_EnableSlaveSelectSignal(&SPI_MASTER_TC, SPI_MASTER_SS_SIGNAL_3);
-								SPI_MASTER_Receive(&SPI_MASTER_TC, dataArray+12, 4U);
-							break;
+		// ADC SPI Transfers
+			// Priority between ADC0 and ADC1: earliest deadline first (adc_capture.c), misses counted for CMD_DEADLINES
+			// NOTE: I HAD TO MAKE THE FIFO IN THE DAVE APP 32, NOT 16, BECAUSE 16 WOULD NOT HOLD ENOUGH DATA AND THE SPI TRANSFER WOULD SPLIT
 
-							default : // We should never get here
-								thermocouple_ss = 0;
-								SPI_MASTER_EnableSlaveSelectSignal(&SPI_MASTER_TC, SPI_MASTER_SS_SIGNAL_0);
-								SPI_MASTER_Receive(&SPI_MASTER_TC, dataArray, 4U);
+			// Reads are started by the DRDY interrupts in DMA mode -- this only does work in polled mode
+				adc_capture_poll();
 
-						} // End switch
+		// Ethernet Transactions
+			// Host command -- one per pass, ahead of the data so the reply gets the connection (legacy transport: one
+			// packet per connection). Commands wait in their queue while there is no connection to carry the reply
+			// and until the ADC bring-up has let go of the bus.
+				if ((connection_ready == 1) && adc_ready) {
+					const uint8_t *cmd = command_next();
 
-					thermocouple_ss++; // Increment slave
+					if (cmd != 0) {
+						uint8_t *packet = send_buffer(dataArray);
 
-					if (thermocouple_ss > 3){ // All slaves read
-						thermocouple_ss = 0; // reset to slave 0
-						ReadTC = 0; //Reset Flag
-						// NEED TO DO SOMETHING HERE ABOUT NEW DATA (NOT STALE)
+						sendPacket(packet, runCommand(packet, cmd));
+						command_done();
 					}
+				}
 
-				} // End if !busy
-			} // End TC Read
+			// Burst record closed -- announced ahead of its samples, once the transmit queue can take it
+				if (send_room() && adc_burst_take(&burstRecord, timebase_now())) {
+					uint8_t *packet = send_buffer(dataArray);
 
-		// ADC SPI Transfers
-			// NEED TO SET SOME SORT OF PRIORITY HERE, WHERE WE NEED TO HAVE ADC1 HAPPEN, EVEN IF ADC1 IS READY -- NOT SURE IF THIS IS A REAL PROBLEM ONCE WE ACTUALLY HAVE INTERRUPTS INSTEAD OF READ0 and READ1 AUTO-SET TO 1 AT BEGINNING OF LOOP
-			// NOTE: I HAD TO MAKE THE FIFO IN THE DAVE APP 32, NOT 16, BECAUSE 16 WOULD NOT HOLD ENOUGH DATA AND THE SPI TRANSFER WOULD SPLIT
+					sendPacket(packet, packBurst(packet, &burstRecord));
+				}
+
+			// One packet per ADC once it has a full batch waiting, or with whatever is buffered once the oldest sample is
+			// PACKET_FULL_RATE_AGE_US old (decimated ADCs: PACKET_MAX_AGE_MS). Burst capture: the record being drained
+			// instead, only as fast as the transmit queue takes it
+				for (uint8_t adc = 0; adc < ADC_COUNT; adc++) {
+					if ((boot_first_sample_us == 0U) && (adc_ring_count(&adc_rings[adc]) > 0U)) {
+						const adc_frame_t *first = adc_ring_peek(&adc_rings[adc], 0);
 
-			// ADC0 SPI Transfers
-				if (ReadADC0 == 1) { // Flag set
-					if ( !SPI_MASTER_IsRxBusy(&SPI_MASTER_ADC) ) { // SPI not already in transaction
-						SPI_MASTER_EnableSlaveSelectSignal(&SPI_MASTER_ADC, SPI_MASTER_SS_SIGNAL_0); // Change to ADC0
-						SPI_MASTER_Transfer(&SPI_MASTER_ADC, null, dataArray+16, 18U);
-						ReadADC0 = 0; // Reset Flag
+						boot_first_sample_us = (uint32_t)timebase_us(first->time);
 					}
-				}
+					if ((channel_enable & PKT_CH_ADC(adc)) == 0U) {
+						adc_ring_release(&adc_rings[adc], adc_ring_count(&adc_rings[adc])); // ADC not sent -- keep its ring empty
+					}
+					else {
+						adc_ring_t *ring = adc_burst_poll(adc, adc_decimate_poll(adc)); // Capture ring at full rate, decimated frames otherwise
+						uint32_t waiting = adc_ring_count(ring);
+						uint64_t max_age = (adc_decimate_log2(adc) == 0U) ? (uint64_t)PACKET_FULL_RATE_AGE_US * HAL_TICKS_PER_US :
+							PACKET_MAX_AGE_MS * TIMEBASE_TICKS_PER_MS;
 
-			// ADC1 SPI Transfers
-				if (ReadADC1 == 1) {
-					if ( !SPI_MASTER_IsRxBusy(&SPI_MASTER_ADC) ) { // SPI not already in transaction
-						SPI_MASTER_EnableSlaveSelectSignal(&SPI_MASTER_ADC, SPI_MASTER_SS_SIGNAL_1); // Change to ADC1
-						SPI_MASTER_Transfer(&SPI_MASTER_ADC, null, dataArray+34, 18U);
-						ReadADC1 = 0; // Reset Flag
+						if (((ring != &burst_rings[adc]) || send_room()) && ((waiting >= SAMPLES_PER_PACKET) ||
+							((waiting > 0) && ((timebase_now() - adc_ring_peek(ring, 0)->time) >= max_age)))) {
+							uint8_t *packet = send_buffer(dataArray); // Where the packet is built (UDP: straight into the datagram)
+
+							sendPacket(packet, packSamples(packet, adc, ring));
+						}
 					}
 				}
 
-		// Ethernet Transactions
-			if (tx_flag == 1) { // if hardware timer reached period -- send data
-				// Parse Times into respective bytes
-					parseTime(dataArray);
-
-				// Packet count split
-					dataArray[67] = (packet_count >> 24) 	& 0xff; // MSB
-					dataArray[68] = (packet_count >> 16) 	& 0xff;
-					dataArray[69] = (packet_count >> 8) 	& 0xff; // Nice
-					dataArray[70] = (packet_count >> 0)		& 0xff; // LSB
-
-				// Transmit
-					if ((connection_ready==0)&&(pcb_valid==0)) { // Connection already/still active?
-						client_init(); // Re-Initialize TCP/IP connection
-					}
-					else {
-						// Send data out
-							send_data(dataArray);
+			// Thermocouple packet once a read cycle has finished (or missed its deadline, see tc_capture.h)
+				if (tc_capture_take(&tcCycle) && ((channel_enable & PKT_CH_TC) != 0U)) {
+					uint8_t *packet = send_buffer(dataArray);
+
+					sendPacket(packet, packThermocouples(packet, &tcCycle));
+				}
 
-						// Increment Packet
-							packet_count++;
+		#if TELEMETRY
+			// Telemetry packet every TELEMETRY_PERIOD_MS, once the ADCs are up
+				{
+					static uint32_t telemetry_ms = 0;	// Time the last telemetry packet was sent
 
+					if (adc_ready && ((millisec - telemetry_ms) >= TELEMETRY_PERIOD_MS)) {
+						uint8_t *packet = send_buffer(dataArray);
+
+						telemetry_ms = millisec;
+						sendPacket(packet, packTelemetry(packet));
 					}
-					// Reset flag
-					tx_flag = 0; //
-			}
+				}
+		#endif
+
+			// Packets still waiting for a full batch go out at the latency deadline (tx_batch.h)
+				send_poll();
 
 	} // End While Loop
+
+	return 0; // Only reached in the host simulator
 } // End main
 
 
@@ -442,159 +889,458 @@ int main(void) {
 
 	// Timer configured with 1000us period = 1ms
 		void TimeStampIRQ(void) {
-			TIMER_ClearEvent(&TIMER_TIMESTAMP); // Clear Event Flag
+			timebase_period();					// Move the 64-bit clock on, clear Event Flag
 			millisec++; 						// New device uptime
 		}
 
 	// Thermocouple trigger -- Timer configured with 100000us period = 100ms = 10Hz
 		void TCIRQ(void) {
-			TIMER_ClearEvent(&TIMER_TC);		// Clear Event Flag
-			TC_us = TIMER_GetTime(&TIMER_TIMESTAMP) / 100; // Get microseconds from timer -- DAVE TIMER APP returns (us * 100);
-			TC_ms = millisec;	// Grab milliseconds for capture time
-			ReadTC = 1;		// Set flag to read Thermocouples
+			hal_tc_timer_clear_event();		// Clear Event Flag
+			tc_capture_tick(timebase_now());	// Queue the four reads and start the first
 		}
 
 
 	// Data Ready Interrupt for ADC0
-		void ADC0_DRDY_INT(){
-			ADC0_us = TIMER_GetTime(&TIMER_TIMESTAMP) / 100; // Get microseconds from timer -- DAVE TIMER APP returns (us * 100);
-			ADC0_ms = millisec;	// Grab milliseconds for capture time
-			ReadADC0 = 1; // Set flag to read ADC0
+		void ADC0_DRDY_INT(void){
+			ADC0_index++;		// Count every conversion, read or not
+			adc_capture_drdy(0, ADC0_index, timebase_capture(hal_drdy_capture(0))); // Request read of ADC0 at the edge time latched by CAPTURE_ADC0 (started here in DMA mode)
 		}
 
 	// Data Ready Interrupt for ADC1
-		void ADC1_DRDY_INT(){
-			ADC1_us = TIMER_GetTime(&TIMER_TIMESTAMP) / 100; // Get microseconds from timer -- DAVE TIMER APP returns (us * 100);
-			ADC1_ms = millisec;	// Grab milliseconds for capture time
-			ReadADC1 = 1; // Set flag to read ADC1
+		void ADC1_DRDY_INT(void){
+			ADC1_index++;		// Count every conversion, read or not
+			adc_capture_drdy(1, ADC1_index, timebase_capture(hal_drdy_capture(1))); // Request read of ADC1 at the edge time latched by CAPTURE_ADC1 (started here in DMA mode)
 		}
 
-	// Ethernet Timer (NOT USED IN FINAL PRODUCT)
-		void ETHIRQ(){
-			tx_flag = 1;
-			DIGITAL_IO_ToggleOutput(&LED_INDICATOR); // LED Toggle for speed check on scope
+	// ADC SPI end of receive -- set as "End of receive callback" in the SPI_MASTER_ADC APP
+		void ADC_SPI_RxDone(void){
+			adc_capture_done(); // Frame complete -- hand it to the main loop, start the next held-back read
+		}
+
+	// Thermocouple SPI end of receive -- set as "End of receive callback" in the SPI_MASTER_TC APP
+		void TC_SPI_RxDone(void){
+			tc_capture_done(); // Converter read -- start the next one of the cycle
+		}
+
+	// Ethernet Timer -- no longer enabled: the stream is paced by tx_batch.h. Kept for the LED speed check on a scope
+		void ETHIRQ(void){
+			hal_led_toggle(); // LED Toggle for speed check on scope
 		}
 
 
 // FUNCIONS ///////////////////////////////////////////////////////////////////////////////////////
 
-void adc_register_config(){
-	// Register Configurations
-		uint8_t unlock[3] = {0x06, 0x55, 0x0}; 				// Unlocks ADC
-		uint8_t null[18] = {0x00};							// Sends null for reads
-		uint8_t write_A_SYS_CFG[3] = {0x4B, 0x68, 0x00};	// b(01101000) -- Neg Charge Pump Powered Down | High-Res | 2.442 Internal Reference | Internal Voltage Enabled | 5/95% Comparator Threshold
-		uint8_t write_D_SYS_CFG[3] = {0x4C, 0x3C, 0x00};	// b(00111100) -- Watchdog Disabled | No CRC | 12ns delay for DONE (not used) | 12ns delay for Hi-Z on DOUT | Fixed Frame Size (6 frames) | CRC disabled
-		uint8_t write_CLK1[3] = {0x4D, 0x02, 0x00};			// b(00000010) -- XTAL CLK Source | CLKIN /2
-		uint8_t write_CLK2_43kHz[3] = {0x4E, 0x4E, 0x00};	// b(01001110) -- ICLK / 4 | OSR = fMOD / 48
-		uint8_t write_CLK2_8kHz[3] = {0x4E, 0x48, 0x00};	// b(01001000) -- ICLK / 4 | OSR = fMOD / 256
-		// NOTE -- write_CLK2_43kHz gives a final sample rate of 42.667kHz
-		// NOTE -- write_CLK2_8kHz gives a final sample rate of 8kHz
+void sendPacket(uint8_t data[], uint16_t len) {
+	if ((connection_ready==0)&&(pcb_valid==0)) { // Connection already/still active?
+		tx_dropped++; // Packed but nowhere to send it
+		client_init(); // Re-Initialize TCP/IP connection
+	}
+	else {
+		// Send data out
+			uint32_t send_stamp = TELEM_STAMP();
+			hal_stage_t stage = hal_stage_enter(HAL_STAGE_TRANSPORT);
+
+			send_data(data, len);
+			hal_stage_exit(stage);
+			TELEM_RECORD(TELEM_HIST_SEND, send_stamp);
+
+		// Increment Packet
+			packet_count++;
+	}
+}
 
 
-	// Clear configArray for debug
-		for (uint8_t i = 0; i<  56; i++){
-			configArray[i] = 0x00;
+// Packs up to SAMPLES_PER_PACKET buffered frames of one ADC (from its capture or decimated ring) into a packet and releases them
+uint16_t packSamples(uint8_t data[], uint8_t adc, adc_ring_t *ring) {
+	static uint32_t overflows_seen[2] = {0, 0};
+	static uint32_t misses_seen[2] = {0, 0};
+	uint32_t overflows = adc_rings[adc].overflows + decim_rings[adc].overflows;
+	uint32_t misses = adc_capture_misses[adc].dropped + adc_capture_misses[adc].late;
+	uint8_t full_rate = (ring == &adc_rings[adc]) ? 1U : 0U;	// Decimated and burst frames were checked on the way in
+	const adc_frame_t *first = adc_ring_peek(ring, 0);
+	uint16_t mask = channel_enable & (PKT_CH_ADC(adc) | PKT_CH_STATUS);
+	uint8_t *out = data + PKT_HEADER_SIZE;
+	uint32_t count = adc_ring_count(ring);
+	uint64_t base;				// Packet time in ticks
+	uint16_t len;
+	daq_header_t header;
+	hal_stage_t stage = hal_stage_enter(HAL_STAGE_PACKETIZE);
+
+	if (count > SAMPLES_PER_PACKET){
+		count = SAMPLES_PER_PACKET;
+	}
+
+	// Header -- index and time of the first sample
+		header.device = DEVICE_ID;
+		header.faults = (ring == &burst_rings[adc]) ? PKT_FLAG_BURST : 0x00U;
+		header.mask = mask;
+		header.decim = adc_decimate_log2(adc);
+		header.type = PKT_TYPE_SAMPLES;
+		header.packet = packet_count;
+		header.index = first->index;
+		header.time_us = timebase_us(first->time);
+		base = header.time_us * HAL_TICKS_PER_US;
+
+	// Ring overflowed since the last packet -> flag it
+		if (overflows != overflows_seen[adc]) {
+			overflows_seen[adc] = overflows;
+			header.faults |= PKT_FAULT_OVERFLOW;
 		}
 
-	// Transfer Null
-		SPI_MASTER_Transfer(&SPI_MASTER_ADC, null, configArray, 3U);
-		while(SPI_MASTER_IsRxBusy(&SPI_MASTER_ADC)){} // Wait for completion
+	// Conversion dropped or read late since the last packet -> flag it
+		if (misses != misses_seen[adc]) {
+			misses_seen[adc] = misses;
+			header.faults |= PKT_FAULT_MISSED;
+		}
 
-	//  Unlock ADC for configuration
-		SPI_MASTER_Transfer(&SPI_MASTER_ADC, unlock, configArray, 3U);
-		while(SPI_MASTER_IsRxBusy(&SPI_MASTER_ADC)){} // Wait for completion
+	// Samples -- selected words only, zeros frame dropped. The packet ends early at a sample whose delta would not fit
+	// 16 bits (a decimated ADC draining a burst record), the rest goes in the next one
+		for (uint32_t i = 0; i < count; i++) {
+			const adc_frame_t *frame = adc_ring_peek(ring, i);
+			uint64_t ticks = frame->time - base;
 
-	// Transfer Null
-		SPI_MASTER_Transfer(&SPI_MASTER_ADC, null, configArray+3, 3U);
-		while(SPI_MASTER_IsRxBusy(&SPI_MASTER_ADC)){} // Wait for completion
+			if (ticks > (uint64_t)UINT16_MAX * HAL_TICKS_PER_US) {
+				count = i;
+				break;
+			}
+			uint16_t delta = (uint16_t)((uint32_t)ticks / HAL_TICKS_PER_US); // 32-bit division -- bounded above
 
-	// Write to A_SYS_CFG (See Above)
-		SPI_MASTER_Transfer(&SPI_MASTER_ADC, write_A_SYS_CFG, configArray+6, 3U);
-		while(SPI_MASTER_IsRxBusy(&SPI_MASTER_ADC)){} // Wait for completion
-		// Transfer Null
-		SPI_MASTER_Transfer(&SPI_MASTER_ADC, null, configArray+9, 3U);
-		while(SPI_MASTER_IsRxBusy(&SPI_MASTER_ADC)){} // Wait for completion
+			if (full_rate) {
+				adc_status_scan(adc, frame);
+			}
+			out = daq_put_adc_sample(out, mask, adc, delta, frame->data);
+		}
+		adc_ring_release(ring, count);
+		header.count = (uint16_t)count;
 
-	// Write to D_SYS_CFG (See Above)
-		SPI_MASTER_Transfer(&SPI_MASTER_ADC, write_D_SYS_CFG, configArray+12, 3U);
-		while(SPI_MASTER_IsRxBusy(&SPI_MASTER_ADC)){} // Wait for completion
+	// Status word faults of these samples (or, decimated, of the conversions filtered since the last packet)
+		header.faults |= adc_status_take(adc);
 
-	// Transfer Null
-		SPI_MASTER_Transfer(&SPI_MASTER_ADC, null, configArray+15, 3U);
-		while(SPI_MASTER_IsRxBusy(&SPI_MASTER_ADC)){} // Wait for completion
+	daq_put_header(data, &header);
+	len = (uint16_t)(out - data);
 
-	// Write to CLK1 (See Above)
-		SPI_MASTER_Transfer(&SPI_MASTER_ADC, write_CLK1, configArray+18, 3U);
-		while(SPI_MASTER_IsRxBusy(&SPI_MASTER_ADC)){} // Wait for completion
+	// Lossless compression -- the packet is one block on its own, kept as it is if it would not get smaller
+		if (compression) {
+			uint32_t codec_stamp = TELEM_STAMP();
+			uint16_t packed = daq_compress(data, len, codec_buffer);
 
-	// Transfer Null
-		SPI_MASTER_Transfer(&SPI_MASTER_ADC, null, configArray+21, 3U);
-		while(SPI_MASTER_IsRxBusy(&SPI_MASTER_ADC)){} // Wait for completion
+			TELEM_RECORD(TELEM_HIST_CODEC, codec_stamp);
+			if (packed != 0U) {
+				memcpy(data, codec_buffer, packed);
+				len = packed;
+			}
+		}
+	hal_stage_exit(stage);
+	return len;
+}
 
-	// Write to CLK2 (See Above)
-		SPI_MASTER_Transfer(&SPI_MASTER_ADC, write_CLK2_43kHz, configArray+24, 3U);
-		while(SPI_MASTER_IsRxBusy(&SPI_MASTER_ADC)){} // Wait for completion
 
-	// Transfer Null
-		SPI_MASTER_Transfer(&SPI_MASTER_ADC, null, configArray+27, 3U);
-		while(SPI_MASTER_IsRxBusy(&SPI_MASTER_ADC)){} // Wait for completion
+// Packs the thermocouple words of a read cycle, time stamped by the TC timer interrupt that started it
+uint16_t packThermocouples(uint8_t data[], const tc_cycle_t *tc) {
+	daq_header_t header;
+	uint8_t *out;
 
+	header.device = DEVICE_ID;
+	header.faults = 0x00;
+	for (uint8_t n = 0; n < TC_COUNT; n++) {
+		if (tc->fresh & (1U << n)) {
+			header.faults |= PKT_FRESH_TC(n); // Read in this cycle -- clear: previous reading repeated
+		}
+	}
+	header.mask = channel_enable & PKT_CH_TC;
+	header.count = 1U;
+	header.decim = 0U;
+	header.type = PKT_TYPE_SAMPLES;
+	header.packet = packet_count;
+	header.index = tc->cycle;
+	header.time_us = timebase_us(tc->time);
+
+	out = daq_put_tc_sample(data + PKT_HEADER_SIZE, header.mask, 0U, tc->words);
+	daq_put_header(data, &header);
+	return (uint16_t)(out - data);
 }
 
-void xmc_ADC_setup(){
-	uint8_t null[18] = {0x00};						// Sends null for reads
-	uint8_t write_ADC_ENA[3] = {0x4F, 0x0F, 0x00};	// b(00001111) -- Enables all ADC channels (note: no option to enable certain channels, all or nothing)
-	uint8_t wakeup[3] = {0x00, 0x33, 0x00};			// b(00110011) -- Bring ADC out of standby (start collection)
 
-	// Write to ADC_ENA (See Above)
-		SPI_MASTER_Transfer(&SPI_MASTER_ADC, write_ADC_ENA, configArray, 3U);
-		while(SPI_MASTER_IsRxBusy(&SPI_MASTER_ADC)){} // Wait for completion
+// Packs the latency histograms and the loss counters (TELEMETRY in daq_packet.h)
+uint16_t packTelemetry(uint8_t data[]) {
+	static uint32_t telemetry_count = 0;
+	daq_header_t header;
+	uint32_t counters[TELEM_COUNTERS];
+	uint8_t *out;
+
+	counters[TELEM_CTR_DROPPED0] = adc_capture_misses[0].dropped;
+	counters[TELEM_CTR_DROPPED1] = adc_capture_misses[1].dropped;
+	counters[TELEM_CTR_OVERFLOW0] = adc_rings[0].overflows + decim_rings[0].overflows;
+	counters[TELEM_CTR_OVERFLOW1] = adc_rings[1].overflows + decim_rings[1].overflows;
+	counters[TELEM_CTR_OVERRUN0] = adc_capture_misses[0].late;
+	counters[TELEM_CTR_OVERRUN1] = adc_capture_misses[1].late;
+	counters[TELEM_CTR_TC_MISSED] = tc_capture_misses;
+	counters[TELEM_CTR_RECONNECTS] = tx_reconnects;
+	counters[TELEM_CTR_TX_DROPPED] = tx_dropped;
+	counters[TELEM_CTR_STATUS0] = adc_status_counts[0].fault_frames;
+	counters[TELEM_CTR_STATUS1] = adc_status_counts[1].fault_frames;
+	counters[TELEM_CTR_SYNC0] = adc_status_counts[0].sync_errors;
+	counters[TELEM_CTR_SYNC1] = adc_status_counts[1].sync_errors;
+	counters[TELEM_CTR_TX_FLUSHES] = tx_batch_stats.flushes;
+	counters[TELEM_CTR_TX_BYTES] = tx_batch_stats.bytes;
+	counters[TELEM_CTR_TX_DEADLINE] = tx_batch_stats.deadline;
+	counters[TELEM_CTR_BOOT_CONFIG] = boot_config_us;
+	counters[TELEM_CTR_BOOT_SAMPLE] = boot_first_sample_us;
+	out = telemetry_put(data + PKT_HEADER_SIZE, counters);
+
+	header.device = DEVICE_ID;
+	header.faults = 0x00;
+	header.mask = 0U;
+	header.count = (uint16_t)(out - (data + PKT_HEADER_SIZE));
+	header.decim = 0U;
+	header.type = PKT_TYPE_TELEMETRY;
+	header.packet = packet_count;
+	header.index = telemetry_count++;
+	header.time_us = timebase_us(timebase_now());
+	daq_put_header(data, &header);
+	return (uint16_t)(out - data);
+}
 
-	// Transfer Null
-		SPI_MASTER_Transfer(&SPI_MASTER_ADC, null, configArray+30, 3U);
-		while(SPI_MASTER_IsRxBusy(&SPI_MASTER_ADC)){} // Wait for completion
 
-	// Wakeup ADC and start conversions
-		SPI_MASTER_Transfer(&SPI_MASTER_ADC, wakeup, configArray, 3U);
-		while(SPI_MASTER_IsRxBusy(&SPI_MASTER_ADC)){} // Wait for completion
+// Packs the announcement of a burst record (BURST RECORD in daq_packet.h), its ADC packets follow
+uint16_t packBurst(uint8_t data[], const burst_record_t *record) {
+	uint8_t *out = data + PKT_HEADER_SIZE;
+	const uint32_t words[6] = {record->pre_us, record->post_us, record->frames[0], record->frames[1],
+		record->first_index[0], record->first_index[1]};
+	daq_header_t header;
+
+	*out++ = record->cause;
+	*out++ = record->channel;
+	*out++ = record->truncated ? BURST_FLAG_TRUNCATED : 0U;
+	*out++ = 0U;
+	for (uint8_t n = 0; n < 6U; n++) {
+		for (uint8_t shift = 32U; shift != 0U; shift -= 8U) {
+			*out++ = (uint8_t)(words[n] >> (shift - 8U));
+		}
+	}
+
+	header.device = DEVICE_ID;
+	header.faults = 0x00;
+	header.mask = 0U;
+	header.count = BURST_INFO_SIZE;
+	header.decim = 0U;
+	header.type = PKT_TYPE_BURST;
+	header.packet = packet_count;
+	header.index = record->number;
+	header.time_us = timebase_us(record->time);
+	daq_put_header(data, &header);
+	return (uint16_t)(out - data);
+}
 
-	// Transfer Null
-		SPI_MASTER_Transfer(&SPI_MASTER_ADC, null, configArray+33, 3U);
-		while(SPI_MASTER_IsRxBusy(&SPI_MASTER_ADC)){} // Wait for completion
 
-	// Set to "infinite" frame length
-		XMC_SPI_CH_SetFrameLength(XMC_SPI2_CH0, 64); // When set to 64, frame does not end based on DAVE App Configuration -- this allows us to grab all 144 bits of data out of the ADC during data collection
+// Executes one host command (daq_packet.h) and builds its reply packet
+uint16_t runCommand(uint8_t data[], const uint8_t cmd[]) {
+	const uint8_t *payload = cmd + CMD_HEADER_SIZE;
+	uint8_t len = cmd[CMD_OFS_LENGTH];
+	uint8_t adc = payload[0];
+	uint8_t *reply = data + PKT_HEADER_SIZE;
+	uint8_t *out = reply + CMD_REPLY_DATA;
+	uint8_t result = CMD_OK;
+	daq_header_t header;
 
-}
+	switch (cmd[CMD_OFS_OPCODE]) {
+		case CMD_REG_WRITE: // adc, (addr, value) x n -- written together, ADC restarted once
+		case CMD_REG_READ:	// adc, addr x n
+		{
+			uint8_t write = (cmd[CMD_OFS_OPCODE] == CMD_REG_WRITE) ? 1U : 0U;
+			uint8_t step = write ? 2U : 1U;
 
+			if ((len < 1U + step) || (((len - 1U) % step) != 0U) || (adc >= ADC_COUNT)) {
+				result = CMD_ERR_INVALID;
+				break;
+			}
+			for (uint8_t i = 1; i < len; i += step) {
+				if (adc_config_find(adc, payload[i]) == 0) {
+					result = CMD_ERR_INVALID; // Only registers in the table can be changed or read
+				}
+			}
+			if (result != CMD_OK) {
+				break;
+			}
 
-void parseTime(uint8_t data[]) {
-	// TC ms
-		data[52] = (TC_ms >> 16) 	& 0xff; // MSB
-		data[53] = (TC_ms >> 8) 	& 0xff;
-		data[54] = (TC_ms >> 0) 	& 0xff;
+			if (write) {
+				for (uint8_t i = 1; i < len; i += 2U) {
+					adc_config_find(adc, payload[i])->value = payload[i + 1U];
+				}
+				if (adc_config_apply(adc, 1) != 0U) {
+					result = CMD_ERR_VERIFY;
+				}
+				adc_decimate_set(adc, adc_decimate_log2(adc)); // Restart the filter -- the input rate may have changed
+				adc_burst_set(adc_burst_config());				// and the burst history
+			}
 
-	// TC us
-		data[55] = (TC_us >> 8) 	& 0xff; // MSB
-		data[56] = (TC_us >> 0) 	& 0xff;
+			*out++ = adc;
+			for (uint8_t i = 1; i < len; i += step) {
+				adc_reg_t *reg = adc_config_find(adc, payload[i]);
 
-	// ADCO0 ms
-		data[57] = (ADC0_ms >> 16) 	& 0xff; // MSB
-		data[58] = (ADC0_ms >> 8) 	& 0xff;
-		data[59] = (ADC0_ms >> 0) 	& 0xff;
+				if (!write && !adc_config_read(adc, reg)) {
+					result = CMD_ERR_VERIFY; // No answer from the ADC
+				}
+				*out++ = reg->addr;
+				*out++ = reg->value;
+				*out++ = reg->readback;
+			}
+			break;
+		}
 
-	// ADCO0 us
-		data[60] = (ADC0_us >> 8) 	& 0xff; // MSB
-		data[61] = (ADC0_us >> 0) 	& 0xff;
+		case CMD_STREAMS: // channel mask
+		{
+			uint16_t mask = (uint16_t)((payload[0] << 8) | payload[1]);
+
+			if ((len != 2U) || ((mask >> PKT_CH_COUNT) != 0U)) {
+				result = CMD_ERR_INVALID;
+				break;
+			}
+			channel_enable = mask;
+			adc_burst_set(adc_burst_config()); // Restart burst capture -- a record only holds ADCs that are sent
+			*out++ = (uint8_t)(channel_enable >> 8);
+			*out++ = (uint8_t)channel_enable;
+			break;
+		}
 
-	// ADC1 ms
-		data[62] = (ADC1_ms >> 16) 	& 0xff; // MSB
-		data[63] = (ADC1_ms >> 8) 	& 0xff;
-		data[64] = (ADC1_ms >> 0) 	& 0xff;
+		case CMD_STATUS: // Boot result and timing
+			if (len != 0U) {
+				result = CMD_ERR_INVALID;
+				break;
+			}
+			for (uint8_t n = 0; n < ADC_COUNT; n++) {
+				*out++ = config_failed[n];
+			}
+			for (uint8_t shift = 32U; shift != 0U; shift -= 8U) {
+				*out++ = (uint8_t)(boot_config_us >> (shift - 8U));
+			}
+			for (uint8_t shift = 32U; shift != 0U; shift -= 8U) {
+				*out++ = (uint8_t)(boot_first_sample_us >> (shift - 8U));
+			}
+			break;
+
+		case CMD_DEADLINES: // Deadline misses of the bus schedulers since boot
+			if (len != 0U) {
+				result = CMD_ERR_INVALID;
+				break;
+			}
+			{
+				const uint32_t misses[5] = {adc_capture_misses[0].dropped, adc_capture_misses[0].late,
+					adc_capture_misses[1].dropped, adc_capture_misses[1].late, tc_capture_misses};
+
+				for (uint8_t n = 0; n < 5U; n++) {
+					for (uint8_t shift = 32U; shift != 0U; shift -= 8U) {
+						*out++ = (uint8_t)(misses[n] >> (shift - 8U));
+					}
+				}
+			}
+			break;
+
+		case CMD_COMPRESS: // on / off
+			if ((len != 1U) || (payload[0] > 1U)) {
+				result = CMD_ERR_INVALID;
+				break;
+			}
+			compression = payload[0];
+			*out++ = compression;
+			break;
+
+		case CMD_BURST: // mode, trigger, channel, threshold, pre ms, post ms
+		{
+			burst_config_t burst;
+			const burst_config_t *now;
+
+			burst.mode = payload[0];
+			burst.trigger = payload[1];
+			burst.channel = payload[2];
+			burst.threshold = (int32_t)(((uint32_t)payload[3] << 24) | ((uint32_t)payload[4] << 16) |
+				((uint32_t)payload[5] << 8) | payload[6]);
+			burst.pre_ms = (uint16_t)((payload[7] << 8) | payload[8]);
+			burst.post_ms = (uint16_t)((payload[9] << 8) | payload[10]);
+			if ((len != 11U) || !adc_burst_set(&burst)) {
+				result = CMD_ERR_INVALID;
+				break;
+			}
+			now = adc_burst_config();
+			*out++ = now->mode;
+			*out++ = now->trigger;
+			*out++ = now->channel;
+			for (uint8_t shift = 32U; shift != 0U; shift -= 8U) {
+				*out++ = (uint8_t)((uint32_t)now->threshold >> (shift - 8U));
+			}
+			*out++ = (uint8_t)(now->pre_ms >> 8);
+			*out++ = (uint8_t)now->pre_ms;
+			*out++ = (uint8_t)(now->post_ms >> 8);
+			*out++ = (uint8_t)now->post_ms;
+			break;
+		}
+
+		case CMD_TRIGGER: // Host trigger
+			if ((len != 0U) || (adc_burst_state() == BURST_OFF)) {
+				result = CMD_ERR_INVALID;
+				break;
+			}
+			*out++ = adc_burst_trigger(timebase_now());
+			break;
+
+		case CMD_DECIMATE: // adc, log2
+			if ((len != 2U) || (adc >= ADC_COUNT) || (payload[1] > DECIM_MAX_LOG2)) {
+				result = CMD_ERR_INVALID;
+				break;
+			}
+			adc_decimate_set(adc, payload[1]);
+			adc_burst_set(adc_burst_config()); // Restart burst capture -- one rate per record
+			*out++ = adc;
+			*out++ = adc_decimate_log2(adc);
+			break;
+
+		case CMD_TX_LATENCY: // latency us
+		{
+			uint32_t latency = ((uint32_t)payload[0] << 24) | ((uint32_t)payload[1] << 16) | ((uint32_t)payload[2] << 8) | payload[3];
+			uint32_t target, rate;
+
+			if ((len != 4U) || (latency > TX_LATENCY_MAX_US)) {
+				result = CMD_ERR_INVALID;
+				break;
+			}
+			tx_batch_set(latency);
+			latency = tx_batch_latency();
+			target = tx_batch_target();
+			rate = tx_batch_rate();
+			for (uint8_t shift = 32U; shift != 0U; shift -= 8U) {
+				*out++ = (uint8_t)(latency >> (shift - 8U));
+			}
+			*out++ = (uint8_t)(target >> 8);
+			*out++ = (uint8_t)target;
+			for (uint8_t shift = 32U; shift != 0U; shift -= 8U) {
+				*out++ = (uint8_t)(rate >> (shift - 8U));
+			}
+			break;
+		}
 
-	// ADC1 us
-		data[65] = (ADC1_us >> 8) 	& 0xff;	// MSB
-		data[66] = (ADC1_us >> 0) 	& 0xff;
+		default:
+			result = CMD_ERR_INVALID;
+			break;
+	}
+
+	reply[CMD_REPLY_OPCODE] = cmd[CMD_OFS_OPCODE];
+	reply[CMD_REPLY_SEQUENCE] = cmd[CMD_OFS_SEQUENCE];
+	reply[CMD_REPLY_RESULT] = result;
+	if (result == CMD_ERR_INVALID) {
+		out = reply + CMD_REPLY_DATA; // Nothing was done
+	}
+
+	header.device = DEVICE_ID;
+	header.faults = 0x00;
+	header.mask = 0U;
+	header.count = (uint16_t)(out - reply);
+	header.decim = 0U;
+	header.type = PKT_TYPE_REPLY;
+	header.packet = packet_count;
+	header.index = 0U;
+	header.time_us = timebase_us(timebase_now());
+	daq_put_header(data, &header);
+	return (uint16_t)(out - data);
 }
 
 
@@ -615,35 +1361,79 @@ ADC1 = FB/CL
 
 
 /* FORMAT OF dataArray ////////////////////////////////////////////////////////////////////////////
-Bytes:		| 	Data:
+Version 3 -- one packet per source (ADC0 block, ADC1 block, thermocouple read cycle or command reply), all multi-byte values MSB first
+Field:		| 	Data:			(offsets: PKT_HEADER_FIELDS in daq_packet.h, checked at build time)
 =======================================================
-0 - 3		|	Thermocouple 0 Data (32 bits = 4 bytes)
-4 - 7		|	Thermocouple 1 Data (32 bits = 4 bytes)
-8 - 11		|	Thermocouple 2 Data (32 bits = 4 bytes)
-12 - 15		|	Thermocouple 3 Data (32 bits = 4 bytes)
-16 - 18		|	ADC0 Status 		(24 bits = 3 bytes)
-19 - 21		|	ADC0 CH1 Data 		(24 bits = 3 bytes) -- 	IEPE0 Data
-22 - 24		|	ADC0 CH2 Data 		(24 bits = 3 bytes) -- 	IEPE1 Data
-25 - 27		|	ADC0 CH3 Data 		(24 bits = 3 bytes) -- 	IEPE2 Data
-28 - 30		|	ADC0 CH4 Data 		(24 bits = 3 bytes) -- 	IEPE3 Data
-31 - 33		|	ADC0 Zeros			(24 bits = 3 bytes)
-34 - 36		|	ADC1 Status 		(24 bits = 3 bytes)
-37 - 39		|	ADC1 CH0 Data 		(24 bits = 3 bytes) -- 	FB0 Data
-40 - 42		|	ADC1 CH1 Data 		(24 bits = 3 bytes) -- 	FB1 Data
-43 - 45		|	ADC1 CH2 Data 		(24 bits = 3 bytes) -- 	CL0 Data
-46 - 48		|	ADC1 CH3 Data 		(24 bits = 3 bytes) -- 	CL1 Data
-49 - 51		|	ADC1 Zeros			(24 bits = 3 bytes)
-52 - 54		|	TC Time ms 			(24 bits = 3 bytes) --  Thermocouple Milliseconds Timestamp (24 bits = 4.66 hours of capture time)
-55 - 56		|  	TC Time us 			(16 bits = 2 bytes) --  Thermocouple Microseconds Timestamp (16 bits = holds at least 1000us -- timer should keep this under 1000 anyway)
-57 - 59		|	ADC0 Time ms 		(24 bits = 3 bytes) --  ADC0 Milliseconds Timestamp (24 bits = 4.66 hours of capture time)
-60 - 61		|  	ADC0 Time us 		(16 bits = 2 bytes) --  ADC0 Microseconds Timestamp (16 bits = holds at least 1000us -- timer should keep this under 1000 anyway)
-62 - 64		|	ADC1 Time ms 		(24 bits = 3 bytes) --  ADC1 Milliseconds Timestamp (24 bits = 4.66 hours of capture time)
-65 - 66		|  	ADC1 Time us 		(16 bits = 2 bytes) --  ADC1 Microseconds Timestamp (16 bits = holds at least 1000us -- timer should keep this under 1000 anyway)
-67 - 70		|	Packet Counter		(32 bits = 4 bytes) -- 	Packet counter to check for lost packets
-71			|	Faults/Fresh/Stale	(8 	bits = 1 byte ) --	Faults / Flags if we want to add any | Identifies data is new -- mainly for Thermocouples as ADC data is pumped out all the time
+SYNC		|	Sync				(8 	bits = 1 byte ) --	0xDA, start of every packet
+VERSION		|	Format Version		(8 	bits = 1 byte ) --	3
+DEVICE		|	Device ID			(8 	bits = 1 byte ) --	DEVICE_ID
+FAULTS		|	Faults/Fresh/Stale	(8 	bits = 1 byte ) --	bit0 = ring overflow of this source since its previous packet,
+			|											ADC: bit1 = conversions dropped or read late (adc_capture.h),
+			|											bit2 = STAT_1 fault, bit3 = status word out of sync (adc_status.h),
+			|											ADC: bit4 = samples of a burst record (adc_burst.h), not live,
+			|											TC: bit4 - 7 = TC0 - TC3 read in this cycle (clear = stale, previous reading)
+LENGTH		|	Packet Length		(16 bits = 2 bytes) --	Including this header
+MASK		|	Channel Mask		(16 bits = 2 bytes) --	Words present in every sample (PKT_CH_* in daq_packet.h, channel_enable), reply: 0
+COUNT		|	Sample Count		(16 bits = 2 bytes) --	ADC: up to SAMPLES_PER_PACKET (40), TC: 1, reply/telemetry/burst: bytes after the header
+DECIM		|	Decimation			(8 	bits = 1 byte ) --	log2 of the decimation factor, 0 = full rate (adc_decimate.h), TC: 0
+TYPE		|	Packet Type			(8 	bits = 1 byte ) --	0 = samples, 1 = command reply, 2 = telemetry, 3 = compressed samples,
+			|											4 = burst record
+PACKET		|	Packet Counter		(32 bits = 4 bytes) -- 	Packet counter to check for lost packets (all sources)
+INDEX		|	First Index			(32 bits = 4 bytes) --	ADC: number of the first sample at the packet's rate, TC: read cycle number
+TIME		|	Time us				(64 bits = 8 bytes) --	Time of the first sample in microseconds since start (timebase.h)
+SAMPLES		|	Samples				(Count x sample size) --	From PKT_HEADER_SIZE (28)
+
+One sample:
+0 - 1		|	Time Delta			(16 bits = 2 bytes) --	Microseconds after the packet time
+			|	Status 				(24 bits = 3 bytes) --	If the status bit is set (ADC packets)
+			|	Channels							--	In ascending mask bit order, 24 bits per ADC channel, 32 bits per thermocouple
+	Mask bit 0 - 3		IEPE0 - IEPE3	(ADC0 CH1 - CH4)
+	Mask bit 4 - 7		FB0 FB1 CL0 CL1	(ADC1 CH1 - CH4)
+	Mask bit 8 - 11		TC0 - TC3
+	Mask bit 12			ADC status word
+
+With all channels enabled an ADC sample is 17 bytes and a full ADC packet 708 bytes.
+Sample i of an ADC packet was converted at index First Index + i; missing indices between packets are lost conversions.
+Decimated ADC packets (Decimation = n): sample k is the CIC output over conversions k x 2^n ... (k + 1) x 2^n - 1,
+time stamped with the last of them; the filter delays the signal by 3 x (2^n - 1) / 2 conversions (decimator.h).
+The status word is the OR of the status words of those conversions.
+ADC sample times are the DRDY edges as latched by the timer capture slices, not the time their interrupt ran.
+All sources and replies share one 64-bit clock, so ADC0, ADC1 and thermocouple times compare directly.
+Thermocouple packets are sent when a read cycle completes (10Hz); a cycle that missed its deadline (the next tick)
+is sent with the converters it got to, the others repeated and their fresh bits clear (tc_capture.h).
+Decoder: daq_get_header / daq_get_sample in daq_packet.c.
+TCP: packets follow each other back to back on the stream (Sync + Length to frame them).
+
+Commands (host -> board, same connection/port, see COMMANDS in daq_packet.h):
+0			|	Sync				(8 	bits = 1 byte ) --	0xC5
+1			|	Opcode				(8 	bits = 1 byte ) --	CMD_REG_WRITE, CMD_REG_READ, CMD_STREAMS, CMD_DECIMATE, CMD_STATUS,
+			|											CMD_DEADLINES, CMD_COMPRESS, CMD_BURST, CMD_TRIGGER, CMD_TX_LATENCY
+2			|	Sequence			(8 	bits = 1 byte ) --	Echoed in the reply
+3			|	Payload Length		(8 	bits = 1 byte ) --	Up to CMD_MAX_PAYLOAD (16)
+4 - ...		|	Payload
+Every command is answered by a reply packet (type 1) in the data stream: Opcode | Sequence | Result | reply data.
+Register writes take effect without a reboot: the ADC is stopped, the table written and read back, then restarted
+(adc_config.h); the capture of both ADCs pauses for 14 frames, which shows as missing indices like any lost conversion.
+CMD_STATUS reports the boot: the bring-up result of each ADC (adc_config_result) and the time from the end of
+DAVE_Init to the ADCs converting and to the first sample, which is what a watchdog reset costs in data.
+CMD_DEADLINES reports the deadline misses of the SPI bus schedulers (adc_capture.h, tc_capture.h).
+Compressed packets (type 3, COMPRESSION / CMD_COMPRESS) carry the samples of one ADC packet coded losslessly by
+daq_codec.h: same header, shorter length; daq_expand gives back the type 0 packet. Each packet decodes on its own.
+Burst capture (BURST_MODE / CMD_BURST, adc_burst.h) replaces the ADC stream: the ADC frames go into a record buffer
+that always holds the last BURST_FRAMES per ADC. A level or slope on one channel, or CMD_TRIGGER, freezes the
+pre-trigger window; after the post-trigger window the record is announced by a burst packet (type 4: cause, channel,
+flags, windows in us, frames and first index per ADC; First Index = record number, Time = trigger time) and then sent
+as ADC packets with bit4 set, as fast as the transmit queue takes them, before the next trigger is armed. Changing
+the streams, the decimation or the ADC registers restarts the burst history.
+Telemetry packets (type 2, TELEMETRY every TELEMETRY_PERIOD_MS) carry the latency histograms of telemetry.h and the
+drop/overrun/reconnect counters, counted since boot (TELEMETRY in daq_packet.h); Sample Count is the payload size.
+Transmit batching (tx_batch.h): packets wait in the transmit queue until a batch has filled or the oldest has waited
+TX_LATENCY_US (CMD_TX_LATENCY); telemetry carries the queueing delay histogram and the flush counters.
+UDP (UDP_STREAMING): each datagram carries whole packets back to back, up to UDP_PAYLOAD_MAX bytes; the packet
+counter is the sequence number (see host/udp_receiver.cpp).
 
 
 // NOTES: ADC outputs 6 frames -- Status | CH1 | CH2 | CH3 | CH4 | Zeros
-	- In the future we can write over the zeros
+	- The zeros frame is read (fixed frame size) but not sent
 
 /*/////////////////////////////////////////////////////////////////////////////////////////////////
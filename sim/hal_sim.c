@@ -0,0 +1,519 @@
+/****************************************************************
+* HAL -- host simulator implementation
+*
+* Simulates the pieces of the board the firmware talks to:
+*  - two ADS131A04-style ADCs on SPI_MASTER_ADC: command/register model (unlock, RREG/WREG, wakeup/standby),
+*    DRDY at the rate set by CLK1/CLK2 (or a fixed rate), data frames with synthetic waveforms, power-on reset
+*    time (or already converting, as after a watchdog reset of the MCU alone)
+*  - four MAX31855-style thermocouple converters on SPI_MASTER_TC
+*  - the 1ms timestamp timer (with its DRDY capture slices), the 10Hz thermocouple timer, the Ethernet timer and the
+*    lwIP system timer
+* Interrupt handlers are called in time order from hal_running (between main loop passes) and from busy polls.
+***************************************************************/
+#ifdef HAL_SIM
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include "hal.h"
+#include "sim.h"
+
+	// ADC MODEL
+		#define ADC_XTAL_HZ		16384000.0	// Crystal on CLKIN
+		#define ADC_WORD_BYTES	3U			// 24-bit words (fixed frame of 6 words)
+		#define ADC_REG_COUNT	32U
+
+		#define ADC_CMD_NULL	0x0000U
+		#define ADC_CMD_RESET	0x0011U
+		#define ADC_CMD_STANDBY	0x0022U
+		#define ADC_CMD_WAKEUP	0x0033U
+		#define ADC_CMD_LOCK	0x0555U
+		#define ADC_CMD_UNLOCK	0x0655U
+		#define ADC_READY		0xFF04U		// Reported until the device is unlocked after power up
+
+		#define ADC_REG_STAT_1	0x02U
+		#define ADC_F_DRDY		0x02U		// STAT_1: conversion not read before the next one
+		#define ADC_REG_CLK1	0x0DU
+		#define ADC_REG_CLK2	0x0EU
+		#define ADC_REG_ADC_ENA	0x0FU
+
+		typedef struct {
+			uint8_t reg[ADC_REG_COUNT];
+			uint8_t unlocked;
+			uint8_t awake;				// Converting (after WAKEUP)
+			uint16_t response;			// Status/response word of the next frame
+			uint64_t next_drdy;			// Virtual time of the next conversion
+			uint64_t conversion;		// Number of the latest conversion
+			uint64_t por_end;			// Virtual time power-on reset ends -- the ADC ignores the bus before
+			uint32_t capture;			// Timestamp timer count at the last DRDY edge (CAPTURE_ADC0/1)
+			uint8_t unread;				// Latest conversion not clocked out yet -- F_DRDY at the next DRDY
+		} sim_adc_t;
+
+		static sim_adc_t adcs[2];
+
+	// EVENT SOURCES
+		typedef enum {
+			EV_TIMESTAMP,		// 1ms timer
+			EV_TC_TIMER,		// 10Hz thermocouple timer
+			EV_ETH_TIMER,		// Ethernet timer
+			EV_LWIP_TIMER,		// lwIP SYSTIMER callback
+			EV_ADC0_DRDY,
+			EV_ADC1_DRDY,
+			EV_ADC_SPI_DONE,	// ADC SPI transfer complete
+			EV_TC_SPI_DONE,		// Thermocouple SPI transfer complete
+			EV_COUNT
+		} sim_event_t;
+
+		typedef struct {
+			uint8_t armed;
+			uint64_t at;		// Virtual time of the next occurrence
+			uint64_t period;	// 0 = one shot
+		} sim_source_t;
+
+		static sim_source_t sources[EV_COUNT];
+		static uint8_t irq_enabled[5] = {0};
+		static uint8_t timestamp_event = 0;		// Period match flag of the timestamp timer, cleared by TimeStampIRQ
+
+	// BUS STATE
+		static uint8_t adc_selected = 0;
+		static uint8_t *adc_tx = 0;
+		static uint8_t *adc_rx = 0;
+		static uint32_t adc_len = 0;
+		static uint8_t tc_selected = 0;
+		static uint8_t *tc_rx = 0;
+		static uint32_t tc_len = 0;
+
+	static void (*lwip_callback)(void *args) = 0;
+	static uint64_t pass_start = 0;		// Host time the current main loop pass started (0 = startup)
+	static hal_stage_t stage = HAL_STAGE_OTHER;
+	static uint64_t stage_since = 0;	// Host time the running stage was last switched to
+
+	sim_config_t sim_config;
+	uint64_t sim_now_ns = 0;
+	uint8_t sim_in_isr = 0;
+	sim_hal_stats_t sim_hal_stats;
+
+
+// HELPERS ////////////////////////////////////////////////////////////////////////////////////////
+
+static uint64_t host_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000U + (uint64_t)ts.tv_nsec;
+}
+
+static void arm(sim_event_t ev, uint64_t at, uint64_t period) {
+	sources[ev].armed = 1;
+	sources[ev].at = at;
+	sources[ev].period = period;
+}
+
+// Timestamp timer count at a virtual time -- the timer wraps every millisecond from t = 0
+static uint32_t timestamp_ticks(uint64_t ns) {
+	return (uint32_t)((ns % 1000000U) * HAL_TICKS_PER_US / 1000U);
+}
+
+static void put_word(uint8_t *p, int32_t value) {
+	p[0] = (value >> 16) & 0xff; // MSB
+	p[1] = (value >> 8) & 0xff;
+	p[2] = (value >> 0) & 0xff;
+}
+
+// Conversion period from the clock registers: XTAL / CLKIN divider / ICLK divider / OSR
+static uint64_t adc_period_ns(const sim_adc_t *adc) {
+	static const uint16_t osr[16] = {4096, 2048, 1024, 800, 768, 512, 400, 384, 256, 200, 192, 128, 96, 64, 48, 32};
+	uint32_t clkin_div = ((adc->reg[ADC_REG_CLK1] >> 1) & 0x07U) * 2U;
+	uint32_t iclk_div = ((adc->reg[ADC_REG_CLK2] >> 5) & 0x07U) * 2U;
+	double hz;
+
+	if (sim_config.drdy_hz > 0.0) {
+		hz = sim_config.drdy_hz;
+	}
+	else {
+		if (clkin_div == 0) clkin_div = 2U;
+		if (iclk_div == 0) iclk_div = 2U;
+		hz = ADC_XTAL_HZ / clkin_div / iclk_div / osr[adc->reg[ADC_REG_CLK2] & 0x0FU];
+	}
+	return (uint64_t)(1e9 / hz + 0.5);
+}
+
+static void adc_reset(sim_adc_t *adc) {
+	memset(adc, 0, sizeof(*adc));
+	adc->reg[0x00] = 0x04;		// ID_MSB -- 4 channel device
+	adc->reg[0x0B] = 0x60;		// A_SYS_CFG
+	adc->reg[0x0C] = 0x3C;		// D_SYS_CFG
+	adc->reg[ADC_REG_CLK1] = 0x08;
+	adc->reg[ADC_REG_CLK2] = 0x86;
+	adc->response = ADC_READY;
+}
+
+// Synthetic channel data for conversion n: IEPE tones on ADC0, slow load signals on ADC1
+static int32_t adc_sample(uint8_t adc, uint8_t ch, uint64_t n, double fs) {
+	static const double iepe_hz[4] = {160.0, 1000.0, 3150.0, 8000.0};
+	static const double load_hz[4] = {0.5, 2.0, 0.1, 0.25};
+	double t = (double)n / fs;
+	double v;
+
+	if (adc == 0) {
+		v = 0.4 * sin(2.0 * M_PI * iepe_hz[ch] * t) + 0.05 * sin(2.0 * M_PI * 7.0 * iepe_hz[ch] * t);
+	}
+	else {
+		v = 0.25 + 0.1 * ch + 0.05 * sin(2.0 * M_PI * load_hz[ch] * t);
+	}
+	v += ((double)((n * 2654435761U + ch * 40503U) & 0xFFU) - 127.5) / 8388608.0; // LSB-level noise
+	return (int32_t)(v * 8388607.0);
+}
+
+// One SPI transfer on the ADC bus: reply with the pending response (+ data when converting), then execute the command
+static void adc_transfer_complete(void) {
+	sim_adc_t *adc = &adcs[adc_selected];
+	uint16_t cmd = (adc_tx != 0) ? (uint16_t)((adc_tx[0] << 8) | adc_tx[1]) : ADC_CMD_NULL;
+	uint8_t addr = (cmd >> 8) & 0x1FU;
+	uint32_t words = adc_len / ADC_WORD_BYTES;
+
+	memset(adc_rx, 0x00, adc_len);
+	if (sim_now_ns < adc->por_end) {
+		return; // Still in power-on reset
+	}
+	put_word(adc_rx, (int32_t)adc->response << 8);
+	if (adc->awake && (words >= 5U)) {
+		double fs = 1e9 / (double)adc_period_ns(adc);
+		for (uint8_t ch = 0; ch < 4; ch++) {
+			put_word(adc_rx + (ch + 1U) * ADC_WORD_BYTES, (adc->reg[ADC_REG_ADC_ENA] & (1U << ch)) ? adc_sample(adc_selected, ch, adc->conversion, fs) : 0);
+		}
+		sim_hal_stats.frames_read[adc_selected]++;
+		adc->unread = 0;
+	}
+
+	if ((cmd & 0xE000U) == 0x4000U) {			// WREG
+		if (adc->unlocked) {
+			adc->reg[addr] = cmd & 0xFFU;
+		}
+		adc->response = (uint16_t)(0x2000U | (addr << 8) | adc->reg[addr]);
+	}
+	else if ((cmd & 0xE000U) == 0x2000U) {		// RREG
+		adc->response = (uint16_t)(0x2000U | (addr << 8) | adc->reg[addr]);
+	}
+	else {
+		switch (cmd) {
+			case ADC_CMD_UNLOCK:	adc->unlocked = 1;	adc->response = cmd;	break;
+			case ADC_CMD_LOCK:		adc->unlocked = 0;	adc->response = cmd;	break;
+			case ADC_CMD_RESET:		adc_reset(adc);								break;
+			case ADC_CMD_STANDBY:	adc->awake = 0;		adc->response = cmd;	break;
+			case ADC_CMD_WAKEUP:
+				if (!adc->awake) {
+					adc->next_drdy = sim_now_ns + adc_period_ns(adc);
+				}
+				adc->awake = 1;
+				adc->response = cmd;
+				break;
+			default:				// NULL -- status
+				if (adc->unlocked || adc->awake) {
+					adc->response = (uint16_t)(0x2200U | adc->reg[ADC_REG_STAT_1]);
+					adc->reg[ADC_REG_STAT_1] = 0; // Fault flags clear when read
+				}
+				break;
+		}
+	}
+}
+
+// MAX31855 word: 14-bit thermocouple temperature (0.25C) in 31:18, 12-bit internal temperature (0.0625C) in 15:4
+static void tc_transfer_complete(void) {
+	double t = (double)sim_now_ns / 1e9;
+	int32_t hot = (int32_t)((25.0 + 5.0 * tc_selected + 0.5 * sin(0.1 * t)) / 0.25);
+	int32_t cold = (int32_t)(24.0 / 0.0625);
+	uint32_t word = ((uint32_t)(hot & 0x3FFF) << 18) | ((uint32_t)(cold & 0x0FFF) << 4);
+
+	memset(tc_rx, 0x00, tc_len);
+	for (uint32_t i = 0; (i < tc_len) && (i < 4U); i++) {
+		tc_rx[i] = (word >> (24U - 8U * i)) & 0xff;
+	}
+}
+
+
+// STAGE CLOCK ////////////////////////////////////////////////////////////////////////////////////
+
+// Charges the host time since the last switch to the running stage
+static void stage_switch(hal_stage_t next) {
+	uint64_t now = host_ns();
+
+	if (stage_since != 0) {
+		sim_hal_stats.stage_ns[stage] += now - stage_since;
+	}
+	stage = next;
+	stage_since = now;
+}
+
+hal_stage_t hal_stage_enter(hal_stage_t next) {
+	hal_stage_t previous = stage;
+
+	stage_switch(next);
+	sim_hal_stats.stage_calls[next]++;
+	return previous;
+}
+
+void hal_stage_exit(hal_stage_t previous) {
+	stage_switch(previous);
+}
+
+
+// DISPATCH ///////////////////////////////////////////////////////////////////////////////////////
+
+static void fire(sim_event_t ev) {
+	sim_source_t *src = &sources[ev];
+
+	if (src->period != 0) {
+		src->at += src->period;
+	}
+	else {
+		src->armed = 0;
+	}
+
+	switch (ev) {
+		case EV_TIMESTAMP:
+			timestamp_event = 1;
+			if (irq_enabled[HAL_IRQ_TIMESTAMP]) TimeStampIRQ();
+			break;
+		case EV_TC_TIMER:	if (irq_enabled[HAL_IRQ_TC_TIMER]) TCIRQ();			break;
+		case EV_ETH_TIMER:	if (irq_enabled[HAL_IRQ_ETH_TIMER]) ETHIRQ();		break;
+		case EV_LWIP_TIMER:	lwip_callback(0);									break;
+		case EV_ADC_SPI_DONE:
+		{
+			hal_stage_t previous;
+
+			adc_transfer_complete();
+			previous = hal_stage_enter(HAL_STAGE_ACQUIRE);
+			ADC_SPI_RxDone();
+			hal_stage_exit(previous);
+			break;
+		}
+		case EV_TC_SPI_DONE:
+			tc_transfer_complete();
+			TC_SPI_RxDone();
+			break;
+		default:
+			break;
+	}
+}
+
+static void fire_drdy(uint8_t n) {
+	sim_adc_t *adc = &adcs[n];
+
+	if (adc->unread) {
+		adc->reg[ADC_REG_STAT_1] |= ADC_F_DRDY;
+	}
+	adc->unread = 1;
+	adc->conversion++;
+	adc->capture = timestamp_ticks(adc->next_drdy); // Latched by the edge, however late the interrupt runs
+	adc->next_drdy += adc_period_ns(adc);
+	sim_hal_stats.conversions[n]++;
+	if (irq_enabled[n == 0 ? HAL_IRQ_ADC0_DRDY : HAL_IRQ_ADC1_DRDY]) {
+		hal_stage_t previous = hal_stage_enter(HAL_STAGE_ACQUIRE);
+
+		if (n == 0) ADC0_DRDY_INT(); else ADC1_DRDY_INT();
+		hal_stage_exit(previous);
+	}
+}
+
+// Runs every interrupt that is due at the current virtual time, in time order
+static void dispatch(void) {
+	hal_stage_t previous;
+
+	if (sim_in_isr) {
+		return;
+	}
+	sim_in_isr = 1;
+	previous = hal_stage_enter(HAL_STAGE_OTHER);
+	for (;;) {
+		int32_t next = -1;
+		uint64_t at = sim_now_ns;
+
+		for (int32_t ev = 0; ev < EV_COUNT; ev++) {
+			if (sources[ev].armed && (sources[ev].at <= at)) {
+				at = sources[ev].at;
+				next = ev;
+			}
+		}
+		for (uint8_t n = 0; n < 2; n++) {
+			if (adcs[n].awake && (adcs[n].next_drdy <= at)) {
+				at = adcs[n].next_drdy;
+				next = EV_ADC0_DRDY + n;
+			}
+		}
+		if (next < 0) {
+			break;
+		}
+		if ((next == EV_ADC0_DRDY) || (next == EV_ADC1_DRDY)) {
+			fire_drdy((uint8_t)(next - EV_ADC0_DRDY));
+		}
+		else {
+			fire((sim_event_t)next);
+		}
+	}
+	sim_net_advance();
+	hal_stage_exit(previous);
+	sim_in_isr = 0;
+}
+
+static void advance(uint64_t ns) {
+	if (!sim_in_isr) {
+		sim_now_ns += ns;
+		dispatch();
+	}
+}
+
+
+// STARTUP ////////////////////////////////////////////////////////////////////////////////////////
+
+uint8_t hal_init(void) {
+	for (uint8_t n = 0; n < 2; n++) {
+		sim_adc_t *adc = &adcs[n];
+
+		adc_reset(adc);
+		adc->por_end = (uint64_t)sim_config.adc_por_us * 1000U;
+		if (sim_config.adc_por_us == 0) { // MCU reset only: the ADC kept converting with the boot configuration
+			adc->reg[0x0B] = 0x68;
+			adc->reg[ADC_REG_CLK1] = 0x02;
+			adc->reg[ADC_REG_CLK2] = 0x4E;
+			adc->reg[ADC_REG_ADC_ENA] = 0x0F;
+			adc->unlocked = 1;
+			adc->awake = 1;
+			adc->response = (uint16_t)(0x2200U | adc->reg[ADC_REG_STAT_1]);
+			adc->next_drdy = adc_period_ns(adc);
+		}
+	}
+	arm(EV_TIMESTAMP, 1000000U, 1000000U);
+	arm(EV_TC_TIMER, 100000000U, 100000000U);
+	arm(EV_ETH_TIMER, (uint64_t)sim_config.eth_us * 1000U, (uint64_t)sim_config.eth_us * 1000U);
+	return HAL_OK;
+}
+
+void hal_irq_enable(hal_irq_t irq) {
+	irq_enabled[irq] = 1;
+}
+
+void hal_irq_disable(hal_irq_t irq) {
+	irq_enabled[irq] = 0;
+}
+
+void hal_lwip_timer_start(void (*callback)(void *args), uint32_t period_us) {
+	lwip_callback = callback;
+	arm(EV_LWIP_TIMER, sim_now_ns + (uint64_t)period_us * 1000U, (uint64_t)period_us * 1000U);
+}
+
+// Interrupts only run from hal calls, so there is nothing to mask
+uint32_t hal_critical_enter(void) {
+	return 0;
+}
+
+void hal_critical_exit(uint32_t state) {
+	(void)state;
+}
+
+// Ends one main loop pass: records its host time, advances virtual time by its cost and runs due interrupts
+uint8_t hal_running(void) {
+	uint64_t now = host_ns();
+
+	hal_stage_exit(HAL_STAGE_OTHER); // The pass ends here
+	if (pass_start != 0) {
+		uint64_t pass = now - pass_start;
+		uint32_t bucket = 0;
+
+		while ((bucket < 31U) && ((pass >> (bucket + 1U)) != 0)) {
+			bucket++;
+		}
+		sim_hal_stats.iter_hist[bucket]++;
+		sim_hal_stats.iterations++;
+		sim_hal_stats.iter_ns_total += pass;
+		if (pass > sim_hal_stats.iter_ns_max) {
+			sim_hal_stats.iter_ns_max = pass;
+		}
+		advance((sim_config.cpu_scale > 0.0) ? (uint64_t)(pass * sim_config.cpu_scale) : sim_config.loop_ns);
+	}
+	else {
+		advance(sim_config.loop_ns);
+	}
+
+	if (sim_now_ns >= (uint64_t)(sim_config.seconds * 1e9)) {
+		return 0;
+	}
+	pass_start = host_ns();
+	hal_stage_enter(HAL_STAGE_LOOP);
+	return 1U;
+}
+
+
+// ADC SPI BUS ////////////////////////////////////////////////////////////////////////////////////
+
+void hal_adc_select(uint8_t adc) {
+	adc_selected = adc & 0x01U;
+}
+
+void hal_adc_transfer(uint8_t *tx, uint8_t *rx, uint32_t len) {
+	adc_tx = tx;
+	adc_rx = rx;
+	adc_len = len;
+	arm(EV_ADC_SPI_DONE, sim_now_ns + (uint64_t)(len * 8U * 1e9 / sim_config.adc_spi_hz), 0);
+}
+
+uint8_t hal_adc_busy(void) {
+	advance(sim_config.poll_ns);
+	return sources[EV_ADC_SPI_DONE].armed;
+}
+
+void hal_adc_frame_length_continuous(void) {
+}
+
+
+// THERMOCOUPLE SPI BUS ///////////////////////////////////////////////////////////////////////////
+
+void hal_tc_select(uint8_t tc) {
+	tc_selected = tc & 0x03U;
+}
+
+void hal_tc_receive(uint8_t *rx, uint32_t len) {
+	tc_rx = rx;
+	tc_len = len;
+	arm(EV_TC_SPI_DONE, sim_now_ns + (uint64_t)(len * 8U * 1e9 / sim_config.tc_spi_hz), 0);
+}
+
+uint8_t hal_tc_busy(void) {
+	advance(sim_config.poll_ns);
+	return sources[EV_TC_SPI_DONE].armed;
+}
+
+
+// TIMERS /////////////////////////////////////////////////////////////////////////////////////////
+
+uint32_t hal_timestamp_ticks(void) {
+	return timestamp_ticks(sim_now_ns);
+}
+
+// Set from the wrap until TimeStampIRQ clears it -- including a wrap that is due but not dispatched yet, as seen
+// from an interrupt that runs first
+uint8_t hal_timestamp_pending(void) {
+	return (timestamp_event || (sources[EV_TIMESTAMP].at <= sim_now_ns)) ? 1U : 0U;
+}
+
+void hal_timestamp_clear_event(void) {
+	timestamp_event = 0;
+}
+
+uint32_t hal_drdy_capture(uint8_t adc) {
+	return adcs[adc & 0x01U].capture;
+}
+
+// Virtual time at the target's CPU clock -- a measurement covers the virtual cost of the code, not the host's
+uint32_t hal_cycles(void) {
+	return (uint32_t)(sim_now_ns * HAL_CYCLES_PER_US / 1000U);
+}
+
+void hal_tc_timer_clear_event(void) {
+}
+
+
+// INDICATOR //////////////////////////////////////////////////////////////////////////////////////
+
+void hal_led_toggle(void) {
+}
+
+#endif /* HAL_SIM */
@@ -0,0 +1,685 @@
+/****************************************************************
+* lwIP STAND-IN AND TCP SINK (host simulator)
+***************************************************************/
+#ifdef HAL_SIM
+#include <stdlib.h>
+#include <string.h>
+#include "lwip_sim.h"
+#include "sim.h"
+#include "daq_packet.h"
+#include "daq_codec.h"
+#include "adc_burst.h"
+
+	// PCB STATES
+		#define PCB_FREE		0U
+		#define PCB_NEW			1U
+		#define PCB_CONNECTING	2U
+		#define PCB_ESTABLISHED	3U
+		#define PCB_CLOSED		4U
+
+		#define PCB_POOL		8U		// Aborted PCBs are recycled round robin, like lwIP's memp pool
+		#define TCP_MSS			1460U
+		#define ACK_QUEUE		64U
+		#define UDP_TX_BACKLOG_NS	500000U	// Ethernet transmit descriptors full after this much queued link time
+		#define UDP_HELD_MAX	1472U
+
+	struct tcp_pcb {
+		uint8_t state;
+		void *arg;
+		tcp_err_fn err;
+		tcp_connected_fn connected;
+		tcp_sent_fn sent;
+		tcp_recv_fn recv;
+		uint64_t connect_at;		// Virtual time the SYN/ACK arrives
+		uint32_t snd_buf;			// Free send buffer
+		uint8_t *queue;				// Bytes written but not yet on the wire (FIFO of sndbuf bytes)
+		uint32_t queue_head;
+		uint32_t queue_len;
+		struct {
+			uint64_t at;
+			uint32_t len;
+		} acks[ACK_QUEUE];			// Segments on the wire, acknowledged at 'at'
+		uint32_t ack_head;
+		uint32_t ack_len;
+	};
+
+	const ip_addr_t ip_addr_any = {0};
+
+	static struct tcp_pcb pool[PCB_POOL];
+	static uint32_t pool_next = 0;
+	static uint64_t link_free_at = 0;		// Virtual time the link finishes the current segment
+	static uint64_t next_reset = 0;
+
+	// UDP -- one datagram can be held back to be delivered out of order
+		struct udp_pcb {
+			uint8_t used;
+			udp_recv_fn recv;
+			void *recv_arg;
+		};
+		static struct udp_pcb udp_pool[2];
+		static uint8_t udp_held[UDP_HELD_MAX];
+		static uint32_t udp_held_len = 0;
+		static uint32_t udp_rand = 12345U;
+
+	// SINK -- reassembles the packet stream of the current connection
+		static uint8_t sink_stream[PACKET_MAX_SIZE];
+		static uint32_t sink_fill = 0;
+		static uint8_t sink_synced = 0;			// First packet seen (counter/index continuity starts here)
+		static uint32_t sink_next_count = 0;
+		static uint32_t sink_next_index[2] = {0, 0};
+		static uint8_t sink_index_valid[2] = {0, 0};
+		static uint8_t sink_decim[2] = {0, 0};		// Rate the index continuity refers to
+
+	// SCRIPTED COMMANDS -- sent once, --command-ms after the start
+		static uint8_t commands_sent = 0;
+		static uint8_t burst_sent = 0;			// --burst-ms
+
+	sim_net_stats_t sim_net_stats;
+
+
+// SINK ///////////////////////////////////////////////////////////////////////////////////////////
+
+// ADC the packet belongs to, -1 for thermocouple packets and command replies
+static int8_t packet_adc(const daq_header_t *h) {
+	for (uint8_t adc = 0; adc < 2; adc++) {
+		if (h->mask & PKT_CH_ADC(adc)) {
+			return (int8_t)adc;
+		}
+	}
+	return -1;
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// Decodes every sample back out of the packet -- times must not go backwards within a packet
+static void sink_check_samples(const uint8_t *packet, const daq_header_t *h, int8_t adc) {
+	uint16_t last = 0;
+	uint16_t delta;
+	int32_t values[PKT_CH_COUNT];
+
+	for (uint16_t i = 0; i < h->count; i++) {
+		daq_get_sample(packet, h, i, &delta, values);
+		if (delta < last) {
+			sim_net_stats.malformed++;
+			return;
+		}
+		if ((i > 0U) && (adc >= 0) && (h->decim == 0U)) {
+			uint32_t spacing = (uint32_t)(delta - last);
+
+			if ((sim_net_stats.spacing_max[adc] == 0U) || (spacing < sim_net_stats.spacing_min[adc])) {
+				sim_net_stats.spacing_min[adc] = spacing;
+			}
+			if (spacing > sim_net_stats.spacing_max[adc]) {
+				sim_net_stats.spacing_max[adc] = spacing;
+			}
+		}
+		last = delta;
+	}
+}
+
+// Command reply -- counted by result; register replies must also read back what the table holds
+static void sink_reply(const uint8_t *packet, const daq_header_t *h) {
+	const uint8_t *reply = packet + PKT_HEADER_SIZE;
+	uint8_t result = (h->count > CMD_REPLY_RESULT) ? reply[CMD_REPLY_RESULT] : CMD_ERR_INVALID;
+
+	sim_net_stats.replies++;
+	if ((result == CMD_OK) && ((reply[CMD_REPLY_OPCODE] == CMD_REG_WRITE) || (reply[CMD_REPLY_OPCODE] == CMD_REG_READ))) {
+		for (uint32_t i = CMD_REPLY_DATA + 1U; i + 2U < h->count; i += 3U) {
+			if (reply[i + 1U] != reply[i + 2U]) {
+				result = CMD_ERR_VERIFY;
+			}
+		}
+	}
+	if ((result == CMD_OK) && (reply[CMD_REPLY_OPCODE] == CMD_STATUS)) {
+		if ((h->count != CMD_REPLY_DATA + 10U) || (reply[CMD_REPLY_DATA] != 0U) || (reply[CMD_REPLY_DATA + 1U] != 0U)) {
+			result = CMD_ERR_VERIFY; // An ADC failed its bring-up
+		}
+	}
+	if ((result == CMD_OK) && (reply[CMD_REPLY_OPCODE] == CMD_DEADLINES) && (h->count != CMD_REPLY_DATA + 20U)) {
+		result = CMD_ERR_VERIFY;
+	}
+	switch (result) {
+		case CMD_OK:			sim_net_stats.replies_ok++;			break;
+		case CMD_ERR_VERIFY:	sim_net_stats.replies_verify++;		break;
+		default:				sim_net_stats.replies_invalid++;	break;
+	}
+}
+
+static void sink_packet_done(const uint8_t *packet, const daq_header_t *h) {
+	static uint8_t expanded[PACKET_MAX_SIZE];
+	daq_header_t samples;
+	int8_t adc = packet_adc(h);
+	uint32_t n = h->count;
+	uint32_t covered = n << h->decim;		// Conversions the samples stand for (decimated ADCs)
+
+	sim_net_stats.packets++;
+	if (h->type == PKT_TYPE_COMPRESSED) {
+		int32_t size = daq_expand(packet, h->length, expanded, sizeof(expanded));
+
+		if ((size < 0) || (daq_get_header(expanded, (uint32_t)size, &samples) != size)) {
+			sim_net_stats.malformed++;
+			return;
+		}
+		sim_net_stats.compressed++;
+		sim_net_stats.compressed_bytes += h->length;
+		sim_net_stats.expanded_bytes += (uint32_t)size;
+		packet = expanded;
+		h = &samples;
+	}
+	if (h->type == PKT_TYPE_REPLY) {
+		sink_reply(packet, h);
+	}
+	else if (h->type == PKT_TYPE_BURST) {
+		const uint8_t *info = packet + PKT_HEADER_SIZE;
+
+		if (h->count != BURST_INFO_SIZE) {
+			sim_net_stats.malformed++;
+			return;
+		}
+		sim_net_stats.bursts++;
+		sim_net_stats.bursts_truncated += (info[2] & BURST_FLAG_TRUNCATED) ? 1U : 0U;
+		for (uint8_t n = 0; n < 2U; n++) {
+			uint32_t frames = (uint32_t)get_u32(info + 12U + 4U * n);
+
+			// The record's packets follow with their own indices -- continuity restarts at its first frame
+			sim_net_stats.burst_frames[n] += frames;
+			sink_index_valid[n] = (frames != 0U) ? 1U : 0U;
+			sink_next_index[n] = (uint32_t)get_u32(info + 20U + 4U * n);
+		}
+	}
+	else if (h->type == PKT_TYPE_TELEMETRY) {
+		sim_net_stats.telemetry++;
+		if ((h->count != TELEM_PAYLOAD_SIZE) || (packet[PKT_HEADER_SIZE + 1U] != TELEM_HISTOGRAMS) ||
+			(packet[PKT_HEADER_SIZE + 2U] != TELEM_BUCKETS) || (packet[PKT_HEADER_SIZE + 3U] != TELEM_COUNTERS)) {
+			sim_net_stats.malformed++;
+		}
+	}
+	else {
+		sink_check_samples(packet, h, adc);
+		if ((adc >= 0) && (h->faults & PKT_FLAG_BURST)) {
+			sim_net_stats.burst_received[adc] += n;
+		}
+		if ((adc >= 0) && !(h->faults & PKT_FLAG_BURST)) {
+			uint64_t now_us = sim_now_ns / 1000U;
+			uint32_t latency = (now_us > h->time_us) ? (uint32_t)(now_us - h->time_us) : 0U;
+
+			sim_net_stats.latency_us_sum += latency;
+			sim_net_stats.latency_packets++;
+			if (latency > sim_net_stats.latency_us_max) {
+				sim_net_stats.latency_us_max = latency;
+			}
+		}
+		if (adc >= 0) {
+			sim_net_stats.flagged[adc][0] += (h->faults & PKT_FAULT_MISSED) ? 1U : 0U;
+			sim_net_stats.flagged[adc][1] += (h->faults & PKT_FAULT_ADC) ? 1U : 0U;
+			sim_net_stats.flagged[adc][2] += (h->faults & PKT_FAULT_SYNC) ? 1U : 0U;
+		}
+		else {
+			sim_net_stats.tc_packets++;
+			if ((h->faults & (PKT_FRESH_TC(0) | PKT_FRESH_TC(1) | PKT_FRESH_TC(2) | PKT_FRESH_TC(3))) !=
+				(PKT_FRESH_TC(0) | PKT_FRESH_TC(1) | PKT_FRESH_TC(2) | PKT_FRESH_TC(3))) {
+				sim_net_stats.tc_stale++;
+			}
+		}
+	}
+
+	if (sink_synced && ((int32_t)(h->packet - sink_next_count) < 0)) {
+		// Late packet (UDP) -- fills a gap counted earlier
+		sim_net_stats.reordered++;
+		if (sim_net_stats.packet_gaps > 0) {
+			sim_net_stats.packet_gaps--;
+		}
+		if (adc >= 0) {
+			sim_net_stats.samples[adc] += covered;
+			sim_net_stats.index_gaps[adc] -= (sim_net_stats.index_gaps[adc] >= covered) ? covered : sim_net_stats.index_gaps[adc];
+		}
+		return;
+	}
+	if (sink_synced && (h->packet != sink_next_count)) {
+		sim_net_stats.packet_gaps += (uint32_t)(h->packet - sink_next_count);
+	}
+	sink_synced = 1;
+	sink_next_count = h->packet + 1U;
+
+	if ((adc < 0) || (n == 0)) {
+		return;
+	}
+	if (h->decim != sink_decim[adc]) {
+		sink_index_valid[adc] = 0; // Rate changed -- the index restarts at the new rate
+		sink_decim[adc] = h->decim;
+	}
+	if (sink_index_valid[adc] && (h->index != sink_next_index[adc])) {
+		sim_net_stats.index_gaps[adc] += (uint32_t)(h->index - sink_next_index[adc]) << h->decim;
+	}
+	sink_index_valid[adc] = 1;
+	sink_next_index[adc] = h->index + n;
+	sim_net_stats.samples[adc] += covered;
+}
+
+// Splits buffered bytes into packets; on a bad header skip ahead to the next sync byte
+static uint32_t sink_parse(const uint8_t *data, uint32_t len) {
+	uint32_t used = 0;
+	daq_header_t h;
+
+	while (used < len) {
+		int32_t size = daq_get_header(data + used, len - used, &h);
+
+		if (size == 0) {
+			break;
+		}
+		if (size < 0) {
+			sim_net_stats.malformed++;
+			do {
+				used++;
+			} while ((used < len) && (data[used] != PKT_SYNC));
+			continue;
+		}
+		sink_packet_done(data + used, &h);
+		used += (uint32_t)size;
+	}
+	return used;
+}
+
+static void sink_receive(const uint8_t *data, uint32_t len) {
+	hal_stage_t previous;
+
+	if (sim_config.record != 0) {
+		fwrite(data, 1, len, sim_config.record);
+	}
+	previous = hal_stage_enter(HAL_STAGE_SINK);
+	sim_net_stats.bytes += len;
+	while (len > 0) {
+		uint32_t n = sizeof(sink_stream) - sink_fill;
+		uint32_t used;
+
+		if (n > len) {
+			n = len;
+		}
+		memcpy(sink_stream + sink_fill, data, n);
+		sink_fill += n;
+		data += n;
+		len -= n;
+
+		used = sink_parse(sink_stream, sink_fill);
+		sink_fill -= used;
+		memmove(sink_stream, sink_stream + used, sink_fill);
+	}
+	hal_stage_exit(previous);
+}
+
+
+static void sink_datagram(const uint8_t *data, uint32_t len) {
+	hal_stage_t previous;
+
+	if (sim_config.record != 0) {
+		fwrite(data, 1, len, sim_config.record);
+	}
+	previous = hal_stage_enter(HAL_STAGE_SINK);
+	sim_net_stats.bytes += len;
+	sim_net_stats.datagrams++;
+	if (sink_parse(data, len) != len) {
+		sim_net_stats.malformed++; // Truncated packet at the end
+	}
+	hal_stage_exit(previous);
+}
+
+
+// LINK ///////////////////////////////////////////////////////////////////////////////////////////
+
+static void pcb_close(struct tcp_pcb *pcb, err_t err) {
+	tcp_err_fn errf = pcb->err;
+	void *arg = pcb->arg;
+
+	pcb->state = PCB_CLOSED;
+	pcb->queue_len = 0;
+	pcb->ack_len = 0;
+	sink_fill = 0; // Partial packet of this connection never completes
+	if (errf != 0) {
+		errf(arg, err);
+	}
+}
+
+static void pcb_advance(struct tcp_pcb *pcb) {
+	uint64_t now = sim_now_ns;
+
+	if ((pcb->state == PCB_CONNECTING) && (now >= pcb->connect_at)) {
+		pcb->state = PCB_ESTABLISHED;
+		sim_net_stats.connections++;
+		sink_fill = 0;
+		if (pcb->connected != 0) {
+			pcb->connected(pcb->arg, pcb, ERR_OK);
+		}
+	}
+	if (pcb->state != PCB_ESTABLISHED) {
+		return;
+	}
+
+	// Put queued bytes on the wire, one segment at a time
+		while ((pcb->queue_len > 0) && (link_free_at <= now) && (pcb->ack_len < ACK_QUEUE)) {
+			uint32_t seg = (pcb->queue_len < TCP_MSS) ? pcb->queue_len : TCP_MSS;
+			uint32_t size = sim_config.sndbuf;
+			uint32_t first = size - pcb->queue_head;
+			uint32_t slot;
+
+			if (first > seg) {
+				first = seg;
+			}
+			sink_receive(pcb->queue + pcb->queue_head, first);
+			sink_receive(pcb->queue, seg - first);
+			pcb->queue_head = (pcb->queue_head + seg) % size;
+			pcb->queue_len -= seg;
+
+			link_free_at = now + (uint64_t)((seg + 54U) * 8.0 * 1000.0 / sim_config.link_mbps); // + Ethernet/IP/TCP headers
+			slot = (pcb->ack_head + pcb->ack_len) % ACK_QUEUE;
+			pcb->acks[slot].at = link_free_at + (uint64_t)sim_config.rtt_us * 1000U;
+			pcb->acks[slot].len = seg;
+			pcb->ack_len++;
+		}
+
+	// Acknowledgements free send buffer and are reported through the sent callback
+		while ((pcb->ack_len > 0) && (pcb->acks[pcb->ack_head].at <= now)) {
+			uint32_t len = pcb->acks[pcb->ack_head].len;
+
+			pcb->ack_head = (pcb->ack_head + 1U) % ACK_QUEUE;
+			pcb->ack_len--;
+			pcb->snd_buf += len;
+			if (pcb->sent != 0) {
+				hal_stage_t previous = hal_stage_enter(HAL_STAGE_TRANSPORT);
+
+				pcb->sent(pcb->arg, pcb, (u16_t)len);
+				hal_stage_exit(previous);
+			}
+			if (pcb->state != PCB_ESTABLISHED) {
+				return; // Closed from the callback
+			}
+		}
+}
+
+// Server -> board bytes: to the receive callback of the open connection, or as one datagram to the UDP PCB. Returns 0
+// if nothing is listening yet
+static uint8_t server_send(const uint8_t *data, uint32_t len) {
+	struct pbuf *p;
+
+	for (uint32_t i = 0; i < PCB_POOL; i++) {
+		if ((pool[i].state == PCB_ESTABLISHED) && (pool[i].recv != 0)) {
+			p = pbuf_alloc(PBUF_TRANSPORT, (u16_t)len, PBUF_RAM);
+			memcpy(p->payload, data, len);
+			pool[i].recv(pool[i].arg, &pool[i], p, ERR_OK);
+			return 1;
+		}
+	}
+	for (uint32_t i = 0; i < 2U; i++) {
+		if (udp_pool[i].used && (udp_pool[i].recv != 0)) {
+			p = pbuf_alloc(PBUF_TRANSPORT, (u16_t)len, PBUF_RAM);
+			memcpy(p->payload, data, len);
+			udp_pool[i].recv(udp_pool[i].recv_arg, &udp_pool[i], p, 0, 0);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Scripted commands: ADC1 to 8kHz (CLK2), read back CLK1/CLK2, ADC0 decimated by 4, thermocouples off, one
+ * write to a register outside the table (must be refused), the boot status, the deadline misses and compression on.
+ * All eight go in one piece -- a UDP datagram must hold
+ * whole commands -- except over TCP, where the first command is split to exercise the reassembly.
+ * Returns 0 (nothing sent) while the firmware has no connection to receive them. */
+static uint8_t server_commands(void) {
+	static const uint8_t clk2[] = {1, 0x0E, 0x48};
+	static const uint8_t read[] = {1, 0x0D, 0x0E};
+	static const uint8_t decim[] = {0, 2};
+	static const uint8_t streams[] = {(uint8_t)((PKT_CH_ADC(0) | PKT_CH_ADC(1) | PKT_CH_STATUS) >> 8),
+		(uint8_t)(PKT_CH_ADC(0) | PKT_CH_ADC(1) | PKT_CH_STATUS)};
+	static const uint8_t bad[] = {0, 0x02, 0x00};
+	static const uint8_t compress[] = {1};
+	uint8_t cmds[8U * CMD_MAX_SIZE];
+	uint16_t len = 0;
+	uint8_t tcp = 0;
+
+	len += daq_put_command(cmds + len, CMD_REG_WRITE, 1, clk2, sizeof(clk2));
+	len += daq_put_command(cmds + len, CMD_REG_READ, 2, read, sizeof(read));
+	len += daq_put_command(cmds + len, CMD_DECIMATE, 3, decim, sizeof(decim));
+	len += daq_put_command(cmds + len, CMD_STREAMS, 4, streams, sizeof(streams));
+	len += daq_put_command(cmds + len, CMD_REG_WRITE, 5, bad, sizeof(bad));
+	len += daq_put_command(cmds + len, CMD_STATUS, 6, 0, 0);
+	len += daq_put_command(cmds + len, CMD_DEADLINES, 7, 0, 0);
+	len += daq_put_command(cmds + len, CMD_COMPRESS, 8, compress, sizeof(compress));
+
+	for (uint32_t i = 0; i < PCB_POOL; i++) {
+		tcp |= ((pool[i].state == PCB_ESTABLISHED) && (pool[i].recv != 0)) ? 1U : 0U;
+	}
+	if (tcp) {
+		server_send(cmds, 3U);
+		server_send(cmds + 3U, len - 3U);
+	}
+	else if (!server_send(cmds, len)) {
+		return 0;
+	}
+	sim_net_stats.commands += 8U;
+	return 1;
+}
+
+/* Burst capture: level trigger on IEPE0 at 0.4 FS (a 0.4 FS 160Hz tone plus a 0.05 FS harmonic, so it fires near
+ * its peaks), --burst-window ms before and after the trigger (default 10 and 12). */
+static uint8_t server_burst(void) {
+	uint8_t burst[] = {1, BURST_TRIG_LEVEL, 0, 0x00, 0x33, 0x33, 0x33, // 0.4 FS
+		(uint8_t)(sim_config.burst_pre_ms >> 8), (uint8_t)sim_config.burst_pre_ms,
+		(uint8_t)(sim_config.burst_post_ms >> 8), (uint8_t)sim_config.burst_post_ms};
+	uint8_t cmd[CMD_MAX_SIZE];
+
+	if (!server_send(cmd, daq_put_command(cmd, CMD_BURST, 9, burst, sizeof(burst)))) {
+		return 0;
+	}
+	sim_net_stats.commands++;
+	return 1;
+}
+
+void sim_net_advance(void) {
+	if ((sim_config.burst_ms != 0) && !burst_sent && (sim_now_ns >= (uint64_t)sim_config.burst_ms * 1000000U)) {
+		burst_sent = server_burst();
+	}
+	if ((sim_config.command_ms != 0) && !commands_sent && (sim_now_ns >= (uint64_t)sim_config.command_ms * 1000000U)) {
+		commands_sent = server_commands();
+	}
+	if ((sim_config.reset_ms != 0) && (sim_now_ns >= next_reset)) {
+		next_reset = sim_now_ns + (uint64_t)sim_config.reset_ms * 1000000U;
+		for (uint32_t i = 0; i < PCB_POOL; i++) {
+			if (pool[i].state == PCB_ESTABLISHED) {
+				sim_net_stats.resets++;
+				pcb_close(&pool[i], ERR_RST);
+			}
+		}
+	}
+
+	for (uint32_t i = 0; i < PCB_POOL; i++) {
+		pcb_advance(&pool[i]);
+	}
+}
+
+
+// lwIP API ///////////////////////////////////////////////////////////////////////////////////////
+
+struct tcp_pcb *tcp_new(void) {
+	for (uint32_t n = 0; n < PCB_POOL; n++) {
+		struct tcp_pcb *pcb = &pool[pool_next];
+
+		pool_next = (pool_next + 1U) % PCB_POOL;
+		if ((pcb->state == PCB_FREE) || (pcb->state == PCB_CLOSED)) {
+			uint8_t *queue = pcb->queue;
+
+			memset(pcb, 0, sizeof(*pcb));
+			pcb->queue = (queue != 0) ? queue : malloc(sim_config.sndbuf);
+			pcb->state = PCB_NEW;
+			pcb->snd_buf = sim_config.sndbuf;
+			return pcb;
+		}
+	}
+	return 0;
+}
+
+err_t tcp_bind(struct tcp_pcb *pcb, ip_addr_t *ipaddr, u16_t port) {
+	return ERR_OK;
+}
+
+err_t tcp_connect(struct tcp_pcb *pcb, ip_addr_t *ipaddr, u16_t port, tcp_connected_fn connected) {
+	pcb->connected = connected;
+	pcb->state = PCB_CONNECTING;
+	pcb->connect_at = sim_now_ns + (uint64_t)sim_config.rtt_us * 1000U;
+	return ERR_OK;
+}
+
+void tcp_abort(struct tcp_pcb *pcb) {
+	if ((pcb == 0) || (pcb->state == PCB_FREE) || (pcb->state == PCB_CLOSED)) {
+		return; // Already gone -- a real stack would be touching freed memory here
+	}
+	pcb_close(pcb, ERR_ABRT);
+}
+
+void tcp_arg(struct tcp_pcb *pcb, void *arg) {
+	pcb->arg = arg;
+}
+
+void tcp_err(struct tcp_pcb *pcb, tcp_err_fn err) {
+	pcb->err = err;
+}
+
+void tcp_sent(struct tcp_pcb *pcb, tcp_sent_fn sent) {
+	pcb->sent = sent;
+}
+
+err_t tcp_write(struct tcp_pcb *pcb, const void *dataptr, u16_t len, u8_t apiflags) {
+	uint32_t size = sim_config.sndbuf;
+	uint32_t tail;
+	uint32_t first;
+	hal_stage_t previous;
+
+	if (pcb->state != PCB_ESTABLISHED) {
+		return ERR_CONN;
+	}
+	if (len > pcb->snd_buf) {
+		return ERR_MEM;
+	}
+	previous = hal_stage_enter(HAL_STAGE_TRANSPORT);
+
+	tail = (pcb->queue_head + pcb->queue_len) % size;
+	first = size - tail;
+	if (first > len) {
+		first = len;
+	}
+	memcpy(pcb->queue + tail, dataptr, first);
+	memcpy(pcb->queue, (const uint8_t *)dataptr + first, len - first);
+	pcb->queue_len += len;
+	pcb->snd_buf -= len;
+	hal_stage_exit(previous);
+	return ERR_OK;
+}
+
+err_t tcp_output(struct tcp_pcb *pcb) {
+	return ERR_OK; // The link drains the queue as virtual time advances
+}
+
+u16_t tcp_sndbuf(struct tcp_pcb *pcb) {
+	return (u16_t)((pcb->snd_buf > 0xFFFFU) ? 0xFFFFU : pcb->snd_buf);
+}
+
+void tcp_nagle_disable(struct tcp_pcb *pcb) {
+}
+
+void tcp_recv(struct tcp_pcb *pcb, tcp_recv_fn recv) {
+	pcb->recv = recv;
+}
+
+void tcp_recved(struct tcp_pcb *pcb, u16_t len) {
+}
+
+struct pbuf *pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type) {
+	hal_stage_t previous = hal_stage_enter(HAL_STAGE_TRANSPORT);
+	struct pbuf *p = malloc(sizeof(struct pbuf) + ((type == PBUF_REF || type == PBUF_ROM) ? 0U : length));
+
+	hal_stage_exit(previous);
+	if (p == 0) {
+		return 0;
+	}
+	p->next = 0;
+	p->payload = (type == PBUF_REF || type == PBUF_ROM) ? 0 : (void *)(p + 1);
+	p->tot_len = length;
+	p->len = length;
+	p->type = (u8_t)type;
+	return p;
+}
+
+u8_t pbuf_free(struct pbuf *p) {
+	hal_stage_t previous = hal_stage_enter(HAL_STAGE_TRANSPORT);
+
+	free(p);
+	hal_stage_exit(previous);
+	return 1;
+}
+
+struct udp_pcb *udp_new(void) {
+	for (uint32_t i = 0; i < 2U; i++) {
+		if (!udp_pool[i].used) {
+			udp_pool[i].used = 1;
+			return &udp_pool[i];
+		}
+	}
+	return 0;
+}
+
+err_t udp_bind(struct udp_pcb *pcb, ip_addr_t *ipaddr, u16_t port) {
+	return ERR_OK;
+}
+
+err_t udp_connect(struct udp_pcb *pcb, ip_addr_t *ipaddr, u16_t port) {
+	return ERR_OK;
+}
+
+void udp_recv(struct udp_pcb *pcb, udp_recv_fn recv, void *recv_arg) {
+	pcb->recv = recv;
+	pcb->recv_arg = recv_arg;
+}
+
+// Datagram on the link: refused while the transmit backlog is full, then possibly lost or held back one datagram
+err_t udp_send(struct udp_pcb *pcb, struct pbuf *p) {
+	uint64_t now = sim_now_ns;
+	uint64_t start = (link_free_at > now) ? link_free_at : now;
+	uint32_t len = p->tot_len;
+	hal_stage_t previous;
+
+	if ((start - now) > UDP_TX_BACKLOG_NS) {
+		sim_net_stats.udp_dropped++;
+		return ERR_MEM;
+	}
+	previous = hal_stage_enter(HAL_STAGE_TRANSPORT);
+	link_free_at = start + (uint64_t)((len + 46U) * 8.0 * 1000.0 / sim_config.link_mbps); // + Ethernet/IP/UDP headers
+
+	udp_rand = udp_rand * 1103515245U + 12345U;
+	if (((udp_rand >> 8) & 0xFFFFU) < (uint32_t)(sim_config.udp_loss * 65536.0)) {
+		sim_net_stats.udp_dropped++;
+		hal_stage_exit(previous);
+		return ERR_OK; // Lost on the wire -- the sender cannot tell
+	}
+
+	udp_rand = udp_rand * 1103515245U + 12345U;
+	if ((udp_held_len == 0) && (len <= UDP_HELD_MAX) && (((udp_rand >> 8) & 0xFFFFU) < (uint32_t)(sim_config.udp_reorder * 65536.0))) {
+		memcpy(udp_held, p->payload, len);
+		udp_held_len = len;
+		hal_stage_exit(previous);
+		return ERR_OK;
+	}
+
+	sink_datagram(p->payload, len);
+	if (udp_held_len != 0) {
+		sink_datagram(udp_held, udp_held_len);
+		udp_held_len = 0;
+	}
+	hal_stage_exit(previous);
+	return ERR_OK;
+}
+
+void sys_check_timeouts(void) {
+}
+
+#endif /* HAL_SIM */
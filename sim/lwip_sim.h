@@ -0,0 +1,102 @@
+/****************************************************************
+* lwIP STAND-IN (host simulator)
+*
+* Just enough of the raw lwIP TCP API for the firmware to build and run on the host.
+* Connections go to a simulated server (the TCP sink in lwip_sim.c) over a link with configurable rate, round trip
+* time and send buffer, so send buffer backpressure, client_sent acknowledgements and connection resets behave
+* like on the board. The server can also send a scripted set of commands back (--command-ms).
+***************************************************************/
+#ifndef LWIP_SIM_H
+#define LWIP_SIM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+	// TYPES
+		typedef int8_t err_t;
+		typedef uint8_t u8_t;
+		typedef uint16_t u16_t;
+		typedef uint32_t u32_t;
+
+		typedef struct ip_addr {
+			u32_t addr;
+		} ip_addr_t;
+
+		struct netif;
+		struct tcp_pcb;
+
+	// ERRORS
+		#define ERR_OK		0
+		#define ERR_MEM		-1
+		#define ERR_CONN	-11
+		#define ERR_ABRT	-8
+		#define ERR_RST		-9
+
+	// ADDRESSES
+		extern const ip_addr_t ip_addr_any;
+		#define IP_ADDR_ANY ((ip_addr_t *)&ip_addr_any)
+		#define IP4_ADDR(ipaddr, a, b, c, d) ((ipaddr)->addr = ((u32_t)(a) << 24) | ((u32_t)(b) << 16) | ((u32_t)(c) << 8) | (u32_t)(d))
+
+	// TCP
+		#define TCP_WRITE_FLAG_COPY	0x01
+		#define TCP_WRITE_FLAG_MORE	0x02
+
+		typedef void (*tcp_err_fn)(void *arg, err_t err);
+		typedef err_t (*tcp_connected_fn)(void *arg, struct tcp_pcb *pcb, err_t err);
+		typedef err_t (*tcp_sent_fn)(void *arg, struct tcp_pcb *pcb, u16_t len);
+		struct pbuf;
+		typedef err_t (*tcp_recv_fn)(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err);
+
+		struct tcp_pcb *tcp_new(void);
+		err_t tcp_bind(struct tcp_pcb *pcb, ip_addr_t *ipaddr, u16_t port);
+		err_t tcp_connect(struct tcp_pcb *pcb, ip_addr_t *ipaddr, u16_t port, tcp_connected_fn connected);
+		void tcp_abort(struct tcp_pcb *pcb);
+		void tcp_arg(struct tcp_pcb *pcb, void *arg);
+		void tcp_err(struct tcp_pcb *pcb, tcp_err_fn err);
+		void tcp_sent(struct tcp_pcb *pcb, tcp_sent_fn sent);
+		void tcp_recv(struct tcp_pcb *pcb, tcp_recv_fn recv);
+		void tcp_recved(struct tcp_pcb *pcb, u16_t len);
+		err_t tcp_write(struct tcp_pcb *pcb, const void *dataptr, u16_t len, u8_t apiflags);
+		err_t tcp_output(struct tcp_pcb *pcb);
+		u16_t tcp_sndbuf(struct tcp_pcb *pcb);
+		void tcp_nagle_disable(struct tcp_pcb *pcb);
+
+	// PBUF
+		typedef enum {
+			PBUF_TRANSPORT,
+			PBUF_IP,
+			PBUF_RAW
+		} pbuf_layer;
+
+		typedef enum {
+			PBUF_RAM,
+			PBUF_ROM,
+			PBUF_REF,
+			PBUF_POOL
+		} pbuf_type;
+
+		struct pbuf {
+			struct pbuf *next;
+			void *payload;
+			u16_t tot_len;
+			u16_t len;
+			u8_t type;
+		};
+
+		struct pbuf *pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type);
+		u8_t pbuf_free(struct pbuf *p);
+
+	// UDP
+		struct udp_pcb;
+		typedef void (*udp_recv_fn)(void *arg, struct udp_pcb *pcb, struct pbuf *p, ip_addr_t *addr, u16_t port);
+
+		struct udp_pcb *udp_new(void);
+		err_t udp_bind(struct udp_pcb *pcb, ip_addr_t *ipaddr, u16_t port);
+		err_t udp_connect(struct udp_pcb *pcb, ip_addr_t *ipaddr, u16_t port);
+		err_t udp_send(struct udp_pcb *pcb, struct pbuf *p);
+		void udp_recv(struct udp_pcb *pcb, udp_recv_fn recv, void *recv_arg);
+
+	// TIMERS
+		void sys_check_timeouts(void);
+
+#endif /* LWIP_SIM_H */
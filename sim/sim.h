@@ -0,0 +1,100 @@
+/****************************************************************
+* HOST SIMULATOR -- shared state
+*
+* Time is virtual: it advances by a fixed (or measured and scaled) cost for every main loop pass and busy poll, and
+* simulated interrupts are dispatched in time order between main loop passes.
+***************************************************************/
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "hal.h"
+
+	// CONFIG -- set from the command line (sim_main.c)
+		typedef struct {
+			double seconds;			// Simulated run time
+			double drdy_hz;			// ADC DRDY rate, 0 = derived from the CLK1/CLK2 registers the firmware writes
+			double adc_spi_hz;		// ADC SPI bit clock
+			double tc_spi_hz;		// Thermocouple SPI bit clock
+			uint32_t loop_ns;		// Virtual cost of one main loop pass (used when cpu_scale is 0)
+			double cpu_scale;		// > 0: virtual cost = measured host time of the pass x cpu_scale
+			uint32_t poll_ns;		// Virtual cost of one busy poll
+			uint32_t eth_us;		// ETHIRQ period
+			double link_mbps;		// Link rate to the server
+			uint32_t rtt_us;		// Round trip time (connect and acknowledge delay)
+			uint32_t sndbuf;		// lwIP TCP send buffer (TCP_SND_BUF)
+			uint32_t reset_ms;		// Reset the connection every N ms (0 = never)
+			double udp_loss;		// Fraction of datagrams lost on the link
+			double udp_reorder;		// Fraction of datagrams delivered after the next one
+			uint32_t command_ms;	// Send the scripted commands (lwip_sim.c) after N ms (0 = never)
+			uint32_t burst_ms;		// Switch to burst capture, level trigger on IEPE0, after N ms (0 = never)
+			uint16_t burst_pre_ms;	// Its windows before and after the trigger
+			uint16_t burst_post_ms;
+			uint32_t adc_por_us;	// ADC power-on reset time, 0 = ADCs still running from before (MCU-only reset)
+			int32_t streams;		// Boot channel mask (PKT_CH_*), -1 = the firmware's CHANNEL_ENABLE
+			int32_t tx_latency_us;	// Boot transmit latency (tx_batch.h), -1 = the firmware's TX_LATENCY_US
+			uint8_t json;			// Report as one JSON object instead of text
+			FILE *record;			// Every byte the sink receives is written here (0 = not recorded)
+		} sim_config_t;
+
+		extern sim_config_t sim_config;
+
+	// CLOCK
+		extern uint64_t sim_now_ns;		// Virtual time since start
+		extern uint8_t sim_in_isr;		// Set while simulated interrupts run (no nested dispatch)
+
+	// STATISTICS
+		typedef struct {
+			uint64_t conversions[2];	// DRDY edges generated per ADC
+			uint64_t frames_read[2];	// Data frames clocked out per ADC
+			uint64_t iterations;		// Main loop passes
+			uint64_t iter_ns_total;		// Host time spent in main loop passes
+			uint64_t iter_ns_max;
+			uint64_t iter_hist[32];		// log2 histogram of pass time (bucket i = [2^i, 2^(i+1)) ns)
+			uint64_t stage_ns[HAL_STAGES];		// Host time per benchmark stage (exclusive), clock reads included
+			uint64_t stage_calls[HAL_STAGES];	// Times each was entered
+		} sim_hal_stats_t;
+
+		typedef struct {
+			uint64_t connections;		// Connections accepted by the sink
+			uint64_t resets;			// Connection resets injected
+			uint64_t bytes;				// Bytes received by the sink
+			uint64_t packets;			// Complete packets received
+			uint64_t tc_packets;		// Thermocouple packets among them
+			uint64_t tc_stale;			// Thermocouple packets with a reading repeated (missed deadline)
+			uint64_t telemetry;			// Telemetry packets
+			uint64_t compressed;		// Compressed ADC packets (daq_codec.h), expanded before the checks
+			uint64_t compressed_bytes;	// Their length as received
+			uint64_t expanded_bytes;	// Their length expanded
+			uint64_t malformed;			// Headers or samples that did not decode
+			uint64_t packet_gaps;		// Packets missing according to the packet counter
+			uint64_t reordered;			// Packets that arrived after a later one
+			uint64_t datagrams;			// UDP datagrams received
+			uint64_t udp_dropped;		// UDP datagrams lost on the link (injected) or refused (link busy)
+			uint64_t samples[2];		// ADC conversions covered by the received samples (2^n per sample when decimated)
+			uint64_t index_gaps[2];		// Conversions missing according to the sample index
+			uint64_t flagged[2][3];		// ADC packets flagged PKT_FAULT_MISSED / _ADC / _SYNC
+			uint32_t spacing_min[2];	// Time between neighbouring full-rate samples of a packet, us -- edge jitter, or a pause or lost conversion
+			uint32_t spacing_max[2];
+			uint64_t latency_us_sum;	// Live ADC packets: first sample converted to packet complete at the sink
+			uint32_t latency_us_max;
+			uint64_t latency_packets;
+			uint64_t bursts;			// Burst records announced (PKT_TYPE_BURST)
+			uint64_t bursts_truncated;
+			uint64_t burst_frames[2];	// Frames the records announced
+			uint64_t burst_received[2];	// Samples received in PKT_FLAG_BURST packets
+			uint64_t commands;			// Commands sent by the server
+			uint64_t replies;			// Command replies received
+			uint64_t replies_ok;
+			uint64_t replies_verify;	// Register did not read back the value written
+			uint64_t replies_invalid;	// Command refused
+		} sim_net_stats_t;
+
+		extern sim_hal_stats_t sim_hal_stats;
+		extern sim_net_stats_t sim_net_stats;
+
+	// NETWORK -- called by the dispatcher
+		void sim_net_advance(void);
+
+#endif /* SIM_H */
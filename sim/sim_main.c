@@ -0,0 +1,355 @@
+/****************************************************************
+* HOST SIMULATOR -- entry point and report
+*
+* Runs the firmware main() (built as firmware_main) against the simulated board for a fixed amount of virtual
+* time, then reports throughput, dropped samples and main loop pass latency -- as text, or with --json as one JSON
+* object for the benchmark suite (host/daq_bench.cpp). Host time is also split by benchmark stage (HAL_STAGE_* in
+* hal.h): the firmware's own code per frame, packet or pass, the simulator's models kept out of it.
+***************************************************************/
+#ifdef HAL_SIM
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "hal.h"
+#include "sim.h"
+#include "daq_packet.h"
+#include "adc_capture.h"
+#include "adc_status.h"
+#include "command.h"
+#include "tc_capture.h"
+#include "telemetry.h"
+#include "tx_batch.h"
+
+	// FIRMWARE STATE REPORTED AFTER THE RUN
+		int firmware_main(void);
+		extern uint32_t packet_count;
+		extern uint32_t tx_dropped;
+		extern uint32_t tx_reconnects;
+		extern uint8_t config_failed[ADC_COUNT];
+		extern uint32_t boot_config_us;
+		extern uint32_t boot_first_sample_us;
+		extern uint16_t channel_enable;
+
+
+static void usage(const char *name) {
+	printf("usage: %s [options]\n"
+		"  --seconds S      simulated run time (default 2)\n"
+		"  --rate HZ        ADC DRDY rate, 0 = from the CLK registers (default 0 -> 42667)\n"
+		"  --adc-spi HZ     ADC SPI clock (default 20e6)\n"
+		"  --tc-spi HZ      thermocouple SPI clock (default 5e6)\n"
+		"  --loop-ns NS     virtual cost of a main loop pass (default 1000)\n"
+		"  --cpu-scale X    use host pass time x X as the virtual cost instead of --loop-ns\n"
+		"  --poll-ns NS     virtual cost of a busy poll (default 50)\n"
+		"  --eth-us US      ETHIRQ period, if the firmware enables it (default 1000)\n"
+		"  --link-mbps M    link rate (default 100)\n"
+		"  --rtt-us US      round trip time (default 200)\n"
+		"  --sndbuf BYTES   lwIP send buffer (default 5840)\n"
+		"  --reset-ms MS    reset the connection every MS of virtual time (default 0 = never)\n"
+		"  --udp-loss P     fraction of UDP datagrams lost on the link (default 0)\n"
+		"  --udp-reorder P  fraction of UDP datagrams delivered late (default 0)\n"
+		"  --command-ms MS  server sends the scripted commands (sim/lwip_sim.c) after MS of virtual time (default 0 = never)\n"
+		"  --burst-ms MS    server switches the board to burst capture after MS of virtual time (default 0 = never)\n"
+		"  --burst-window PRE:POST  its ms before and after the trigger (default 10:12)\n"
+		"  --adc-por-us US  ADC power-on reset time, 0 = ADCs already converting (MCU-only reset) (default 16000)\n"
+		"  --streams M      boot channel mask, PKT_CH_* (default: the firmware's CHANNEL_ENABLE)\n"
+		"  --tx-latency US  boot transmit latency, tx_batch.h (default: the firmware's TX_LATENCY_US)\n"
+		"  --record FILE    write every byte the sink receives to FILE\n"
+		"  --json           report as one JSON object\n", name);
+}
+
+static uint64_t host_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000U + (uint64_t)ts.tv_nsec;
+}
+
+// Upper edge of the log2 bucket that holds the given fraction of main loop passes
+static uint64_t pass_percentile(double fraction) {
+	uint64_t target = (uint64_t)(sim_hal_stats.iterations * fraction);
+	uint64_t seen = 0;
+
+	for (uint32_t i = 0; i < 32U; i++) {
+		seen += sim_hal_stats.iter_hist[i];
+		if (seen > target) {
+			return (uint64_t)2U << i;
+		}
+	}
+	return sim_hal_stats.iter_ns_max;
+}
+
+// Upper edge in us of the telemetry bucket that holds the given fraction of a histogram's durations
+static double telem_percentile(uint8_t id, double fraction) {
+	const telem_hist_t *hist = &telem_hist[id];
+	uint64_t total = 0;
+	uint64_t seen = 0;
+
+	for (uint32_t i = 0; i < TELEM_BUCKETS; i++) {
+		total += hist->count[i];
+	}
+	for (uint32_t i = 0; i < TELEM_BUCKETS; i++) {
+		seen += hist->count[i];
+		if (seen > (uint64_t)(total * fraction)) {
+			return (double)((uint64_t)2U << i) / HAL_CYCLES_PER_US;
+		}
+	}
+	return (double)hist->max / HAL_CYCLES_PER_US;
+}
+
+// Host ns of a stage per unit of work (frames, packets, passes), 0 if there was none
+static double stage_per(hal_stage_t stage, uint64_t units) {
+	return units ? (double)sim_hal_stats.stage_ns[stage] / (double)units : 0.0;
+}
+
+// Fraction of the conversions of the streamed ADCs that reached the sink
+static double delivered(void) {
+	uint64_t conv = 0;
+	uint64_t recv = 0;
+
+	for (uint8_t adc = 0; adc < ADC_COUNT; adc++) {
+		if (channel_enable & PKT_CH_ADC(adc)) {
+			conv += sim_hal_stats.conversions[adc];
+			recv += sim_net_stats.samples[adc];
+		}
+	}
+	return conv ? (double)recv / (double)conv : 0.0;
+}
+
+static void report_json(uint64_t host_elapsed) {
+	double sim_s = (double)sim_now_ns / 1e9;
+	uint64_t frames = sim_hal_stats.frames_read[0] + sim_hal_stats.frames_read[1];
+
+	printf("{\"seconds\": %.3f, \"rate_hz\": %.0f, \"streams\": %u, \"tx_latency_us\": %u, \"transport\": \"%s\", ",
+		sim_s, sim_config.drdy_hz, channel_enable, tx_batch_latency(), (sim_net_stats.datagrams != 0) ? "udp" : "tcp");
+	printf("\"samples_per_s\": %.1f, \"samples_delivered\": %.6f, \"packets_per_s\": %.1f, \"link_mb_per_s\": %.4f, ",
+		(double)(sim_net_stats.samples[0] + sim_net_stats.samples[1]) / sim_s, delivered(), sim_net_stats.packets / sim_s,
+		sim_net_stats.bytes / sim_s / 1e6);
+	printf("\"flush_bytes\": %.1f, \"deadline_fraction\": %.4f, \"latency_mean_us\": %.1f, \"latency_max_us\": %u, "
+		"\"malformed\": %llu, ", tx_batch_stats.flushes ? (double)tx_batch_stats.bytes / tx_batch_stats.flushes : 0.0,
+		tx_batch_stats.flushes ? (double)tx_batch_stats.deadline / tx_batch_stats.flushes : 0.0,
+		sim_net_stats.latency_packets ? (double)sim_net_stats.latency_us_sum / sim_net_stats.latency_packets : 0.0,
+		sim_net_stats.latency_us_max, (unsigned long long)sim_net_stats.malformed);
+	printf("\"realtime_x\": %.2f, \"acquire_ns_per_frame\": %.1f, \"packetize_ns_per_packet\": %.1f, "
+		"\"transport_ns_per_packet\": %.1f, \"sink_ns_per_packet\": %.1f, \"loop_ns_per_pass\": %.1f}\n",
+		sim_s / ((double)host_elapsed / 1e9), stage_per(HAL_STAGE_ACQUIRE, frames),
+		stage_per(HAL_STAGE_PACKETIZE, sim_hal_stats.stage_calls[HAL_STAGE_PACKETIZE]),
+		stage_per(HAL_STAGE_TRANSPORT, packet_count), stage_per(HAL_STAGE_SINK, sim_net_stats.packets),
+		stage_per(HAL_STAGE_LOOP, sim_hal_stats.iterations));
+}
+
+static void report(uint64_t host_elapsed) {
+	double sim_s = (double)sim_now_ns / 1e9;
+	double host_s = (double)host_elapsed / 1e9;
+
+	printf("virtual time        %.3f s (host %.3f s, %.1fx real time)\n", sim_s, host_s, sim_s / host_s);
+	printf("boot                ADCs configured %.3f ms, first sample %.3f ms, bring-up result 0x%02X 0x%02X\n",
+		boot_config_us / 1e3, boot_first_sample_us / 1e3, config_failed[0], config_failed[1]);
+	printf("main loop passes    %llu, host ns/pass avg %.0f p50 <%llu p99 <%llu max %llu\n",
+		(unsigned long long)sim_hal_stats.iterations,
+		sim_hal_stats.iterations ? (double)sim_hal_stats.iter_ns_total / sim_hal_stats.iterations : 0.0,
+		(unsigned long long)pass_percentile(0.50), (unsigned long long)pass_percentile(0.99),
+		(unsigned long long)sim_hal_stats.iter_ns_max);
+	printf("host stages         ns: acquire %.0f per frame, packetize %.0f per ADC packet, transport %.0f per packet "
+		"sent, sink %.0f per packet received, loop %.0f per pass\n",
+		stage_per(HAL_STAGE_ACQUIRE, sim_hal_stats.frames_read[0] + sim_hal_stats.frames_read[1]),
+		stage_per(HAL_STAGE_PACKETIZE, sim_hal_stats.stage_calls[HAL_STAGE_PACKETIZE]),
+		stage_per(HAL_STAGE_TRANSPORT, packet_count), stage_per(HAL_STAGE_SINK, sim_net_stats.packets),
+		stage_per(HAL_STAGE_LOOP, sim_hal_stats.iterations));
+
+	for (uint8_t adc = 0; adc < ADC_COUNT; adc++) {
+		uint64_t conv = sim_hal_stats.conversions[adc];
+		uint64_t recv = sim_net_stats.samples[adc];
+		uint64_t dropped = (conv > recv) ? conv - recv : 0;
+
+		printf("ADC%u                conversions %llu, read %llu, received %llu, dropped %llu (%.3f%%), ring overflows %u, index gaps %llu, sample spacing %u-%u us\n",
+			adc, (unsigned long long)conv, (unsigned long long)sim_hal_stats.frames_read[adc], (unsigned long long)recv,
+			(unsigned long long)dropped, conv ? 100.0 * dropped / conv : 0.0, adc_rings[adc].overflows,
+			(unsigned long long)sim_net_stats.index_gaps[adc], sim_net_stats.spacing_min[adc], sim_net_stats.spacing_max[adc]);
+	}
+
+	printf("packets             sent %u, received %llu (%.0f/s), lost %llu (%.3f%%), counter gaps %llu, tx dropped %u\n",
+		packet_count, (unsigned long long)sim_net_stats.packets, sim_net_stats.packets / sim_s,
+		(unsigned long long)(packet_count - sim_net_stats.packets),
+		packet_count ? 100.0 * (packet_count - sim_net_stats.packets) / packet_count : 0.0,
+		(unsigned long long)sim_net_stats.packet_gaps, tx_dropped);
+	printf("decode              thermocouple packets %llu (stale %llu), malformed %llu\n",
+		(unsigned long long)sim_net_stats.tc_packets, (unsigned long long)sim_net_stats.tc_stale,
+		(unsigned long long)sim_net_stats.malformed);
+	printf("deadline misses     ADC0 dropped %u late %u, ADC1 dropped %u late %u, thermocouples %u\n",
+		adc_capture_misses[0].dropped, adc_capture_misses[0].late, adc_capture_misses[1].dropped,
+		adc_capture_misses[1].late, tc_capture_misses);
+	for (uint8_t adc = 0; adc < ADC_COUNT; adc++) {
+		printf("ADC%u status          sync errors %u, fault frames %u (F_DRDY %u), packets flagged missed %llu "
+			"fault %llu sync %llu\n", adc, adc_status_counts[adc].sync_errors, adc_status_counts[adc].fault_frames,
+			adc_status_counts[adc].faults[1], (unsigned long long)sim_net_stats.flagged[adc][0],
+			(unsigned long long)sim_net_stats.flagged[adc][1], (unsigned long long)sim_net_stats.flagged[adc][2]);
+	}
+	printf("link                %.3f MB/s, connections %llu, reconnects %u, injected resets %llu\n",
+		sim_net_stats.bytes / sim_s / 1e6, (unsigned long long)sim_net_stats.connections, tx_reconnects,
+		(unsigned long long)sim_net_stats.resets);
+	if (sim_net_stats.datagrams != 0) {
+		printf("udp                 datagrams %llu, dropped on link %llu, packets reordered %llu\n",
+			(unsigned long long)sim_net_stats.datagrams, (unsigned long long)sim_net_stats.udp_dropped,
+			(unsigned long long)sim_net_stats.reordered);
+	}
+	printf("transmit            flushes %u, mean %.0f bytes, at the deadline %.1f%% | latency %u us, batch %u bytes, ACK rate %.3f MB/s\n",
+		tx_batch_stats.flushes, tx_batch_stats.flushes ? (double)tx_batch_stats.bytes / tx_batch_stats.flushes : 0.0,
+		tx_batch_stats.flushes ? 100.0 * tx_batch_stats.deadline / tx_batch_stats.flushes : 0.0, tx_batch_latency(),
+		tx_batch_target(), tx_batch_rate() / 1e6);
+	printf("sample latency      first sample to sink, ADC packets: mean %.0f us, max %u us\n",
+		sim_net_stats.latency_packets ? (double)sim_net_stats.latency_us_sum / sim_net_stats.latency_packets : 0.0,
+		sim_net_stats.latency_us_max);
+	if (sim_net_stats.compressed != 0) {
+		printf("compression         packets %llu, %llu -> %llu bytes (%.2fx)\n",
+			(unsigned long long)sim_net_stats.compressed, (unsigned long long)sim_net_stats.expanded_bytes,
+			(unsigned long long)sim_net_stats.compressed_bytes,
+			(double)sim_net_stats.expanded_bytes / (double)sim_net_stats.compressed_bytes);
+	}
+	if (sim_net_stats.bursts != 0) {
+		printf("burst               records %llu (truncated %llu), frames received/announced ADC0 %llu/%llu ADC1 %llu/%llu\n",
+			(unsigned long long)sim_net_stats.bursts, (unsigned long long)sim_net_stats.bursts_truncated,
+			(unsigned long long)sim_net_stats.burst_received[0], (unsigned long long)sim_net_stats.burst_frames[0],
+			(unsigned long long)sim_net_stats.burst_received[1], (unsigned long long)sim_net_stats.burst_frames[1]);
+	}
+	if (sim_net_stats.telemetry != 0) {
+		static const char *const names[TELEM_HISTOGRAMS] = {"DRDY->SPI", "SPI", "loop", "send", "codec", "tx queue"};
+
+		printf("telemetry           packets %llu, firmware us p50/p99/max:", (unsigned long long)sim_net_stats.telemetry);
+		for (uint8_t id = 0; id < TELEM_HISTOGRAMS; id++) {
+			printf(" %s <%.3g/<%.3g/%.3g", names[id], telem_percentile(id, 0.50), telem_percentile(id, 0.99),
+				(double)telem_hist[id].max / HAL_CYCLES_PER_US);
+		}
+		printf("\n");
+	}
+	if (sim_net_stats.commands != 0) {
+		printf("commands            sent %llu, replies %llu (ok %llu, verify failed %llu, refused %llu), dropped %u\n",
+			(unsigned long long)sim_net_stats.commands, (unsigned long long)sim_net_stats.replies,
+			(unsigned long long)sim_net_stats.replies_ok, (unsigned long long)sim_net_stats.replies_verify,
+			(unsigned long long)sim_net_stats.replies_invalid, command_dropped);
+	}
+}
+
+int main(int argc, char **argv) {
+	static const struct option options[] = {
+		{"seconds",   required_argument, 0, 's'},
+		{"rate",      required_argument, 0, 'r'},
+		{"adc-spi",   required_argument, 0, 'a'},
+		{"tc-spi",    required_argument, 0, 't'},
+		{"loop-ns",   required_argument, 0, 'l'},
+		{"cpu-scale", required_argument, 0, 'c'},
+		{"poll-ns",   required_argument, 0, 'p'},
+		{"eth-us",    required_argument, 0, 'e'},
+		{"link-mbps", required_argument, 0, 'm'},
+		{"rtt-us",    required_argument, 0, 'd'},
+		{"sndbuf",    required_argument, 0, 'b'},
+		{"reset-ms",  required_argument, 0, 'x'},
+		{"udp-loss",  required_argument, 0, 'u'},
+		{"udp-reorder", required_argument, 0, 'o'},
+		{"command-ms", required_argument, 0, 'k'},
+		{"burst-ms",  required_argument, 0, 'g'},
+		{"burst-window", required_argument, 0, 'i'},
+		{"adc-por-us", required_argument, 0, 'w'},
+		{"streams",   required_argument, 0, 'n'},
+		{"tx-latency", required_argument, 0, 'y'},
+		{"record",    required_argument, 0, 'f'},
+		{"json",      no_argument,       0, 'j'},
+		{"help",      no_argument,       0, 'h'},
+		{0, 0, 0, 0}
+	};
+	uint64_t start;
+	int opt;
+
+	sim_config.seconds = 2.0;
+	sim_config.drdy_hz = 0.0;
+	sim_config.adc_spi_hz = 20e6;
+	sim_config.tc_spi_hz = 5e6;
+	sim_config.loop_ns = 1000;
+	sim_config.cpu_scale = 0.0;
+	sim_config.poll_ns = 50;
+	sim_config.eth_us = 1000;
+	sim_config.link_mbps = 100.0;
+	sim_config.rtt_us = 200;
+	sim_config.sndbuf = 5840;
+	sim_config.reset_ms = 0;
+	sim_config.udp_loss = 0.0;
+	sim_config.udp_reorder = 0.0;
+	sim_config.command_ms = 0;
+	sim_config.burst_ms = 0;
+	sim_config.burst_pre_ms = 10;
+	sim_config.burst_post_ms = 12;
+	sim_config.adc_por_us = 16000;
+	sim_config.streams = -1;
+	sim_config.tx_latency_us = -1;
+	sim_config.json = 0;
+	sim_config.record = 0;
+
+	while ((opt = getopt_long(argc, argv, "h", options, 0)) != -1) {
+		switch (opt) {
+			case 's': sim_config.seconds = atof(optarg);				break;
+			case 'r': sim_config.drdy_hz = atof(optarg);				break;
+			case 'a': sim_config.adc_spi_hz = atof(optarg);				break;
+			case 't': sim_config.tc_spi_hz = atof(optarg);				break;
+			case 'l': sim_config.loop_ns = (uint32_t)atol(optarg);		break;
+			case 'c': sim_config.cpu_scale = atof(optarg);				break;
+			case 'p': sim_config.poll_ns = (uint32_t)atol(optarg);		break;
+			case 'e': sim_config.eth_us = (uint32_t)atol(optarg);		break;
+			case 'm': sim_config.link_mbps = atof(optarg);				break;
+			case 'd': sim_config.rtt_us = (uint32_t)atol(optarg);		break;
+			case 'b': sim_config.sndbuf = (uint32_t)atol(optarg);		break;
+			case 'x': sim_config.reset_ms = (uint32_t)atol(optarg);		break;
+			case 'u': sim_config.udp_loss = atof(optarg);				break;
+			case 'o': sim_config.udp_reorder = atof(optarg);			break;
+			case 'k': sim_config.command_ms = (uint32_t)atol(optarg);	break;
+			case 'g': sim_config.burst_ms = (uint32_t)atol(optarg);		break;
+			case 'i':
+			{
+				unsigned pre, post;
+
+				if (sscanf(optarg, "%u:%u", &pre, &post) != 2) {
+					usage(argv[0]);
+					return 1;
+				}
+				sim_config.burst_pre_ms = (uint16_t)pre;
+				sim_config.burst_post_ms = (uint16_t)post;
+				break;
+			}
+			case 'w': sim_config.adc_por_us = (uint32_t)atol(optarg);	break;
+			case 'n': sim_config.streams = (int32_t)strtol(optarg, 0, 0);	break;
+			case 'y': sim_config.tx_latency_us = (int32_t)atol(optarg);	break;
+			case 'j': sim_config.json = 1;								break;
+			case 'f':
+				if ((sim_config.record = fopen(optarg, "wb")) == 0) {
+					perror(optarg);
+					return 1;
+				}
+				break;
+			default:  usage(argv[0]);	return (opt == 'h') ? 0 : 1;
+		}
+	}
+
+	if ((sim_config.streams >= 0) && ((sim_config.streams >> PKT_CH_COUNT) != 0)) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (sim_config.streams >= 0) {
+		channel_enable = (uint16_t)sim_config.streams;
+	}
+	if (sim_config.tx_latency_us >= 0) {
+		tx_batch_set((uint32_t)sim_config.tx_latency_us);
+	}
+
+	start = host_ns();
+	firmware_main();
+	if (sim_config.json) {
+		report_json(host_ns() - start);
+	}
+	else {
+		report(host_ns() - start);
+	}
+	if (sim_config.record != 0) {
+		fclose(sim_config.record);
+	}
+	return 0;
+}
+
+#endif /* HAL_SIM */
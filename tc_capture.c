@@ -0,0 +1,147 @@
+/****************************************************************
+* HEADER FILES
+***************************************************************/
+#include "hal.h"				// Hardware abstraction (DAVE APPs on the target, simulator on the host)
+#include <string.h>
+#include "tc_capture.h"
+
+	// CYCLE BEING READ -- written by the interrupts only
+		static uint8_t words[TC_COUNT * TC_WORD_BYTES];	// Receive buffers, one slot per converter
+		static uint8_t fresh = 0;						// Converters read in this cycle
+		static uint8_t active = 0;						// Cycle started and not yet handed over
+		static uint32_t cycle = 0;
+		static uint64_t cycle_time = 0;
+
+	// TRANSACTION QUEUE -- the converters of the cycle in slave select order
+		static uint8_t next_tc = TC_COUNT;				// Next transaction to start (TC_COUNT = queue empty)
+		static uint8_t inflight = 0;					// Transaction running on the bus
+		static uint8_t inflight_tc = 0;
+		static uint32_t inflight_cycle = 0;
+
+	// FINISHED CYCLE -- handed to the main loop
+		static tc_cycle_t finished;
+		static volatile uint8_t finished_ready = 0;
+
+	// DEADLINE MISSES
+		volatile uint32_t tc_capture_misses = 0;
+
+
+/**
+ * @start_next
+ *
+ * Starts the next queued transaction if the bus is free.
+ *
+ * */
+static void start_next(void)
+{
+	if (inflight || (next_tc >= TC_COUNT)) {
+		return;
+	}
+	inflight = 1;
+	inflight_tc = next_tc;
+	inflight_cycle = cycle;
+	next_tc++;
+	hal_tc_select(inflight_tc); // Change slave
+	hal_tc_receive(words + inflight_tc * TC_WORD_BYTES, TC_WORD_BYTES);
+}
+
+/**
+ * @publish
+ *
+ * Hands the current cycle to the main loop (replacing one it has not taken yet) and closes it.
+ *
+ * */
+static void publish(void)
+{
+	memcpy(finished.words, words, sizeof(words));
+	finished.fresh = fresh;
+	finished.cycle = cycle;
+	finished.time = cycle_time;
+	finished_ready = 1;
+	active = 0;
+	cycle++;
+}
+
+/**
+ * @tc_capture_tick
+ *
+ * Called from TCIRQ. Closes a cycle that missed its deadline -- it is sent with the converters it got to -- and
+ * queues the reads of the next one.
+ *
+ * @input  : time - tick time (timebase_now)
+ *
+ * @output : none
+ *
+ * @return : none
+ *
+ * */
+void tc_capture_tick(uint64_t time)
+{
+	if (active) {
+		for (uint8_t tc = 0; tc < TC_COUNT; tc++) {
+			if ((fresh & (1U << tc)) == 0U) {
+				tc_capture_misses++;
+			}
+		}
+		publish();
+	}
+	fresh = 0;
+	cycle_time = time;
+	active = 1;
+	next_tc = 0;
+	start_next();
+}
+
+/**
+ * @tc_capture_done
+ *
+ * Called from the SPI_MASTER_TC end-of-receive interrupt (TC_SPI_RxDone). Marks the converter read, hands the
+ * cycle over once all four are in, and starts the next queued read.
+ *
+ * @input  : none
+ *
+ * @output : none
+ *
+ * @return : none
+ *
+ * */
+void tc_capture_done(void)
+{
+	if (!inflight) {
+		return;
+	}
+	inflight = 0;
+	if (active && (inflight_cycle == cycle)) { // Not a read left over from a cycle closed by the tick
+		fresh |= (uint8_t)(1U << inflight_tc);
+		if (fresh == ((1U << TC_COUNT) - 1U)) {
+			publish();
+		}
+	}
+	start_next();
+}
+
+/**
+ * @tc_capture_take
+ *
+ * Main loop: copies out the last finished cycle, once.
+ *
+ * @input  : none
+ *
+ * @output : out - the cycle
+ *
+ * @return : 1 if there was a new cycle, 0 otherwise
+ *
+ * */
+uint8_t tc_capture_take(tc_cycle_t *out)
+{
+	uint32_t state;
+
+	if (!finished_ready) {
+		return 0;
+	}
+	state = hal_critical_enter(); // A tick may publish the next cycle
+	*out = finished;
+	finished_ready = 0;
+	hal_critical_exit(state);
+	return 1;
+}
@@ -0,0 +1,39 @@
+/****************************************************************
+* THERMOCOUPLE CAPTURE
+*
+* Reads the four thermocouple converters on SPI_MASTER_TC once per TC timer tick, without the main loop.
+* TCIRQ queues a read cycle -- one 32-bit transaction per slave select -- and starts the first; the end-of-receive
+* interrupt (TC_SPI_RxDone) starts the next, so the four reads are chained back to back on the bus. The finished
+* cycle is handed to the main loop (tc_capture_take), which sends it as one thermocouple packet.
+*
+*  Deadline		A cycle must be finished by the next tick. A converter not read by then is counted as a miss
+*				(CMD_DEADLINES), the cycle is sent with what it has and the converter's freshness bit clear
+*				(PKT_FRESH_TC in daq_packet.h) -- its word is the previous reading.
+*  Priority		TCIRQ and TC_SPI_RxDone must not preempt each other, and both must be below the ADC DRDY and
+*				SPI interrupts (adc_capture.h): thermocouple reads only get the time the ADC frames leave over.
+***************************************************************/
+#ifndef TC_CAPTURE_H
+#define TC_CAPTURE_H
+
+#include <stdint.h>
+
+	// CONVERTERS
+		#define TC_COUNT 4U				// TC0 - TC3, slave selects 0 - 3
+		#define TC_WORD_BYTES 4U		// MAX31855 word
+
+	typedef struct {
+		uint8_t words[TC_COUNT * TC_WORD_BYTES];	// TC0 - TC3 as read
+		uint8_t fresh;								// Bit n: TC n was read in this cycle (else its previous reading)
+		uint32_t cycle;								// Read cycle number
+		uint64_t time;								// Tick that started the cycle, timebase ticks
+	} tc_cycle_t;
+
+	// DEADLINE MISSES -- converters not read before the next tick
+		extern volatile uint32_t tc_capture_misses;
+
+	// PROTOTYPES
+		void tc_capture_tick(uint64_t time);
+		void tc_capture_done(void);
+		uint8_t tc_capture_take(tc_cycle_t *out);
+
+#endif /* TC_CAPTURE_H */
@@ -0,0 +1,51 @@
+/****************************************************************
+* TELEMETRY -- see telemetry.h
+***************************************************************/
+#include "telemetry.h"
+
+	// HISTOGRAMS -- TELEM_HIST_*
+		telem_hist_t telem_hist[TELEM_HISTOGRAMS];
+
+
+static uint8_t *put_u32(uint8_t *out, uint32_t value)
+{
+	out[0] = (uint8_t)(value >> 24);
+	out[1] = (uint8_t)(value >> 16);
+	out[2] = (uint8_t)(value >> 8);
+	out[3] = (uint8_t)value;
+	return out + 4;
+}
+
+/**
+ * @telemetry_put
+ *
+ * Writes the telemetry payload (TELEMETRY in daq_packet.h): the histograms as they stand and the counters given.
+ * Counts are copied without locking -- an interrupt may add to a histogram while it is copied, which the next
+ * packet shows.
+ *
+ * @input  : out - TELEM_PAYLOAD_SIZE bytes
+ *           counters - TELEM_CTR_* values
+ *
+ * @output : none
+ *
+ * @return : end of the payload
+ *
+ * */
+uint8_t *telemetry_put(uint8_t *out, const uint32_t counters[TELEM_COUNTERS])
+{
+	*out++ = HAL_CYCLES_PER_US;
+	*out++ = TELEM_HISTOGRAMS;
+	*out++ = TELEM_BUCKETS;
+	*out++ = TELEM_COUNTERS;
+
+	for (uint8_t id = 0; id < TELEM_HISTOGRAMS; id++) {
+		for (uint8_t b = 0; b < TELEM_BUCKETS; b++) {
+			out = put_u32(out, telem_hist[id].count[b]);
+		}
+		out = put_u32(out, telem_hist[id].max);
+	}
+	for (uint8_t n = 0; n < TELEM_COUNTERS; n++) {
+		out = put_u32(out, counters[n]);
+	}
+	return out;
+}
@@ -0,0 +1,64 @@
+/****************************************************************
+* TELEMETRY
+*
+* Hot path latencies in CPU cycles (hal_cycles: the DWT cycle counter on the target, virtual time in the host
+* simulator), kept in fixed log2 histograms (TELEM_HIST_* in daq_packet.h) and sent to the host once per
+* TELEMETRY_PERIOD_MS as a telemetry packet next to the data, with the drop/overrun/reconnect counters.
+* Everything counts since boot: the host takes the difference of two packets, so a lost packet only widens the
+* interval it looks at.
+*
+* Each histogram is recorded from one context only (the ADC interrupts or the main loop), so the counts need no
+* locking. TELEMETRY = 0 compiles the measurements out and stops the packets.
+***************************************************************/
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include "hal.h"
+#include "daq_packet.h"
+
+	// CONFIG
+		#ifndef TELEMETRY
+		#define TELEMETRY 1U			// 1 = measure and send telemetry packets, 0 = compiled out
+		#endif
+		#ifndef TELEMETRY_PERIOD_MS
+		#define TELEMETRY_PERIOD_MS 1000U
+		#endif
+
+	typedef struct {
+		uint32_t count[TELEM_BUCKETS];
+		uint32_t max;					// Longest duration, cycles
+	} telem_hist_t;
+
+	extern telem_hist_t telem_hist[TELEM_HISTOGRAMS];
+
+	// PROTOTYPES
+		uint8_t *telemetry_put(uint8_t *out, const uint32_t counters[TELEM_COUNTERS]);
+
+	/**
+	 * @telem_record
+	 *
+	 * Counts one duration into a histogram: bucket floor(log2(cycles)), one CLZ.
+	 *
+	 * */
+	static inline void telem_record(uint8_t id, uint32_t cycles)
+	{
+		telem_hist_t *hist = &telem_hist[id];
+		uint32_t bucket = (cycles > 1U) ? (31U - (uint32_t)__builtin_clz(cycles)) : 0U;
+
+		hist->count[(bucket < TELEM_BUCKETS) ? bucket : (TELEM_BUCKETS - 1U)]++;
+		if (cycles > hist->max) {
+			hist->max = cycles;
+		}
+	}
+
+	// MEASUREMENT -- TELEM_STAMP at the start, TELEM_RECORD(id, stamp) at the end
+	#if TELEMETRY
+		#define TELEM_STAMP()				hal_cycles()
+		#define TELEM_RECORD(id, stamp)		telem_record((id), hal_cycles() - (stamp))
+	#else
+		#define TELEM_STAMP()				0U
+		#define TELEM_RECORD(id, stamp)		((void)(stamp))
+	#endif
+
+#endif /* TELEMETRY_H */
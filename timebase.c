@@ -0,0 +1,101 @@
+/****************************************************************
+* TIMEBASE -- see timebase.h
+***************************************************************/
+#include "timebase.h"
+
+	// EPOCH -- ticks at the start of the current timer period, written only by timebase_period
+		static volatile uint64_t epoch = 0;
+
+
+/**
+ * @snapshot
+ *
+ * Consistent epoch and counter: the start of the period the counter value belongs to.
+ *
+ * */
+static void snapshot(uint64_t *period_start, uint32_t *count)
+{
+	uint64_t start;
+	uint32_t ticks;
+	uint8_t wrapped;
+
+	do {
+		start = epoch;
+		ticks = hal_timestamp_ticks();
+		wrapped = hal_timestamp_pending();
+		if (wrapped) {
+			ticks = hal_timestamp_ticks(); // Read again -- certain to be after the wrap
+		}
+	} while (start != epoch); // TimeStampIRQ ran in between -- try again
+
+	*period_start = wrapped ? start + HAL_TICKS_PER_PERIOD : start; // Wrap whose interrupt has not run yet
+	*count = ticks;
+}
+
+/**
+ * @timebase_period
+ *
+ * Called from TimeStampIRQ: moves the epoch on by one timer period and clears the timer event. Interrupts are masked
+ * so a preempting reader never sees the epoch advanced with the event still pending (or the reverse).
+ *
+ * @input  : none
+ *
+ * @output : none
+ *
+ * @return : none
+ *
+ * */
+void timebase_period(void)
+{
+	uint32_t state = hal_critical_enter();
+
+	epoch += HAL_TICKS_PER_PERIOD;
+	hal_timestamp_clear_event(); // Clear Event Flag
+	hal_critical_exit(state);
+}
+
+/**
+ * @timebase_now
+ *
+ * Current time in ticks since the timer started. Lock-free, from any context.
+ *
+ * @input  : none
+ *
+ * @output : none
+ *
+ * @return : ticks (HAL_TICKS_PER_US per microsecond)
+ *
+ * */
+uint64_t timebase_now(void)
+{
+	uint64_t period_start;
+	uint32_t count;
+
+	snapshot(&period_start, &count);
+	return period_start + count;
+}
+
+/**
+ * @timebase_capture
+ *
+ * Full time of a hardware capture (hal_drdy_capture) taken less than one timer period ago. A captured count above
+ * the current one was latched before the last wrap.
+ *
+ * @input  : captured - timer count latched by the capture slice
+ *
+ * @output : none
+ *
+ * @return : ticks since the timer started
+ *
+ * */
+uint64_t timebase_capture(uint32_t captured)
+{
+	uint64_t period_start;
+	uint32_t count;
+
+	snapshot(&period_start, &count);
+	if (captured > count) {
+		period_start -= HAL_TICKS_PER_PERIOD;
+	}
+	return period_start + captured;
+}
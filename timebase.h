@@ -0,0 +1,37 @@
+/****************************************************************
+* TIMEBASE
+*
+* One free-running 64-bit clock for every time stamp on the board: ADC0, ADC1, the thermocouples and command replies
+* all count in ticks of the timestamp timer (TIMER_TIMESTAMP, HAL_TICKS_PER_US per microsecond), so their samples
+* line up without conversion.
+*
+*  Period		The timer counts 0 ... HAL_TICKS_PER_PERIOD - 1 (1ms) and interrupts on the wrap; TimeStampIRQ calls
+*				timebase_period, which adds one period to the 64-bit epoch with interrupts masked
+*  Reads		timebase_now is lock-free and safe from any context: it re-reads the epoch until it did not change
+*				under the counter read, and counts a wrap whose interrupt is still pending (a read from a DRDY
+*				interrupt that preempted TimeStampIRQ, or right at the wrap) -- the time never steps back
+*  Capture		DRDY edges are latched by CCU4 capture slices that run in step with the timer (hal_drdy_capture);
+*				timebase_capture extends the latched count to 64 bits, so a sample's time is its edge, not the
+*				moment its interrupt got to run
+*
+* Conversion to microseconds (a division) is left to the main loop: the interrupts only store ticks.
+***************************************************************/
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+#include <stdint.h>
+#include "hal.h"
+
+	#define TIMEBASE_TICKS_PER_MS ((uint64_t)HAL_TICKS_PER_US * 1000U)
+
+	// PROTOTYPES
+		void timebase_period(void);
+		uint64_t timebase_now(void);
+		uint64_t timebase_capture(uint32_t captured);
+
+	// Microseconds since start of a tick count
+	static inline uint64_t timebase_us(uint64_t ticks) {
+		return ticks / HAL_TICKS_PER_US;
+	}
+
+#endif /* TIMEBASE_H */
@@ -0,0 +1,215 @@
+/****************************************************************
+* TRANSMIT BATCHING -- see tx_batch.h
+***************************************************************/
+#include "tx_batch.h"
+#include "hal.h"
+#include "timebase.h"
+#include "telemetry.h"
+#include "daq_packet.h"
+
+	// STATISTICS
+		tx_batch_stats_t tx_batch_stats;
+
+	// POLICY STATE -- main loop only (the lwIP callbacks run from interrupts and hand their acknowledged bytes over
+	// through client_service, main.c)
+		static uint32_t latency_us = TX_LATENCY_US;
+		static uint32_t target = TX_SEGMENT;		// Batch size, bytes
+		static uint32_t sndbuf_max = 0;			// Largest free send buffer seen -- lwIP's TCP_SND_BUF
+		static uint32_t rate = 0;				// Acknowledged bytes per ms, smoothed
+		static uint32_t window_bytes = 0;		// Acknowledged in the current rate window
+		static uint64_t window_start = 0;
+
+
+/**
+ * @retarget
+ *
+ * Batch size from the ACK rate and the latency: half the latency's worth of acknowledged bytes, between one
+ * segment and half the send buffer.
+ *
+ * */
+static void retarget(void)
+{
+	uint64_t batch = (uint64_t)rate * latency_us / 2000U;
+	uint32_t cap = sndbuf_max / 2U;
+
+	if (cap < TX_SEGMENT) {
+		cap = TX_SEGMENT;
+	}
+	target = (batch < TX_SEGMENT) ? TX_SEGMENT : ((batch > cap) ? cap : (uint32_t)batch);
+}
+
+/**
+ * @update_rate
+ *
+ * Closes the rate window once TX_RATE_WINDOW_MS have passed. A window without acknowledgements (idle or stalled
+ * connection) lowers the rate like any other, so the batch shrinks back towards one segment.
+ *
+ * */
+static void update_rate(uint64_t now)
+{
+	uint64_t elapsed = now - window_start;
+	uint32_t window_rate;
+
+	if (elapsed < TX_RATE_WINDOW_MS * TIMEBASE_TICKS_PER_MS) {
+		return;
+	}
+	window_rate = (uint32_t)((uint64_t)window_bytes * TIMEBASE_TICKS_PER_MS / elapsed);
+	rate = (uint32_t)(((uint64_t)rate * 3U + window_rate) / 4U);
+	window_bytes = 0;
+	window_start = now;
+	retarget();
+}
+
+/**
+ * @tx_batch_set
+ *
+ * Sets the latency deadline (the latency-vs-throughput knob).
+ *
+ * @input  : latency - us a packet may wait for a batch to fill, limited to TX_LATENCY_MAX_US
+ *
+ * @output : none
+ *
+ * @return : none
+ *
+ * */
+void tx_batch_set(uint32_t latency)
+{
+	latency_us = (latency > TX_LATENCY_MAX_US) ? TX_LATENCY_MAX_US : latency;
+	retarget();
+}
+
+/**
+ * @tx_batch_latency
+ *
+ * Latency deadline in effect, us.
+ *
+ * */
+uint32_t tx_batch_latency(void)
+{
+	return latency_us;
+}
+
+/**
+ * @tx_batch_target
+ *
+ * Current batch size, bytes.
+ *
+ * */
+uint32_t tx_batch_target(void)
+{
+	return target;
+}
+
+/**
+ * @tx_batch_rate
+ *
+ * Smoothed ACK rate, bytes per second.
+ *
+ * */
+uint32_t tx_batch_rate(void)
+{
+	return rate * 1000U;
+}
+
+/**
+ * @tx_batch_due
+ *
+ * How much of the queue to write now. The batch is full once another largest packet would not fit it; it is
+ * written when it fits the send buffer or at least a segment of it does. Short of that the queue waits, until its
+ * oldest packet reaches the deadline and whatever fits goes out.
+ *
+ * @input  : pending - bytes queued
+ *           room - free send buffer (tcp_sndbuf; UDP: pending)
+ *           age - ticks the oldest queued packet has waited
+ *           now - timebase_now
+ *
+ * @output : deadline - 1 if the write is forced by the deadline rather than a full batch
+ *
+ * @return : bytes to write, 0 = hold
+ *
+ * */
+uint32_t tx_batch_due(uint32_t pending, uint32_t room, uint64_t age, uint64_t now, uint8_t *deadline)
+{
+	uint32_t n = (pending < room) ? pending : room;
+
+	if (room > sndbuf_max) {
+		sndbuf_max = room;
+		retarget();
+	}
+	update_rate(now);
+
+	*deadline = 0;
+	if (n == 0U) {
+		return 0;
+	}
+	if ((pending + PACKET_MAX_SIZE > target) && ((n == pending) || (n >= TX_SEGMENT))) {
+		return n;
+	}
+	if (age >= (uint64_t)latency_us * HAL_TICKS_PER_US) {
+		*deadline = 1;
+		return n;
+	}
+	return 0;
+}
+
+/**
+ * @tx_batch_sent
+ *
+ * Counts a write handed to lwIP.
+ *
+ * @input  : bytes - written
+ *           deadline - as returned by tx_batch_due
+ *
+ * @output : none
+ *
+ * @return : none
+ *
+ * */
+void tx_batch_sent(uint32_t bytes, uint8_t deadline)
+{
+	tx_batch_stats.flushes++;
+	tx_batch_stats.bytes += bytes;
+	tx_batch_stats.deadline += deadline;
+}
+
+/**
+ * @tx_batch_acked
+ *
+ * Acknowledged bytes (counted by client_sent, passed on by the main loop) -- the ACK rate the batch size follows.
+ *
+ * @input  : bytes - acknowledged
+ *           now - timebase_now
+ *
+ * @output : none
+ *
+ * @return : none
+ *
+ * */
+void tx_batch_acked(uint32_t bytes, uint64_t now)
+{
+	window_bytes += bytes;
+	update_rate(now);
+}
+
+/**
+ * @tx_batch_waited
+ *
+ * Queueing delay of one packet, from queued to its last byte written, into TELEM_HIST_TX_QUEUE.
+ *
+ * @input  : ticks - timebase ticks
+ *
+ * @output : none
+ *
+ * @return : none
+ *
+ * */
+void tx_batch_waited(uint64_t ticks)
+{
+#if TELEMETRY
+	uint64_t cycles = ticks * HAL_CYCLES_PER_US / HAL_TICKS_PER_US;
+
+	telem_record(TELEM_HIST_TX_QUEUE, (cycles > 0xFFFFFFFFU) ? 0xFFFFFFFFU : (uint32_t)cycles);
+#else
+	(void)ticks;
+#endif
+}
@@ -0,0 +1,54 @@
+/****************************************************************
+* TRANSMIT BATCHING
+*
+* When the queued packets go to lwIP: a flush is due once a batch has filled or the oldest queued packet has waited
+* out the latency deadline, whichever comes first. The main loop asks on every pass (send_poll) and send_data after
+* every packet -- no timer paces the stream. Acknowledgements arrive in lwIP's interrupt context (client_sent) and
+* reach the policy through the main loop, so the whole policy runs in the main loop.
+*
+*  Latency	Longest a packet waits in the queue for a batch to fill -- the latency-vs-throughput knob. 0 writes every
+*			packet as it comes (most segments, least delay); larger values write fewer, fuller segments.
+*			TX_LATENCY_US at boot, CMD_TX_LATENCY at run time
+*  Batch	What the connection carries in half the latency, from the acknowledged bytes per TX_RATE_WINDOW_MS:
+*			a batch fills well inside the deadline at the current rate. At least one segment (TX_SEGMENT), at most
+*			half the send buffer (largest tcp_sndbuf seen), so one batch is always in flight while the next fills.
+*			Full once another largest packet would not fit it, as a UDP datagram
+*  Backlog	While the send buffer has less than a segment free, a full batch waits for the acknowledgements instead of
+*			going out as small segments; the deadline still writes whatever fits
+*
+* UDP has no acknowledgements: a datagram goes out when the next packet might not fit it or at the deadline.
+* Flush sizes and the queueing delay of every packet (queued to its last byte written) are counted for telemetry.
+***************************************************************/
+#ifndef TX_BATCH_H
+#define TX_BATCH_H
+
+#include <stdint.h>
+
+	// CONFIG
+		#ifndef TX_LATENCY_US
+		#define TX_LATENCY_US 2000U			// Boot value of the latency deadline
+		#endif
+		#define TX_LATENCY_MAX_US 100000U	// Sample time deltas and the queue size bound it
+		#define TX_SEGMENT 1460U			// TCP MSS: the smallest write worth making while data is in flight
+		#define TX_RATE_WINDOW_MS 10U		// ACK rate measured over this, smoothed over about four windows
+
+	// STATISTICS -- since boot, sent as TELEM_CTR_TX_*
+		typedef struct {
+			uint32_t flushes;			// Writes handed to lwIP (UDP: datagrams)
+			uint32_t bytes;				// Bytes in them
+			uint32_t deadline;			// Flushes forced by the deadline before a batch filled
+		} tx_batch_stats_t;
+
+		extern tx_batch_stats_t tx_batch_stats;
+
+	// PROTOTYPES
+		void tx_batch_set(uint32_t latency_us);
+		uint32_t tx_batch_latency(void);
+		uint32_t tx_batch_target(void);
+		uint32_t tx_batch_rate(void);
+		uint32_t tx_batch_due(uint32_t pending, uint32_t room, uint64_t age, uint64_t now, uint8_t *deadline);
+		void tx_batch_sent(uint32_t bytes, uint8_t deadline);
+		void tx_batch_acked(uint32_t bytes, uint64_t now);
+		void tx_batch_waited(uint64_t ticks);
+
+#endif /* TX_BATCH_H */